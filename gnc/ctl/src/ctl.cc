@@ -26,6 +26,7 @@
 #include <msg_conversions/msg_conversions.h>
 
 #include <ff_util/ff_names.h>
+#include <gnc_profile.h>
 
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
@@ -517,6 +518,9 @@ bool Ctl::Step(void) {
     std::lock_guard<std::mutex> cmd_lock(mutex_cmd_msg_);
     gnc_.Step();
   }
+  if (gnc_profile_enabled())
+    NODELET_INFO_STREAM_THROTTLE(60, "CTL step profile:\n"
+                                 << gnc_profile_report(GNC_PROFILE_CTL_STEP, GNC_PROFILE_CTL_STEP));
 
   // Output of the Step() function is FAM control (ctl)
   auto& cmd = gnc_.cmd_;
@@ -20,6 +20,7 @@
 #define EKF_EKF_H_
 
 #include <gnc_autocode/ekf.h>
+#include <gnc_autocode/step_record.h>
 
 #include <Eigen/Geometry>
 #include <config_reader/config_reader.h>
@@ -48,9 +49,49 @@ typedef struct {
   float y;
 } OFObservation;
 
+// The observations of a feature, newest first, in a circular buffer. Only
+// the newest ASE_OF_NUM_AUG are ever used, so the oldest is dropped when full.
+class OFHistory {
+ public:
+  static const unsigned int kCapacity = 32;
+
+  OFHistory(void) : start_(0), size_(0) {}
+
+  unsigned int size(void) const {return size_;}
+  const OFObservation & operator[](unsigned int i) const {return obs_[(start_ + i) & (kCapacity - 1)];}
+
+  void push_front(const OFObservation & o) {
+    start_ = (start_ - 1) & (kCapacity - 1);
+    obs_[start_] = o;
+    if (size_ < kCapacity)
+      size_++;
+  }
+
+  // moves the shorter side over the erased observation
+  void erase(unsigned int i) {
+    if (i < size_ / 2) {
+      for (unsigned int j = i; j > 0; j--)
+        at(j) = at(j - 1);
+      start_ = (start_ + 1) & (kCapacity - 1);
+    } else {
+      for (unsigned int j = i; j + 1 < size_; j++)
+        at(j) = at(j + 1);
+    }
+    size_--;
+  }
+
+ private:
+  OFObservation & at(unsigned int i) {return obs_[(start_ + i) & (kCapacity - 1)];}
+
+  OFObservation obs_[kCapacity];
+  unsigned int start_, size_;
+};
+static_assert(OFHistory::kCapacity > ASE_OF_NUM_AUG && (OFHistory::kCapacity & (OFHistory::kCapacity - 1)) == 0,
+              "The optical flow history must hold every augmentation and be a power of two.");
+
 typedef struct {
   uint32_t feature_id;
-  std::vector<OFObservation> obs;
+  OFHistory obs;
   int missing_frames;  // number of frames skipped
 } OFFeature;
 
@@ -69,6 +110,10 @@ class Ekf {
   kfl_msg* GetOutput(void) {return &gnc_.kfl_;}
 
   void ReadParams(config_reader::ConfigReader* config);
+  // records the autocode inputs of every step to filename, for
+  // gnc_step_benchmark. The file is truncated, so only one Ekf may record
+  // to it.
+  bool RecordStepInputs(std::string const& filename);
   void SetBias(Eigen::Vector3f gyro_bias, Eigen::Vector3f accel_bias);
 
   void PrepareStep(const sensor_msgs::Imu & imu, const geometry_msgs::Quaternion & quat);
@@ -146,9 +191,11 @@ class Ekf {
   // optional: called when a reset occurs
   std::function<void()> reset_callback_;
 
-  // vector of feature ids and observations, observations are features ids and positions
-  // this list is sorted by feature id
-  std::map<int, OFFeature> optical_flow_features_;
+  // tracked features and their observations, sorted by feature id, which is
+  // the order they are passed to the EKF in
+  std::vector<OFFeature> optical_flow_features_;
+  // the features of the last frame sorted by id, kept to not allocate every frame
+  std::vector<std::pair<uint32_t, OFObservation> > of_observed_;
   // the number of features for each augmentation
   std::vector<int> optical_flow_augs_feature_counts_;
   std::vector<unsigned int> deleting_augs_;
@@ -158,6 +205,8 @@ class Ekf {
 
   // in output to file mode, the file to output to
   FILE* output_file_;
+  // records the autocode inputs of each step when asked to
+  gnc_autocode::GncStepRecorder step_recorder_;
 
   // only save this for writing to a file later
   geometry_msgs::Pose last_estimate_pose_;
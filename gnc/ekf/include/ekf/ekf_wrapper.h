@@ -20,6 +20,7 @@
 #define EKF_EKF_WRAPPER_H_
 
 #include <ekf/ekf.h>
+#include <ekf/lock_free.h>
 
 #include <Eigen/Geometry>
 #include <config_reader/config_reader.h>
@@ -46,6 +47,7 @@
 #include <std_msgs/Empty.h>
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable> // NOLINT
 #include <list>
 #include <mutex>
@@ -76,7 +78,28 @@ class EkfWrapper {
    */
   int Step();
 
+  // imu messages lost because the step fell behind, and stepped more than an
+  // imu period after they arrived
+  uint64_t ImuSamplesDropped(void) const {return imu_samples_dropped_;}
+  uint64_t ImuSamplesLate(void) const {return imu_samples_late_;}
+
  protected:
+  // an imu message and when its callback ran
+  struct ImuSample {
+    sensor_msgs::Imu::ConstPtr imu;
+    std::chrono::steady_clock::time_point received;
+  };
+
+  /**
+   * Steps the EKF forward with one imu message and publishes the state.
+   **/
+  int StepImu(ImuSample const& sample);
+  /**
+   * Publishes the timing of the step and warns about lost imu messages,
+   * about once a second.
+   **/
+  void ReportPerformance(void);
+
   void ReadParams(void);
   /**
    * Initialize services and topics besides IMU.
@@ -105,9 +128,9 @@ class EkfWrapper {
   bool SetInputService(ff_msgs::SetEkfInput::Request& req, ff_msgs::SetEkfInput::Response& res);  //NOLINT
 
   /**
-   * Actually does the bias estimation, called from IMU callback.
+   * Actually does the bias estimation, called for every imu message stepped.
    **/
-  void EstimateBias(sensor_msgs::Imu::ConstPtr const& imu);
+  void EstimateBias(sensor_msgs::Imu const& imu);
 
   /**
    * Callback functions. These all record the information
@@ -146,26 +169,27 @@ class EkfWrapper {
 
   bool ekf_initialized_;
 
-  // most recent imu message
-  sensor_msgs::Imu imu_;
-  geometry_msgs::Quaternion quat_;
-  int imus_dropped_;
+  // imu messages not stepped yet, the callback never waits for the step
+  SpscRing<ImuSample, 64> imu_queue_;
+  std::atomic<uint64_t> imu_samples_dropped_, imu_samples_late_;
+  // the counts in the last report
+  uint64_t imu_samples_reported_, imu_samples_late_reported_;
+  // number of steps in a row without an imu message
+  int imu_timeouts_;
+  std::chrono::steady_clock::time_point last_report_;
 
-  // Truth messages
-  geometry_msgs::PoseStamped truth_pose_;
-  geometry_msgs::TwistStamped truth_twist_;
+  // latest ground truth, written by the callbacks and read by the step
+  LatestValue<geometry_msgs::Quaternion> quat_;
+  LatestValue<geometry_msgs::PoseStamped> truth_pose_;
+  LatestValue<geometry_msgs::TwistStamped> truth_twist_;
 
-  // EKF wrapper needs to capture the first landmark message to do PnP before
-  // it can initialize the EKF autocode and let it run. This variable holds
-  // that state and is atomic so that it doesn't require a mutex.
-  std::atomic<bool> have_imu_;
   std::atomic<int> input_mode_;
 
   /** Configuration Constants **/
 
   /** Ros **/
   config_reader::ConfigReader config_;
-  ff_util::PerfTimer pt_ekf_;
+  ff_util::PerfTimer pt_ekf_, pt_imu_latency_;
   ros::Timer config_timer_;
 
   ros::NodeHandle* nh_;
@@ -184,20 +208,16 @@ class EkfWrapper {
 
   /** Threading **/
 
-  // mutex for msgs, concurrency protection
-  std::mutex mutex_act_msg_;
-  std::mutex mutex_imu_msg_;
-  std::mutex mutex_of_msg_;
-  std::mutex mutex_vl_msg_;
-  std::mutex mutex_dl_msg_;
-  std::mutex mutex_truth_msg_;
+  // the vision callbacks write the EKF inputs that the step copies
+  std::mutex mutex_vision_msg_;
 
-  // cv to wait for an imu reading
+  // cv to wait for an imu reading, the mutex is only held to check the queue
+  std::mutex mutex_imu_wait_;
   std::condition_variable cv_imu_;
 
   /** IMU Bias reset variables **/
   std::string bias_file_;
-  bool estimating_bias_;
+  std::atomic<bool> estimating_bias_;
   float bias_reset_sums_[6];
   int bias_reset_count_;
   int bias_required_observations_;
@@ -0,0 +1,104 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_LOCK_FREE_H_
+#define EKF_LOCK_FREE_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace ekf {
+
+/**
+ * @brief Queue between one producer and one consumer thread.
+ * @details Neither side ever waits for the other. When the queue is full the
+ * producer's value is refused, the consumer sees values in the order pushed.
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+ public:
+  SpscRing(void) : head_(0), tail_(0) {}
+
+  // producer side, returns false if full
+  bool Push(T const& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity)
+      return false;
+    slots_[tail & (Capacity - 1)] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, returns false if empty
+  bool Pop(T* value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return false;
+    *value = slots_[head & (Capacity - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Empty(void) const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  T slots_[Capacity];
+  // the producer and consumer indices are on their own cache lines
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+};
+
+/**
+ * @brief The most recent value written by one thread, for one reader thread.
+ * @details A triple buffer: the writer fills a spare copy and swaps it in, the
+ * reader swaps out the newest copy when there is one. Neither side waits.
+ */
+template <typename T>
+class LatestValue {
+ public:
+  LatestValue(void) : write_(0), shared_(1), read_(2) {}
+
+  void Write(T const& value) {
+    values_[write_] = value;
+    write_ = shared_.exchange(write_ | kFresh, std::memory_order_acq_rel) & kIndex;
+  }
+
+  // returns the latest value written, or the last one read if nothing is new
+  T const& Read(void) {
+    if (shared_.load(std::memory_order_relaxed) & kFresh)
+      read_ = shared_.exchange(read_, std::memory_order_acq_rel) & kIndex;
+    return values_[read_];
+  }
+
+ private:
+  static const int kIndex = 3;
+  static const int kFresh = 4;
+
+  T values_[3];
+  int write_;                // only used by the writer
+  std::atomic<int> shared_;  // the spare copy, and whether it is newer than read_
+  int read_;                 // only used by the reader
+};
+
+}  // end namespace ekf
+
+#endif  // EKF_LOCK_FREE_H_
@@ -29,7 +29,13 @@
 #include <msg_conversions/msg_conversions.h>
 #include <ros/package.h>
 
+#include <algorithm>
+#include <utility>
+
 DEFINE_bool(save_inputs_file, false, "Save the inputs to a file.");
+DEFINE_string(record_step_inputs, "",
+              "Record the autocode inputs of every step to this file, for gnc_step_benchmark. Read by the EKF "
+              "nodelet and bag_to_csv, which each record a single Ekf.");
 
 namespace ekf {
 
@@ -64,6 +70,13 @@ Ekf::~Ekf() {
   }
 }
 
+bool Ekf::RecordStepInputs(std::string const& filename) {
+  if (!step_recorder_.Open(filename))
+    return false;
+  ROS_WARN("Recording EKF step inputs to %s.", filename.c_str());
+  return true;
+}
+
 void Ekf::ReadParams(config_reader::ConfigReader* config) {
   gnc_.ReadParams(config);
 
@@ -133,38 +146,45 @@ void Ekf::OpticalFlowUpdate(const ff_msgs::Feature2dArray & of) {
     return;
   }
 
-  // put new features in tree to make it faster
-  std::map<int, OFObservation> new_features;
-  for (size_t i = 0; i < of.feature_array.size(); i++) {
-    new_features.insert(std::pair<int, OFObservation>(of.feature_array[i].id,
-    {of.feature_array[i].x, of.feature_array[i].y}));
-  }
-
-  // delete all observations that we didn't see
-  std::map<int, OFFeature>::iterator of_iter = optical_flow_features_.begin();
-  while (of_iter != optical_flow_features_.end()) {
-    if (new_features.count((*of_iter).first) == 0) {
-      OFFeature & f = (*of_iter).second;
-      f.missing_frames++;
-    }
-    of_iter++;
-  }
-
-  // now, add new features to the list of existing features
+  // sort the new observations by id, the tracker mostly sends them in order
+  of_observed_.clear();
   for (size_t i = 0; i < of.feature_array.size(); i++) {
     uint16_t feature_id = of.feature_array[i].id;
-    float x = of.feature_array[i].x;
-    float y = of.feature_array[i].y;
-    // add new feature to list
-    if (optical_flow_features_.count(feature_id) == 0) {
-      optical_flow_features_.insert(std::pair<int, OFFeature>(
-            feature_id, {feature_id, std::vector<OFObservation>(), 0}));
+    of_observed_.push_back(std::make_pair(static_cast<uint32_t>(feature_id),
+                                          OFObservation{of.feature_array[i].x, of.feature_array[i].y}));
+  }
+  std::stable_sort(of_observed_.begin(), of_observed_.end(),
+    [](const std::pair<uint32_t, OFObservation> & a, const std::pair<uint32_t, OFObservation> & b) {
+      return a.first < b.first;
+    });
+
+  // merge them into the features, counting the frames the features we didn't see missed
+  const size_t num_tracked = optical_flow_features_.size();
+  size_t t = 0;
+  for (size_t i = 0; i < of_observed_.size(); i++) {
+    const uint32_t feature_id = of_observed_[i].first;
+    while (t < num_tracked && optical_flow_features_[t].feature_id < feature_id)
+      optical_flow_features_[t++].missing_frames++;
+    if (t < num_tracked && optical_flow_features_[t].feature_id == feature_id) {
+      optical_flow_features_[t].obs.push_front(of_observed_[i].second);
+      // a repeated id adds another observation to the same feature
+      if (i + 1 == of_observed_.size() || of_observed_[i + 1].first != feature_id)
+        t++;
+    } else {
+      // new feature, appended and put in place below
+      if (optical_flow_features_.empty() || optical_flow_features_.back().feature_id != feature_id)
+        optical_flow_features_.push_back({feature_id, OFHistory(), 0});
+      optical_flow_features_.back().obs.push_front(of_observed_[i].second);
     }
-    OFFeature & f = optical_flow_features_[feature_id];
-    // add the new observations
-    f.obs.insert(f.obs.begin(), {x, y});
     optical_flow_augs_feature_counts_[0]++;
   }
+  for (; t < num_tracked; t++)
+    optical_flow_features_[t].missing_frames++;
+  // the ids of new features are usually larger than all tracked ones
+  if (optical_flow_features_.size() > num_tracked && num_tracked > 0 &&
+      optical_flow_features_[num_tracked].feature_id < optical_flow_features_[num_tracked - 1].feature_id)
+    std::sort(optical_flow_features_.begin(), optical_flow_features_.end(),
+      [](const OFFeature & a, const OFFeature & b) {return a.feature_id < b.feature_id;});
   of_camera_id_ = 0;
 
   if (deleting_augs_.size() > 0)
@@ -216,59 +236,41 @@ void Ekf::OpticalFlowUpdate(const ff_msgs::Feature2dArray & of) {
   } else {
     of_inputs_delayed_ = true;
   }
-  std::map<int, OFFeature>::iterator iter = optical_flow_features_.begin();
-  while (iter != optical_flow_features_.end()) {
-    OFFeature & f = (*iter).second;
+  // in one pass, drop the features that were lost and pass the others to the
+  // EKF, up to of_max_features_
+  size_t kept = 0;
+  for (size_t i = 0; i < optical_flow_features_.size(); i++) {
+    const OFFeature & f = optical_flow_features_[i];
     if (f.missing_frames > 0) {
       // We are no longer using these observations because we can greatly speed up
       // computation in the EKF with a sparse block H matrix
-      for (unsigned int i = 0; i < f.obs.size(); i++) {
-        unsigned int aug = i + f.missing_frames;
+      for (unsigned int j = 0; j < f.obs.size(); j++) {
+        unsigned int aug = j + f.missing_frames;
         if (aug >= of_history_size_)
           break;
-        // of_.cvs_observations[aug * of_max_features_ * 2 + index] = f.obs[i].x;
-        // of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = f.obs[i].y;
-        // of_.cvs_valid_flag[aug * of_max_features_ + index] = 1;
         if (optical_flow_augs_feature_counts_.size() > aug)
           optical_flow_augs_feature_counts_[aug]--;
       }
-      iter = optical_flow_features_.erase(iter);
-    } else {
-      // only use oldest features, and choose three oldest frames and newest
-      if (f.obs.size() >= of_history_size_) {
-        of_.cvs_observations[0 * of_max_features_ * 2 + index] = f.obs[0].x;
-        of_.cvs_observations[0 * of_max_features_ * 2 + index + of_max_features_] = f.obs[0].y;
-        of_.cvs_valid_flag[0 * of_max_features_ + index] = 1;
-        for (unsigned int aug = of_history_size_ - 3; aug < of_history_size_; aug++) {
-          of_.cvs_observations[aug * of_max_features_ * 2 + index] = f.obs[aug].x;
-          of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = f.obs[aug].y;
-          of_.cvs_valid_flag[aug * of_max_features_ + index] = 1;
-        }
-      }
-      iter++;
-      index++;
+      continue;
     }
-    if (index >= of_max_features_)
-      break;
-  }
-  // just delete any missing features we didn't have space for
-  while (iter != optical_flow_features_.end()) {
-    OFFeature & f = (*iter).second;
-    if (f.missing_frames > 0) {
-      for (unsigned int i = 0; i < f.obs.size(); i++) {
-        unsigned int aug = i + f.missing_frames;
-        if (aug >= of_history_size_)
-          break;
-      //   of_.cvs_observations[aug * of_max_features_ * 2 + index] = f.obs[i].x;
-      //   of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = f.obs[i].y;
-      //   of_.cvs_valid_flag[aug * of_max_features_ + index] = 1;
-        if (optical_flow_augs_feature_counts_.size() > aug)
-          optical_flow_augs_feature_counts_[aug]--;
+    // only use oldest features, and choose three oldest frames and newest
+    if (index < of_max_features_ && f.obs.size() >= of_history_size_) {
+      of_.cvs_observations[0 * of_max_features_ * 2 + index] = f.obs[0].x;
+      of_.cvs_observations[0 * of_max_features_ * 2 + index + of_max_features_] = f.obs[0].y;
+      of_.cvs_valid_flag[0 * of_max_features_ + index] = 1;
+      for (unsigned int aug = of_history_size_ - 3; aug < of_history_size_; aug++) {
+        of_.cvs_observations[aug * of_max_features_ * 2 + index] = f.obs[aug].x;
+        of_.cvs_observations[aug * of_max_features_ * 2 + index + of_max_features_] = f.obs[aug].y;
+        of_.cvs_valid_flag[aug * of_max_features_ + index] = 1;
       }
-      iter = optical_flow_features_.erase(iter);
     }
-    iter++;
+    if (index < of_max_features_)
+      index++;
+    if (kept != i)
+      optical_flow_features_[kept] = f;
+    kept++;
   }
+  optical_flow_features_.resize(kept);
 }
 
 void Ekf::SparseMapUpdate(const ff_msgs::VisualLandmarks & vl) {
@@ -451,17 +453,18 @@ void Ekf::OpticalFlowRegister(const ff_msgs::CameraRegistration & cr) {
       }
     }
     // delete the features from the deleted augmented state
-    std::map<int, OFFeature>::iterator of_iter = optical_flow_features_.begin();
-    while (of_iter != optical_flow_features_.end()) {
-      OFFeature & f = (*of_iter).second;
-      if (f.obs.size() > erased_aug) {
-        f.obs.erase(f.obs.begin() + erased_aug);
-      }
+    size_t kept = 0;
+    for (size_t i = 0; i < optical_flow_features_.size(); i++) {
+      OFFeature & f = optical_flow_features_[i];
+      if (f.obs.size() > erased_aug)
+        f.obs.erase(erased_aug);
       if (f.obs.size() == 0)
-        of_iter = optical_flow_features_.erase(of_iter);
-      else
-        of_iter++;
+        continue;
+      if (kept != i)
+        optical_flow_features_[kept] = f;
+      kept++;
     }
+    optical_flow_features_.resize(kept);
 
     // update arrays of times and counts
     if (optical_flow_augs_feature_counts_.size() > of_history_size_) {
@@ -629,10 +632,12 @@ void Ekf::PrepareStep(const sensor_msgs::Imu & imu, const geometry_msgs::Quatern
 }
 
 int Ekf::Step(ff_msgs::EkfState* state) {
-  if (output_file_)
+  if (output_file_) {
     WriteToFile();
-  else
+  } else {
+    step_recorder_.Record(gnc_);
     gnc_.Step();
+  }
   if (gnc_.kfl_.confidence == 2)
     reset_ekf_ = true;
   UpdateState(state);
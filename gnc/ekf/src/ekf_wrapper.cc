@@ -23,15 +23,26 @@
 #include <Eigen/Geometry>
 #include <Eigen/Dense>
 
+#include <inttypes.h>
+
 #include <msg_conversions/msg_conversions.h>
 #include <ros/package.h>
 
 #include <ff_util/ff_names.h>
 
+#include <gflags/gflags.h>
+#include <gnc_profile.h>
+
+DECLARE_string(record_step_inputs);  // defined in ekf.cc
+
 namespace ekf {
 
+// the imu runs at 62.5 Hz
+const std::chrono::milliseconds kImuPeriod(16);
+
 EkfWrapper::EkfWrapper(ros::NodeHandle* nh, std::string const& platform_name) :
-          ekf_initialized_(false), imus_dropped_(0), have_imu_(false),
+          ekf_initialized_(false), imu_samples_dropped_(0), imu_samples_late_(0),
+          imu_samples_reported_(0), imu_samples_late_reported_(0), imu_timeouts_(0),
           input_mode_(ff_msgs::SetEkfInputRequest::MODE_NONE), nh_(nh),
           estimating_bias_(false), disp_features_(false), killed_(false) {
   platform_name_ = (platform_name.empty() ? "" : platform_name + "/");
@@ -43,6 +54,12 @@ EkfWrapper::EkfWrapper(ros::NodeHandle* nh, std::string const& platform_name) :
   config_timer_ = nh->createTimer(ros::Duration(1), [this](ros::TimerEvent e) {
       config_.CheckFilesUpdated(std::bind(&EkfWrapper::ReadParams, this));}, false, true);
   pt_ekf_.Initialize("ekf");
+  pt_imu_latency_.Initialize("ekf_imu_latency");
+  last_report_ = std::chrono::steady_clock::now();
+
+  // The nodelet owns the only Ekf of the process, so it is the one to record
+  if (!FLAGS_record_step_inputs.empty())
+    ekf_.RecordStepInputs(FLAGS_record_step_inputs);
 
   // Register to receive a callback when the EKF resets
   ekf_.SetResetCallback(std::bind(&EkfWrapper::ResetCallback, this));
@@ -198,31 +215,26 @@ void EkfWrapper::ResetCallback() {
 }
 
 void EkfWrapper::ImuCallBack(sensor_msgs::Imu::ConstPtr const& imu) {
-  // concurrency protection
-  std::unique_lock<std::mutex> lock(mutex_imu_msg_);
-  while (have_imu_ && !killed_)
-    cv_imu_.wait_for(lock, std::chrono::milliseconds(8));
-
-  // copy IMU data
-  imu_ = *imu;
-
-  have_imu_ = true;
-  // now notify the condition variable waiting for IMU that we have it
-  lock.unlock();
-  cv_imu_.notify_all();
-
-  if (estimating_bias_)
-    EstimateBias(imu);
+  // if the step fell this far behind, lose the message rather than wait
+  ImuSample sample = {imu, std::chrono::steady_clock::now()};
+  if (!imu_queue_.Push(sample)) {
+    imu_samples_dropped_++;
+    return;
+  }
+  // Step only holds the mutex while it checks the queue, taking it here makes
+  // sure the notification isn't missed
+  { std::lock_guard<std::mutex> lock(mutex_imu_wait_); }
+  cv_imu_.notify_one();
 }
 
-void EkfWrapper::EstimateBias(sensor_msgs::Imu::ConstPtr const& imu) {
+void EkfWrapper::EstimateBias(sensor_msgs::Imu const& imu) {
   bias_reset_count_++;
-  bias_reset_sums_[0] += imu->angular_velocity.x;
-  bias_reset_sums_[1] += imu->angular_velocity.y;
-  bias_reset_sums_[2] += imu->angular_velocity.z;
-  bias_reset_sums_[3] += imu->linear_acceleration.x;
-  bias_reset_sums_[4] += imu->linear_acceleration.y;
-  bias_reset_sums_[5] += imu->linear_acceleration.z;
+  bias_reset_sums_[0] += imu.angular_velocity.x;
+  bias_reset_sums_[1] += imu.angular_velocity.y;
+  bias_reset_sums_[2] += imu.angular_velocity.z;
+  bias_reset_sums_[3] += imu.linear_acceleration.x;
+  bias_reset_sums_[4] += imu.linear_acceleration.y;
+  bias_reset_sums_[5] += imu.linear_acceleration.z;
   if (bias_reset_count_ >= bias_required_observations_) {
     for (int i = 0; i < 6; i++)
       bias_reset_sums_[i] = bias_reset_sums_[i] / bias_reset_count_;
@@ -247,13 +259,13 @@ void EkfWrapper::EstimateBias(sensor_msgs::Imu::ConstPtr const& imu) {
 }
 
 void EkfWrapper::OpticalFlowCallBack(ff_msgs::Feature2dArray::ConstPtr const& of) {
-  std::lock_guard<std::mutex> lock(mutex_of_msg_);
+  std::lock_guard<std::mutex> lock(mutex_vision_msg_);
   ekf_.OpticalFlowUpdate(*of.get());
 }
 
 void EkfWrapper::VLVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr const& vl) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_MAP_LANDMARKS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
+    std::lock_guard<std::mutex> lock(mutex_vision_msg_);
     ekf_.SparseMapUpdate(*vl.get());
     PublishFeatures(vl);
   }
@@ -261,7 +273,7 @@ void EkfWrapper::VLVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr co
 
 void EkfWrapper::ARVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr const& vl) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_AR_TAGS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
+    std::lock_guard<std::mutex> lock(mutex_vision_msg_);
     bool updated = ekf_.ARTagUpdate(*vl.get());
     if (updated) {
       Eigen::Affine3d t = ekf_.GetDockToWorldTransform();
@@ -280,7 +292,7 @@ void EkfWrapper::ARVisualLandmarksCallBack(ff_msgs::VisualLandmarks::ConstPtr co
 
 void EkfWrapper::DepthLandmarksCallBack(ff_msgs::DepthLandmarks::ConstPtr const& dl) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_HANDRAIL) {
-    std::lock_guard<std::mutex> lock(mutex_dl_msg_);
+    std::lock_guard<std::mutex> lock(mutex_vision_msg_);
     bool updated = ekf_.HRTagUpdate(*dl.get());
     if (updated) {
       Eigen::Affine3d t = ekf_.GetHandrailToWorldTransform();
@@ -298,27 +310,27 @@ void EkfWrapper::DepthLandmarksCallBack(ff_msgs::DepthLandmarks::ConstPtr const&
 }
 
 void EkfWrapper::RegisterOpticalFlowCamera(ff_msgs::CameraRegistration::ConstPtr const& cr) {
-  std::lock_guard<std::mutex> lock(mutex_of_msg_);
+  std::lock_guard<std::mutex> lock(mutex_vision_msg_);
   ekf_.OpticalFlowRegister(*cr.get());
 }
 
 void EkfWrapper::VLRegisterCamera(ff_msgs::CameraRegistration::ConstPtr const& reg) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_MAP_LANDMARKS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
+    std::lock_guard<std::mutex> lock(mutex_vision_msg_);
     ekf_.SparseMapRegister(*reg.get());
   }
 }
 
 void EkfWrapper::ARRegisterCamera(ff_msgs::CameraRegistration::ConstPtr const& reg) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_AR_TAGS) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
+    std::lock_guard<std::mutex> lock(mutex_vision_msg_);
     ekf_.ARTagRegister(*reg.get());
   }
 }
 
 void EkfWrapper::RegisterDepthCamera(ff_msgs::CameraRegistration::ConstPtr const& reg) {
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_HANDRAIL) {
-    std::lock_guard<std::mutex> lock(mutex_vl_msg_);
+    std::lock_guard<std::mutex> lock(mutex_vision_msg_);
     ekf_.HandrailRegister(*reg.get());
   }
 }
@@ -326,20 +338,18 @@ void EkfWrapper::RegisterDepthCamera(ff_msgs::CameraRegistration::ConstPtr const
 void EkfWrapper::GroundTruthCallback(geometry_msgs::PoseStamped::ConstPtr const& pose) {
   // For certain contexts (like MGTF) we want to extract the correct orientation, and pass it to
   // GNC, so that Earth's gravity can be extracted out of the linear acceleration.
-  std::lock_guard<std::mutex> lk(mutex_truth_msg_);
   assert(pose->header.frame_id == "world");
-  quat_ = pose->pose.orientation;
+  quat_.Write(pose->pose.orientation);
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_TRUTH) {
-    truth_pose_= *pose;
+    truth_pose_.Write(*pose);
     pose_pub_.publish(pose);
   }
 }
 
 void EkfWrapper::GroundTruthTwistCallback(geometry_msgs::TwistStamped::ConstPtr const& twist) {
-  std::lock_guard<std::mutex> lk(mutex_truth_msg_);
   assert(twist->header.frame_id == "world");
   if (input_mode_ == ff_msgs::SetEkfInputRequest::MODE_TRUTH) {
-    truth_twist_= *twist;
+    truth_twist_.Write(*twist);
     twist_pub_.publish(twist);
   }
 }
@@ -359,16 +369,17 @@ void EkfWrapper::Run(std::atomic<bool> const& killed) {
 }
 
 int EkfWrapper::Step() {
-  // don't modify anything while we're copying the data
-  {
+  ImuSample sample;
+  if (!imu_queue_.Pop(&sample)) {
     // wait until we get an imu reading with the condition variable
-    std::unique_lock<std::mutex> lk(mutex_imu_msg_);
-    if (!have_imu_)
-      cv_imu_.wait_for(lk, std::chrono::milliseconds(8));
-    if (!have_imu_) {
-      imus_dropped_++;
+    {
+      std::unique_lock<std::mutex> lk(mutex_imu_wait_);
+      cv_imu_.wait_for(lk, std::chrono::milliseconds(8), [this] {return !imu_queue_.Empty();});
+    }
+    if (!imu_queue_.Pop(&sample)) {
+      imu_timeouts_++;
       // publish a failure if we stop getting imu messages
-      if (imus_dropped_ > 10 && ekf_initialized_) {
+      if (imu_timeouts_ > 10 && ekf_initialized_) {
         state_.header.stamp = ros::Time::now();
         state_.confidence = 2;  // lost
         state_pub_.publish<ff_msgs::EkfState>(state_);
@@ -376,25 +387,37 @@ int EkfWrapper::Step() {
       }
       return 0;   // Changed by Andrew due to 250Hz ctl messages when sim blocks (!)
     }
-    imus_dropped_ = 0;
-    if (!ekf_initialized_)
-      InitializeEkf();
-
-    std::lock(mutex_act_msg_, mutex_vl_msg_, mutex_dl_msg_, mutex_of_msg_, mutex_truth_msg_);
-    std::lock_guard<std::mutex> lock_actMsg(mutex_act_msg_, std::adopt_lock);
-    std::lock_guard<std::mutex> lock_vlMsg(mutex_vl_msg_, std::adopt_lock);
-    std::lock_guard<std::mutex> lock_dlMsg(mutex_dl_msg_, std::adopt_lock);
-    std::lock_guard<std::mutex> lock_ofMsg(mutex_of_msg_, std::adopt_lock);
-    std::lock_guard<std::mutex> lock_truthMsg(mutex_truth_msg_, std::adopt_lock);
+  }
+  imu_timeouts_ = 0;
+  if (!ekf_initialized_)
+    InitializeEkf();
+
+  // step every imu message that arrived since the last call, in order
+  int ret;
+  do {
+    ret = StepImu(sample);
+  } while (imu_queue_.Pop(&sample));
+  ReportPerformance();
+  return ret;
+}
+
+int EkfWrapper::StepImu(ImuSample const& sample) {
+  std::chrono::duration<double> latency = std::chrono::steady_clock::now() - sample.received;
+  pt_imu_latency_.Add(latency.count());
+  if (latency > kImuPeriod)
+    imu_samples_late_++;
+
+  if (estimating_bias_)
+    EstimateBias(*sample.imu);
+
+  {
     // copy everything in EKF, so data structures can be modified for next
     // step while current step processes. We pass the ground truth quaternion
     // representing the latest ISS2BODY rotation, which is used in certain
     // testing contexts to remove the effect of Earth's gravity.
-    ekf_.PrepareStep(imu_, quat_);
-    // don't reuse imu reading
-    have_imu_ = false;
+    std::lock_guard<std::mutex> lock(mutex_vision_msg_);
+    ekf_.PrepareStep(*sample.imu, quat_.Read());
   }
-  cv_imu_.notify_all();
 
   int ret = 1;
   switch (input_mode_) {
@@ -406,14 +429,15 @@ int EkfWrapper::Step() {
   // In truth mode we don't step the filter forward, but we do copy the pose
   // and twist into the EKF message.
   case ff_msgs::SetEkfInputRequest::MODE_TRUTH: {
-      std::lock_guard<std::mutex> lk(mutex_truth_msg_);
+      geometry_msgs::PoseStamped const& truth_pose = truth_pose_.Read();
+      geometry_msgs::TwistStamped const& truth_twist = truth_twist_.Read();
       ros::Time t = ros::Time::now();
-      if (fabs((truth_pose_.header.stamp - t).toSec()) < 1 &&
-          fabs((truth_twist_.header.stamp - t).toSec()) < 1) {
+      if (fabs((truth_pose.header.stamp - t).toSec()) < 1 &&
+          fabs((truth_twist.header.stamp - t).toSec()) < 1) {
         state_.header.stamp = t;
-        state_.pose = truth_pose_.pose;
-        state_.velocity = truth_twist_.twist.linear;
-        state_.omega = truth_twist_.twist.angular;
+        state_.pose = truth_pose.pose;
+        state_.velocity = truth_twist.twist.linear;
+        state_.omega = truth_twist.twist.angular;
         break;
       }
       ret = 0;
@@ -434,6 +458,28 @@ int EkfWrapper::Step() {
   return ret;
 }
 
+void EkfWrapper::ReportPerformance(void) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - last_report_ < std::chrono::seconds(1))
+    return;
+  last_report_ = now;
+  pt_ekf_.Send();
+  pt_imu_latency_.Send();
+  uint64_t lost = imu_samples_dropped_;
+  if (lost != imu_samples_reported_) {
+    ROS_WARN("EKF fell behind, %" PRIu64 " imu messages lost so far.", lost);
+    imu_samples_reported_ = lost;
+  }
+  uint64_t late = imu_samples_late_;
+  if (late != imu_samples_late_reported_) {
+    ROS_INFO("%" PRIu64 " imu messages stepped more than a period after they arrived so far.", late);
+    imu_samples_late_reported_ = late;
+  }
+  if (gnc_profile_enabled())
+    ROS_INFO_STREAM_THROTTLE(60, "EKF step profile:\n"
+                             << gnc_profile_report(GNC_PROFILE_EST_STEP, GNC_PROFILE_EST_APPLY_DELTA_STATE));
+}
+
 void EkfWrapper::PublishState(const ff_msgs::EkfState & state) {
   // Publish the full EKF state
   state_pub_.publish<ff_msgs::EkfState>(state);
@@ -0,0 +1,147 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Test the queue and the triple buffer the EKF nodelet passes messages
+// between its callbacks and its step thread with, from one thread and from a
+// producer and a consumer running at once
+
+#include <ekf/lock_free.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace {
+
+// Written as a whole and checked as a whole by the reader, so a torn copy
+// shows up as fields that disagree
+struct Sample {
+  uint64_t a, b, c, d;
+};
+
+Sample MakeSample(uint64_t i) {
+  return Sample{i, 2 * i, 3 * i, ~i};
+}
+
+bool Consistent(Sample const& s) {
+  return s.b == 2 * s.a && s.c == 3 * s.a && s.d == ~s.a;
+}
+
+}  // namespace
+
+TEST(SpscRing, FifoAndFull) {
+  ekf::SpscRing<int, 4> ring;
+  int value = 0;
+  EXPECT_TRUE(ring.Empty());
+  EXPECT_FALSE(ring.Pop(&value));
+
+  // Fills up, refuses the fifth value, and gives the others back in order
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(ring.Push(i));
+  EXPECT_FALSE(ring.Push(4));
+  EXPECT_FALSE(ring.Empty());
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(ring.Pop(&value));
+    EXPECT_EQ(i, value);
+  }
+  EXPECT_TRUE(ring.Empty());
+
+  // Keeps its order as the indices wrap around the slots many times
+  int next_pushed = 0, next_popped = 0;
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 1 + round % 4; i++)
+      EXPECT_TRUE(ring.Push(next_pushed++));
+    while (ring.Pop(&value))
+      EXPECT_EQ(next_popped++, value);
+  }
+  EXPECT_EQ(next_pushed, next_popped);
+}
+
+TEST(SpscRing, ConcurrentProducerAndConsumer) {
+  // Every value pushed is popped exactly once and in order, and values are
+  // only refused while the queue is full
+  static const uint64_t kValues = 200000;
+  ekf::SpscRing<Sample, 64> ring;
+  std::thread producer([&ring]() {
+      for (uint64_t i = 0; i < kValues; i++)
+        while (!ring.Push(MakeSample(i)))
+          std::this_thread::yield();
+    });
+  // keeps draining after a failure, so the producer always finishes
+  uint64_t expected = 0, wrong = 0;
+  Sample s;
+  while (expected < kValues) {
+    if (!ring.Pop(&s)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (!Consistent(s) || s.a != expected)
+      wrong++;
+    expected++;
+  }
+  producer.join();
+  EXPECT_EQ(0u, wrong);
+  EXPECT_TRUE(ring.Empty());
+}
+
+TEST(LatestValue, ReadsNewestWrite) {
+  ekf::LatestValue<int> value;
+  value.Write(1);
+  EXPECT_EQ(1, value.Read());
+  // Nothing new, the last value read again
+  EXPECT_EQ(1, value.Read());
+  // Only the newest of several writes is seen
+  value.Write(2);
+  value.Write(3);
+  value.Write(4);
+  EXPECT_EQ(4, value.Read());
+  EXPECT_EQ(4, value.Read());
+  value.Write(5);
+  EXPECT_EQ(5, value.Read());
+}
+
+TEST(LatestValue, ConcurrentWriterAndReader) {
+  // The reader never sees a torn value, nor an older one than it saw before
+  static const uint64_t kValues = 200000;
+  ekf::LatestValue<Sample> value;
+  value.Write(MakeSample(0));
+  std::atomic<bool> done(false);
+  std::thread writer([&value, &done]() {
+      for (uint64_t i = 1; i <= kValues; i++)
+        value.Write(MakeSample(i));
+      done = true;
+    });
+  uint64_t last = 0, wrong = 0;
+  while (!done) {
+    Sample const& s = value.Read();
+    if (!Consistent(s) || s.a < last)
+      wrong++;
+    last = s.a;
+  }
+  writer.join();
+  EXPECT_EQ(0u, wrong);
+  EXPECT_EQ(kValues, value.Read().a);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,217 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Test the circular history of an optical flow feature, and how the EKF
+// wrapper merges the features of each frame into its table sorted by id and
+// drops the features the tracker lost
+
+#include <ekf/ekf.h>
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const unsigned int kCapacity = ekf::OFHistory::kCapacity;
+
+// Gives the tests the feature table and the inputs it fills for the EKF
+class TestEkf : public ekf::Ekf {
+ public:
+  using ekf::Ekf::optical_flow_features_;
+  using ekf::Ekf::optical_flow_augs_feature_counts_;
+  using ekf::Ekf::of_;
+};
+
+// Registers frame number frame, then sends the features of the ids given,
+// in that order, each seen at (id, frame)
+void SendFrame(int frame, std::vector<int> const& ids, TestEkf * ekf) {
+  ff_msgs::CameraRegistration reg;
+  reg.header.stamp = ros::Time(1000 + 0.1 * frame);
+  reg.camera_id = frame + 1;
+  ekf->OpticalFlowRegister(reg);
+  ff_msgs::Feature2dArray of;
+  of.header.stamp = reg.header.stamp;
+  of.camera_id = reg.camera_id;
+  for (int id : ids) {
+    ff_msgs::Feature2d f;
+    f.id = id;
+    f.x = id;
+    f.y = frame;
+    of.feature_array.push_back(f);
+  }
+  ekf->OpticalFlowUpdate(of);
+}
+
+std::vector<uint32_t> FeatureIds(TestEkf const& ekf) {
+  std::vector<uint32_t> ids;
+  for (ekf::OFFeature const& f : ekf.optical_flow_features_)
+    ids.push_back(f.feature_id);
+  return ids;
+}
+
+void ExpectSame(std::deque<float> const& expected, ekf::OFHistory const& h) {
+  ASSERT_EQ(expected.size(), h.size());
+  for (unsigned int i = 0; i < h.size(); i++)
+    EXPECT_EQ(expected[i], h[i].x) << "observation " << i;
+}
+
+}  // namespace
+
+TEST(OFHistory, WrapsAroundAtCapacity) {
+  // Newest first, and the oldest dropped once full, as the start goes
+  // around the slots more than once
+  ekf::OFHistory h;
+  std::deque<float> expected;
+  for (int i = 0; i < 3 * static_cast<int>(kCapacity) + 5; i++) {
+    h.push_front({static_cast<float>(i), 0});
+    expected.push_front(i);
+    if (expected.size() > kCapacity)
+      expected.pop_back();
+    ExpectSame(expected, h);
+  }
+  EXPECT_EQ(kCapacity, h.size());
+
+  // Erasing from either half keeps the others in order, across the wrap
+  h.erase(3);
+  expected.erase(expected.begin() + 3);
+  ExpectSame(expected, h);
+  h.erase(h.size() - 2);
+  expected.erase(expected.end() - 2);
+  ExpectSame(expected, h);
+  h.erase(0);
+  expected.pop_front();
+  ExpectSame(expected, h);
+  h.erase(h.size() - 1);
+  expected.pop_back();
+  ExpectSame(expected, h);
+
+  // And so does any mix of both, down to empty and full again
+  std::mt19937 gen(0);
+  for (int i = 0; i < 10000; i++) {
+    if (h.size() > 0 && gen() % 2) {
+      unsigned int j = gen() % h.size();
+      h.erase(j);
+      expected.erase(expected.begin() + j);
+    } else {
+      h.push_front({static_cast<float>(i), 0});
+      expected.push_front(i);
+      if (expected.size() > kCapacity)
+        expected.pop_back();
+    }
+    ExpectSame(expected, h);
+  }
+}
+
+TEST(OFFeatures, MergesOutOfOrderIds) {
+  TestEkf ekf;
+  SendFrame(0, {9, 2, 5}, &ekf);
+  EXPECT_EQ(std::vector<uint32_t>({2, 5, 9}), FeatureIds(ekf));
+  for (ekf::OFFeature const& f : ekf.optical_flow_features_) {
+    ASSERT_EQ(1u, f.obs.size());
+    EXPECT_EQ(f.feature_id, f.obs[0].x);
+    EXPECT_EQ(0, f.missing_frames);
+  }
+
+  // A new id below the tracked ones, one above, and a repeated one, which
+  // adds both observations to its feature in the order they came
+  ff_msgs::CameraRegistration reg;
+  reg.header.stamp = ros::Time(1000.1);
+  reg.camera_id = 2;
+  ekf.OpticalFlowRegister(reg);
+  ff_msgs::Feature2dArray of;
+  of.header.stamp = reg.header.stamp;
+  of.camera_id = reg.camera_id;
+  of.feature_array.resize(4);
+  of.feature_array[0].id = 12;
+  of.feature_array[1].id = 5;
+  of.feature_array[1].x = 5;
+  of.feature_array[1].y = 1;
+  of.feature_array[2].id = 1;
+  of.feature_array[3].id = 5;
+  of.feature_array[3].x = 50;
+  of.feature_array[3].y = 1;
+  ekf.OpticalFlowUpdate(of);
+
+  EXPECT_EQ(std::vector<uint32_t>({1, 2, 5, 9, 12}), FeatureIds(ekf));
+  std::vector<ekf::OFFeature> const& features = ekf.optical_flow_features_;
+  EXPECT_EQ(0, features[0].missing_frames);
+  EXPECT_EQ(1, features[1].missing_frames);
+  EXPECT_EQ(0, features[2].missing_frames);
+  EXPECT_EQ(1, features[3].missing_frames);
+  EXPECT_EQ(0, features[4].missing_frames);
+  ekf::OFHistory const& h = features[2].obs;
+  ASSERT_EQ(3u, h.size());
+  EXPECT_EQ(50, h[0].x);
+  EXPECT_EQ(5, h[1].x);
+  EXPECT_EQ(1, h[1].y);
+  EXPECT_EQ(5, h[2].x);
+  EXPECT_EQ(0, h[2].y);
+  EXPECT_EQ(1u, features[0].obs.size());
+  EXPECT_EQ(1u, features[4].obs.size());
+}
+
+TEST(OFFeatures, DropsLostFeatures) {
+  // Once the augmentations are all filled, the features missing from the
+  // last frame are dropped, and those seen in every augmentation are passed
+  // to the EKF in id order. Feature 25 is kept, but only seen since frame 8.
+  TestEkf ekf;
+  const int kFrames = ASE_OF_NUM_AUG;
+  for (int frame = 0; frame < kFrames; frame++) {
+    std::vector<int> ids = {40, 10};
+    if (frame + 1 < kFrames)
+      ids.push_back(30);
+    ids.push_back(20);
+    if (frame >= 8)
+      ids.push_back(25);
+    SendFrame(frame, ids, &ekf);
+  }
+
+  EXPECT_EQ(std::vector<uint32_t>({10, 20, 25, 40}), FeatureIds(ekf));
+  for (ekf::OFFeature const& f : ekf.optical_flow_features_)
+    EXPECT_EQ(0, f.missing_frames);
+  // feature 30 is taken out of the counts of the augmentations it was in
+  ASSERT_EQ(kFrames, static_cast<int>(ekf.optical_flow_augs_feature_counts_.size()));
+  EXPECT_EQ(4, ekf.optical_flow_augs_feature_counts_[0]);
+  EXPECT_EQ(4, ekf.optical_flow_augs_feature_counts_[1]);
+  EXPECT_EQ(3, ekf.optical_flow_augs_feature_counts_[kFrames - 1]);
+
+  const int kMax = ASE_OF_NUM_FEATURES;
+  const int slots[] = {0, kFrames - 3, kFrames - 2, kFrames - 1};
+  const float ids[] = {10, 20, 25, 40};
+  for (int index = 0; index < 4; index++) {
+    for (int aug : slots) {
+      bool valid = ids[index] != 25;
+      EXPECT_EQ(valid, ekf.of_.cvs_valid_flag[aug * kMax + index]) << "feature " << ids[index] << " aug " << aug;
+      if (!valid)
+        continue;
+      EXPECT_EQ(ids[index], ekf.of_.cvs_observations[aug * kMax * 2 + index]);
+      EXPECT_EQ(kFrames - 1 - aug, ekf.of_.cvs_observations[aug * kMax * 2 + index + kMax]);
+    }
+  }
+  EXPECT_FALSE(ekf.of_.cvs_valid_flag[4]);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
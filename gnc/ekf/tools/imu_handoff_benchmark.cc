@@ -0,0 +1,208 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Measures how long imu messages wait between arriving and being stepped by
+// the EKF, with the handoff the EKF nodelet used before SpscRing, where the
+// callback kept one message and waited for the step to take it, and with the
+// SpscRing it uses now. The nodelet publishes the same latency as
+// /performance/ekf_imu_latency. Messages arrive every 16 ms and are queued
+// five deep, as the imu subscriber does. Each step spins for step_us, and
+// every spike_every-th step for spike_us instead:
+//
+//   imu_handoff_benchmark [seconds] [step_us] [spike_us] [spike_every]
+
+#include <ekf/lock_free.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::function<void(Clock::time_point)> StepImu;
+
+const std::chrono::milliseconds kImuPeriod(16);
+const int kSubscriberQueue = 5;
+
+// The handoff before SpscRing
+class WaitingHandoff {
+ public:
+  WaitingHandoff(void) : have_imu_(false) {}
+
+  void Callback(Clock::time_point arrived, std::atomic<bool> const& killed) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (have_imu_ && !killed)
+      cv_.wait_for(lock, std::chrono::milliseconds(8));
+    arrived_ = arrived;
+    have_imu_ = true;
+    lock.unlock();
+    cv_.notify_all();
+  }
+
+  void Step(StepImu const& step_imu) {
+    Clock::time_point arrived;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!have_imu_)
+        cv_.wait_for(lock, std::chrono::milliseconds(8));
+      if (!have_imu_)
+        return;
+      arrived = arrived_;
+      have_imu_ = false;
+    }
+    cv_.notify_all();
+    step_imu(arrived);
+  }
+
+  uint64_t Dropped(void) const {return 0;}
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool have_imu_;
+  Clock::time_point arrived_;
+};
+
+// The handoff of EkfWrapper::ImuCallBack and EkfWrapper::Step
+class RingHandoff {
+ public:
+  RingHandoff(void) : dropped_(0) {}
+
+  void Callback(Clock::time_point arrived, std::atomic<bool> const&) {
+    if (!queue_.Push(arrived)) {
+      dropped_++;
+      return;
+    }
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    cv_.notify_one();
+  }
+
+  void Step(StepImu const& step_imu) {
+    Clock::time_point arrived;
+    if (!queue_.Pop(&arrived)) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, std::chrono::milliseconds(8), [this] {return !queue_.Empty();});
+      }
+      if (!queue_.Pop(&arrived))
+        return;
+    }
+    do {
+      step_imu(arrived);
+    } while (queue_.Pop(&arrived));
+  }
+
+  uint64_t Dropped(void) const {return dropped_;}
+
+ private:
+  ekf::SpscRing<Clock::time_point, 64> queue_;
+  std::atomic<uint64_t> dropped_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+void Spin(std::chrono::microseconds duration) {
+  Clock::time_point end = Clock::now() + duration;
+  while (Clock::now() < end) {}
+}
+
+// milliseconds, sorted
+struct Times {
+  std::vector<double> ms;
+
+  void Add(Clock::duration d) {ms.push_back(std::chrono::duration<double, std::milli>(d).count());}
+  double Mean(void) const {
+    double sum = 0;
+    for (double t : ms)
+      sum += t;
+    return ms.empty() ? 0 : sum / ms.size();
+  }
+  double Percentile(double p) {
+    if (ms.empty())
+      return 0;
+    std::sort(ms.begin(), ms.end());
+    return ms[std::min(ms.size() - 1, static_cast<size_t>(p * ms.size()))];
+  }
+};
+
+template <typename Handoff>
+void Run(char const* name, int seconds, std::chrono::microseconds step, std::chrono::microseconds spike,
+         int spike_every) {
+  Handoff handoff;
+  std::atomic<bool> killed(false);
+  Times latency, callback;
+  uint64_t lost = 0;
+  Clock::time_point start = Clock::now();
+  const int num_imu = seconds * 1000 / kImuPeriod.count();
+
+  // the subscriber runs the callbacks one after the other, and loses the
+  // oldest message waiting when its queue is full
+  std::thread subscriber([&]() {
+      int next = 0;
+      while (next < num_imu) {
+        int arrived = std::min(num_imu, static_cast<int>((Clock::now() - start) / kImuPeriod) + 1);
+        if (arrived - next > kSubscriberQueue) {
+          lost += arrived - kSubscriberQueue - next;
+          next = arrived - kSubscriberQueue;
+        }
+        Clock::time_point t = start + next * kImuPeriod;
+        std::this_thread::sleep_until(t);
+        Clock::time_point called = Clock::now();
+        handoff.Callback(t, killed);
+        callback.Add(Clock::now() - called);
+        next++;
+      }
+    });
+
+  int steps = 0;
+  StepImu step_imu = [&](Clock::time_point arrived) {
+      latency.Add(Clock::now() - arrived);
+      Spin(++steps % spike_every == 0 ? spike : step);
+    };
+  while (Clock::now() < start + num_imu * kImuPeriod + std::chrono::milliseconds(100))
+    handoff.Step(step_imu);
+  killed = true;
+  subscriber.join();
+
+  printf("%-8s %9.3f %9.3f %9.3f %9.3f %9.3f %6lu\n", name, latency.Mean(), latency.Percentile(0.99),
+         latency.Percentile(1), callback.Percentile(0.99), callback.Percentile(1),
+         static_cast<unsigned long>(lost + handoff.Dropped()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int seconds = (argc > 1 ? atoi(argv[1]) : 20);
+  std::chrono::microseconds step(argc > 2 ? atoi(argv[2]) : 1000);
+  std::chrono::microseconds spike(argc > 3 ? atoi(argv[3]) : 50000);
+  int spike_every = (argc > 4 ? atoi(argv[4]) : 100);
+
+  printf("%-8s %9s %9s %9s %9s %9s %6s\n", "handoff", "lat_mean", "lat_p99", "lat_max", "cb_p99", "cb_max",
+         "lost");
+  Run<WaitingHandoff>("waiting", seconds, step, spike, spike_every);
+  Run<RingHandoff>("ring", seconds, step, spike, spike_every);
+  return 0;
+}
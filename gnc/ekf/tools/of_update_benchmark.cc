@@ -0,0 +1,83 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Times an optical flow registration and update of the EKF wrapper, with the
+// tracker sending from of_max_features_ (ASE_OF_NUM_FEATURES) up to four
+// times as many features. Every frame a few features are lost and replaced
+// by new ones, as the tracker does:
+//
+//   of_update_benchmark [frames]
+
+#include <ekf/ekf.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::vector<ff_msgs::Feature2dArray> TrackedFrames(int frames, int num_features) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> pixel(-0.5, 0.5);
+  std::vector<ff_msgs::Feature2dArray> out(frames);
+  std::vector<int> ids;
+  int next_id = 0;
+  for (int i = 0; i < frames; i++) {
+    std::vector<int> kept;
+    for (int id : ids)
+      if (gen() % 25)
+        kept.push_back(id);
+    while (static_cast<int>(kept.size()) < num_features)
+      kept.push_back(next_id++);
+    ids = kept;
+    out[i].header.stamp = ros::Time(1000 + 0.1 * i);
+    out[i].camera_id = i + 1;
+    out[i].feature_array.resize(ids.size());
+    for (size_t j = 0; j < ids.size(); j++) {
+      out[i].feature_array[j].id = ids[j];
+      out[i].feature_array[j].x = pixel(gen);
+      out[i].feature_array[j].y = pixel(gen);
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int frames = (argc > 1 ? atoi(argv[1]) : 5000);
+
+  printf("%10s %14s\n", "features", "us_per_frame");
+  for (int n = ASE_OF_NUM_FEATURES; n <= 4 * ASE_OF_NUM_FEATURES; n *= 2) {
+    std::vector<ff_msgs::Feature2dArray> input = TrackedFrames(frames, n);
+    ekf::Ekf ekf;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+      ff_msgs::CameraRegistration reg;
+      reg.header.stamp = input[i].header.stamp;
+      reg.camera_id = input[i].camera_id;
+      ekf.OpticalFlowRegister(reg);
+      ekf.OpticalFlowUpdate(input[i]);
+    }
+    std::chrono::duration<double, std::micro> dt = std::chrono::steady_clock::now() - start;
+    printf("%10d %14.2f\n", n, dt.count() / frames);
+  }
+  return 0;
+}
@@ -20,6 +20,7 @@
 #include <msg_conversions/msg_conversions.h>
 #include <ff_util/ff_names.h>
 #include <ff_hw_msgs/PmcCommand.h>
+#include <gnc_profile.h>
 
 // parameters fam_force_allocation_module_P are set in
 //  matlab/code_generation/fam_force_allocation_module_ert_rtw/fam_force_allocation_module_data.c
@@ -116,6 +117,9 @@ void Fam::Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl) {
   pmc_pub_.publish<ff_hw_msgs::PmcCommand>(pmc);
 
   pt_fam_.Send();
+  if (gnc_profile_enabled())
+    ROS_INFO_STREAM_THROTTLE(60, "FAM step profile:\n"
+                             << gnc_profile_report(GNC_PROFILE_FAM_STEP, GNC_PROFILE_FAM_STEP));
 }
 
 void Fam::ReadParams(void) {
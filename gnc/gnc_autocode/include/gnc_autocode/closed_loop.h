@@ -0,0 +1,144 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GNC_AUTOCODE_CLOSED_LOOP_H_
+#define GNC_AUTOCODE_CLOSED_LOOP_H_
+
+#include <gnc_autocode/sim.h>
+#include <gnc_autocode/ekf.h>
+#include <gnc_autocode/ctl.h>
+#include <gnc_autocode/fam.h>
+#include <gnc_autocode/step_record.h>
+
+#include <stdint.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace config_reader {
+  class ConfigReader;
+}
+
+namespace gnc_autocode {
+
+// A setpoint held from its time until the next command's time. The modes are
+// those of ff_msgs::ControlCommand.
+struct GncCommand {
+  enum Mode {IDLE = 0, STOP = 1, NOMINAL = 2};
+  double time;          // seconds since the start of the run
+  uint8_t mode;
+  float position[3];    // P_B_ISS_ISS
+  float attitude[4];    // quat_ISS2B, x y z w
+};
+
+// Reads one command per line, "time mode px py pz qx qy qz qw", where mode
+// is idle, stop or nominal. Blank lines and lines starting with # are skipped.
+bool ReadCommandScript(std::string const& filename, std::vector<GncCommand>* commands);
+
+// Spread of the parameters drawn for each Monte Carlo run
+struct GncPerturbation {
+  float position;       // initial position, meters per axis
+  float attitude;       // initial attitude, radians about a random axis
+  float velocity;       // initial velocity, meters per second per axis
+  float mass;           // mass error, kilograms
+  float inertia;        // error of each diagonal inertia term, kg m^2
+};
+
+// One step of a run, as written to the telemetry file
+struct GncTelemetry {
+  double time;
+  float truth_position[3];
+  float truth_attitude[4];
+  float truth_velocity[3];
+  float truth_omega[3];
+  float est_position[3];
+  float est_attitude[4];
+  float est_velocity[3];
+  float est_omega[3];
+  float cmd_position[3];
+  float cmd_attitude[4];
+  float force[3];
+  float torque[3];
+  uint16_t kfl_status;
+  uint8_t confidence;
+  uint8_t ctl_status;
+};
+
+// Starts a telemetry file, followed by one GncTelemetry per record
+struct GncTelemetryHeader {
+  char magic[4];        // "GNCT"
+  uint32_t version;
+  uint32_t record_size;  // sizeof(GncTelemetry)
+  uint32_t run;
+  uint64_t seed;
+};
+
+/**
+ * The simulator, estimator, controller and force allocation autocode wired
+ * together as in the Simulink closed loop model, without ROS in between. Each
+ * call to Step advances all four by one 16 ms tick of the simulator.
+ *
+ * Constructing the autocode writes to global state, so instances must not be
+ * constructed concurrently. Once constructed, each instance only touches its
+ * own data and can step in its own thread.
+ **/
+class GncClosedLoop {
+ public:
+  GncClosedLoop(void);
+
+  // Reads the parameters of all four subsystems, and the default gains,
+  // inertia and localization mode the controller is commanded with
+  void ReadParams(config_reader::ConfigReader* config);
+  // Copies every parameter from another instance, instead of reading them
+  void CopyParams(GncClosedLoop const& other);
+  // Draws new noise seeds, initial conditions and inertia errors
+  void Perturb(GncPerturbation const& spread, std::mt19937* generator);
+
+  // Starts the EKF at the simulator's initial state and resets all four
+  // subsystems. Call after changing parameters.
+  void Initialize(void);
+  void SetCommands(std::vector<GncCommand> const& commands);
+  void Step(void);
+
+  double Time(void) const;
+  void Telemetry(GncTelemetry* t) const;
+
+  GncSimAutocode sim_;
+  GncEkfAutocode ekf_;
+  GncCtlAutocode ctl_;
+  GncFamAutocode fam_;
+
+  // the mid level command sent to all subsystems
+  cmc_msg cmc_;
+  // control on the simulator's truth instead of the EKF state
+  bool use_truth_;
+  // if set, records the inputs of the EKF, CTL and FAM steps
+  GncStepRecorder* recorder_;
+
+ private:
+  void UpdateCommand(void);
+
+  std::vector<GncCommand> commands_;
+  size_t command_;
+  double start_time_;
+};
+
+}  // end namespace gnc_autocode
+
+#endif  // GNC_AUTOCODE_CLOSED_LOOP_H_
@@ -56,6 +56,13 @@ class GncSimAutocode {
   cmc_msg cmc_out_msg_;
   imu_msg imu_msg_;
   bpm_msg bpm_msg_;
+
+ private:
+  // scheduling of the model's four slower rates, kept per instance so that
+  // several simulators can run side by side
+  bool overrun_flags_[5];
+  bool event_flags_[5];
+  int task_counter_[5];
 };
 }  // end namespace gnc_autocode
 
@@ -0,0 +1,119 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GNC_AUTOCODE_STEP_RECORD_H_
+#define GNC_AUTOCODE_STEP_RECORD_H_
+
+#include <gnc_autocode/ekf.h>
+#include <gnc_autocode/ctl.h>
+#include <gnc_autocode/fam.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace gnc_autocode {
+
+// Everything each autocode step function reads
+struct GncEkfInputs {
+  cvs_landmark_msg vis;
+  cvs_registration_pulse reg;
+  cvs_optical_flow_msg of;
+  cvs_handrail_msg hand;
+  imu_msg imu;
+  real32_T quat[4];
+  cmc_msg cmc;
+
+  void Get(GncEkfAutocode const& ekf);
+  void Set(GncEkfAutocode* ekf) const;
+};
+
+struct GncCtlInputs {
+  ctl_input_msg ctl_input;
+
+  void Get(GncCtlAutocode const& ctl);
+  void Set(GncCtlAutocode* ctl) const;
+};
+
+struct GncFamInputs {
+  ex_time_msg time;
+  cmd_msg cmd;
+  ctl_msg ctl;
+  cmc_msg cmc;
+};
+
+enum GncStepType {GNC_STEP_EKF = 0, GNC_STEP_CTL = 1, GNC_STEP_FAM = 2, GNC_STEP_TYPES = 3};
+
+/**
+ * Writes the inputs of every step to a file, to replay them through the
+ * autocode later. Only the messages that changed since the last step of the
+ * same subsystem are written, the camera messages change far less often
+ * than the IMU.
+ **/
+class GncStepRecorder {
+ public:
+  GncStepRecorder(void);
+  ~GncStepRecorder(void);
+
+  bool Open(std::string const& filename);
+  void Close(void);
+
+  // call just before the corresponding Step
+  void Record(GncEkfAutocode const& ekf);
+  void Record(GncCtlAutocode const& ctl);
+  void Record(GncFamAutocode const& fam, ex_time_msg const& time, cmd_msg const& cmd, ctl_msg const& ctl);
+
+ private:
+  void Write(int type, void const* inputs);
+
+  FILE* file_;
+  // the inputs last written of each type, to compare with
+  GncEkfInputs ekf_;
+  GncCtlInputs ctl_;
+  GncFamInputs fam_;
+  bool written_[GNC_STEP_TYPES];
+};
+
+/**
+ * The steps of a recording. Each step only holds the messages that changed,
+ * so steps of one type must be applied in order, starting from the first,
+ * to the same inputs.
+ **/
+class GncStepLog {
+ public:
+  bool Read(std::string const& filename);
+
+  size_t Steps(GncStepType type) const;
+  // updates the inputs to those of step i
+  void Apply(size_t i, GncEkfInputs* inputs) const;
+  void Apply(size_t i, GncCtlInputs* inputs) const;
+  void Apply(size_t i, GncFamInputs* inputs) const;
+
+ private:
+  void Apply(GncStepType type, size_t i, void* inputs) const;
+
+  std::vector<uint8_t> data_;
+  // where each step of each type starts in data_
+  std::vector<size_t> steps_[GNC_STEP_TYPES];
+};
+
+}  // end namespace gnc_autocode
+
+#endif  // GNC_AUTOCODE_STEP_RECORD_H_
@@ -0,0 +1,299 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <gnc_autocode/closed_loop.h>
+
+#include <config_reader/config_reader.h>
+#include <msg_conversions/msg_conversions.h>
+#include <ros/console.h>
+
+#include <Eigen/Geometry>
+
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace gnc_autocode {
+
+namespace {
+
+void SetState(GncCommand const& c, double start_time, cmc_state_cmd* s) {
+  double t = start_time + c.time;
+  s->timestamp_sec = static_cast<uint32_T>(t);
+  s->timestamp_nsec = static_cast<uint32_T>((t - s->timestamp_sec) * 1e9);
+  memcpy(s->P_B_ISS_ISS, c.position, sizeof(s->P_B_ISS_ISS));
+  memcpy(s->quat_ISS2B, c.attitude, sizeof(s->quat_ISS2B));
+  memset(s->V_B_ISS_ISS, 0, sizeof(s->V_B_ISS_ISS));
+  memset(s->A_B_ISS_ISS, 0, sizeof(s->A_B_ISS_ISS));
+  memset(s->omega_B_ISS_B, 0, sizeof(s->omega_B_ISS_B));
+  memset(s->alpha_B_ISS_B, 0, sizeof(s->alpha_B_ISS_B));
+}
+
+}  // namespace
+
+bool ReadCommandScript(std::string const& filename, std::vector<GncCommand>* commands) {
+  std::ifstream f(filename.c_str());
+  if (!f.is_open())
+    return false;
+  commands->clear();
+  std::string line;
+  while (std::getline(f, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream s(line);
+    GncCommand c;
+    std::string mode;
+    if (!(s >> c.time >> mode))
+      continue;
+    if (mode == "idle") {
+      c.mode = GncCommand::IDLE;
+    } else if (mode == "stop") {
+      c.mode = GncCommand::STOP;
+    } else if (mode == "nominal") {
+      c.mode = GncCommand::NOMINAL;
+    } else {
+      return false;
+    }
+    if (!(s >> c.position[0] >> c.position[1] >> c.position[2] >>
+               c.attitude[0] >> c.attitude[1] >> c.attitude[2] >> c.attitude[3]))
+      return false;
+    // the setpoint in effect is found by time, so they have to be in order
+    if (!commands->empty() && c.time < commands->back().time)
+      return false;
+    commands->push_back(c);
+  }
+  return true;
+}
+
+GncClosedLoop::GncClosedLoop(void) : use_truth_(false), recorder_(NULL), command_(0), start_time_(-1) {
+  memset(&cmc_, 0, sizeof(cmc_));
+  cmc_.cmc_mode_cmd = GncCommand::STOP;
+}
+
+void GncClosedLoop::ReadParams(config_reader::ConfigReader* config) {
+  sim_.ReadParams(config);
+  ekf_.ReadParams(config);
+  ctl_.ReadParams(config);
+  fam_.ReadParams(config);
+
+  // on the robot these come from the flight mode and the inertia messages
+  if (!msg_conversions::config_read_array(config, "tun_default_att_kp", 3, cmc_.att_kp))
+    ROS_FATAL("Unspecified tun_default_att_kp.");
+  if (!msg_conversions::config_read_array(config, "tun_default_att_ki", 3, cmc_.att_ki))
+    ROS_FATAL("Unspecified tun_default_att_ki.");
+  if (!msg_conversions::config_read_array(config, "tun_default_omega_kd", 3, cmc_.omega_kd))
+    ROS_FATAL("Unspecified tun_default_omega_kd.");
+  if (!msg_conversions::config_read_array(config, "tun_default_pos_kp", 3, cmc_.pos_kp))
+    ROS_FATAL("Unspecified tun_default_pos_kp.");
+  if (!msg_conversions::config_read_array(config, "tun_default_pos_ki", 3, cmc_.pos_ki))
+    ROS_FATAL("Unspecified tun_default_pos_ki.");
+  if (!msg_conversions::config_read_array(config, "tun_default_vel_kd", 3, cmc_.vel_kd))
+    ROS_FATAL("Unspecified tun_default_vel_kd.");
+  if (!msg_conversions::config_read_array(config, "tun_default_center_of_mass", 3, cmc_.center_of_mass))
+    ROS_FATAL("Unspecified tun_default_center_of_mass.");
+  if (!msg_conversions::config_read_matrix(config, "tun_default_inertia_matrix", 3, 3, cmc_.inertia_matrix))
+    ROS_FATAL("Unspecified tun_default_inertia_matrix.");
+  if (!config->GetReal("tun_default_mass", &cmc_.mass))
+    ROS_FATAL("Unspecified tun_default_mass.");
+  int speed = 0, localization = 0;
+  if (!config->GetInt("tun_default_speed_gain_cmd", &speed))
+    ROS_FATAL("Unspecified tun_default_speed_gain_cmd.");
+  if (!config->GetInt("tun_default_localization_mode_cmd", &localization))
+    ROS_FATAL("Unspecified tun_default_localization_mode_cmd.");
+  cmc_.speed_gain_cmd = speed;
+  cmc_.localization_mode_cmd = localization;
+}
+
+void GncClosedLoop::CopyParams(GncClosedLoop const& other) {
+  *sim_.sim_->defaultParam = *other.sim_.sim_->defaultParam;
+  *ekf_.est_->defaultParam = *other.ekf_.est_->defaultParam;
+  *ctl_.controller_->defaultParam = *other.ctl_.controller_->defaultParam;
+  *fam_.fam_->defaultParam = *other.fam_.fam_->defaultParam;
+  cmc_ = other.cmc_;
+  use_truth_ = other.use_truth_;
+}
+
+void GncClosedLoop::Perturb(GncPerturbation const& spread, std::mt19937* generator) {
+  auto& p = sim_.sim_->defaultParam;
+  std::normal_distribution<float> normal;
+  std::uniform_int_distribution<int> seed(1, 1 << 30);
+
+  for (int i = 0; i < 3; i++) {
+    p->epson_accel_noise_seed[i] = seed(*generator);
+    p->epson_gyro_noise_seed[i] = seed(*generator);
+  }
+  p->cvs_noise_seed = seed(*generator);
+  p->bpm_PM1_randn_noise_seed = seed(*generator);
+  p->bpm_PM2_randn_noise_seed = seed(*generator);
+
+  for (int i = 0; i < 3; i++) {
+    p->tun_ini_P_B_ISS_ISS[i] += spread.position * normal(*generator);
+    p->tun_ini_V_B_ISS_ISS[i] += spread.velocity * normal(*generator);
+    p->tun_inertia_error_mat[4 * i] += spread.inertia * normal(*generator);
+  }
+  p->tun_mass_error += spread.mass * normal(*generator);
+
+  Eigen::Vector3f axis(normal(*generator), normal(*generator), normal(*generator));
+  Eigen::Map<Eigen::Vector4f> q_array(p->tun_ini_Q_ISS2B);
+  Eigen::Quaternionf q(q_array[3], q_array[0], q_array[1], q_array[2]);
+  q = q * Eigen::AngleAxisf(spread.attitude * normal(*generator), axis.normalized());
+  q_array = q.normalized().coeffs();
+}
+
+void GncClosedLoop::Initialize(void) {
+  // start the estimator at the simulator's initial state, as the EKF wrapper
+  // does when it is reset to a known pose
+  auto& s = sim_.sim_->defaultParam;
+  auto& e = ekf_.est_->defaultParam;
+  Eigen::Quaternionf world_q_body(s->tun_ini_Q_ISS2B[3], s->tun_ini_Q_ISS2B[0],
+                                  s->tun_ini_Q_ISS2B[1], s->tun_ini_Q_ISS2B[2]);
+  Eigen::Map<Eigen::Vector3f> world_r_body(s->tun_ini_P_B_ISS_ISS);
+  Eigen::Map<Eigen::Vector3f> body_r_imu(e->tun_abp_p_imu_body_body);
+  Eigen::Map<Eigen::Vector3f>(e->tun_ase_state_ic_P_EST_ISS_ISS) = world_r_body + world_q_body * body_r_imu;
+  memcpy(e->tun_ase_state_ic_quat_ISS2B, s->tun_ini_Q_ISS2B, sizeof(e->tun_ase_state_ic_quat_ISS2B));
+  memcpy(e->tun_ase_state_ic_P_B_ISS_ISS, s->tun_ini_P_B_ISS_ISS, sizeof(e->tun_ase_state_ic_P_B_ISS_ISS));
+  memcpy(e->tun_ase_state_ic_V_B_ISS_ISS, s->tun_ini_V_B_ISS_ISS, sizeof(e->tun_ase_state_ic_V_B_ISS_ISS));
+
+  sim_.Initialize();
+  ekf_.Initialize();
+  ctl_.Initialize();
+  fam_.Initialize();
+  command_ = 0;
+  start_time_ = -1;
+}
+
+void GncClosedLoop::SetCommands(std::vector<GncCommand> const& commands) {
+  commands_ = commands;
+  command_ = 0;
+}
+
+double GncClosedLoop::Time(void) const {
+  double t = sim_.ex_time_msg_.timestamp_sec + sim_.ex_time_msg_.timestamp_nsec / 1e9;
+  return start_time_ < 0 ? 0.0 : t - start_time_;
+}
+
+void GncClosedLoop::UpdateCommand(void) {
+  double t = Time();
+  while (command_ + 1 < commands_.size() && commands_[command_ + 1].time <= t)
+    command_++;
+  // hold position until the first command
+  if (commands_.empty() || commands_[command_].time > t) {
+    cmc_.cmc_mode_cmd = GncCommand::STOP;
+    return;
+  }
+  GncCommand const& a = commands_[command_];
+  GncCommand const& b = commands_[std::min(command_ + 1, commands_.size() - 1)];
+  cmc_.cmc_mode_cmd = a.mode;
+  SetState(a, start_time_, &cmc_.cmc_state_cmd_a);
+  SetState(b, start_time_, &cmc_.cmc_state_cmd_b);
+}
+
+void GncClosedLoop::Step(void) {
+  // the force allocation output of the last step drives the simulator
+  sim_.act_msg_ = fam_.act_;
+  sim_.cmc_in_msg_ = cmc_;
+  sim_.Step();
+  if (start_time_ < 0)
+    start_time_ = sim_.ex_time_msg_.timestamp_sec + sim_.ex_time_msg_.timestamp_nsec / 1e9;
+  UpdateCommand();
+
+  // the estimator reads the simulated sensors directly, the AR tags take the
+  // place of the mapped landmarks when docking
+  ekf_.imu_ = sim_.imu_msg_;
+  ekf_.of_ = sim_.optical_msg_;
+  ekf_.hand_ = sim_.hand_msg_;
+  ekf_.reg_ = sim_.reg_pulse_;
+  if (cmc_.localization_mode_cmd == ekf_.est_->defaultParam->ase_local_mode_docking) {
+    ekf_.vis_ = sim_.ar_tag_msg_;
+    ekf_.reg_.cvs_landmark_pulse = sim_.reg_pulse_.cvs_ar_tag_pulse;
+  } else {
+    ekf_.vis_ = sim_.landmark_msg_;
+  }
+  memcpy(ekf_.quat_, sim_.env_msg_.Q_ISS2B, sizeof(ekf_.quat_));
+  ekf_.cmc_ = cmc_;
+  if (recorder_)
+    recorder_->Record(ekf_);
+  ekf_.Step();
+
+  // the controller steps on every new state, as it does on the EKF messages
+  ctl_input_msg& in = ctl_.ctl_input_;
+  if (use_truth_) {
+    memcpy(in.est_quat_ISS2B, sim_.env_msg_.Q_ISS2B, sizeof(in.est_quat_ISS2B));
+    memcpy(in.est_omega_B_ISS_B, sim_.env_msg_.omega_B_ISS_B, sizeof(in.est_omega_B_ISS_B));
+    memcpy(in.est_V_B_ISS_ISS, sim_.env_msg_.V_B_ISS_ISS, sizeof(in.est_V_B_ISS_ISS));
+    memcpy(in.est_P_B_ISS_ISS, sim_.env_msg_.P_B_ISS_ISS, sizeof(in.est_P_B_ISS_ISS));
+    in.est_confidence = 0;
+  } else {
+    memcpy(in.est_quat_ISS2B, ekf_.kfl_.quat_ISS2B, sizeof(in.est_quat_ISS2B));
+    memcpy(in.est_omega_B_ISS_B, ekf_.kfl_.omega_B_ISS_B, sizeof(in.est_omega_B_ISS_B));
+    memcpy(in.est_V_B_ISS_ISS, ekf_.kfl_.V_B_ISS_ISS, sizeof(in.est_V_B_ISS_ISS));
+    memcpy(in.est_P_B_ISS_ISS, ekf_.kfl_.P_B_ISS_ISS, sizeof(in.est_P_B_ISS_ISS));
+    in.est_confidence = ekf_.kfl_.confidence;
+  }
+  in.cmd_state_a = cmc_.cmc_state_cmd_a;
+  in.cmd_state_b = cmc_.cmc_state_cmd_b;
+  in.ctl_mode_cmd = cmc_.cmc_mode_cmd;
+  in.current_time_sec = sim_.ex_time_msg_.timestamp_sec;
+  in.current_time_nsec = sim_.ex_time_msg_.timestamp_nsec;
+  in.speed_gain_cmd = cmc_.speed_gain_cmd;
+  memcpy(in.att_kp, cmc_.att_kp, sizeof(in.att_kp));
+  memcpy(in.att_ki, cmc_.att_ki, sizeof(in.att_ki));
+  memcpy(in.omega_kd, cmc_.omega_kd, sizeof(in.omega_kd));
+  memcpy(in.pos_kp, cmc_.pos_kp, sizeof(in.pos_kp));
+  memcpy(in.pos_ki, cmc_.pos_ki, sizeof(in.pos_ki));
+  memcpy(in.vel_kd, cmc_.vel_kd, sizeof(in.vel_kd));
+  memcpy(in.inertia_matrix, cmc_.inertia_matrix, sizeof(in.inertia_matrix));
+  in.mass = cmc_.mass;
+  if (recorder_)
+    recorder_->Record(ctl_);
+  ctl_.Step();
+
+  // as in the FAM nodelet, the speed comes from the flight mode
+  ex_time_msg time = sim_.ex_time_msg_;
+  cmd_msg cmd = ctl_.cmd_;
+  cmd.speed_gain_cmd = cmc_.speed_gain_cmd;
+  fam_.cmc_ = cmc_;
+  if (recorder_)
+    recorder_->Record(fam_, time, cmd, ctl_.ctl_);
+  fam_.Step(&time, &cmd, &ctl_.ctl_);
+}
+
+void GncClosedLoop::Telemetry(GncTelemetry* t) const {
+  const env_msg& env = sim_.env_msg_;
+  const kfl_msg& kfl = ekf_.kfl_;
+  t->time = Time();
+  memcpy(t->truth_position, env.P_B_ISS_ISS, sizeof(t->truth_position));
+  memcpy(t->truth_attitude, env.Q_ISS2B, sizeof(t->truth_attitude));
+  memcpy(t->truth_velocity, env.V_B_ISS_ISS, sizeof(t->truth_velocity));
+  memcpy(t->truth_omega, env.omega_B_ISS_B, sizeof(t->truth_omega));
+  memcpy(t->est_position, kfl.P_B_ISS_ISS, sizeof(t->est_position));
+  memcpy(t->est_attitude, kfl.quat_ISS2B, sizeof(t->est_attitude));
+  memcpy(t->est_velocity, kfl.V_B_ISS_ISS, sizeof(t->est_velocity));
+  memcpy(t->est_omega, kfl.omega_B_ISS_B, sizeof(t->est_omega));
+  memcpy(t->cmd_position, cmc_.cmc_state_cmd_a.P_B_ISS_ISS, sizeof(t->cmd_position));
+  memcpy(t->cmd_attitude, cmc_.cmc_state_cmd_a.quat_ISS2B, sizeof(t->cmd_attitude));
+  memcpy(t->force, ctl_.ctl_.body_force_cmd, sizeof(t->force));
+  memcpy(t->torque, ctl_.ctl_.body_torque_cmd, sizeof(t->torque));
+  t->kfl_status = kfl.kfl_status;
+  t->confidence = kfl.confidence;
+  t->ctl_status = ctl_.ctl_.ctl_status;
+}
+
+}  // end namespace gnc_autocode
@@ -22,6 +22,7 @@
 #include <assert.h>
 
 #include <ctl_tunable_funcs.h>
+#include <gnc_profile.h>
 
 namespace gnc_autocode {
 
@@ -36,6 +37,7 @@ GncCtlAutocode::~GncCtlAutocode() {
 }
 
 void GncCtlAutocode::Step(void) {
+  GNC_PROFILE_SCOPE(GNC_PROFILE_CTL_STEP);
   ctl_controller0_step(controller_, &ctl_input_, &cmd_, &ctl_);
 }
 
@@ -22,6 +22,7 @@
 #include <assert.h>
 
 #include <est_tunable_funcs.h>
+#include <gnc_profile.h>
 
 namespace gnc_autocode {
 
@@ -32,6 +33,16 @@ GncEkfAutocode::GncEkfAutocode(void) {
   est_ = est_estimator(&vis_, &reg_, &of_, &hand_, &imu_, &cmc_, quat_, &kfl_, P_);
   assert(est_);
   assert(rtmGetErrorStatus(est_) == NULL);
+  // The first model made uses the default parameters in place and later ones
+  // get a copy. Give the first one its own copy too, so that reading a config
+  // into one estimator never changes the parameters of another.
+  if (!est_->paramIsMalloced) {
+    P_est_estimator_T* p = static_cast<P_est_estimator_T*>(malloc(sizeof(P_est_estimator_T)));
+    assert(p);
+    *p = *est_->defaultParam;
+    est_->defaultParam = p;
+    est_->paramIsMalloced = true;
+  }
   Initialize();
 }
 
@@ -41,6 +52,7 @@ GncEkfAutocode::~GncEkfAutocode() {
 }
 
 void GncEkfAutocode::Step() {
+  GNC_PROFILE_SCOPE(GNC_PROFILE_EST_STEP);
   est_estimator_step(est_, &vis_, &reg_, &of_, &hand_, &imu_, &cmc_, quat_, &kfl_, P_);
 }
 
@@ -22,6 +22,7 @@
 #include <assert.h>
 
 #include <fam_tunable_funcs.h>
+#include <gnc_profile.h>
 
 namespace gnc_autocode {
 
@@ -37,6 +38,7 @@ GncFamAutocode::~GncFamAutocode() {
 }
 
 void GncFamAutocode::Step(ex_time_msg* ex_time, cmd_msg* cmd, ctl_msg* ctl) {
+  GNC_PROFILE_SCOPE(GNC_PROFILE_FAM_STEP);
   fam_force_allocation_module_step(fam_, ex_time, cmd, ctl, &cmc_, &act_);
 }
 
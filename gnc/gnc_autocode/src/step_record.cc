@@ -0,0 +1,260 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <gnc_autocode/step_record.h>
+
+#include <stddef.h>
+#include <string.h>
+
+namespace gnc_autocode {
+
+namespace {
+
+// The file starts with the magic and the size of each inputs struct, so
+// recordings made before the autocode was regenerated are refused. Each step
+// is then its type, a bit mask of the fields that follow, and those fields.
+const char kMagic[4] = {'G', 'N', 'C', 'S'};
+const uint32_t kVersion = 1;
+
+struct Field {
+  size_t offset;
+  size_t size;
+};
+
+const Field kEkfFields[] = {
+  {offsetof(GncEkfInputs, vis), sizeof(cvs_landmark_msg)},
+  {offsetof(GncEkfInputs, reg), sizeof(cvs_registration_pulse)},
+  {offsetof(GncEkfInputs, of), sizeof(cvs_optical_flow_msg)},
+  {offsetof(GncEkfInputs, hand), sizeof(cvs_handrail_msg)},
+  {offsetof(GncEkfInputs, imu), sizeof(imu_msg)},
+  {offsetof(GncEkfInputs, quat), sizeof(real32_T[4])},
+  {offsetof(GncEkfInputs, cmc), sizeof(cmc_msg)},
+};
+const Field kCtlFields[] = {
+  {offsetof(GncCtlInputs, ctl_input), sizeof(ctl_input_msg)},
+};
+const Field kFamFields[] = {
+  {offsetof(GncFamInputs, time), sizeof(ex_time_msg)},
+  {offsetof(GncFamInputs, cmd), sizeof(cmd_msg)},
+  {offsetof(GncFamInputs, ctl), sizeof(ctl_msg)},
+  {offsetof(GncFamInputs, cmc), sizeof(cmc_msg)},
+};
+
+struct Layout {
+  Field const* fields;
+  int count;
+  uint32_t size;
+};
+
+const Layout kLayouts[GNC_STEP_TYPES] = {
+  {kEkfFields, sizeof(kEkfFields) / sizeof(Field), sizeof(GncEkfInputs)},
+  {kCtlFields, sizeof(kCtlFields) / sizeof(Field), sizeof(GncCtlInputs)},
+  {kFamFields, sizeof(kFamFields) / sizeof(Field), sizeof(GncFamInputs)},
+};
+
+}  // namespace
+
+void GncEkfInputs::Get(GncEkfAutocode const& ekf) {
+  vis = ekf.vis_;
+  reg = ekf.reg_;
+  of = ekf.of_;
+  hand = ekf.hand_;
+  imu = ekf.imu_;
+  memcpy(quat, ekf.quat_, sizeof(quat));
+  cmc = ekf.cmc_;
+}
+
+void GncEkfInputs::Set(GncEkfAutocode* ekf) const {
+  ekf->vis_ = vis;
+  ekf->reg_ = reg;
+  ekf->of_ = of;
+  ekf->hand_ = hand;
+  ekf->imu_ = imu;
+  memcpy(ekf->quat_, quat, sizeof(quat));
+  ekf->cmc_ = cmc;
+}
+
+void GncCtlInputs::Get(GncCtlAutocode const& ctl) {
+  ctl_input = ctl.ctl_input_;
+}
+
+void GncCtlInputs::Set(GncCtlAutocode* ctl) const {
+  ctl->ctl_input_ = ctl_input;
+}
+
+GncStepRecorder::GncStepRecorder(void) : file_(NULL) {}
+
+GncStepRecorder::~GncStepRecorder(void) {
+  Close();
+}
+
+bool GncStepRecorder::Open(std::string const& filename) {
+  Close();
+  file_ = fopen(filename.c_str(), "wb");
+  if (file_ == NULL) {
+    fprintf(stderr, "Failed to open file %s.\n", filename.c_str());
+    return false;
+  }
+  fwrite(kMagic, sizeof(kMagic), 1, file_);
+  fwrite(&kVersion, sizeof(kVersion), 1, file_);
+  for (int i = 0; i < GNC_STEP_TYPES; i++)
+    fwrite(&kLayouts[i].size, sizeof(uint32_t), 1, file_);
+  for (int i = 0; i < GNC_STEP_TYPES; i++)
+    written_[i] = false;
+  return true;
+}
+
+void GncStepRecorder::Close(void) {
+  if (file_)
+    fclose(file_);
+  file_ = NULL;
+}
+
+void GncStepRecorder::Record(GncEkfAutocode const& ekf) {
+  if (file_ == NULL)
+    return;
+  GncEkfInputs inputs;
+  inputs.Get(ekf);
+  Write(GNC_STEP_EKF, &inputs);
+}
+
+void GncStepRecorder::Record(GncCtlAutocode const& ctl) {
+  if (file_ == NULL)
+    return;
+  GncCtlInputs inputs;
+  inputs.Get(ctl);
+  Write(GNC_STEP_CTL, &inputs);
+}
+
+void GncStepRecorder::Record(GncFamAutocode const& fam, ex_time_msg const& time, cmd_msg const& cmd,
+                             ctl_msg const& ctl) {
+  if (file_ == NULL)
+    return;
+  GncFamInputs inputs;
+  inputs.time = time;
+  inputs.cmd = cmd;
+  inputs.ctl = ctl;
+  inputs.cmc = fam.cmc_;
+  Write(GNC_STEP_FAM, &inputs);
+}
+
+void GncStepRecorder::Write(int type, void const* inputs) {
+  void* last[GNC_STEP_TYPES] = {&ekf_, &ctl_, &fam_};
+  const Layout& layout = kLayouts[type];
+  const uint8_t* in = static_cast<const uint8_t*>(inputs);
+  uint8_t* prev = static_cast<uint8_t*>(last[type]);
+
+  uint8_t changed = 0;
+  for (int f = 0; f < layout.count; f++) {
+    const Field& field = layout.fields[f];
+    if (!written_[type] || memcmp(in + field.offset, prev + field.offset, field.size) != 0)
+      changed |= 1 << f;
+  }
+  uint8_t header[2] = {static_cast<uint8_t>(type), changed};
+  fwrite(header, sizeof(header), 1, file_);
+  for (int f = 0; f < layout.count; f++) {
+    const Field& field = layout.fields[f];
+    if (changed & (1 << f))
+      fwrite(in + field.offset, field.size, 1, file_);
+  }
+  memcpy(prev, in, layout.size);
+  written_[type] = true;
+}
+
+bool GncStepLog::Read(std::string const& filename) {
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open file %s.\n", filename.c_str());
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  data_.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  size_t read = fread(data_.data(), 1, data_.size(), f);
+  fclose(f);
+
+  const size_t header_size = sizeof(kMagic) + sizeof(uint32_t) * (1 + GNC_STEP_TYPES);
+  uint32_t header[1 + GNC_STEP_TYPES];
+  if (read != data_.size() || read < header_size || memcmp(data_.data(), kMagic, sizeof(kMagic)) != 0) {
+    fprintf(stderr, "%s is not a GNC step recording.\n", filename.c_str());
+    return false;
+  }
+  memcpy(header, data_.data() + sizeof(kMagic), sizeof(header));
+  if (header[0] != kVersion) {
+    fprintf(stderr, "%s has version %u, expected %u.\n", filename.c_str(), header[0], kVersion);
+    return false;
+  }
+  for (int i = 0; i < GNC_STEP_TYPES; i++) {
+    if (header[1 + i] != kLayouts[i].size) {
+      fprintf(stderr, "%s was recorded with different autocode.\n", filename.c_str());
+      return false;
+    }
+  }
+
+  for (int i = 0; i < GNC_STEP_TYPES; i++)
+    steps_[i].clear();
+  size_t pos = header_size;
+  while (pos + 2 <= data_.size()) {
+    uint8_t type = data_[pos], changed = data_[pos + 1];
+    if (type >= GNC_STEP_TYPES)
+      break;
+    size_t size = 2;
+    for (int f = 0; f < kLayouts[type].count; f++)
+      if (changed & (1 << f))
+        size += kLayouts[type].fields[f].size;
+    if (pos + size > data_.size())
+      break;
+    steps_[type].push_back(pos);
+    pos += size;
+  }
+  if (pos != data_.size())
+    fprintf(stderr, "Ignoring the truncated end of %s.\n", filename.c_str());
+  return true;
+}
+
+size_t GncStepLog::Steps(GncStepType type) const {
+  return steps_[type].size();
+}
+
+void GncStepLog::Apply(size_t i, GncEkfInputs* inputs) const {
+  Apply(GNC_STEP_EKF, i, inputs);
+}
+
+void GncStepLog::Apply(size_t i, GncCtlInputs* inputs) const {
+  Apply(GNC_STEP_CTL, i, inputs);
+}
+
+void GncStepLog::Apply(size_t i, GncFamInputs* inputs) const {
+  Apply(GNC_STEP_FAM, i, inputs);
+}
+
+void GncStepLog::Apply(GncStepType type, size_t i, void* inputs) const {
+  const Layout& layout = kLayouts[type];
+  const uint8_t* in = data_.data() + steps_[type][i];
+  uint8_t changed = in[1];
+  in += 2;
+  for (int f = 0; f < layout.count; f++) {
+    const Field& field = layout.fields[f];
+    if (changed & (1 << f)) {
+      memcpy(static_cast<uint8_t*>(inputs) + field.offset, in, field.size);
+      in += field.size;
+    }
+  }
+}
+
+}  // end namespace gnc_autocode
@@ -0,0 +1,217 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Runs the closed loop GNC autocode, simulator included, as fast as it will
+// go. Every run follows the same command script, with initial conditions,
+// inertia errors and sensor noise drawn from --seed plus the run number. Run
+// zero is left unperturbed. Up to --num_threads runs step at the same time.
+
+#include <ff_common/init.h>
+#include <ff_common/thread.h>
+#include <config_reader/config_reader.h>
+#include <gnc_autocode/closed_loop.h>
+#include <gnc_profile.h>
+
+#include <Eigen/Geometry>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+DEFINE_string(commands, "", "Command script, one \"time mode px py pz qx qy qz qw\" per line.");
+DEFINE_string(gnc_config, "gnc.config", "The gnc config file to read.");
+DEFINE_string(output_dir, ".", "Directory for the telemetry of each run and summary.csv.");
+DEFINE_double(duration, 60.0, "Simulated seconds per run.");
+DEFINE_int32(runs, 1, "Number of Monte Carlo runs.");
+DEFINE_int32(seed, 0, "Seed of the first run, later runs add their number.");
+DEFINE_int32(decimate, 1, "Write telemetry every this many steps, 0 for none.");
+DEFINE_bool(use_truth, false, "Control on the simulated truth instead of the EKF.");
+DEFINE_string(record_inputs, "", "Record the inputs of every GNC step of run zero, for gnc_step_benchmark.");
+DEFINE_double(sigma_position, 0.05, "Standard deviation of the initial position, meters.");
+DEFINE_double(sigma_attitude, 0.05, "Standard deviation of the initial attitude, radians.");
+DEFINE_double(sigma_velocity, 0.0, "Standard deviation of the initial velocity, meters per second.");
+DEFINE_double(sigma_mass, 0.1, "Standard deviation of the mass error, kilograms.");
+DEFINE_double(sigma_inertia, 0.005, "Standard deviation of the inertia errors, kg m^2.");
+
+DECLARE_bool(logtostderr);
+
+namespace {
+
+// constructing the autocode is not thread safe
+std::mutex construct_mutex;
+
+struct RunSummary {
+  bool completed;               // false if the run could not start
+  uint64_t seed;
+  double final_position_error;  // from the last command, meters
+  double est_position_rmse;     // meters
+  double est_position_max;      // meters
+  double est_attitude_max;      // degrees
+  double run_time;              // seconds
+};
+
+void RunTask(int run, gnc_autocode::GncClosedLoop const* prototype,
+             std::vector<gnc_autocode::GncCommand> const* commands, RunSummary* summary) {
+  // a run that fails before it steps is in the summary as failed, not garbage
+  summary->completed = false;
+  summary->seed = FLAGS_seed + run;
+  summary->final_position_error = NAN;
+  summary->est_position_rmse = NAN;
+  summary->est_position_max = NAN;
+  summary->est_attitude_max = NAN;
+  summary->run_time = 0;
+
+  std::unique_ptr<gnc_autocode::GncClosedLoop> loop;
+  {
+    std::lock_guard<std::mutex> lock(construct_mutex);
+    loop.reset(new gnc_autocode::GncClosedLoop());
+  }
+  loop->CopyParams(*prototype);
+  if (run > 0) {
+    gnc_autocode::GncPerturbation spread;
+    spread.position = FLAGS_sigma_position;
+    spread.attitude = FLAGS_sigma_attitude;
+    spread.velocity = FLAGS_sigma_velocity;
+    spread.mass = FLAGS_sigma_mass;
+    spread.inertia = FLAGS_sigma_inertia;
+    std::mt19937 generator(summary->seed);
+    loop->Perturb(spread, &generator);
+  }
+  loop->Initialize();
+  loop->SetCommands(*commands);
+  gnc_autocode::GncStepRecorder recorder;
+  if (run == 0 && !FLAGS_record_inputs.empty() && recorder.Open(FLAGS_record_inputs))
+    loop->recorder_ = &recorder;
+
+  FILE* f = NULL;
+  if (FLAGS_decimate > 0) {
+    char filename[32];
+    snprintf(filename, sizeof(filename), "/run_%05d.gnct", run);
+    f = fopen((FLAGS_output_dir + filename).c_str(), "wb");
+    if (f == NULL) {
+      LOG(ERROR) << "Failed to open telemetry file in " << FLAGS_output_dir << ".";
+      return;
+    }
+    gnc_autocode::GncTelemetryHeader header = {{'G', 'N', 'C', 'T'}, 1, sizeof(gnc_autocode::GncTelemetry),
+                                               static_cast<uint32_t>(run), summary->seed};
+    fwrite(&header, sizeof(header), 1, f);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  gnc_autocode::GncTelemetry t;
+  double position_sq = 0;
+  int steps = 0;
+  summary->est_position_max = 0;
+  summary->est_attitude_max = 0;
+  while (loop->Time() < FLAGS_duration) {
+    loop->Step();
+    loop->Telemetry(&t);
+    if (f && steps % FLAGS_decimate == 0)
+      fwrite(&t, sizeof(t), 1, f);
+    steps++;
+
+    Eigen::Map<const Eigen::Vector3f> truth(t.truth_position), est(t.est_position);
+    Eigen::Quaternionf q_truth(t.truth_attitude[3], t.truth_attitude[0], t.truth_attitude[1], t.truth_attitude[2]);
+    Eigen::Quaternionf q_est(t.est_attitude[3], t.est_attitude[0], t.est_attitude[1], t.est_attitude[2]);
+    double error = (est - truth).norm();
+    position_sq += error * error;
+    summary->est_position_max = std::max(summary->est_position_max, error);
+    summary->est_attitude_max = std::max(summary->est_attitude_max,
+      static_cast<double>(q_est.angularDistance(q_truth)) * 180.0 / M_PI);
+  }
+  summary->run_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  summary->est_position_rmse = std::sqrt(position_sq / std::max(steps, 1));
+  summary->final_position_error = (Eigen::Map<const Eigen::Vector3f>(t.truth_position) -
+                                   Eigen::Map<const Eigen::Vector3f>(t.cmd_position)).norm();
+  if (f)
+    fclose(f);
+  summary->completed = true;
+}
+
+bool WriteSummary(std::string const& filename, std::vector<RunSummary> const& runs) {
+  FILE* f = fopen(filename.c_str(), "w");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open file %s.\n", filename.c_str());
+    return false;
+  }
+  fprintf(f, "run,seed,completed,final_position_error,est_position_rmse,est_position_max,est_attitude_max_deg,"
+          "run_time\n");
+  for (size_t i = 0; i < runs.size(); i++) {
+    const RunSummary& r = runs[i];
+    fprintf(f, "%zu,%" PRIu64 ",%d,%g,%g,%g,%g,%g\n", i, r.seed, r.completed ? 1 : 0, r.final_position_error,
+            r.est_position_rmse, r.est_position_max, r.est_attitude_max, r.run_time);
+  }
+  fclose(f);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = true;
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  std::vector<gnc_autocode::GncCommand> commands;
+  if (!gnc_autocode::ReadCommandScript(FLAGS_commands, &commands)) {
+    LOG(INFO) << "Usage: " << argv[0] << " --commands script.txt [--runs n] [--duration s] [--num_threads n]";
+    LOG(ERROR) << "Failed to read command script " << FLAGS_commands << ".";
+    return 1;
+  }
+
+  // Reading config files sets the lua path in the environment, so they are
+  // read once here and every run copies its parameters from this instance
+  gnc_autocode::GncClosedLoop prototype;
+  config_reader::ConfigReader config;
+  config.AddFile(FLAGS_gnc_config.c_str());
+  config.AddFile("geometry.config");
+  config.AddFile("cameras.config");
+  if (!config.ReadFiles()) {
+    LOG(ERROR) << "Failed to read config files.";
+    return 1;
+  }
+  prototype.ReadParams(&config);
+  prototype.use_truth_ = FLAGS_use_truth;
+
+  std::vector<RunSummary> runs(FLAGS_runs);
+  auto start = std::chrono::steady_clock::now();
+  {
+    ff_common::ThreadPool pool;
+    for (int i = 0; i < FLAGS_runs; i++)
+      pool.AddTask(&RunTask, i, &prototype, &commands, &runs[i]);
+    pool.Join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  LOG(INFO) << FLAGS_runs << " runs of " << FLAGS_duration << " s in " << elapsed << " s, "
+            << FLAGS_runs * FLAGS_duration / elapsed << " times real time.";
+  if (gnc_profile_enabled())
+    LOG(INFO) << "GNC step profile, all runs:\n" << gnc_profile_report();
+  int failed = std::count_if(runs.begin(), runs.end(), [](RunSummary const& r) { return !r.completed; });
+  if (failed > 0)
+    LOG(ERROR) << failed << " of " << FLAGS_runs << " runs failed.";
+  bool written = WriteSummary(FLAGS_output_dir + "/summary.csv", runs);
+  return (written && failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Replays the step inputs recorded by gnc_batch_sim --record_inputs or the
+// EKF's --record_step_inputs through the EKF, CTL and FAM autocode, each on
+// its own, and reports the time and the memory allocations of every step.
+// Each pass starts from a freshly initialized model, so every pass computes
+// the same outputs, which is checked.
+
+#include <ff_common/init.h>
+#include <config_reader/config_reader.h>
+#include <gnc_autocode/step_record.h>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+DEFINE_string(gnc_config, "gnc.config", "The gnc config file to read.");
+DEFINE_int32(passes, 5, "Number of times to replay the recording.");
+DEFINE_double(max_p99_us, 0, "Fail if the 99th percentile step time of any subsystem exceeds this, "
+              "0 to not check.");
+
+DECLARE_bool(logtostderr);
+
+// Allocations are counted by wrapping glibc's malloc and its aligned
+// variants, which Eigen and aligned operator new use, only while stepping
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+
+bool counting = false;
+uint64_t allocations = 0;
+
+}  // namespace
+
+extern "C" {
+
+void* malloc(size_t size) {
+  if (counting) allocations++;
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  if (counting) allocations++;
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+  if (counting) allocations++;
+  return __libc_realloc(p, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  if (counting) allocations++;
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  if (counting) allocations++;
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size) {
+  if (counting) allocations++;
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  *p = __libc_memalign(alignment, size);
+  return *p == NULL ? ENOMEM : 0;
+}
+
+}
+
+namespace {
+
+// the GNC rate
+const double kPeriodUs = 16000.0;
+
+struct StepStats {
+  std::vector<double> times;       // microseconds, every step of every pass
+  uint64_t allocations = 0;
+  uint64_t max_allocations = 0;   // in one step
+  std::vector<uint64_t> outputs;   // hash of the last output of each pass
+};
+
+uint64_t Hash(void const* data, size_t size, uint64_t h = 14695981039346656037ull) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++)
+    h = (h ^ p[i]) * 1099511628211ull;
+  return h;
+}
+
+// Times one call, with the allocations it makes
+template <typename F>
+void TimeStep(F step, StepStats* stats) {
+  allocations = 0;
+  counting = true;
+  auto start = std::chrono::steady_clock::now();
+  step();
+  auto end = std::chrono::steady_clock::now();
+  counting = false;
+  stats->times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+  stats->allocations += allocations;
+  stats->max_allocations = std::max(stats->max_allocations, allocations);
+}
+
+void BenchmarkEkf(gnc_autocode::GncStepLog const& log, config_reader::ConfigReader* config, StepStats* stats) {
+  std::unique_ptr<gnc_autocode::GncEkfAutocode> ekf(new gnc_autocode::GncEkfAutocode());
+  ekf->ReadParams(config);
+  std::unique_ptr<gnc_autocode::GncEkfInputs> inputs(new gnc_autocode::GncEkfInputs());
+  for (int pass = 0; pass < FLAGS_passes; pass++) {
+    ekf->Initialize();
+    memset(inputs.get(), 0, sizeof(*inputs));
+    for (size_t i = 0; i < log.Steps(gnc_autocode::GNC_STEP_EKF); i++) {
+      log.Apply(i, inputs.get());
+      inputs->Set(ekf.get());
+      TimeStep([&]() { ekf->Step(); }, stats);
+    }
+    stats->outputs.push_back(Hash(&ekf->kfl_, sizeof(ekf->kfl_)));
+  }
+}
+
+void BenchmarkCtl(gnc_autocode::GncStepLog const& log, config_reader::ConfigReader* config, StepStats* stats) {
+  std::unique_ptr<gnc_autocode::GncCtlAutocode> ctl(new gnc_autocode::GncCtlAutocode());
+  ctl->ReadParams(config);
+  gnc_autocode::GncCtlInputs inputs;
+  for (int pass = 0; pass < FLAGS_passes; pass++) {
+    ctl->Initialize();
+    memset(&inputs, 0, sizeof(inputs));
+    for (size_t i = 0; i < log.Steps(gnc_autocode::GNC_STEP_CTL); i++) {
+      log.Apply(i, &inputs);
+      inputs.Set(ctl.get());
+      TimeStep([&]() { ctl->Step(); }, stats);
+    }
+    stats->outputs.push_back(Hash(&ctl->ctl_, sizeof(ctl->ctl_), Hash(&ctl->cmd_, sizeof(ctl->cmd_))));
+  }
+}
+
+void BenchmarkFam(gnc_autocode::GncStepLog const& log, config_reader::ConfigReader* config, StepStats* stats) {
+  std::unique_ptr<gnc_autocode::GncFamAutocode> fam(new gnc_autocode::GncFamAutocode());
+  fam->ReadParams(config);
+  gnc_autocode::GncFamInputs inputs;
+  for (int pass = 0; pass < FLAGS_passes; pass++) {
+    fam->Initialize();
+    memset(&inputs, 0, sizeof(inputs));
+    for (size_t i = 0; i < log.Steps(gnc_autocode::GNC_STEP_FAM); i++) {
+      log.Apply(i, &inputs);
+      fam->cmc_ = inputs.cmc;
+      TimeStep([&]() { fam->Step(&inputs.time, &inputs.cmd, &inputs.ctl); }, stats);
+    }
+    stats->outputs.push_back(Hash(&fam->act_, sizeof(fam->act_)));
+  }
+}
+
+// Prints a line of the table, returns false if the passes computed different
+// outputs or the step time is over the limit
+bool Report(const char* name, StepStats* stats) {
+  std::vector<double>& t = stats->times;
+  if (t.empty()) {
+    printf("%-4s %8s\n", name, "no steps");
+    return true;
+  }
+  double mean = 0;
+  for (double x : t)
+    mean += x;
+  mean /= t.size();
+  std::sort(t.begin(), t.end());
+  double p99 = t[std::min(t.size() - 1, static_cast<size_t>(0.99 * t.size()))];
+  bool deterministic = std::all_of(stats->outputs.begin(), stats->outputs.end(),
+                                   [&](uint64_t h) { return h == stats->outputs[0]; });
+  printf("%-4s %8zu %10.2f %10.2f %10.2f %10.2f %8.2f%% %12.3f %10lu %6s\n", name, t.size(), mean,
+         t[t.size() / 2], p99, t.back(), 100.0 * t.back() / kPeriodUs,
+         static_cast<double>(stats->allocations) / t.size(), static_cast<unsigned long>(stats->max_allocations),  // NOLINT
+         deterministic ? "yes" : "NO");
+  if (!deterministic)
+    LOG(ERROR) << "The " << name << " passes computed different outputs.";
+  if (FLAGS_max_p99_us > 0 && p99 > FLAGS_max_p99_us) {
+    LOG(ERROR) << "The " << name << " p99 step time is over --max_p99_us " << FLAGS_max_p99_us << " us.";
+    return false;
+  }
+  return deterministic;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = true;
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  if (argc != 2) {
+    LOG(INFO) << "Usage: " << argv[0] << " [--passes n] [--max_p99_us t] inputs.gncs";
+    return 1;
+  }
+
+  gnc_autocode::GncStepLog log;
+  if (!log.Read(argv[1]))
+    return 1;
+
+  config_reader::ConfigReader config;
+  config.AddFile(FLAGS_gnc_config.c_str());
+  config.AddFile("geometry.config");
+  if (!config.ReadFiles()) {
+    LOG(ERROR) << "Failed to read config files.";
+    return 1;
+  }
+
+  StepStats ekf, ctl, fam;
+  BenchmarkEkf(log, &config, &ekf);
+  BenchmarkCtl(log, &config, &ctl);
+  BenchmarkFam(log, &config, &fam);
+
+  printf("%-4s %8s %10s %10s %10s %10s %9s %12s %10s %6s\n", "", "steps", "mean_us", "p50_us", "p99_us",
+         "max_us", "max/16ms", "allocs/step", "max_allocs", "same");
+  bool ok = Report("ekf", &ekf);
+  ok = Report("ctl", &ctl) && ok;
+  ok = Report("fam", &fam) && ok;
+  return ok ? 0 : 1;
+}
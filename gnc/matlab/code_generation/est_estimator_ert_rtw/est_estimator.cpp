@@ -864,14 +864,7 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
 
   boolean_T d_0[12];
   real32_T x[12];
-  boolean_T b_0[17];
   int32_T ar;
-  static const int8_T Aug_Indx[102] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
-    13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
-    32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50,
-    51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69,
-    70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 88,
-    89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100, 101, 102 };
 
   real_T kept_augmentations[15];
   real_T of_in_prange[90];
@@ -989,7 +982,6 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
   real32_T rtb_Switch1_1[2];
   real32_T H[4];
   int32_T rtb_valid_out_0[16];
-  uint32_T tmp_1[17];
   real32_T tmp_2[117];
   real32_T rtb_VectorConcatenate_l[16];
   real32_T rtb_Product1_0[9];
@@ -1021,16 +1013,11 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
   real_T rtb_VectorConcatenate_o[4];
   real32_T tmp_e[9];
   real32_T rtb_BusAssignment_h[48];
-  real32_T M_0[126];
-  real32_T M_1[126];
-  real32_T M_2[540];
   real32_T tmp_f[9];
   real32_T rtb_Merge2_1[9];
   int8_T tmp_g[6];
   int8_T b_data[12];
   int8_T c_data[12];
-  int8_T valid_indx_mat_data[102];
-  int8_T c_data_0[17];
   int8_T f_data[90];
   int8_T rot_indices_data[63];
   int8_T c_data_1[63];
@@ -1069,7 +1056,6 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
   real32_T a_data_0[600];
   int32_T of_measured_in_sizes[3];
   real32_T A_data[96];
-  int8_T valid_indx_mat_data_0[102];
   real32_T b_data_0[32];
   boolean_T d_1;
   int32_T C_sizes_idx_1;
@@ -2825,7 +2811,6 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
 
   // MATLAB Function: '<S95>/MATLAB Function2'
   // MATLAB Function 'predictor/Covariance Propogation/MATLAB Function2': '<S100>:1' 
-  // '<S100>:1:7'
   // '<S100>:1:4'
   for (i = 0; i < 102; i++) {
     for (b_m = 0; b_m < 15; b_m++) {
@@ -2840,110 +2825,15 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
   // '<S100>:1:7'
   //  Number of columns is number of OF augmentations + ML augmentations
   //  Collect the indices of the valid current augmentations
-  //  Form a vector with the valid indices corresponding to the current
-  //  number of augmentations
-  // '<S100>:1:12'
-  mglfbimobiechdbi_bitget(rtb_BusAssignment_aug_state_enu, tmp_1);
-  br = 0;
-  for (num_original = 0; num_original < 17; num_original++) {
-    rtb_FixPtRelationalOperator_n = (tmp_1[num_original] != 0U);
-    if (rtb_FixPtRelationalOperator_n) {
-      br++;
-    }
-
-    b_0[num_original] = rtb_FixPtRelationalOperator_n;
-  }
-
-  handrail_knowledge_dims = br;
-  br = 0;
-  for (num_original = 0; num_original < 17; num_original++) {
-    if (b_0[num_original]) {
-      c_data_0[br] = (int8_T)(int32_T)(num_original + 1);
-      br++;
-    }
-  }
-
-  // '<S100>:1:12'
-  for (i = 0; i <= (int32_T)(handrail_knowledge_dims - 1); i++) {
-    for (b_m = 0; b_m < 6; b_m++) {
-      valid_indx_mat_data[(int32_T)(b_m + (int32_T)(6 * i))] = Aug_Indx[(int32_T)
-        ((int32_T)((int32_T)((int32_T)c_data_0[i] - 1) * 6) + b_m)];
-    }
-  }
-
-  // '<S100>:1:13'
-  //  Do the covariance propagation
-  C_sizes_idx_1 = (int32_T)(int8_T)(int32_T)(6 * handrail_knowledge_dims);
-  for (i = 0; i <= (int32_T)(C_sizes_idx_1 - 1); i++) {
-    for (b_m = 0; b_m < 15; b_m++) {
-      est_estimator_B->Selector1[(int32_T)(b_m + (int32_T)(15 * i))] = 0.0F;
-    }
-  }
-
-  if ((int32_T)(6 * handrail_knowledge_dims) != 0) {
-    num_original = (int32_T)((int32_T)((int32_T)(6 * handrail_knowledge_dims) -
-      1) * 15);
-    for (br = 0; br <= num_original; br += 15) {
-      for (nx = (int32_T)(br + 1); nx <= (int32_T)(br + 15); nx++) {
-        est_estimator_B->Selector1[(int32_T)(nx - 1)] = 0.0F;
-      }
-    }
-
-    br = 0;
-    for (nx = 0; nx <= num_original; nx += 15) {
-      ar = -1;
-      for (i = br; (int32_T)(i + 1) <= (int32_T)(br + 15); i++) {
-        for (b_m = 0; b_m <= (int32_T)(handrail_knowledge_dims - 1); b_m++) {
-          for (i_0 = 0; i_0 < 6; i_0++) {
-            valid_indx_mat_data_0[(int32_T)(i_0 + (int32_T)(6 * b_m))] =
-              valid_indx_mat_data[(int32_T)((int32_T)(6 * b_m) + i_0)];
-          }
-        }
-
-        if (est_estimator_B->Assignment[(int32_T)((int32_T)((int32_T)((int32_T)
-               valid_indx_mat_data_0[div_nzp_s32_floor(i, 15)] + 14) * 117) + i %
-             15)] != 0.0F) {
-          s12_iter = ar;
-          for (O_sizes_idx_0 = nx; (int32_T)(O_sizes_idx_0 + 1) <= (int32_T)(nx
-                + 15); O_sizes_idx_0++) {
-            s12_iter++;
-            for (b_m = 0; b_m <= (int32_T)(handrail_knowledge_dims - 1); b_m++)
-            {
-              for (i_0 = 0; i_0 < 6; i_0++) {
-                valid_indx_mat_data_0[(int32_T)(i_0 + (int32_T)(6 * b_m))] =
-                  valid_indx_mat_data[(int32_T)((int32_T)(6 * b_m) + i_0)];
-              }
-            }
-
-            est_estimator_B->Selector1[O_sizes_idx_0] +=
-              est_estimator_B->Assignment[(int32_T)((int32_T)((int32_T)((int32_T)
-              valid_indx_mat_data_0[div_nzp_s32_floor(i, 15)] + 14) * 117) + i %
-              15)] * rtb_state_trans[s12_iter];
-          }
-        }
-
-        ar += 15;
-      }
-
-      br += 15;
-    }
-  }
-
-  // '<S100>:1:16'
-  for (i = 0; i <= (int32_T)(handrail_knowledge_dims - 1); i++) {
-    for (b_m = 0; b_m < 6; b_m++) {
-      valid_indx_mat_data_0[(int32_T)(b_m + (int32_T)(6 * i))] =
-        valid_indx_mat_data[(int32_T)((int32_T)(6 * i) + b_m)];
-    }
-  }
-
-  for (i = 0; i <= (int32_T)(C_sizes_idx_1 - 1); i++) {
-    for (b_m = 0; b_m < 15; b_m++) {
-      est_estimator_B->P_IC[(int32_T)(b_m + (int32_T)(15 * (int32_T)((int32_T)
-        valid_indx_mat_data_0[i] - 1)))] = est_estimator_B->Selector1[(int32_T)
-        ((int32_T)(15 * i) + b_m)];
-    }
-  }
+  // '<S100>:1:10'
+  //  The generated code calls the hand written version, which multiplies the
+  //  blocks of the valid augmentations one by one instead of gathering their
+  //  indices (cxx_functions/propagate_covariance.cpp)
+  // '<S100>:1:14'
+  // '<S100>:1:15'
+  propagate_covariance(&rtb_state_trans[0], rtb_BusAssignment_aug_state_enu,
+                       &est_estimator_B->Assignment[0], 117,
+                       &est_estimator_B->P_IC[0]);
 
   // End of MATLAB Function: '<S95>/MATLAB Function2'
 
@@ -8092,51 +7982,6 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
            (uint32_T)(sizeof(real32_T) << 4U));
 
     //  Augmenting the covariance matrix
-    //  Move covariances down the stack:
-    //  P = [A B C] then P+1 = [A 0 B]
-    //      [D E F]            [0 0 0]
-    //      [G H J]            [D 0 E]
-    //  Section D
-    for (i = 0; i < 21; i++) {
-      for (b_m = 0; b_m < 90; b_m++) {
-        est_estimator_B->Switch1[(int32_T)((int32_T)(b_m + (int32_T)(117 * i)) +
-          27)] = est_estimator_B->Assignment[(int32_T)((int32_T)((int32_T)(117 *
-          i) + (int32_T)of_in_prange[b_m]) - 1)];
-      }
-    }
-
-    //  Section B
-    for (i = 0; i < 90; i++) {
-      for (b_m = 0; b_m < 21; b_m++) {
-        est_estimator_B->Switch1_c[(int32_T)(b_m + (int32_T)(21 * i))] =
-          est_estimator_B->Switch1[(int32_T)((int32_T)((int32_T)((int32_T)
-          of_in_prange[i] - 1) * 117) + b_m)];
-      }
-    }
-
-    for (i = 0; i < 90; i++) {
-      memcpy(&est_estimator_B->Switch1[(int32_T)((int32_T)(i * 117) + 3159)],
-             &est_estimator_B->Switch1_c[(int32_T)(i * 21)], (uint32_T)(21U *
-              sizeof(real32_T)));
-    }
-
-    //  Section E
-    for (i = 0; i < 90; i++) {
-      for (b_m = 0; b_m < 90; b_m++) {
-        est_estimator_B->Switch1_k[(int32_T)(b_m + (int32_T)(90 * i))] =
-          est_estimator_B->Switch1[(int32_T)((int32_T)((int32_T)((int32_T)
-          ((int32_T)of_in_prange[i] - 1) * 117) + (int32_T)of_in_prange[b_m]) -
-          1)];
-      }
-    }
-
-    for (i = 0; i < 90; i++) {
-      memcpy(&est_estimator_B->Switch1[(int32_T)((int32_T)(i * 117) + 3186)],
-             &est_estimator_B->Switch1_k[(int32_T)(i * 90)], (uint32_T)(90U *
-              sizeof(real32_T)));
-    }
-
-    //  Now actually place an augmentation of IMU into OF
     //  M here is actually just the left part of J as defined in equation 24 in the 
     //  Visinav paper by Mourikis '09 + space for the ML augmentation.
     fkfcbaiengdjgdje_quaternion_to_rotation(rtb_BusAssignment_a.quat_ISS2B,
@@ -8218,94 +8063,10 @@ void est_estimator_step(RT_MODEL_est_estimator_T *const est_estimator_M,
       M[(int32_T)(5 + (int32_T)(6 * (int32_T)(i + 15)))] = 0.0F;
     }
 
-    //    J = [eye(21, size(P, 2)); M zeros(6, size(P, 2) - size(M, 2)); zeros(size(P, 1) - 27, 27) eye(size(P, 1) - 27, size(P, 2) - 27)]; 
-    //    P = J * P * J';
-    //  P = [A 0 C] then P+1 = [A  AMt  C ]
-    //      [0 0 0]            [MA MAMt MC]
-    //      [G 0 J]            [G  GMt  J ]
-    //  Center section
-    //  Top left sections
-    for (i = 0; i < 6; i++) {
-      for (b_m = 0; b_m < 21; b_m++) {
-        M_0[(int32_T)(i + (int32_T)(6 * b_m))] = 0.0F;
-        for (i_0 = 0; i_0 < 21; i_0++) {
-          M_0[(int32_T)(i + (int32_T)(6 * b_m))] += M[(int32_T)((int32_T)(6 *
-            i_0) + i)] * est_estimator_B->Switch1[(int32_T)((int32_T)(117 * b_m)
-            + i_0)];
-        }
-      }
-
-      for (b_m = 0; b_m < 6; b_m++) {
-        est_estimator_B->Switch1[(int32_T)((int32_T)(i + (int32_T)(117 *
-          (int32_T)(21 + b_m))) + 21)] = 0.0F;
-        for (i_0 = 0; i_0 < 21; i_0++) {
-          est_estimator_B->Switch1[(int32_T)((int32_T)(i + (int32_T)(117 *
-            (int32_T)(21 + b_m))) + 21)] = est_estimator_B->Switch1[(int32_T)
-            ((int32_T)((int32_T)((int32_T)(21 + b_m) * 117) + i) + 21)] + M_0
-            [(int32_T)((int32_T)(6 * i_0) + i)] * M[(int32_T)((int32_T)(6 * i_0)
-            + b_m)];
-        }
-      }
-
-      for (b_m = 0; b_m < 21; b_m++) {
-        M_1[(int32_T)(i + (int32_T)(6 * b_m))] = 0.0F;
-        for (i_0 = 0; i_0 < 21; i_0++) {
-          M_1[(int32_T)(i + (int32_T)(6 * b_m))] += M[(int32_T)((int32_T)(6 *
-            i_0) + i)] * est_estimator_B->Switch1[(int32_T)((int32_T)(117 * b_m)
-            + i_0)];
-        }
-      }
-    }
-
-    for (i = 0; i < 21; i++) {
-      for (b_m = 0; b_m < 6; b_m++) {
-        est_estimator_B->Switch1[(int32_T)((int32_T)(b_m + (int32_T)(117 * i)) +
-          21)] = M_1[(int32_T)((int32_T)(6 * i) + b_m)];
-      }
-    }
-
-    for (i = 0; i < 6; i++) {
-      for (b_m = 0; b_m < 21; b_m++) {
-        M_0[(int32_T)(b_m + (int32_T)(21 * i))] = est_estimator_B->Switch1
-          [(int32_T)((int32_T)((int32_T)(117 * b_m) + i) + 21)];
-      }
-    }
-
-    for (i = 0; i < 6; i++) {
-      memcpy(&est_estimator_B->Switch1[(int32_T)((int32_T)(i * 117) + 2457)],
-             &M_0[(int32_T)(i * 21)], (uint32_T)(21U * sizeof(real32_T)));
-    }
-
-    //  Bottom right sections
-    for (i = 0; i < 6; i++) {
-      for (b_m = 0; b_m < 90; b_m++) {
-        M_2[(int32_T)(i + (int32_T)(6 * b_m))] = 0.0F;
-        for (i_0 = 0; i_0 < 21; i_0++) {
-          M_2[(int32_T)(i + (int32_T)(6 * b_m))] += est_estimator_B->Switch1
-            [(int32_T)((int32_T)((int32_T)(27 + b_m) * 117) + i_0)] * M[(int32_T)
-            ((int32_T)(6 * i_0) + i)];
-        }
-      }
-    }
-
-    for (i = 0; i < 90; i++) {
-      for (b_m = 0; b_m < 6; b_m++) {
-        est_estimator_B->Switch1[(int32_T)((int32_T)(b_m + (int32_T)(117 *
-          (int32_T)(27 + i))) + 21)] = M_2[(int32_T)((int32_T)(6 * i) + b_m)];
-      }
-    }
-
-    for (i = 0; i < 6; i++) {
-      for (b_m = 0; b_m < 90; b_m++) {
-        M_2[(int32_T)(b_m + (int32_T)(90 * i))] = est_estimator_B->Switch1
-          [(int32_T)((int32_T)((int32_T)((int32_T)(27 + b_m) * 117) + i) + 21)];
-      }
-    }
-
-    for (i = 0; i < 6; i++) {
-      memcpy(&est_estimator_B->Switch1[(int32_T)((int32_T)(i * 117) + 2484)],
-             &M_2[(int32_T)(i * 90)], (uint32_T)(90U * sizeof(real32_T)));
-    }
+    //  The generated code calls the hand written version of the block products
+    //  below, which only uses the nonzero columns of M (cxx_functions/augment_covariance.cpp)
+    augment_covariance(&M[0], &of_in_prange[0], 90, &est_estimator_B->Assignment[0],
+                       117, &est_estimator_B->Switch1[0]);
 
     // SignalConversion: '<S129>/Signal Conversion1'
     // '<S130>:1:5'
@@ -25,6 +25,8 @@
 #include "apply_delta_state.h"
 #include "of_residual_and_h.h"
 #include "matrix_multiply.h"
+#include "propagate_covariance.h"
+#include "augment_covariance.h"
 #endif                                 // est_estimator_COMMON_INCLUDES_
 
 #include "est_estimator_types.h"
@@ -55,7 +57,6 @@
 #include "jmohiecblfcjnohl_qr.h"
 #include "kngldbimhdbaimgd_quat_propagate_step.h"
 #include "mgdbbiekfknonglf_nullAssignment.h"
-#include "mglfbimobiechdbi_bitget.h"
 #include "mglnkfkfmglfjekn_PadeApproximantOfDegree.h"
 #include "moppbaaafkfkimgd_diag.h"
 #include "ngdjjecbgdbaglfc_eye.h"
@@ -138,9 +139,7 @@ typedef struct {
   real32_T ex_of_residual_and_h_o3[11232];// '<S24>/ex_of_residual_and_h'
   real32_T q1_data_c[10000];
   real32_T ex_of_residual_and_h_o7[9216];// '<S24>/ex_of_residual_and_h'
-  ase_cov_datatype Switch1_k[8100];
   real32_T x_data[2500];
-  ase_cov_datatype Switch1_c[1890];
   real32_T MatrixConcatenate[1755];    // '<S95>/Matrix Concatenate'
   real32_T of_measured_in[1600];
   real32_T of_measured[1600];          // '<S24>/compute_of_global_points'
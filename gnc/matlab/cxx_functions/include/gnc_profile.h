@@ -0,0 +1,85 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GNC_PROFILE_H_
+#define GNC_PROFILE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Execution time of the GNC step functions and of the hand-written kernels
+// the estimator calls from inside its step. The hand-written step wrappers in
+// gnc_autocode and the kernels time themselves with GNC_PROFILE_SCOPE, which
+// only compiles to anything when GNC_PROFILE is defined (ENABLE_GNC_PROFILE in
+// cmake), so the generated code is left as it is. The times go into a
+// histogram per block that any thread can record into and any thread can
+// report.
+enum gnc_profile_block {
+  GNC_PROFILE_EST_STEP,                 // GncEkfAutocode::Step
+  GNC_PROFILE_EST_COV_PROPAGATE,        // propagate_covariance, every estimator step
+  GNC_PROFILE_EST_COV_AUGMENT,          // augment_covariance, every optical flow registration
+  GNC_PROFILE_EST_OF_RESIDUAL_AND_H,
+  GNC_PROFILE_EST_DELTA_STATE_AND_COV,  // Kalman gain and covariance update
+  GNC_PROFILE_EST_APPLY_DELTA_STATE,
+  GNC_PROFILE_CTL_STEP,                 // GncCtlAutocode::Step
+  GNC_PROFILE_FAM_STEP,                 // GncFamAutocode::Step
+  GNC_PROFILE_NUM_BLOCKS
+};
+
+// Cycle counter on x86, nanoseconds elsewhere
+inline uint64_t gnc_profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void gnc_profile_record(int block, uint64_t ticks);
+void gnc_profile_reset();
+// Whether the step functions were built with the hooks
+bool gnc_profile_enabled();
+// A table of the blocks in [first, last], their counts, mean, percentiles
+// and maximum in microseconds
+std::string gnc_profile_report(int first = 0, int last = GNC_PROFILE_NUM_BLOCKS - 1);
+
+#ifdef GNC_PROFILE
+// Records the time from its construction to the end of the scope
+class gnc_profile_scope {
+ public:
+  explicit gnc_profile_scope(int block) : block_(block), start_(gnc_profile_ticks()) {}
+  ~gnc_profile_scope() { gnc_profile_record(block_, gnc_profile_ticks() - start_); }
+
+ private:
+  int block_;
+  uint64_t start_;
+};
+#define GNC_PROFILE_SCOPE(block) gnc_profile_scope gnc_profile_scope_(block)
+#else
+#define GNC_PROFILE_SCOPE(block)
+#endif
+
+#endif  // GNC_PROFILE_H_
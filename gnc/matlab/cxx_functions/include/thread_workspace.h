@@ -0,0 +1,35 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THREAD_WORKSPACE_H_
+#define THREAD_WORKSPACE_H_
+
+#include <memory>
+
+// The workspace of a kernel for the calling thread, so that several
+// estimators can step at the same time. It is allocated on the first call,
+// only the pointer to it is thread local.
+template <typename Workspace>
+Workspace & thread_workspace() {
+  static thread_local std::unique_ptr<Workspace> ws;
+  if (!ws)
+    ws.reset(new Workspace());
+  return *ws;
+}
+
+#endif  // THREAD_WORKSPACE_H_
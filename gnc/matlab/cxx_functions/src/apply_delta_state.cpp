@@ -16,6 +16,8 @@
  * under the License.
  */
 
+#include <gnc_profile.h>
+
 #include <Eigen/Dense>
 
 #include <iostream>
@@ -50,6 +52,7 @@ void apply_delta_state(
     float* V_B_ISS_ISS_out, float* accel_bias_out, float* P_B_ISS_ISS_out,
     float* ml_quat_ISS2cam_out, float* ml_P_cam_ISS_ISS_out, unsigned short* kfl_status_out,
     float* of_quat_ISS2cam_out, float* of_P_cam_ISS_ISS_out) {
+  GNC_PROFILE_SCOPE(GNC_PROFILE_EST_APPLY_DELTA_STATE);
   int num_augs = (delta_state_length - 21) / 6;
   Map<VectorXf> ds(delta_state, delta_state_length);
   Map<Quaternionf> quat(quat_ISS2B_in);
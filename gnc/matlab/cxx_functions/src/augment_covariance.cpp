@@ -0,0 +1,130 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <gnc_profile.h>
+#include <thread_workspace.h>
+
+#include <Eigen/Dense>
+
+#include <cstdio>
+
+using namespace Eigen;
+
+namespace {
+
+// The 15 IMU states and the 6 of the mapped landmark augmentation come first,
+// followed by the optical flow augmentations. The newest one goes right after
+// the core states.
+const int kCoreStates = 21;
+const int kAugStates = 6;
+const int kMaxState = kCoreStates + 6 * 16;
+const int kMaxKept = kMaxState - kCoreStates - kAugStates;
+
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kMaxKept, kCoreStates + kMaxKept> KeptRowsMatrix;
+typedef Matrix<float, kCoreStates, Dynamic, ColMajor, kCoreStates, kMaxKept> KeptColsMatrix;
+typedef Matrix<float, kAugStates, Dynamic, ColMajor, kAugStates, kCoreStates> SparseJacobian;
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kCoreStates, kMaxState> UsedRowsMatrix;
+typedef Matrix<float, kAugStates, Dynamic, ColMajor, kAugStates, kMaxState> AugRowsMatrix;
+
+struct Workspace {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  KeptRowsMatrix kept_rows;  // [D E] of the kept augmentations
+  KeptColsMatrix kept_cols;  // B of the kept augmentations
+  SparseJacobian M_used;     // nonzero columns of M
+  SparseJacobian MA_used;    // the same columns of M A
+  UsedRowsMatrix P_used;     // rows of P that M uses
+  AugRowsMatrix MP;          // M P
+};
+
+}  // namespace
+
+// Moves the kept optical flow augmentations down the covariance to make room
+// for a new one, then fills it in from the Jacobian M of the new augmentation
+// with respect to the core states:
+//
+//   P = [A B C] then P+1 = [A  AM' B ]
+//       [D E F]            [MA MAM' MB]
+//       [G H J]            [D' DM' E ]
+//
+// where D and E are gathered from kept_rows, the 1-based rows of the
+// augmentations that are kept. M only depends on a few of the core states, so
+// only its nonzero columns and the matching rows of P are used. P_in and P_out
+// may be the same matrix.
+void augment_covariance(float* M_in, double* kept_rows, int num_kept, float* P_in, int P_size, float* P_out_out) {
+  GNC_PROFILE_SCOPE(GNC_PROFILE_EST_COV_AUGMENT);
+  Map<Matrix<float, kAugStates, kCoreStates> > M(M_in);
+  Map<MatrixXf> P(P_in, P_size, P_size);
+  Map<MatrixXf> P_out(P_out_out, P_size, P_size);
+  const int first_kept = kCoreStates + kAugStates;
+
+  if (P_size > kMaxState || num_kept != P_size - first_kept) {
+    fprintf(stderr, "Augmentation does not match the preallocated workspace.\n");
+    if (P_out_out != P_in)
+      P_out = P;
+    return;
+  }
+
+  Workspace & ws = thread_workspace<Workspace>();
+
+  int rows[kMaxKept];
+  for (int i = 0; i < num_kept; i++)
+    rows[i] = static_cast<int>(kept_rows[i]) - 1;
+
+  // Gather everything that moves first, as it may overlap where it goes
+  ws.kept_rows.resize(num_kept, kCoreStates + num_kept);
+  ws.kept_cols.resize(kCoreStates, num_kept);
+  for (int i = 0; i < num_kept; i++) {
+    ws.kept_cols.col(i) = P.col(rows[i]).head<kCoreStates>();
+    for (int c = 0; c < kCoreStates; c++)
+      ws.kept_rows(i, c) = P(rows[i], c);
+    for (int j = 0; j < num_kept; j++)
+      ws.kept_rows(i, kCoreStates + j) = P(rows[i], rows[j]);
+  }
+  if (P_out_out != P_in)
+    P_out.topLeftCorner<kCoreStates, kCoreStates>() = P.topLeftCorner<kCoreStates, kCoreStates>();
+  P_out.block(first_kept, 0, num_kept, kCoreStates) = ws.kept_rows.leftCols<kCoreStates>();
+  P_out.block(0, first_kept, kCoreStates, num_kept) = ws.kept_cols;
+  P_out.bottomRightCorner(num_kept, num_kept) = ws.kept_rows.rightCols(num_kept);
+
+  // Columns of M that are zero do not contribute
+  int used[kCoreStates];
+  int num_used = 0;
+  for (int c = 0; c < kCoreStates; c++)
+    if ((M.col(c).array() != 0.0f).any())
+      used[num_used++] = c;
+  ws.M_used.resize(kAugStates, num_used);
+  ws.P_used.resize(num_used, P_size);
+  for (int i = 0; i < num_used; i++) {
+    ws.M_used.col(i) = M.col(used[i]);
+    ws.P_used.row(i) = P_out.row(used[i]);
+  }
+
+  // [MA . MB], the columns of the new augmentation itself are filled in below
+  ws.MP.noalias() = ws.M_used * ws.P_used;
+  P_out.block<kAugStates, kCoreStates>(kCoreStates, 0) = ws.MP.leftCols<kCoreStates>();
+  P_out.block<kCoreStates, kAugStates>(0, kCoreStates) = ws.MP.leftCols<kCoreStates>().transpose();
+  P_out.block(kCoreStates, first_kept, kAugStates, num_kept) = ws.MP.rightCols(num_kept);
+  P_out.block(first_kept, kCoreStates, num_kept, kAugStates) = ws.MP.rightCols(num_kept).transpose();
+
+  // MAM' only needs the columns of MA that M uses
+  ws.MA_used.resize(kAugStates, num_used);
+  for (int i = 0; i < num_used; i++)
+    ws.MA_used.col(i) = ws.MP.col(used[i]);
+  P_out.block<kAugStates, kAugStates>(kCoreStates, kCoreStates).noalias() = ws.MA_used * ws.M_used.transpose();
+}
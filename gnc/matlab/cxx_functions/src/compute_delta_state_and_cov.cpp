@@ -16,21 +16,60 @@
  * under the License.
  */
 
+#include <gnc_profile.h>
+#include <thread_workspace.h>
+
 #include <Eigen/Dense>
 #include <Eigen/Cholesky>
-#include <Eigen/Eigenvalues> 
 
-#include <vector>
-#include <iostream>
-//#include <ros/ros.h>
+#include <cstdio>
 
 using namespace Eigen;
 
+namespace {
+
+// Largest update the estimator sets up: 16 augmentations (ASE_OF_NUM_AUG) of
+// 6 states each after the 21 states of the core filter. Every temporary has
+// these compile time maximum sizes, so the kernel only allocates its
+// workspace, on the first call from each thread.
+const int kMaxAugs = 16;
+const int kMaxState = 21 + 6 * kMaxAugs;
+const int kMaxAugState = 6 * kMaxAugs;
+
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kMaxAugState, kMaxAugState> AugMatrix;
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kMaxState, kMaxAugState> StateAugMatrix;
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kMaxAugState, kMaxState> AugStateMatrix;
+typedef Matrix<float, Dynamic, 1, ColMajor, kMaxAugState, 1> AugVector;
+
+struct Workspace {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  StateAugMatrix cols_P;  // columns of P of the used augmentations
+  StateAugMatrix T;       // P H'
+  AugMatrix T_aug;        // rows of T of the used augmentations, P_aug H'
+  AugMatrix S;            // H P H' + R
+  AugStateMatrix KT;      // S^-1 T', the transposed Kalman gain
+  AugVector y;            // S^-1 r
+  LDLT<AugMatrix, Lower> chol;
+};
+
+// Whether the strictly lower part of H is zero, which is the case after the
+// Givens compression of the optical flow residual
+template <typename Derived>
+bool upper_triangular(const MatrixBase<Derived> & H) {
+  for (int j = 0; j < H.cols(); j++)
+    for (int i = j + 1; i < H.rows(); i++)
+      if (H(i, j) != 0.0f)
+        return false;
+  return true;
+}
+
+}  // namespace
+
 int compute_delta_state_and_cov(float* residual_in, int error_in, float* H_in,
         int H_rows, int H_cols, unsigned int augs_bitmask, float* R_mat_in, float* P_in,
         float* delta_state_out_out, float* P_out_out) {
-  //struct timeval secs1, secs2;
-  //gettimeofday(&secs1, 0);
+  GNC_PROFILE_SCOPE(GNC_PROFILE_EST_DELTA_STATE_AND_COV);
   Map<MatrixXf> H_full(H_in, H_rows, H_cols);
   Map<VectorXf> residual_full(residual_in, H_rows);
   Map<MatrixXf> R_mat_full(R_mat_in, H_rows, H_rows);
@@ -41,71 +80,66 @@ int compute_delta_state_and_cov(float* residual_in, int error_in, float* H_in,
   if (error_in) {
     delta_state_out.setZero();
     P_out = P;
-    //ROS_INFO("compute_delta_state stop 1");
     return 1;
   }
 
-  std::vector<int> used_augs;
+  int used_augs[kMaxAugs + 1];
+  int num_augs = 0;
   for (int i = 0; i < (H_cols - 15) / 6; i++)
-    if (augs_bitmask & (1 << i))
-      used_augs.push_back(i);
-  VectorBlock<Map<VectorXf> > residual = residual_full.segment(0, used_augs.size() * 6);
-  Block<Map<MatrixXf> > R_mat = R_mat_full.block(0, 0, used_augs.size() * 6, used_augs.size() * 6);
-  Block<Map<MatrixXf> > reduced_H = H_full.block(0, 0, used_augs.size() * 6, used_augs.size() * 6);
-  MatrixXf reduced_P(used_augs.size() * 6, used_augs.size() * 6);
-  for (int i = 0; i < used_augs.size(); i++)
-    for (int j = 0; j < used_augs.size(); j++)
-      reduced_P.block<6, 6>(6 * i, 6 * j) = P.block<6, 6>(15 + 6 * used_augs[i], 15 + 6 * used_augs[j]);
-  MatrixXf reduced_cols_P(H_cols, used_augs.size() * 6);
-  for (int i = 0; i < used_augs.size(); i++)
-    reduced_cols_P.block(0, 6 * i, H_cols, 6) = P.block(0, 15 + 6 * used_augs[i], H_cols, 6);
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("compute_delta_state %d create Ps", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
-
-  MatrixXf T(reduced_cols_P.rows(), reduced_H.rows()), S(reduced_H.rows(), reduced_H.rows());
-  T.noalias() = reduced_cols_P * reduced_H.transpose();
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("compute_delta_state %d multiplies0", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
-  S.triangularView<Lower>() = reduced_H * reduced_P * reduced_H.transpose();
-  S.triangularView<Lower>() += R_mat;
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("compute_delta_state %d multiplies1", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
-
-  LDLT<MatrixXf,Lower> chol(S);
-  if (chol.info() != Success) {
+    if ((augs_bitmask & (1 << i)) && num_augs <= kMaxAugs)
+      used_augs[num_augs++] = i;
+  const int n = num_augs * 6;
+  if (H_cols > kMaxState || n > kMaxAugState || n > H_rows) {
+    fprintf(stderr, "Update larger than the preallocated workspace.\n");
+    delta_state_out.setZero();
+    P_out = P;
+    return 1;
+  }
+
+  Workspace & ws = thread_workspace<Workspace>();
+
+  VectorBlock<Map<VectorXf> > residual = residual_full.segment(0, n);
+  Block<Map<MatrixXf> > R_mat = R_mat_full.block(0, 0, n, n);
+  Block<Map<MatrixXf> > reduced_H = H_full.block(0, 0, n, n);
+  ws.cols_P.resize(H_cols, n);
+  for (int i = 0; i < num_augs; i++)
+    ws.cols_P.middleCols<6>(6 * i) = P.middleCols<6>(15 + 6 * used_augs[i]);
+
+  // T = P H', and H P H' reuses the rows of T of the augmented states
+  const bool upper = upper_triangular(reduced_H);
+  ws.T.resize(H_cols, n);
+  if (upper)
+    ws.T.noalias() = ws.cols_P * reduced_H.transpose().triangularView<Lower>();
+  else
+    ws.T.noalias() = ws.cols_P * reduced_H.transpose();
+  ws.T_aug.resize(n, n);
+  for (int i = 0; i < num_augs; i++)
+    ws.T_aug.middleRows<6>(6 * i) = ws.T.middleRows<6>(15 + 6 * used_augs[i]);
+  ws.S.resize(n, n);
+  if (upper)
+    ws.S.noalias() = reduced_H.triangularView<Upper>() * ws.T_aug;
+  else
+    ws.S.noalias() = reduced_H * ws.T_aug;
+  ws.S.triangularView<Lower>() += R_mat;
+
+  ws.chol.compute(ws.S);
+  if (ws.chol.info() != Success) {
     fprintf(stderr, "S not positive definite.\n");
     delta_state_out.setZero();
     P_out = P;
-    //ROS_INFO("compute_delta_state stop 2");
     return 1;
   }
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("compute_delta_state %d cholesky", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
-  MatrixXf sinv = MatrixXf::Identity(S.cols(), S.cols());
-  chol.solveInPlace(sinv);
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("compute_delta_state %d inverse", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
-  
-  MatrixXf K;
-  K.noalias() = T * sinv.selfadjointView<Lower>();
-  delta_state_out.noalias() = K * residual;
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("compute_delta_state %d multiplies2", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
+
+  // K = T S^-1 is never formed, the factorization is solved against T' and r
+  ws.y = ws.chol.solve(residual);
+  delta_state_out.noalias() = ws.T * ws.y;
+  ws.KT = ws.chol.solve(ws.T.transpose());
 
   // F = I - KH; P = FPF' + KRK';
   // P = P - (KHP)' - KHP + K(HPH' + R)K'
-  // P = P - KHP
-  P_out.triangularView<Lower>() = P - K * T.transpose(); // P - KHP
+  // P = P - KHP = P - T S^-1 T', only the lower half is computed
+  P_out.triangularView<Lower>() = P;
+  P_out.triangularView<Lower>() -= ws.T * ws.KT;
   P_out.triangularView<StrictlyUpper>() = P_out.transpose();
-  //P_out.noalias() = 0.5 * (P_out + P_out.transpose());
-
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("compute_delta_state %d %d stop 0", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)), H_rows);
   return 0;
 }
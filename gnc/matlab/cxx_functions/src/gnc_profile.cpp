@@ -0,0 +1,146 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "gnc_profile.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace {
+
+const char* kBlockNames[GNC_PROFILE_NUM_BLOCKS] = {
+  "est_step",
+  "est_cov_propagate",
+  "est_cov_augment",
+  "est_of_residual_and_h",
+  "est_delta_state_and_cov",
+  "est_apply_delta_state",
+  "ctl_step",
+  "fam_step",
+};
+
+// Four buckets per power of two, so a bucket spans at most 25% of its value
+const int kBuckets = 256;
+
+int bucket(uint64_t ticks) {
+  if (ticks < 4)
+    return ticks;
+  int e = 63 - __builtin_clzll(ticks);
+  return 4 * e + ((ticks >> (e - 2)) & 3);
+}
+
+// the middle of a bucket
+double bucket_value(int b) {
+  if (b < 4)
+    return b;
+  int e = b / 4;
+  return ((4ull + (b & 3)) << (e - 2)) + 0.5 * (1ull << (e - 2));
+}
+
+struct Histogram {
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+  std::atomic<uint64_t> buckets[kBuckets];
+};
+
+Histogram histograms[GNC_PROFILE_NUM_BLOCKS];
+
+// Converts ticks to time by comparing against the clock since the program
+// started
+struct TickRate {
+  TickRate() : ticks(gnc_profile_ticks()), time(std::chrono::steady_clock::now()) {}
+  double per_second() const {
+#if defined(__x86_64__) || defined(__i386__)
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time).count();
+    return (seconds > 0) ? (gnc_profile_ticks() - ticks) / seconds : 1e9;
+#else
+    return 1e9;
+#endif
+  }
+  uint64_t ticks;
+  std::chrono::steady_clock::time_point time;
+};
+
+TickRate tick_rate;
+
+double percentile(uint64_t const* counts, uint64_t total, double p) {
+  uint64_t rank = p * total, seen = 0;
+  for (int b = 0; b < kBuckets; b++) {
+    seen += counts[b];
+    if (seen > rank)
+      return bucket_value(b);
+  }
+  return 0;
+}
+
+}  // namespace
+
+void gnc_profile_record(int block, uint64_t ticks) {
+  Histogram & h = histograms[block];
+  h.sum.fetch_add(ticks, std::memory_order_relaxed);
+  h.buckets[bucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = h.max.load(std::memory_order_relaxed);
+  while (ticks > max && !h.max.compare_exchange_weak(max, ticks, std::memory_order_relaxed)) {}
+}
+
+void gnc_profile_reset() {
+  for (Histogram & h : histograms) {
+    h.sum = 0;
+    h.max = 0;
+    for (std::atomic<uint64_t> & b : h.buckets)
+      b = 0;
+  }
+}
+
+bool gnc_profile_enabled() {
+#ifdef GNC_PROFILE
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::string gnc_profile_report(int first, int last) {
+  if (!gnc_profile_enabled())
+    return "GNC profiling is not compiled in, build with ENABLE_GNC_PROFILE.\n";
+  double us = 1e6 / tick_rate.per_second();
+  std::string report;
+  char line[160];
+  snprintf(line, sizeof(line), "%-24s %10s %10s %10s %10s %10s %10s %12s\n", "block", "count", "mean_us",
+           "p50_us", "p90_us", "p99_us", "max_us", "total_ms");
+  report += line;
+  for (int i = first; i <= last && i < GNC_PROFILE_NUM_BLOCKS; i++) {
+    Histogram const& h = histograms[i];
+    uint64_t counts[kBuckets], total = 0;
+    for (int b = 0; b < kBuckets; b++) {
+      counts[b] = h.buckets[b].load(std::memory_order_relaxed);
+      total += counts[b];
+    }
+    if (total == 0)
+      continue;
+    double sum = h.sum.load(std::memory_order_relaxed);
+    snprintf(line, sizeof(line), "%-24s %10lu %10.2f %10.2f %10.2f %10.2f %10.2f %12.2f\n", kBlockNames[i],
+             static_cast<unsigned long>(total), sum / total * us, percentile(counts, total, 0.5) * us,  // NOLINT
+             percentile(counts, total, 0.9) * us, percentile(counts, total, 0.99) * us,
+             h.max.load(std::memory_order_relaxed) * us, sum * us * 1e-3);
+    report += line;
+  }
+  return report;
+}
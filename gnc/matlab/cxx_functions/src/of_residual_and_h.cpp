@@ -16,33 +16,59 @@
  * under the License.
  */
 
+#include <gnc_profile.h>
+#include <thread_workspace.h>
+
 #include <Eigen/Dense>
+#include <Eigen/Cholesky>
 #include <Eigen/Jacobi>
-#include <Eigen/SVD>
 
-#include <vector>
-#include <iostream>
+#include <cstdio>
 #include <limits>
-//#include <ros/ros.h>
 
-using Eigen::MatrixXd;
 using namespace Eigen;
-//using namespace std;
-
-void apply_givens(MatrixXf & H_f_j, MatrixXf & H_x_j, VectorXf & r_j, int row1, int row2, int col,
-    int H_x_j_col_start, int H_x_j_num_cols) {
-  JacobiRotation<float> g;
-  g.makeGivens(H_f_j(row1, col), H_f_j(row2, col));
-  H_f_j.applyOnTheLeft(row1, row2, g.adjoint());
-  H_x_j.block(0, H_x_j_col_start, H_x_j.rows(), H_x_j_num_cols).applyOnTheLeft(row1, row2, g.adjoint());
-  r_j.applyOnTheLeft(row1, row2, g.adjoint());
-}
 
-void apply_givens(MatrixXf & H, VectorXf & r, int row1, int row2, int col) {
+namespace {
+
+// Largest problem the estimator sets up, ASE_OF_NUM_AUG augmentations and
+// ASE_OF_NUM_FEATURES features. Every temporary has these compile time
+// maximum sizes, so the workspace is the only allocation.
+const int kMaxAugs = 16;
+const int kMaxFeatures = 50;
+const int kMaxAugState = 6 * kMaxAugs;
+const int kMaxFeatureRows = 2 * kMaxAugs;
+
+// Givens rotations combine rows, so everything they touch is row major. The
+// residual is kept as the last column, so one rotation updates both.
+// [H_f_j | H_x_j | r_j] of one feature, H_x_j only spans the observed augmentations
+typedef Matrix<float, Dynamic, Dynamic, RowMajor, kMaxFeatureRows, 3 + kMaxAugState + 1> FeatureMatrix;
+// [H | r] compressed so far, followed by the rows of the feature being added
+typedef Matrix<float, Dynamic, Dynamic, RowMajor, kMaxAugState + kMaxFeatureRows, kMaxAugState + 1> CompressedMatrix;
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kMaxAugState, kMaxAugState> AugMatrix;
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kMaxFeatureRows, kMaxAugState> FeatureAugMatrix;
+typedef Matrix<float, Dynamic, Dynamic, ColMajor, kMaxFeatureRows, kMaxFeatureRows> FeatureSquareMatrix;
+typedef Matrix<float, Dynamic, 1, ColMajor, kMaxFeatureRows, 1> FeatureVector;
+
+struct Workspace {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  AugMatrix reduced_P;       // covariance of the used augmentations
+  FeatureMatrix A_j;         // [H_f_j | H_x_j | r_j]
+  FeatureAugMatrix HP;       // H_x_j P
+  FeatureSquareMatrix S;     // H_x_j P H_x_j' + R
+  FeatureVector r_j;
+  FeatureVector y;           // S^-1 r_j
+  LDLT<FeatureSquareMatrix, Lower> chol;
+  CompressedMatrix A;        // [H | r]
+};
+
+// Rotate row2 into row1 to zero A(row2, col). Columns left of col are zero in
+// both rows and are not touched.
+template <typename Derived>
+void apply_givens(MatrixBase<Derived> & A, int row1, int row2, int col) {
   JacobiRotation<float> g;
-  g.makeGivens(H(row1, col), H(row2, col));
-  H.block(0, col, H.rows(), H.cols() - col).applyOnTheLeft(row1, row2, g.adjoint());
-  r.applyOnTheLeft(row1, row2, g.adjoint());
+  g.makeGivens(A(row1, col), A(row2, col));
+  A.rightCols(A.cols() - col).applyOnTheLeft(row1, row2, g.adjoint());
 }
 
 Matrix3f skew(const Vector3f & v) {
@@ -53,24 +79,14 @@ Matrix3f skew(const Vector3f & v) {
   return ret;
 }
 
-// S is lower triangular
-int pinv(const MatrixXf & S, MatrixXf & out) {
-  LDLT<MatrixXf,Lower> chol(S);
-  if (chol.info() != Success) {
-    return 1;
-  }
-  out = MatrixXf::Identity(out.rows(), out.cols());
-  chol.solveInPlace(out);
-  return 0;
-}
+}  // namespace
 
 int of_residual_and_h(float* of_measured_p, float* global_points_p, float* camera_tf_global_p,
           int* valid_p, int num_points, int ase_of_num_aug, int ase_of_num_features,
           float tun_ase_mahal_distance_max, float ase_of_r_mag, float ase_inv_focal_length, float ase_distortion, float* P_p,
           float* r_out_p, float* H_out_p, unsigned int* augs_bitmask, unsigned char* num_of_tracks_out, float* mahal_dists_out_p, float* R_out_p)
 {
-  //struct timeval secs1, secs2;
-  //gettimeofday(&secs1, 0);
+  GNC_PROFILE_SCOPE(GNC_PROFILE_EST_OF_RESIDUAL_AND_H);
   int covariance_size = 21 + 6 * ase_of_num_aug;
   Map<VectorXf> of_measured(of_measured_p, ase_of_num_features * 2 * ase_of_num_aug);
   Map<MatrixXf> global_points(global_points_p, 4, ase_of_num_features);
@@ -81,37 +97,47 @@ int of_residual_and_h(float* of_measured_p, float* global_points_p, float* camer
   Map<MatrixXf> H_out(H_out_p, 6 * ase_of_num_aug, covariance_size);
   Map<MatrixXf> R_out(R_out_p, 6 * ase_of_num_aug, 6 * ase_of_num_aug);
   Map<VectorXf> mahal_dists_out(mahal_dists_out_p, ase_of_num_features);
-  
+
   r_out.setZero();
   H_out.setZero();
   R_out.setZero();
   *num_of_tracks_out = 0;
   *augs_bitmask = 0;
-  
+
+  if (ase_of_num_aug > kMaxAugs || ase_of_num_features > kMaxFeatures || num_points > ase_of_num_features) {
+    fprintf(stderr, "Optical flow problem larger than the preallocated workspace.\n");
+    r_out(1) = 1;
+    return 1;
+  }
+
   // figure out which augmentations were used (this helps with speed)
-  std::vector<int> used_augs;
+  int used_augs[kMaxAugs];
+  int num_used = 0;
   for (int i = 0; i < ase_of_num_aug; i++) {
     if ((valid.col(i).array() > 0).any()) {
-      used_augs.push_back(i);
+      used_augs[num_used++] = i;
       *augs_bitmask |= 2 << i;
     }
   }
-  if (used_augs.size() < 3) {
+  if (num_used < 3) {
     r_out(1) = 1;
     return 1;
   }
+  const int n = 6 * num_used;
 
-  MatrixXf reduced_P(used_augs.size() * 6, used_augs.size() * 6);
-  for (int i = 0; i < used_augs.size(); i++)
-    for (int j = 0; j < used_augs.size(); j++)
-      reduced_P.block<6, 6>(6 * i, 6 * j) = P.block<6, 6>(21 + 6 * i, 21 + 6 * j);
+  Workspace & ws = thread_workspace<Workspace>();
 
-  VectorXf r((2 * used_augs.size() - 3) * ase_of_num_features);
-  MatrixXf H((2 * used_augs.size() - 3) * ase_of_num_features, 6 * used_augs.size());
-  H.setZero();
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("of_residual_and_h %d cast", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
+  // block k is augmentation used_augs[k], as compute_delta_state_and_cov
+  // reads them from the bitmask
+  ws.reduced_P.resize(n, n);
+  for (int i = 0; i < num_used; i++)
+    for (int j = 0; j < num_used; j++)
+      ws.reduced_P.block<6, 6>(6 * i, 6 * j) = P.block<6, 6>(21 + 6 * used_augs[i], 21 + 6 * used_augs[j]);
+
+  // The upper triangular [H | r] is built as features are accepted, instead of
+  // stacking all of them and compressing at the end
+  ws.A.setZero(n + 2 * num_used - 3, n + 1);
+  const float r_var = (ase_inv_focal_length * ase_of_r_mag) * (ase_inv_focal_length * ase_of_r_mag);
 
   int cur_row = 0;
   int num_tracks = 0;
@@ -120,124 +146,94 @@ int of_residual_and_h(float* of_measured_p, float* global_points_p, float* camer
     if (valid_augs < 2)
       continue;
     int rows = valid_augs * 2;
-    VectorXf r_j(rows);
-    MatrixXf H_f_j(rows, 3);
-    MatrixXf H_x_j(rows, 6 * used_augs.size());
-    H_x_j.setZero();
-    int aug_ind = 0;
+    // H_x_j is only nonzero between the first and the last observing augmentation
+    int first_aug = 0, last_aug = num_used - 1;
+    while (!valid(j, used_augs[first_aug]))
+      first_aug++;
+    while (!valid(j, used_augs[last_aug]))
+      last_aug--;
+    const int span = 6 * (last_aug - first_aug + 1);
+    const int r_col = 3 + span;
+    ws.A_j.setZero(rows, r_col + 1);
+    int aug_ind = first_aug;
     // construct r_j, H_x_j, and H_f_j
     for (int i = 0; i < valid_augs; i++) {
       while (!valid(j, used_augs[aug_ind]))
         aug_ind++;
-      assert(aug_ind < used_augs.size());
-      
+
       Matrix<float, 3, 4> c_tf_g = camera_tf_global.block<3, 4>(4 * used_augs[aug_ind], 0);
       Vector3f camera_landmark = c_tf_g * global_points.col(j);
       Vector2f z_est(camera_landmark(0), camera_landmark(1));
       z_est *= 1.0 / camera_landmark(2);
- 
+
       Matrix<float, 2, 3> prefix;
       prefix << 1, 0, -z_est(0), 0, 1, -z_est(1);
       prefix *= 1.0 / camera_landmark(2);
       Matrix<float, 2, 3> H_theta_ji = prefix * skew(camera_landmark);
       Matrix<float, 2, 3> H_p_ji = -prefix * c_tf_g.block<3, 3>(0, 0);
 
-      r_j.segment<2>(2 * i) = of_measured.segment<2>(2 * ase_of_num_aug * j + 2 * used_augs[aug_ind]) - z_est;
-      H_x_j.block<2, 3>(2 * i, aug_ind * 6)     = H_theta_ji;
-      H_x_j.block<2, 3>(2 * i, aug_ind * 6 + 3) = H_p_ji;
-      H_f_j.block<2, 3>(2 * i, 0) = -H_p_ji;
+      const int col = 3 + 6 * (aug_ind - first_aug);
+      ws.A_j.block<2, 1>(2 * i, r_col) = of_measured.segment<2>(2 * ase_of_num_aug * j + 2 * used_augs[aug_ind]) - z_est;
+      ws.A_j.block<2, 3>(2 * i, col)     = H_theta_ji;
+      ws.A_j.block<2, 3>(2 * i, col + 3) = H_p_ji;
+      ws.A_j.block<2, 3>(2 * i, 0) = -H_p_ji;
       aug_ind++;
     }
 
     // do givens rotations to make H_f_j upper triangular
-    // optimized version only if we observed all 4 augmentations
-    if (used_augs.size() == valid_augs && valid_augs == 4) {
-      // first make each block of 2 rows x x x; 0 x x
-      for (int i = 0; i < rows; i+=2)
-        apply_givens(H_f_j, H_x_j, r_j, i, i + 1, 0, 6 * (i/2), 6);
-      // now make each block of 4 rows x x x; 0 x x; 0 0 x; 0 0 0
-      for (int i = 0; i < rows; i+=4) {
-        apply_givens(H_f_j, H_x_j, r_j, i    , i + 2, 0, 6 * (i/4), 12);
-        apply_givens(H_f_j, H_x_j, r_j, i + 1, i + 2, 1, 6 * (i/4), 12);
-        apply_givens(H_f_j, H_x_j, r_j, i + 1, i + 3, 1, 6 * (i/4), 12);
-        apply_givens(H_f_j, H_x_j, r_j, i + 2, i + 3, 2, 6 * (i/4), 12);
-      }
-      // finally eliminate the second block of four
-      apply_givens(H_f_j, H_x_j, r_j, 0, 4, 0, 0, 24);
-      apply_givens(H_f_j, H_x_j, r_j, 1, 4, 1, 0, 24);
-      apply_givens(H_f_j, H_x_j, r_j, 1, 5, 1, 0, 24);
-      apply_givens(H_f_j, H_x_j, r_j, 2, 4, 2, 0, 24);
-      apply_givens(H_f_j, H_x_j, r_j, 2, 5, 2, 0, 24);
-      apply_givens(H_f_j, H_x_j, r_j, 2, 6, 2, 0, 24);
-    } else {
-      // normal version
-      for (int col = 0; col < 3; col++)
-       for (int row = rows - 1; row > col; row--)
-         apply_givens(H_f_j, H_x_j, r_j, row - 1, row, col, 0, H_x_j.cols());
-    }
-      
+    for (int col = 0; col < 3; col++)
+      for (int row = rows - 1; row > col; row--)
+        apply_givens(ws.A_j, row - 1, row, col);
+
     // then delete the top three rows which are nonzero in H_f_j
-    Block<MatrixXf> H_x_j_reduced = H_x_j.block(3, 0, rows - 3, H_x_j.cols());
-    VectorBlock<VectorXf> r_j_reduced = r_j.segment(3, rows - 3);
+    Block<FeatureMatrix> H_x_j_reduced = ws.A_j.block(3, 3, rows - 3, span);
+    ws.r_j = ws.A_j.block(3, r_col, rows - 3, 1);
 
     // now check the mahalanobis distance
-    MatrixXf S(H_x_j_reduced.rows(), H_x_j_reduced.rows());
-    S.triangularView<Lower>() = H_x_j_reduced * reduced_P * H_x_j_reduced.transpose();
-    for (int i = 0; i < S.rows(); i++)
-      S(i, i) += (ase_inv_focal_length * ase_of_r_mag) * (ase_inv_focal_length * ase_of_r_mag);
-    MatrixXf S_inv(S.rows(), S.cols());
-    if (pinv(S, S_inv)) {
+    ws.HP.noalias() = H_x_j_reduced * ws.reduced_P.block(6 * first_aug, 6 * first_aug, span, span);
+    ws.S.resize(rows - 3, rows - 3);
+    ws.S.triangularView<Lower>() = ws.HP * H_x_j_reduced.transpose();
+    ws.S.diagonal().array() += r_var;
+    ws.chol.compute(ws.S);
+    if (ws.chol.info() != Success) {
       fprintf(stderr, "Failed to take inverse for Mahalanobis distance.\n");
       continue;
     }
-    float mahal_dist = sqrt(r_j_reduced.transpose() * S_inv * r_j_reduced);
+    ws.y = ws.chol.solve(ws.r_j);
+    float mahal_dist = sqrt(ws.r_j.dot(ws.y));
     mahal_dists_out(j) = mahal_dist;
     if (mahal_dist > tun_ase_mahal_distance_max)
       continue;
 
-    // add to full r and H
-    r.segment(cur_row, r_j_reduced.rows()) = r_j_reduced;
-    H.block(cur_row, 0, r_j_reduced.rows(), H_x_j_reduced.cols()) = H_x_j_reduced;
-    cur_row += r_j_reduced.rows();
+    // add to r and H, then rotate the new rows into the triangle. The diagonal
+    // never gets negative, so skipping zeros only skips identity rotations.
+    ws.A.block(n, 0, rows - 3, n + 1).setZero();
+    ws.A.block(n, 6 * first_aug, rows - 3, span) = H_x_j_reduced;
+    ws.A.block(n, n, rows - 3, 1) = ws.r_j;
+    for (int col = 6 * first_aug; col < n; col++)
+      for (int row = n + rows - 4; row >= n; row--)
+        if (ws.A(row, col) != 0.0f)
+          apply_givens(ws.A, col, row, col);
+    cur_row += rows - 3;
     num_tracks++;
   }
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("of_residual_and_h %d r and h", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
 
   // set the rest to uninitialized
   for (int j = num_points; j < ase_of_num_features; j++)
     mahal_dists_out(j) = std::numeric_limits<double>::quiet_NaN();
 
-  r.conservativeResize(cur_row);
-  H.conservativeResize(cur_row, NoChange);
-  if (r.rows() < 6 * used_augs.size()) {
+  if (cur_row < n) {
     r_out(1) = 1;
-    //ROS_INFO("of_residual_and_h end 1");
     return 1;
   }
 
   *num_of_tracks_out = static_cast<unsigned char>(num_tracks);
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("of_residual_and_h %d output", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
-
-  // now we do the compression
-  // do givens rotations to make H upper triangular and remove as many rows as possible
-  for (int col = 0; col < H.cols(); col++)
-    for (int row = H.rows() - 1; row > col; row--)
-      apply_givens(H, r, col, row, col);
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("of_residual_and_h %d compress", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
-  //secs1 = secs2;
-
-  r_out.segment(0, 6 * used_augs.size()) = r.segment(0, 6 * used_augs.size());
-  H_out.block(0, 0, 6 * used_augs.size(), 6 * used_augs.size()) = H.block(0, 0, 6 * used_augs.size(), 6 * used_augs.size());
+
+  // the rows below the triangle were all rotated away
+  r_out.segment(0, n) = ws.A.block(0, n, n, 1);
+  H_out.block(0, 0, n, n) = ws.A.block(0, 0, n, n);
   for (int i = 0; i < 6 * ase_of_num_aug; i++)
-    R_out(i, i) = (ase_of_r_mag * ase_inv_focal_length) * (ase_of_r_mag * ase_inv_focal_length);
-  //gettimeofday(&secs2, 0);
-  //ROS_INFO("of_residual_and_h %d end 0", (((secs2.tv_sec - secs1.tv_sec) * 1000) + (secs2.tv_usec - secs1.tv_usec)));
+    R_out(i, i) = r_var;
 
   return 0;
 }
-
@@ -0,0 +1,50 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <gnc_profile.h>
+
+#include <Eigen/Dense>
+
+using namespace Eigen;
+
+// Propagates the cross terms of the covariance over one IMU step. The 15
+// core states are propagated with the state transition matrix and the
+// augmentations are constant, so of the whole covariance only the cross
+// terms between the core and the valid augmentations change:
+//
+//   P = [A B]  then  P+1 = [. Phi B]
+//       [C D]               [.     .]
+//
+// This writes the 15 x (P_size - 15) block Phi B, as the predictor's MATLAB
+// Function2 does, which the model then mirrors and concatenates with the
+// propagated core block. aug_state has a bit for each augmentation of 6 states
+// after the core, the blocks of the invalid ones are copied unchanged.
+void propagate_covariance(float* state_trans_in, unsigned int aug_state, float* P_in, int P_size,
+        float* P_cross_out) {
+  GNC_PROFILE_SCOPE(GNC_PROFILE_EST_COV_PROPAGATE);
+  Map<Matrix<float, 15, 15> > state_trans(state_trans_in);
+  Map<MatrixXf> P(P_in, P_size, P_size);
+  Map<Matrix<float, 15, Dynamic> > P_cross(P_cross_out, 15, P_size - 15);
+
+  for (int k = 0; k < (P_size - 15) / 6; k++) {
+    if (aug_state & (1 << k))
+      P_cross.block<15, 6>(0, 6 * k).noalias() = state_trans * P.block<15, 6>(0, 15 + 6 * k);
+    else
+      P_cross.block<15, 6>(0, 6 * k) = P.block<15, 6>(0, 15 + 6 * k);
+  }
+}
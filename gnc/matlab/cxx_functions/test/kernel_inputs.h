@@ -0,0 +1,231 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Inputs of one optical flow update of the estimator, as passed to
+// of_residual_and_h and then compute_delta_state_and_cov. Sets of them are
+// generated for the tests and stored in a text file for the benchmark.
+
+#ifndef GNC_CXX_FUNCTIONS_TEST_KERNEL_INPUTS_H_
+#define GNC_CXX_FUNCTIONS_TEST_KERNEL_INPUTS_H_
+
+#include <Eigen/Dense>
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+struct KernelInputs {
+  int num_aug;
+  int num_features;
+  int num_points;
+  float mahal_distance_max;
+  float of_r_mag;
+  float inv_focal_length;
+  float distortion;
+  std::vector<float> of_measured;        // 2 * num_aug x num_features
+  std::vector<float> global_points;      // 4 x num_features
+  std::vector<float> camera_tf_global;   // 4 * num_aug x 4
+  std::vector<int> valid;                // num_features x num_aug
+  std::vector<float> P;                  // covariance of the core and augmented states
+
+  int CovarianceSize() const { return 21 + 6 * num_aug; }
+};
+
+// Camera poses along a slow drift, features a few meters in front of them
+// tracked over runs of consecutive augmentations, with some outliers. Only the
+// first num_used augmentations observe anything.
+inline KernelInputs GenerateKernelInputs(unsigned int seed, int num_aug = 16,
+    int num_features = 50, int num_used = 16) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  KernelInputs in;
+  in.num_aug = num_aug;
+  in.num_features = num_features;
+  in.num_points = num_features;
+  in.mahal_distance_max = 20.0f;
+  in.of_r_mag = 1.5f;
+  in.inv_focal_length = 1.0f / 600.0f;
+  in.distortion = 1.0f;
+
+  Eigen::MatrixXf camera_tf_global = Eigen::MatrixXf::Zero(4 * num_aug, 4);
+  for (int i = 0; i < num_aug; i++) {
+    Eigen::Matrix3f R = Eigen::AngleAxisf(0.01f * i, Eigen::Vector3f(0.2f, 1.0f, 0.1f).normalized()).matrix();
+    Eigen::Vector3f p(0.02f * i, 0.01f * std::sin(i), 0.005f * i);
+    camera_tf_global.block<3, 3>(4 * i, 0) = R.transpose();
+    camera_tf_global.block<3, 1>(4 * i, 3) = -R.transpose() * p;
+    camera_tf_global(4 * i + 3, 3) = 1.0f;
+  }
+
+  Eigen::MatrixXf global_points(4, num_features);
+  Eigen::MatrixXi valid = Eigen::MatrixXi::Zero(num_features, num_aug);
+  Eigen::VectorXf of_measured = Eigen::VectorXf::Zero(2 * num_aug * num_features);
+  for (int j = 0; j < num_features; j++) {
+    global_points.col(j) << 2.0 * unit(gen) - 1.0, 2.0 * unit(gen) - 1.0, 2.0 + 3.0 * unit(gen), 1.0;
+    // the first feature is seen by all augmentations, so all are used
+    int first = 0, last = num_used - 1;
+    if (j > 0) {
+      first = static_cast<int>(unit(gen) * (num_used - 1));
+      last = first + 1 + static_cast<int>(unit(gen) * (num_used - first - 1));
+    }
+    bool outlier = unit(gen) < 0.05;
+    for (int i = first; i <= last; i++) {
+      valid(j, i) = 1;
+      Eigen::Vector3f c = camera_tf_global.block<3, 4>(4 * i, 0) * global_points.col(j);
+      Eigen::Vector2f z(c(0) / c(2), c(1) / c(2));
+      for (int k = 0; k < 2; k++)
+        z(k) += in.inv_focal_length * (in.of_r_mag * normal(gen) + (outlier ? 30.0 : 0.0));
+      of_measured.segment<2>(2 * num_aug * j + 2 * i) = z;
+    }
+  }
+
+  int n = in.CovarianceSize();
+  Eigen::MatrixXd B(n, n);
+  for (int i = 0; i < n * n; i++)
+    B.data()[i] = 0.01 * normal(gen);
+  Eigen::MatrixXf P = (B * B.transpose() + 1e-4 * Eigen::MatrixXd::Identity(n, n)).cast<float>();
+
+  in.of_measured.assign(of_measured.data(), of_measured.data() + of_measured.size());
+  in.global_points.assign(global_points.data(), global_points.data() + global_points.size());
+  in.camera_tf_global.assign(camera_tf_global.data(), camera_tf_global.data() + camera_tf_global.size());
+  in.valid.assign(valid.data(), valid.data() + valid.size());
+  in.P.assign(P.data(), P.data() + P.size());
+  return in;
+}
+
+// Moves the observations of augmentation i, and its camera pose, to
+// augmentation augs[i], so that the augmentations used are not the leading
+// ones. The pose at augs[i] goes to i.
+inline void ScatterAugmentations(const std::vector<int> & augs, KernelInputs * in) {
+  Eigen::Map<Eigen::MatrixXf> of_measured(in->of_measured.data(), 2 * in->num_aug, in->num_features);
+  Eigen::Map<Eigen::MatrixXf> camera_tf_global(in->camera_tf_global.data(), 4 * in->num_aug, 4);
+  Eigen::Map<Eigen::MatrixXi> valid(in->valid.data(), in->num_features, in->num_aug);
+  for (int i = static_cast<int>(augs.size()) - 1; i >= 0; i--) {
+    if (augs[i] == i)
+      continue;
+    of_measured.middleRows<2>(2 * i).swap(of_measured.middleRows<2>(2 * augs[i]));
+    camera_tf_global.middleRows<4>(4 * i).swap(camera_tf_global.middleRows<4>(4 * augs[i]));
+    valid.col(i).swap(valid.col(augs[i]));
+  }
+}
+
+template <typename T>
+void WriteKernelValues(std::ostream & os, const char* name, const std::vector<T> & v) {
+  os << name << " " << v.size() << std::endl;
+  for (size_t i = 0; i < v.size(); i++)
+    os << v[i] << (i + 1 == v.size() ? "\n" : " ");
+}
+
+template <typename T>
+bool ReadKernelValues(std::istream & is, const char* name, std::vector<T> * v) {
+  std::string word;
+  size_t size;
+  if (!(is >> word >> size) || word != name)
+    return false;
+  v->resize(size);
+  for (size_t i = 0; i < size; i++)
+    if (!(is >> (*v)[i]))
+      return false;
+  return true;
+}
+
+inline bool SaveKernelInputs(const std::string & filename, const std::vector<KernelInputs> & inputs) {
+  std::ofstream os(filename.c_str());
+  if (!os.is_open())
+    return false;
+  os << std::setprecision(std::numeric_limits<float>::max_digits10);
+  os << "kernel_inputs 1 " << inputs.size() << std::endl;
+  for (size_t k = 0; k < inputs.size(); k++) {
+    const KernelInputs & in = inputs[k];
+    os << "sizes " << in.num_aug << " " << in.num_features << " " << in.num_points << std::endl;
+    os << "parameters " << in.mahal_distance_max << " " << in.of_r_mag << " "
+       << in.inv_focal_length << " " << in.distortion << std::endl;
+    WriteKernelValues(os, "of_measured", in.of_measured);
+    WriteKernelValues(os, "global_points", in.global_points);
+    WriteKernelValues(os, "camera_tf_global", in.camera_tf_global);
+    WriteKernelValues(os, "valid", in.valid);
+    WriteKernelValues(os, "P", in.P);
+  }
+  return static_cast<bool>(os);
+}
+
+inline bool LoadKernelInputs(const std::string & filename, std::vector<KernelInputs> * inputs) {
+  std::ifstream is(filename.c_str());
+  std::string word;
+  int version;
+  size_t count;
+  if (!(is >> word >> version >> count) || word != "kernel_inputs" || version != 1)
+    return false;
+  inputs->resize(count);
+  for (size_t k = 0; k < count; k++) {
+    KernelInputs & in = (*inputs)[k];
+    if (!(is >> word >> in.num_aug >> in.num_features >> in.num_points) || word != "sizes")
+      return false;
+    if (!(is >> word >> in.mahal_distance_max >> in.of_r_mag >> in.inv_focal_length >> in.distortion)
+        || word != "parameters")
+      return false;
+    if (!ReadKernelValues(is, "of_measured", &in.of_measured) ||
+        !ReadKernelValues(is, "global_points", &in.global_points) ||
+        !ReadKernelValues(is, "camera_tf_global", &in.camera_tf_global) ||
+        !ReadKernelValues(is, "valid", &in.valid) ||
+        !ReadKernelValues(is, "P", &in.P))
+      return false;
+    const size_t covariance = in.CovarianceSize();
+    if (in.of_measured.size() != static_cast<size_t>(2 * in.num_aug * in.num_features) ||
+        in.global_points.size() != static_cast<size_t>(4 * in.num_features) ||
+        in.camera_tf_global.size() != static_cast<size_t>(16 * in.num_aug) ||
+        in.valid.size() != static_cast<size_t>(in.num_features * in.num_aug) ||
+        in.P.size() != covariance * covariance)
+      return false;
+  }
+  return true;
+}
+
+// Outputs of one optical flow update, sized like the estimator's buffers
+struct KernelOutputs {
+  explicit KernelOutputs(const KernelInputs & in)
+    : r(6 * in.num_aug), H(6 * in.num_aug * in.CovarianceSize()), augs_bitmask(0), num_tracks(0),
+      mahal_dists(in.num_features), R(36 * in.num_aug * in.num_aug), of_error(0), delta_error(0),
+      delta_state(in.CovarianceSize()), P(in.CovarianceSize() * in.CovarianceSize()) {}
+  std::vector<float> r, H;
+  unsigned int augs_bitmask;
+  unsigned char num_tracks;
+  std::vector<float> mahal_dists, R;
+  int of_error, delta_error;
+  std::vector<float> delta_state, P;
+};
+
+// Run one update through the given kernels, the way est_estimator chains them
+template <typename OfResidual, typename ComputeDelta>
+void RunKernels(KernelInputs & in, KernelOutputs * out, OfResidual of_residual_and_h,
+    ComputeDelta compute_delta_state_and_cov) {
+  out->of_error = of_residual_and_h(in.of_measured.data(), in.global_points.data(),
+    in.camera_tf_global.data(), in.valid.data(), in.num_points, in.num_aug, in.num_features,
+    in.mahal_distance_max, in.of_r_mag, in.inv_focal_length, in.distortion, in.P.data(),
+    out->r.data(), out->H.data(), &out->augs_bitmask, &out->num_tracks, out->mahal_dists.data(),
+    out->R.data());
+  out->delta_error = compute_delta_state_and_cov(out->r.data(), out->of_error, out->H.data(),
+    6 * in.num_aug, in.CovarianceSize(), out->augs_bitmask, out->R.data(), in.P.data(),
+    out->delta_state.data(), out->P.data());
+}
+
+#endif  // GNC_CXX_FUNCTIONS_TEST_KERNEL_INPUTS_H_
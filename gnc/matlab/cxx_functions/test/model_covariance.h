@@ -0,0 +1,226 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Covariance propagation and augmentation of the estimator as the code
+// generated from the model computed them before the block kernels, to check
+// and time the kernels against. Also generates their inputs.
+
+#ifndef GNC_CXX_FUNCTIONS_TEST_MODEL_COVARIANCE_H_
+#define GNC_CXX_FUNCTIONS_TEST_MODEL_COVARIANCE_H_
+
+#include <Eigen/Dense>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+struct CovarianceInputs {
+  int size;                          // 15 IMU, 6 landmark and 16 optical flow augmentation states
+  unsigned int aug_state;            // valid augmentations, landmark first
+  std::vector<float> P;              // size x size
+  std::vector<float> state_trans;    // 15 x 15
+  std::vector<float> M;              // 6 x 21 Jacobian of a new augmentation
+  std::vector<double> kept_rows;     // 1-based rows of the kept optical flow augmentations
+};
+
+// A random covariance and IMU transition, an augmentation Jacobian with the
+// structure the estimator uses (rotation and lever arm terms on the attitude,
+// position on the position states) and a random augmentation to drop.
+inline CovarianceInputs GenerateCovarianceInputs(unsigned int seed, unsigned int aug_state = 0x1ffff) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<float> normal(0.0f, 1.0f);
+  CovarianceInputs in;
+  in.size = 21 + 6 * 16;
+  in.aug_state = aug_state;
+
+  Eigen::MatrixXf A(in.size, in.size);
+  for (int i = 0; i < A.size(); i++)
+    A(i) = normal(gen);
+  Eigen::MatrixXf P = 1e-3f * A * A.transpose() / in.size;
+  in.P.assign(P.data(), P.data() + P.size());
+
+  Eigen::MatrixXf state_trans = Eigen::MatrixXf::Identity(15, 15);
+  for (int i = 0; i < state_trans.size(); i++)
+    state_trans(i) += 0.01f * normal(gen);
+  in.state_trans.assign(state_trans.data(), state_trans.data() + state_trans.size());
+
+  Eigen::Matrix<float, 6, 21> M = Eigen::Matrix<float, 6, 21>::Zero();
+  M.block<3, 3>(0, 0) = Eigen::AngleAxisf(normal(gen), Eigen::Vector3f(normal(gen), normal(gen),
+    normal(gen)).normalized()).matrix();
+  Eigen::Vector3f lever(0.1f * normal(gen), 0.1f * normal(gen), 0.1f * normal(gen));
+  M.block<3, 3>(3, 0) << 0, -lever(2), lever(1), lever(2), 0, -lever(0), -lever(1), lever(0), 0;
+  M.block<3, 3>(3, 12) = Eigen::AngleAxisf(normal(gen), Eigen::Vector3f::UnitZ()).matrix();
+  in.M.assign(M.data(), M.data() + M.size());
+
+  // the augmentation that is replaced, the others move down one slot
+  int dropped = std::uniform_int_distribution<int>(0, 15)(gen);
+  for (int a = 0; a < 16; a++)
+    if (a != dropped)
+      for (int j = 0; j < 6; j++)
+        in.kept_rows.push_back(21 + 6 * a + j + 1);
+  return in;
+}
+
+namespace reference {
+
+// The predictor's MATLAB Function2 as generated in est_estimator.cpp for the
+// flight size, P_size of 117: the top right 15 x 102 block of P, with the
+// columns of the valid augmentations multiplied by the state transition
+// matrix. The generated loop skips zeros of P and copies the index matrix on
+// every multiply add.
+inline void propagate_covariance(float* state_trans, unsigned int aug_state, float* P_in, int P_size,
+        float* P_cross) {
+  static float Selector1[1530];
+  int8_t valid_indx_mat_data[102], valid_indx_mat_data_0[102], c_data_0[17];
+  int32_t i, b_m, i_0, br, nx, ar, s12_iter, O_sizes_idx_0, num_original, C_sizes_idx_1;
+  int32_t handrail_knowledge_dims;
+  if (P_size != 117)
+    return;
+
+  for (i = 0; i < 102; i++)
+    for (b_m = 0; b_m < 15; b_m++)
+      P_cross[b_m + 15 * i] = P_in[(15 + i) * 117 + b_m];
+
+  br = 0;
+  for (num_original = 0; num_original < 17; num_original++)
+    if (aug_state & (1u << num_original))
+      c_data_0[br++] = static_cast<int8_t>(num_original + 1);
+  handrail_knowledge_dims = br;
+  for (i = 0; i <= handrail_knowledge_dims - 1; i++)
+    for (b_m = 0; b_m < 6; b_m++)
+      valid_indx_mat_data[b_m + 6 * i] = static_cast<int8_t>((c_data_0[i] - 1) * 6 + b_m + 1);
+
+  C_sizes_idx_1 = 6 * handrail_knowledge_dims;
+  for (i = 0; i <= C_sizes_idx_1 - 1; i++)
+    for (b_m = 0; b_m < 15; b_m++)
+      Selector1[b_m + 15 * i] = 0.0F;
+  if (6 * handrail_knowledge_dims != 0) {
+    num_original = (6 * handrail_knowledge_dims - 1) * 15;
+    br = 0;
+    for (nx = 0; nx <= num_original; nx += 15) {
+      ar = -1;
+      for (i = br; i + 1 <= br + 15; i++) {
+        for (b_m = 0; b_m <= handrail_knowledge_dims - 1; b_m++)
+          for (i_0 = 0; i_0 < 6; i_0++)
+            valid_indx_mat_data_0[i_0 + 6 * b_m] = valid_indx_mat_data[6 * b_m + i_0];
+        if (P_in[(valid_indx_mat_data_0[i / 15] + 14) * 117 + i % 15] != 0.0F) {
+          s12_iter = ar;
+          for (O_sizes_idx_0 = nx; O_sizes_idx_0 + 1 <= nx + 15; O_sizes_idx_0++) {
+            s12_iter++;
+            for (b_m = 0; b_m <= handrail_knowledge_dims - 1; b_m++)
+              for (i_0 = 0; i_0 < 6; i_0++)
+                valid_indx_mat_data_0[i_0 + 6 * b_m] = valid_indx_mat_data[6 * b_m + i_0];
+            Selector1[O_sizes_idx_0] += P_in[(valid_indx_mat_data_0[i / 15] + 14) * 117 + i % 15] *
+              state_trans[s12_iter];
+          }
+        }
+        ar += 15;
+      }
+      br += 15;
+    }
+  }
+
+  for (i = 0; i <= handrail_knowledge_dims - 1; i++)
+    for (b_m = 0; b_m < 6; b_m++)
+      valid_indx_mat_data_0[b_m + 6 * i] = valid_indx_mat_data[6 * i + b_m];
+  for (i = 0; i <= C_sizes_idx_1 - 1; i++)
+    for (b_m = 0; b_m < 15; b_m++)
+      P_cross[b_m + 15 * (valid_indx_mat_data_0[i] - 1)] = Selector1[15 * i + b_m];
+}
+
+// The covariance part of eml_augment_camera_of as generated in
+// est_estimator.cpp for the flight size, P_size of 117 and 90 kept rows: the
+// kept augmentations are shifted down, then the new one is filled in with the
+// products of the whole 6 x 21 M, P = [A MA' C; MA MAM' MC; G (MC)' J]. The
+// generated code computes M A twice.
+inline void augment_covariance(float* M, double* kept_rows, int num_kept, float* P_in, int P_size, float* P_out) {
+  static float Switch1[13689], Switch1_c[1890], Switch1_k[8100];
+  float M_0[126], M_1[126], M_2[540];
+  int32_t i, b_m, i_0;
+  if (P_size != 117 || num_kept != 90)
+    return;
+  memcpy(Switch1, P_in, sizeof(Switch1));
+
+  // Section D
+  for (i = 0; i < 21; i++)
+    for (b_m = 0; b_m < 90; b_m++)
+      Switch1[b_m + 117 * i + 27] = P_in[117 * i + static_cast<int32_t>(kept_rows[b_m]) - 1];
+  // Section B
+  for (i = 0; i < 90; i++)
+    for (b_m = 0; b_m < 21; b_m++)
+      Switch1_c[b_m + 21 * i] = Switch1[(static_cast<int32_t>(kept_rows[i]) - 1) * 117 + b_m];
+  for (i = 0; i < 90; i++)
+    memcpy(&Switch1[i * 117 + 3159], &Switch1_c[i * 21], 21U * sizeof(float));
+  // Section E
+  for (i = 0; i < 90; i++)
+    for (b_m = 0; b_m < 90; b_m++)
+      Switch1_k[b_m + 90 * i] = Switch1[(static_cast<int32_t>(kept_rows[i]) - 1) * 117 +
+                                        static_cast<int32_t>(kept_rows[b_m]) - 1];
+  for (i = 0; i < 90; i++)
+    memcpy(&Switch1[i * 117 + 3186], &Switch1_k[i * 90], 90U * sizeof(float));
+
+  // Center and top left sections
+  for (i = 0; i < 6; i++) {
+    for (b_m = 0; b_m < 21; b_m++) {
+      M_0[i + 6 * b_m] = 0.0F;
+      for (i_0 = 0; i_0 < 21; i_0++)
+        M_0[i + 6 * b_m] += M[6 * i_0 + i] * Switch1[117 * b_m + i_0];
+    }
+    for (b_m = 0; b_m < 6; b_m++) {
+      Switch1[i + 117 * (21 + b_m) + 21] = 0.0F;
+      for (i_0 = 0; i_0 < 21; i_0++)
+        Switch1[i + 117 * (21 + b_m) + 21] = Switch1[(21 + b_m) * 117 + i + 21] + M_0[6 * i_0 + i] * M[6 * i_0 + b_m];
+    }
+    for (b_m = 0; b_m < 21; b_m++) {
+      M_1[i + 6 * b_m] = 0.0F;
+      for (i_0 = 0; i_0 < 21; i_0++)
+        M_1[i + 6 * b_m] += M[6 * i_0 + i] * Switch1[117 * b_m + i_0];
+    }
+  }
+  for (i = 0; i < 21; i++)
+    for (b_m = 0; b_m < 6; b_m++)
+      Switch1[b_m + 117 * i + 21] = M_1[6 * i + b_m];
+  for (i = 0; i < 6; i++)
+    for (b_m = 0; b_m < 21; b_m++)
+      M_0[b_m + 21 * i] = Switch1[117 * b_m + i + 21];
+  for (i = 0; i < 6; i++)
+    memcpy(&Switch1[i * 117 + 2457], &M_0[i * 21], 21U * sizeof(float));
+
+  // Bottom right sections
+  for (i = 0; i < 6; i++)
+    for (b_m = 0; b_m < 90; b_m++) {
+      M_2[i + 6 * b_m] = 0.0F;
+      for (i_0 = 0; i_0 < 21; i_0++)
+        M_2[i + 6 * b_m] += Switch1[(27 + b_m) * 117 + i_0] * M[6 * i_0 + i];
+    }
+  for (i = 0; i < 90; i++)
+    for (b_m = 0; b_m < 6; b_m++)
+      Switch1[b_m + 117 * (27 + i) + 21] = M_2[6 * i + b_m];
+  for (i = 0; i < 6; i++)
+    for (b_m = 0; b_m < 90; b_m++)
+      M_2[b_m + 90 * i] = Switch1[(27 + b_m) * 117 + i + 21];
+  for (i = 0; i < 6; i++)
+    memcpy(&Switch1[i * 117 + 2484], &M_2[i * 90], 90U * sizeof(float));
+
+  memcpy(P_out, Switch1, sizeof(Switch1));
+}
+
+}  // namespace reference
+
+#endif  // GNC_CXX_FUNCTIONS_TEST_MODEL_COVARIANCE_H_
@@ -0,0 +1,93 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Test estimator covariance kernels
+// These tests check the block propagation and augmentation of the covariance
+// against the generated code they replace.
+
+#include <augment_covariance.h>
+#include <propagate_covariance.h>
+
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "model_covariance.h"
+
+namespace {
+
+typedef Eigen::Map<Eigen::MatrixXf> MatrixMap;
+
+float RelativeError(std::vector<float> & expected, std::vector<float> & actual, int size) {
+  MatrixMap e(expected.data(), size, size), a(actual.data(), size, size);
+  return (e - a).norm() / e.norm();
+}
+
+void ExpectPropagationEquivalent(CovarianceInputs & in) {
+  const int n = in.size;
+  std::vector<float> expected(15 * (n - 15)), actual(15 * (n - 15));
+  reference::propagate_covariance(in.state_trans.data(), in.aug_state, in.P.data(), n, expected.data());
+  propagate_covariance(in.state_trans.data(), in.aug_state, in.P.data(), n, actual.data());
+  Eigen::Map<Eigen::MatrixXf> e(expected.data(), 15, n - 15), a(actual.data(), 15, n - 15);
+  EXPECT_LT((e - a).norm() / e.norm(), 1e-5);
+}
+
+void ExpectAugmentationEquivalent(CovarianceInputs & in) {
+  const int n = in.size;
+  const int num_kept = in.kept_rows.size();
+  std::vector<float> expected(n * n), actual(n * n);
+  reference::augment_covariance(in.M.data(), in.kept_rows.data(), num_kept, in.P.data(), n, expected.data());
+  augment_covariance(in.M.data(), in.kept_rows.data(), num_kept, in.P.data(), n, actual.data());
+  EXPECT_LT(RelativeError(expected, actual, n), 1e-5);
+
+  std::vector<float> P = in.P;
+  augment_covariance(in.M.data(), in.kept_rows.data(), num_kept, P.data(), n, P.data());
+  EXPECT_EQ(actual, P);
+}
+
+}  // namespace
+
+TEST(CovarianceKernels, PropagationMatchesModel) {
+  for (unsigned int seed = 0; seed < 5; seed++) {
+    CovarianceInputs in = GenerateCovarianceInputs(seed);
+    ExpectPropagationEquivalent(in);
+  }
+}
+
+TEST(CovarianceKernels, PropagationSkipsInvalidAugmentations) {
+  const unsigned int aug_states[] = {0, 1, 0x2a, 0x10001};
+  for (unsigned int aug_state : aug_states) {
+    CovarianceInputs in = GenerateCovarianceInputs(aug_state, aug_state);
+    ExpectPropagationEquivalent(in);
+  }
+}
+
+TEST(CovarianceKernels, AugmentationMatchesModel) {
+  for (unsigned int seed = 0; seed < 5; seed++) {
+    CovarianceInputs in = GenerateCovarianceInputs(seed);
+    ExpectAugmentationEquivalent(in);
+  }
+}
+
+TEST(CovarianceKernels, AugmentationWithDenseJacobian) {
+  CovarianceInputs in = GenerateCovarianceInputs(7);
+  for (size_t i = 0; i < in.M.size(); i++)
+    in.M[i] += 0.1f;
+  ExpectAugmentationEquivalent(in);
+}
@@ -0,0 +1,329 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Test estimator update kernels
+// These tests check the workspace based kernels against the original ones and
+// that they do not allocate once warmed up. Where the original ones gate on
+// the wrong covariance or rotate the wrong columns, the optical flow kernel is
+// checked against a direct computation instead.
+
+#include <compute_delta_state_and_cov.h>
+#include <of_residual_and_h.h>
+
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "kernel_inputs.h"
+#include "reference_kernels.h"
+
+// Count every heap allocation of the test binary
+static std::atomic<int> allocations(0);
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+namespace {
+
+typedef Eigen::Map<Eigen::MatrixXf> MatrixMap;
+
+// Difference relative to the expected values, the kernels are only equivalent
+// up to float rounding
+float RelativeError(const Eigen::MatrixXf & expected, const Eigen::MatrixXf & actual) {
+  const float norm = expected.norm();
+  return norm > 0.0f ? (expected - actual).norm() / norm : actual.norm();
+}
+
+float RelativeError(std::vector<float> & expected, std::vector<float> & actual) {
+  return RelativeError(MatrixMap(expected.data(), expected.size(), 1),
+                       MatrixMap(actual.data(), actual.size(), 1));
+}
+
+// The autocode builds with -ffast-math, so std::isnan cannot be trusted
+bool IsNan(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return (bits & 0x7f800000) == 0x7f800000 && (bits & 0x007fffff) != 0;
+}
+
+void ExpectEquivalent(KernelInputs & in) {
+  KernelOutputs expected(in), actual(in);
+  // features skipped for too few observations keep their previous distance
+  std::fill(expected.mahal_dists.begin(), expected.mahal_dists.end(), -1.0f);
+  std::fill(actual.mahal_dists.begin(), actual.mahal_dists.end(), -1.0f);
+  RunKernels(in, &expected, reference::of_residual_and_h, reference::compute_delta_state_and_cov);
+  RunKernels(in, &actual, of_residual_and_h, compute_delta_state_and_cov);
+
+  EXPECT_EQ(expected.of_error, actual.of_error);
+  EXPECT_EQ(expected.augs_bitmask, actual.augs_bitmask);
+  EXPECT_EQ(expected.num_tracks, actual.num_tracks);
+  EXPECT_EQ(expected.delta_error, actual.delta_error);
+  for (int j = 0; j < in.num_features; j++) {
+    if (j < in.num_points)
+      EXPECT_NEAR(expected.mahal_dists[j], actual.mahal_dists[j], 1e-4 + 1e-3 * std::fabs(expected.mahal_dists[j]));
+    else
+      EXPECT_TRUE(IsNan(expected.mahal_dists[j]) && IsNan(actual.mahal_dists[j]));
+  }
+  EXPECT_EQ(expected.R, actual.R);
+
+  // The compressed H is rank deficient, as moving all poses together is not
+  // observable, so the rows spanning its null space are not unique. The update
+  // only depends on H'H and H'r, which are.
+  const int n = in.CovarianceSize();
+  MatrixMap H_expected(expected.H.data(), 6 * in.num_aug, n), H_actual(actual.H.data(), 6 * in.num_aug, n);
+  MatrixMap r_expected(expected.r.data(), 6 * in.num_aug, 1), r_actual(actual.r.data(), 6 * in.num_aug, 1);
+  if (expected.of_error == 0) {
+    EXPECT_LT(RelativeError(H_expected.transpose() * H_expected, H_actual.transpose() * H_actual), 1e-4);
+    EXPECT_LT(RelativeError(H_expected.transpose() * r_expected, H_actual.transpose() * r_actual), 1e-4);
+  } else {
+    EXPECT_EQ(expected.r, actual.r);
+    EXPECT_EQ(expected.H, actual.H);
+  }
+  EXPECT_LT(RelativeError(expected.delta_state, actual.delta_state), 1e-3);
+  EXPECT_LT(RelativeError(expected.P, actual.P), 1e-3);
+}
+
+// The optical flow update computed directly in double. Each feature's
+// residual and Jacobian are projected on the left null space of its H_f_j and
+// gated on the covariance of the augmentations used. The block of the k-th
+// used augmentation is at 6 * k, as in the kernel's output.
+struct DirectUpdate {
+  std::vector<double> mahal_dists;  // -1 for features not checked
+  Eigen::MatrixXd HtH;              // H'H and H'r of the accepted features
+  Eigen::VectorXd Htr;
+  int num_tracks;
+};
+
+DirectUpdate ComputeDirectUpdate(KernelInputs & in) {
+  Eigen::Map<Eigen::MatrixXf> of_measured(in.of_measured.data(), 2 * in.num_aug, in.num_features);
+  Eigen::Map<Eigen::MatrixXf> global_points(in.global_points.data(), 4, in.num_features);
+  Eigen::Map<Eigen::MatrixXf> camera_tf_global(in.camera_tf_global.data(), 4 * in.num_aug, 4);
+  Eigen::Map<Eigen::MatrixXi> valid(in.valid.data(), in.num_features, in.num_aug);
+  MatrixMap P(in.P.data(), in.CovarianceSize(), in.CovarianceSize());
+
+  std::vector<int> used_augs;
+  for (int i = 0; i < in.num_aug; i++)
+    if ((valid.col(i).array() > 0).any())
+      used_augs.push_back(i);
+  const int n = 6 * used_augs.size();
+  Eigen::MatrixXd reduced_P(n, n);
+  for (size_t k = 0; k < used_augs.size(); k++)
+    for (size_t l = 0; l < used_augs.size(); l++)
+      reduced_P.block<6, 6>(6 * k, 6 * l) = P.block<6, 6>(21 + 6 * used_augs[k], 21 + 6 * used_augs[l]).cast<double>();
+  const double r_var = std::pow(static_cast<double>(in.inv_focal_length) * in.of_r_mag, 2);
+
+  DirectUpdate direct;
+  direct.mahal_dists.assign(in.num_features, -1.0);
+  direct.HtH = Eigen::MatrixXd::Zero(n, n);
+  direct.Htr = Eigen::VectorXd::Zero(n);
+  direct.num_tracks = 0;
+  for (int j = 0; j < in.num_points; j++) {
+    std::vector<int> seen;
+    for (size_t k = 0; k < used_augs.size(); k++)
+      if (valid(j, used_augs[k]))
+        seen.push_back(k);
+    if (seen.size() < 2)
+      continue;
+    const int rows = 2 * seen.size();
+    Eigen::MatrixXd H_f(rows, 3), H_x = Eigen::MatrixXd::Zero(rows, n);
+    Eigen::VectorXd r(rows);
+    for (size_t i = 0; i < seen.size(); i++) {
+      const int aug = used_augs[seen[i]];
+      Eigen::Matrix<double, 3, 4> c_tf_g = camera_tf_global.block<3, 4>(4 * aug, 0).cast<double>();
+      Eigen::Vector3d c = c_tf_g * global_points.col(j).cast<double>();
+      Eigen::Matrix<double, 2, 3> prefix;
+      prefix << 1, 0, -c(0) / c(2), 0, 1, -c(1) / c(2);
+      prefix /= c(2);
+      Eigen::Matrix3d skew;
+      skew << 0, -c(2), c(1), c(2), 0, -c(0), -c(1), c(0), 0;
+      H_x.block<2, 3>(2 * i, 6 * seen[i]) = prefix * skew;
+      H_x.block<2, 3>(2 * i, 6 * seen[i] + 3) = -prefix * c_tf_g.block<3, 3>(0, 0);
+      H_f.block<2, 3>(2 * i, 0) = prefix * c_tf_g.block<3, 3>(0, 0);
+      r.segment<2>(2 * i) = of_measured.block<2, 1>(2 * aug, j).cast<double>() - c.head<2>() / c(2);
+    }
+    Eigen::MatrixXd Q = Eigen::HouseholderQR<Eigen::MatrixXd>(H_f).householderQ();
+    Eigen::MatrixXd N = Q.rightCols(rows - 3);
+    Eigen::MatrixXd H_j = N.transpose() * H_x;
+    Eigen::VectorXd r_j = N.transpose() * r;
+    Eigen::MatrixXd S = H_j * reduced_P * H_j.transpose();
+    S.diagonal().array() += r_var;
+    direct.mahal_dists[j] = std::sqrt(r_j.dot(S.ldlt().solve(r_j)));
+    if (direct.mahal_dists[j] > in.mahal_distance_max)
+      continue;
+    direct.HtH += H_j.transpose() * H_j;
+    direct.Htr += H_j.transpose() * r_j;
+    direct.num_tracks++;
+  }
+  return direct;
+}
+
+// Largest error of the kernel's Mahalanobis distances relative to the direct
+// ones
+double MahalanobisError(const DirectUpdate & direct, const KernelOutputs & out) {
+  double error = 0.0;
+  for (size_t j = 0; j < direct.mahal_dists.size(); j++)
+    if (direct.mahal_dists[j] >= 0.0)
+      error = std::max(error, std::fabs(out.mahal_dists[j] - direct.mahal_dists[j]) / (1e-2 + direct.mahal_dists[j]));
+  return error;
+}
+
+void ExpectDirect(KernelInputs & in) {
+  DirectUpdate direct = ComputeDirectUpdate(in);
+  KernelOutputs actual(in);
+  RunKernels(in, &actual, of_residual_and_h, compute_delta_state_and_cov);
+  ASSERT_EQ(0, actual.of_error);
+  EXPECT_EQ(direct.num_tracks, actual.num_tracks);
+  EXPECT_LT(MahalanobisError(direct, actual), 1e-3);
+  const int n = direct.Htr.size();
+  MatrixMap H(actual.H.data(), 6 * in.num_aug, in.CovarianceSize()), r(actual.r.data(), 6 * in.num_aug, 1);
+  EXPECT_LT(RelativeError(direct.HtH.cast<float>(), H.topLeftCorner(n, n).transpose() * H.topLeftCorner(n, n)), 1e-3);
+  EXPECT_LT(RelativeError(direct.Htr.cast<float>(), H.topLeftCorner(n, n).transpose() * r.topRows(n)), 1e-3);
+
+  // the original kernel gave other distances
+  KernelOutputs original(in);
+  RunKernels(in, &original, reference::of_residual_and_h, reference::compute_delta_state_and_cov);
+  EXPECT_GT(MahalanobisError(direct, original), 1e-2);
+}
+
+}  // namespace
+
+TEST(EstimatorKernels, OpticalFlowUpdateMatchesReference) {
+  for (unsigned int seed = 0; seed < 20; seed++) {
+    KernelInputs in = GenerateKernelInputs(seed);
+    ExpectEquivalent(in);
+  }
+}
+
+TEST(EstimatorKernels, PartialUpdateMatchesReference) {
+  // only some augmentations observe features, and some features are missing
+  for (unsigned int seed = 0; seed < 10; seed++) {
+    KernelInputs in = GenerateKernelInputs(seed, 16, 50, 6 + seed);
+    in.num_points = 40;
+    ExpectEquivalent(in);
+  }
+}
+
+TEST(EstimatorKernels, FourAugmentationsMatchesDirect) {
+  // the original kernel's shortcut for features seen by all four
+  // augmentations rotated the wrong columns of their second pair
+  for (unsigned int seed = 0; seed < 5; seed++) {
+    KernelInputs in = GenerateKernelInputs(seed, 16, 50, 4);
+    ExpectDirect(in);
+  }
+}
+
+TEST(EstimatorKernels, ScatteredAugmentationsMatchesDirect) {
+  // the original kernel gated on the covariance of the leading augmentations
+  // rather than the used ones
+  for (unsigned int seed = 0; seed < 5; seed++) {
+    KernelInputs in = GenerateKernelInputs(seed, 16, 50, 5);
+    ScatterAugmentations({1, 4, 6, 9, 10}, &in);
+    ExpectDirect(in);
+    in = GenerateKernelInputs(seed, 16, 50, 6);
+    ScatterAugmentations({0, 2, 3, 7, 8, 12}, &in);
+    ExpectDirect(in);
+  }
+}
+
+TEST(EstimatorKernels, TooFewAugmentationsMatchesReference) {
+  KernelInputs in = GenerateKernelInputs(0, 16, 50, 2);
+  ExpectEquivalent(in);
+}
+
+TEST(EstimatorKernels, LandmarkUpdateMatchesReference) {
+  // a dense six row update of a single block, as for landmarks
+  KernelInputs in = GenerateKernelInputs(1);
+  const int n = in.CovarianceSize();
+  std::vector<float> r(6), H(6 * n), R(36, 0.0f);
+  for (int i = 0; i < 6; i++) {
+    r[i] = 0.01f * (i + 1);
+    R[7 * i] = 1e-3f;
+  }
+  for (int i = 0; i < 6 * n; i++)
+    H[i] = std::sin(0.37f * i);
+  std::vector<float> expected_delta(n), expected_P(n * n), actual_delta(n), actual_P(n * n);
+  EXPECT_EQ(0, reference::compute_delta_state_and_cov(r.data(), 0, H.data(), 6, n, 1, R.data(),
+    in.P.data(), expected_delta.data(), expected_P.data()));
+  EXPECT_EQ(0, compute_delta_state_and_cov(r.data(), 0, H.data(), 6, n, 1, R.data(),
+    in.P.data(), actual_delta.data(), actual_P.data()));
+  EXPECT_LT(RelativeError(expected_delta, actual_delta), 1e-3);
+  EXPECT_LT(RelativeError(expected_P, actual_P), 1e-4);
+}
+
+TEST(EstimatorKernels, NoAllocations) {
+  std::vector<KernelInputs> inputs;
+  for (unsigned int seed = 0; seed < 5; seed++)
+    inputs.push_back(GenerateKernelInputs(seed));
+  std::vector<KernelOutputs> outputs;
+  for (size_t i = 0; i < inputs.size(); i++)
+    outputs.push_back(KernelOutputs(inputs[i]));
+  // the first call sets up the workspaces
+  RunKernels(inputs[0], &outputs[0], of_residual_and_h, compute_delta_state_and_cov);
+  int before = allocations;
+  for (size_t i = 0; i < inputs.size(); i++)
+    RunKernels(inputs[i], &outputs[i], of_residual_and_h, compute_delta_state_and_cov);
+  EXPECT_EQ(before, allocations);
+  EXPECT_EQ(0, outputs[0].delta_error);
+}
+
+TEST(EstimatorKernels, ConcurrentCallsMatchSerial) {
+  // every thread has its own workspace, so estimators can run side by side
+  std::vector<KernelInputs> inputs;
+  for (unsigned int seed = 0; seed < 4; seed++)
+    inputs.push_back(GenerateKernelInputs(seed));
+  std::vector<KernelOutputs> serial, concurrent;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    serial.push_back(KernelOutputs(inputs[i]));
+    concurrent.push_back(KernelOutputs(inputs[i]));
+    RunKernels(inputs[i], &serial[i], of_residual_and_h, compute_delta_state_and_cov);
+  }
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < inputs.size(); i++)
+    threads.push_back(std::thread([&inputs, &concurrent, i]() {
+      for (int k = 0; k < 20; k++)
+        RunKernels(inputs[i], &concurrent[i], of_residual_and_h, compute_delta_state_and_cov);
+    }));
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  for (size_t i = 0; i < inputs.size(); i++) {
+    EXPECT_EQ(serial[i].H, concurrent[i].H);
+    EXPECT_EQ(serial[i].P, concurrent[i].P);
+  }
+}
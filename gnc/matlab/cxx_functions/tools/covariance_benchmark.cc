@@ -0,0 +1,94 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Times the block covariance propagation and augmentation of the estimator
+// against the generated code they replace, and counts the floating point
+// operations of both:
+//
+//   covariance_benchmark [runs]
+//
+// Propagation runs on every estimator step, augmentation on every optical
+// flow registration.
+
+#include <augment_covariance.h>
+#include <propagate_covariance.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../test/model_covariance.h"
+
+namespace {
+
+template <typename Kernel>
+double Time(int runs, Kernel kernel) {
+  kernel();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int k = 0; k < runs; k++)
+    kernel();
+  std::chrono::duration<double, std::micro> dt = std::chrono::steady_clock::now() - start;
+  return dt.count() / runs;
+}
+
+int Popcount(unsigned int bits) {
+  int count = 0;
+  for (; bits; bits &= bits - 1)
+    count++;
+  return count;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int runs = (argc > 1 ? atoi(argv[1]) : 1000);
+
+  CovarianceInputs in = GenerateCovarianceInputs(0);
+  const int n = in.size;
+  const int num_kept = in.kept_rows.size();
+  std::vector<float> P_out(n * n);
+
+  // multiply adds count as two operations. The generated code already only
+  // multiplies the valid augmentations when propagating, its time goes into
+  // copying the index matrix for every multiply add. When augmenting it uses all
+  // 21 columns of M, and computes M A twice.
+  const double propagate = 2.0 * 15 * 15 * 6 * Popcount(in.aug_state);
+  const double model_augment = 2.0 * (2 * 6 * 21 * 21 + 6 * 6 * 21 + 6 * 21 * num_kept);
+  int used = 0;
+  for (int c = 0; c < 21; c++)
+    for (int r = 0; r < 6; r++)
+      if (in.M[6 * c + r] != 0.0f) {
+        used++;
+        break;
+      }
+  const double augment = 2.0 * 6 * used * n + 2.0 * 6 * 6 * used;
+
+  printf("%-24s %12s %12s %12s %12s\n", "kernel", "model_flops", "block_flops", "model_us", "block_us");
+  printf("%-24s %12.0f %12.0f %12.1f %12.1f\n", "propagate_covariance", propagate, propagate,
+    Time(runs, [&]() {
+      reference::propagate_covariance(in.state_trans.data(), in.aug_state, in.P.data(), n, P_out.data()); }),
+    Time(runs, [&]() {
+      propagate_covariance(in.state_trans.data(), in.aug_state, in.P.data(), n, P_out.data()); }));
+  printf("%-24s %12.0f %12.0f %12.1f %12.1f\n", "augment_covariance", model_augment, augment,
+    Time(runs, [&]() {
+      reference::augment_covariance(in.M.data(), in.kept_rows.data(), num_kept, in.P.data(), n, P_out.data()); }),
+    Time(runs, [&]() {
+      augment_covariance(in.M.data(), in.kept_rows.data(), num_kept, in.P.data(), n, P_out.data()); }));
+  return 0;
+}
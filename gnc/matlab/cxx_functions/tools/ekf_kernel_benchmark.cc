@@ -0,0 +1,106 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * 
+ * All rights reserved.
+ * 
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Times the estimator's optical flow update kernels against the original
+// implementations. The inputs are read from a file written by
+// SaveKernelInputs, or generated if none is given:
+//
+//   ekf_kernel_benchmark [inputs.txt] [runs]
+//
+// If the inputs file does not exist it is created from generated inputs, so
+// the same set can be replayed later.
+
+#include <compute_delta_state_and_cov.h>
+#include <of_residual_and_h.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../test/kernel_inputs.h"
+#include "../test/reference_kernels.h"
+
+namespace {
+
+template <typename OfResidual, typename ComputeDelta>
+double Time(std::vector<KernelInputs> & inputs, std::vector<KernelOutputs> & outputs, int runs,
+    OfResidual of_residual, ComputeDelta compute_delta) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int k = 0; k < runs; k++)
+    for (size_t i = 0; i < inputs.size(); i++)
+      RunKernels(inputs[i], &outputs[i], of_residual, compute_delta);
+  std::chrono::duration<double, std::micro> dt = std::chrono::steady_clock::now() - start;
+  return dt.count() / (runs * inputs.size());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string filename = (argc > 1 ? argv[1] : "");
+  int runs = (argc > 2 ? atoi(argv[2]) : 100);
+
+  std::vector<KernelInputs> inputs;
+  if (!filename.empty() && LoadKernelInputs(filename, &inputs)) {
+    printf("Loaded %zu updates from %s\n", inputs.size(), filename.c_str());
+  } else {
+    for (unsigned int seed = 0; seed < 20; seed++)
+      inputs.push_back(GenerateKernelInputs(seed));
+    printf("Generated %zu updates\n", inputs.size());
+    if (!filename.empty() && !SaveKernelInputs(filename, inputs)) {
+      fprintf(stderr, "Could not write %s\n", filename.c_str());
+      return 1;
+    }
+  }
+
+  std::vector<KernelOutputs> outputs;
+  for (size_t i = 0; i < inputs.size(); i++)
+    outputs.push_back(KernelOutputs(inputs[i]));
+
+  // one pass to warm up the caches and the workspaces
+  Time(inputs, outputs, 1, reference::of_residual_and_h, reference::compute_delta_state_and_cov);
+  Time(inputs, outputs, 1, of_residual_and_h, compute_delta_state_and_cov);
+
+  printf("%-24s %14s %14s\n", "kernel", "reference_us", "current_us");
+  printf("%-24s %14.1f %14.1f\n", "of_residual_and_h",
+    Time(inputs, outputs, runs, reference::of_residual_and_h, [](float*, int, float*, int, int,
+      unsigned int, float*, float*, float*, float*) { return 0; }),
+    Time(inputs, outputs, runs, of_residual_and_h, [](float*, int, float*, int, int,
+      unsigned int, float*, float*, float*, float*) { return 0; }));
+  // the residual is computed once, then only the covariance update is timed
+  for (size_t i = 0; i < inputs.size(); i++)
+    RunKernels(inputs[i], &outputs[i], of_residual_and_h, compute_delta_state_and_cov);
+  std::chrono::steady_clock::time_point start;
+  double times[2];
+  for (int k = 0; k < 2; k++) {
+    start = std::chrono::steady_clock::now();
+    for (int run = 0; run < runs; run++)
+      for (size_t i = 0; i < inputs.size(); i++) {
+        KernelInputs & in = inputs[i];
+        KernelOutputs & out = outputs[i];
+        (k == 0 ? reference::compute_delta_state_and_cov : compute_delta_state_and_cov)(
+          out.r.data(), out.of_error, out.H.data(), 6 * in.num_aug, in.CovarianceSize(),
+          out.augs_bitmask, out.R.data(), in.P.data(), out.delta_state.data(), out.P.data());
+      }
+    std::chrono::duration<double, std::micro> dt = std::chrono::steady_clock::now() - start;
+    times[k] = dt.count() / (runs * inputs.size());
+  }
+  printf("%-24s %14.1f %14.1f\n", "compute_delta_state_and_cov", times[0], times[1]);
+  return 0;
+}
@@ -78,38 +78,46 @@ ase_of_num_aug = double(ase_of_num_aug); % Cast this back to double to not cause
   of_omega_aug = double(aug_omega);
   
   % Augmenting the covariance matrix
-  % Move covariances down the stack:
-  % P = [A B C] then P+1 = [A 0 B]
-  %     [D E F]            [0 0 0]
-  %     [G H J]            [D 0 E]
-  imu_ml_prange = 1:21;
-  of_out_prange = 21 + 6 + 1:21 + 6 * ase_of_num_aug;
-  % Section D
-  P(of_out_prange, imu_ml_prange) = P(of_in_prange, imu_ml_prange);
-  % Section B
-  P(imu_ml_prange, of_out_prange) = P(imu_ml_prange, of_in_prange);
-  % Section E
-  P(of_out_prange, of_out_prange) = P(of_in_prange, of_in_prange);
-  % Now actually place an augmentation of IMU into OF
   % M here is actually just the left part of J as defined in equation 24 in the
   % Visinav paper by Mourikis '09 + space for the ML augmentation.
   cov_datatype = class(P_in);
   M = [cast(camera_rot_body, 'like', P) zeros(3, 12, cov_datatype) zeros(3, 6, cov_datatype);
        cast(skew(imu_rot_global' * tun_abp_p_cam_body_body'), 'like', P) zeros(3, 9, cov_datatype) eye(3, cov_datatype) zeros(3, 6, cov_datatype)];
-  of_new_prange = 15 + 6 + 1:15 + 6 + 6;
-%   J = [eye(21, size(P, 2)); M zeros(6, size(P, 2) - size(M, 2)); zeros(size(P, 1) - 27, 27) eye(size(P, 1) - 27, size(P, 2) - 27)];
-%   P = J * P * J';
-  % P = [A 0 C] then P+1 = [A  AMt  C ]
-  %     [0 0 0]            [MA MAMt MC]
-  %     [G 0 J]            [G  GMt  J ]
-  % Center section
-  P(of_new_prange, of_new_prange) = M * P(imu_ml_prange, imu_ml_prange) * M';
-  % Top left sections
-  P(of_new_prange, imu_ml_prange) = M * P(imu_ml_prange, imu_ml_prange);
-  P(imu_ml_prange, of_new_prange) = P(of_new_prange, imu_ml_prange)';
-  % Bottom right sections
-  P(of_new_prange, of_out_prange) = M * P(imu_ml_prange, of_out_prange);
-  P(of_out_prange, of_new_prange) = P(of_new_prange, of_out_prange)';
+  if coder.target('Rtw') && isa(P, 'single')
+    % The generated code calls the hand written version of the block products
+    % below, which only uses the nonzero columns of M (cxx_functions/augment_covariance.cpp)
+    coder.cinclude('augment_covariance.h');
+    coder.ceval('augment_covariance', coder.rref(M), coder.rref(of_in_prange), int32(numel(of_in_prange)), ...
+                coder.rref(P_in), int32(size(P, 1)), coder.wref(P));
+  else
+    % Move covariances down the stack:
+    % P = [A B C] then P+1 = [A 0 B]
+    %     [D E F]            [0 0 0]
+    %     [G H J]            [D 0 E]
+    imu_ml_prange = 1:21;
+    of_out_prange = 21 + 6 + 1:21 + 6 * ase_of_num_aug;
+    % Section D
+    P(of_out_prange, imu_ml_prange) = P(of_in_prange, imu_ml_prange);
+    % Section B
+    P(imu_ml_prange, of_out_prange) = P(imu_ml_prange, of_in_prange);
+    % Section E
+    P(of_out_prange, of_out_prange) = P(of_in_prange, of_in_prange);
+    % Now actually place an augmentation of IMU into OF
+    of_new_prange = 15 + 6 + 1:15 + 6 + 6;
+  %   J = [eye(21, size(P, 2)); M zeros(6, size(P, 2) - size(M, 2)); zeros(size(P, 1) - 27, 27) eye(size(P, 1) - 27, size(P, 2) - 27)];
+  %   P = J * P * J';
+    % P = [A 0 C] then P+1 = [A  AMt  C ]
+    %     [0 0 0]            [MA MAMt MC]
+    %     [G 0 J]            [G  GMt  J ]
+    % Center section
+    P(of_new_prange, of_new_prange) = M * P(imu_ml_prange, imu_ml_prange) * M';
+    % Top left sections
+    P(of_new_prange, imu_ml_prange) = M * P(imu_ml_prange, imu_ml_prange);
+    P(imu_ml_prange, of_new_prange) = P(of_new_prange, imu_ml_prange)';
+    % Bottom right sections
+    P(of_new_prange, of_out_prange) = M * P(imu_ml_prange, of_out_prange);
+    P(of_out_prange, of_new_prange) = P(of_new_prange, of_out_prange)';
+  end
 
   P_out = zeros(ase_total_num_states, cov_datatype);
   P_out(1:ase_total_num_states,1:ase_total_num_states) = P(1:ase_total_num_states,1:ase_total_num_states);
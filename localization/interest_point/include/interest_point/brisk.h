@@ -79,6 +79,29 @@ public:
     */
     CV_WRAP virtual void setOctaves(int octaves) { CV_UNUSED(octaves); return; }
     CV_WRAP virtual int getOctaves() const { return -1; }
+
+    /** @brief Prepare to detect keypoints in an image with any of several thresholds.
+    Builds the scale space of the image and finds its AGAST corners at min_threshold, once.
+    @param image image to detect keypoints in.
+    @param min_threshold lowest AGAST detection threshold score detectPrepared will be called with.
+    */
+    CV_WRAP virtual void prepareDetection(InputArray image, int min_threshold)
+    { CV_UNUSED(image); CV_UNUSED(min_threshold); return; }
+
+    /** @brief Detect keypoints in the image given to prepareDetection.
+    Gives the same keypoints as detect() with this threshold, without building the scale space or
+    finding the corners again.
+    @param threshold AGAST detection threshold score, not below the one given to prepareDetection.
+    @param keypoints the detected keypoints.
+    */
+    CV_WRAP virtual void detectPrepared(int threshold, CV_OUT std::vector<KeyPoint>& keypoints)
+    { CV_UNUSED(threshold); keypoints.clear(); return; }
+
+    /** @brief Count the corners found by prepareDetection.
+    @param histogram the number of corners, over all layers, with each AGAST score from 0 to 255.
+    */
+    CV_WRAP virtual void getCornerScoreHistogram(CV_OUT std::vector<int>& histogram) const
+    { histogram.assign(256, 0); return; }
 };
 
 }  // end namespace interest_point
@@ -0,0 +1,76 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef INTEREST_POINT_BRISK_KERNELS_H_
+#define INTEREST_POINT_BRISK_KERNELS_H_
+
+#include <cstddef>
+
+namespace interest_point {
+
+  // The inner loops of BRISK, each with a scalar version, which is the
+  // original code, and one using AVX2 on x86. The two give the same
+  // results, bit for bit. AVX2 is only used when built with
+  // ENABLE_BRISK_AVX2, and only if the processor has it, as the build
+  // otherwise targets machines without AVX.
+
+  // A point of the sampling pattern, relative to the keypoint
+  struct BriskPatternPoint {
+    float x;
+    float y;
+    float sigma;  // Gaussian smoothing sigma
+  };
+
+  // Whether the functions below use AVX2. This is false if the build or
+  // the processor does not have it, or cv::useOptimized() is false.
+  bool BriskKernelsVectorized();
+
+  // The OAST 9_16 score of each of n consecutive pixels starting at ptr,
+  // with the offsets to their circle from makeAgastOffsets. The score is
+  // the largest threshold with which the pixel is a corner, or 0, so with
+  // a threshold of 1 or more a pixel is a corner exactly when its score is
+  // not below the threshold. The circles of all the pixels must be in the
+  // image.
+  void OastScores9_16(const unsigned char* ptr, const int pixel[16], int n, unsigned char* scores);
+  void OastScores9_16Scalar(const unsigned char* ptr, const int pixel[16], int n, unsigned char* scores);
+
+  // The smoothed gray value at each of num_points points of the pattern
+  // placed at (key_x, key_y). The image and its integral image must be
+  // continuous. scaling and scaling2 are the fixed point factors for the
+  // sigma of each point, from BriskScalingFactors.
+  void SmoothedIntensities(const unsigned char* image, int image_cols, size_t image_step, const int* integral,
+                           float key_x, float key_y, const BriskPatternPoint* points, const int* scaling,
+                           const int* scaling2, int num_points, int* values);
+  void SmoothedIntensitiesScalar(const unsigned char* image, int image_cols, size_t image_step,
+                                 const int* integral, float key_x, float key_y, const BriskPatternPoint* points,
+                                 const int* scaling, const int* scaling2, int num_points, int* values);
+
+  // The fixed point factors used to smooth with this sigma. They are 0 if
+  // the sigma is too small to smooth with, and the point is interpolated.
+  void BriskScalingFactors(float sigma, int* scaling, int* scaling2);
+
+  // Sets bit k of the descriptor, in 32 bit words, when
+  // values[pairs_i[k]] > values[pairs_j[k]]. The other bits are left as
+  // they were.
+  void PackComparisons(const int* values, const int* pairs_i, const int* pairs_j, int num_pairs,
+                       unsigned int* descriptor);
+  void PackComparisonsScalar(const int* values, const int* pairs_i, const int* pairs_j, int num_pairs,
+                             unsigned int* descriptor);
+
+}  // namespace interest_point
+
+#endif  // INTEREST_POINT_BRISK_KERNELS_H_
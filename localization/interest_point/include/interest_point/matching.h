@@ -42,8 +42,15 @@ namespace interest_point {
                             cv::Mat* keypoints_description) = 0;
     virtual void TooFew(void) = 0;
     virtual void TooMany(void) = 0;
+    // Detects once with min_thresh, picks the threshold from the scores of
+    // what was found, and gives what detecting with that threshold would.
+    virtual void DetectSinglePass(const cv::Mat& image,
+                                  std::vector<cv::KeyPoint>* keypoints) = 0;
     void GetDetectorParams(int & min_features, int & max_features, int & max_retries,
                            double & min_thresh, double & default_thresh, double & max_thresh);
+    // The threshold is adjusted by each detection, and used by the next one
+    double GetDynamicThreshold() const {return dynamic_thresh_;}
+    virtual void SetDynamicThreshold(double thresh) = 0;
 
    protected:
     unsigned int min_features_, max_features_, max_retries_;
@@ -78,6 +85,9 @@ namespace interest_point {
     void GetDetectorParams(int & min_features, int & max_features, int & max_retries,
                            double & min_thresh, double & default_thresh, double & max_thresh);
 
+    double GetDynamicThreshold() const;
+    void SetDynamicThreshold(double thresh);
+
     friend bool operator== (FeatureDetector const& A, FeatureDetector const& B) {
       return (A.detector_name_ == B.detector_name_);
     }
@@ -69,6 +69,7 @@
 
 #include "interest_point/agast_score.h"
 #include "interest_point/brisk.h"
+#include "interest_point/brisk_kernels.h"
 #include <opencv2/imgproc.hpp>
 
 using namespace cv;
@@ -76,6 +77,8 @@ using namespace cv;
 namespace interest_point
 {
 
+class BriskScaleSpace;
+
 class BRISK_Impl : public interest_point::BRISK
 {
 public:
@@ -125,6 +128,10 @@ public:
         return octaves;
     }
 
+    virtual void prepareDetection(InputArray image, int min_threshold);
+    virtual void detectPrepared(int threshold, std::vector<KeyPoint>& keypoints);
+    virtual void getCornerScoreHistogram(std::vector<int>& histogram) const;
+
     // call this to generate the kernel:
     // circle of radius r (pixels), with n points;
     // short pairings with dMax, long pairings with dMin
@@ -149,11 +156,6 @@ protected:
     CV_PROP_RW int octaves;
 
     // some helper structures for the Brisk pattern representation
-    struct BriskPatternPoint{
-        float x;         // x coordinate relative to center
-        float y;         // x coordinate relative to center
-        float sigma;     // Gaussian smoothing sigma
-    };
     struct BriskShortPair{
         unsigned int i;  // index of the first pattern point
         unsigned int j;  // index of other pattern point
@@ -164,12 +166,10 @@ protected:
         int weighted_dx; // 1024.0/dx
         int weighted_dy; // 1024.0/dy
     };
-    inline int smoothedIntensity(const cv::Mat& image,
-                const cv::Mat& integral,const float key_x,
-                const float key_y, const unsigned int scale,
-                const unsigned int rot, const unsigned int point) const;
     // pattern properties
     BriskPatternPoint* patternPoints_;     //[i][rotation][scale]
+    std::vector<int> scaling_;             // fixed point smoothing factors [i][scale]
+    std::vector<int> scaling2_;
     unsigned int points_;                 // total number of collocation points
     float* scaleList_;                     // lists the scaling per scale index [scale]
     unsigned int* sizeList_;             // lists the total pattern size per scale index [scale]
@@ -185,10 +185,16 @@ protected:
     BriskLongPair* longPairs_;             // d>_dMin
     unsigned int noShortPairs_;         // number of shortParis
     unsigned int noLongPairs_;             // number of longParis
+    std::vector<int> shortPairsI_;       // the indices of the short pairs, apart
+    std::vector<int> shortPairsJ_;
 
     // general
     static const float basicSize_;
 
+    // the scale space of the image given to prepareDetection
+    cv::Ptr<BriskScaleSpace> preparedScaleSpace_;
+    int preparedThreshold_;
+
 private:
     BRISK_Impl(const BRISK_Impl &); // copy disabled
     BRISK_Impl& operator=(const BRISK_Impl &); // assign disabled
@@ -213,6 +219,9 @@ public:
   // Agast without non-max suppression
   void
   getAgastPoints(int threshold, std::vector<cv::KeyPoint>& keypoints);
+  // the same, from the points getAgastPoints found with a lower threshold
+  void
+  getAgastPoints(int threshold, const std::vector<cv::KeyPoint>& corners, std::vector<cv::KeyPoint>& keypoints);
 
   // get scores - attention, this is in layer coordinates, not scale=1 coordinates!
   inline int
@@ -283,7 +292,21 @@ public:
   void
   getKeypoints(const int _threshold, std::vector<cv::KeyPoint>& keypoints);
 
+  // find the agast corners once, then get the keypoints for any threshold not below this one
+  void
+  getCorners(const int _threshold);
+  void
+  getKeypointsFromCorners(const int _threshold, std::vector<cv::KeyPoint>& keypoints);
+  // the number of corners with each score
+  void
+  getCornerScoreHistogram(std::vector<int>& histogram) const;
+
 protected:
+  // nonmax suppression and refinement of the agast corners of each layer
+  void
+  refineKeypoints(const int _threshold, const std::vector<std::vector<cv::KeyPoint> >& agastPoints,
+                  std::vector<cv::KeyPoint>& keypoints);
+
   // nonmax suppression:
   inline bool
   isMax2D(const int layer, const int x_layer, const int y_layer);
@@ -319,6 +342,8 @@ protected:
   // the image pyramids:
   int layers_;
   std::vector<BriskLayer> pyramid_;
+  // the corners found by getCorners
+  std::vector<std::vector<cv::KeyPoint> > corners_;
 
   // some constant parameters:
   static const float safetyFactor_;
@@ -336,6 +361,7 @@ const float BriskScaleSpace::basicSize_ = 12.0f;
 // constructors
 BRISK_Impl::BRISK_Impl(int thresh, int octaves_in, float patternScale)
 {
+  preparedThreshold_ = 0;
   threshold = thresh;
   octaves = octaves_in;
 
@@ -367,6 +393,7 @@ BRISK_Impl::BRISK_Impl(const std::vector<float> &radiusList,
                        float dMax, float dMin,
                        const std::vector<int> indexChange)
 {
+  preparedThreshold_ = 0;
   generateKernel(radiusList, numberList, dMax, dMin, indexChange);
   threshold = 20;
   octaves = 3;
@@ -379,6 +406,7 @@ BRISK_Impl::BRISK_Impl(int thresh,
                        float dMax, float dMin,
                        const std::vector<int> indexChange)
 {
+  preparedThreshold_ = 0;
   generateKernel(radiusList, numberList, dMax, dMin, indexChange);
   threshold = thresh;
   octaves = octaves_in;
@@ -457,6 +485,18 @@ BRISK_Impl::generateKernel(const std::vector<float> &radiusList,
     }
   }
 
+  // the smoothing factors only depend on the sigma, which does not change with the rotation
+  scaling_.resize(points_ * scales_);
+  scaling2_.resize(points_ * scales_);
+  for (unsigned int scale = 0; scale < scales_; ++scale)
+  {
+    for (unsigned int i = 0; i < points_; i++)
+    {
+      BriskScalingFactors(patternPoints_[scale * n_rot_ * points_ + i].sigma, &scaling_[scale * points_ + i],
+                          &scaling2_[scale * points_ + i]);
+    }
+  }
+
   // now also generate pairings
   shortPairs_ = new BriskShortPair[points_ * (points_ - 1) / 2];
   longPairs_ = new BriskLongPair[points_ * (points_ - 1) / 2];
@@ -506,169 +546,18 @@ BRISK_Impl::generateKernel(const std::vector<float> &radiusList,
     }
   }
 
-  // no bits:
-  strings_ = (int) ceil((float(noShortPairs_)) / 128.0) * 4 * 4;
-}
-
-// simple alternative:
-inline int
-BRISK_Impl::smoothedIntensity(const cv::Mat& image, const cv::Mat& integral, const float key_x,
-                                            const float key_y, const unsigned int scale, const unsigned int rot,
-                                            const unsigned int point) const
-{
-
-  // get the float position
-  const BriskPatternPoint& briskPoint = patternPoints_[scale * n_rot_ * points_ + rot * points_ + point];
-  const float xf = briskPoint.x + key_x;
-  const float yf = briskPoint.y + key_y;
-  const int x = int(xf);
-  const int y = int(yf);
-  const int& imagecols = image.cols;
-
-  // get the sigma:
-  const float sigma_half = briskPoint.sigma;
-  const float area = 4.0f * sigma_half * sigma_half;
-
-  // calculate output:
-  int ret_val;
-  if (sigma_half < 0.5)
+  // the short pairs as PackComparisons wants them
+  shortPairsI_.resize(noShortPairs_);
+  shortPairsJ_.resize(noShortPairs_);
+  for (unsigned int k = 0; k < noShortPairs_; k++)
   {
-    //interpolation multipliers:
-    const int r_x = (int)((xf - x) * 1024);
-    const int r_y = (int)((yf - y) * 1024);
-    const int r_x_1 = (1024 - r_x);
-    const int r_y_1 = (1024 - r_y);
-    const uchar* ptr = &image.at<uchar>(y, x);
-    size_t step = image.step;
-    // just interpolate:
-    ret_val = r_x_1 * r_y_1 * ptr[0] + r_x * r_y_1 * ptr[1] +
-              r_x * r_y * ptr[step] + r_x_1 * r_y * ptr[step+1];
-    return (ret_val + 512) / 1024;
-  }
-
-  // this is the standard case (simple, not speed optimized yet):
-
-  // scaling:
-  const int scaling = (int)(4194304.0 / area);
-  const int scaling2 = int(float(scaling) * area / 1024.0);
-  CV_Assert(scaling2 != 0);
-
-  // the integral image is larger:
-  const int integralcols = imagecols + 1;
-
-  // calculate borders
-  const float x_1 = xf - sigma_half;
-  const float x1 = xf + sigma_half;
-  const float y_1 = yf - sigma_half;
-  const float y1 = yf + sigma_half;
-
-  const int x_left = int(x_1 + 0.5);
-  const int y_top = int(y_1 + 0.5);
-  const int x_right = int(x1 + 0.5);
-  const int y_bottom = int(y1 + 0.5);
-
-  // overlap area - multiplication factors:
-  const float r_x_1 = float(x_left) - x_1 + 0.5f;
-  const float r_y_1 = float(y_top) - y_1 + 0.5f;
-  const float r_x1 = x1 - float(x_right) + 0.5f;
-  const float r_y1 = y1 - float(y_bottom) + 0.5f;
-  const int dx = x_right - x_left - 1;
-  const int dy = y_bottom - y_top - 1;
-  const int A = (int)((r_x_1 * r_y_1) * scaling);
-  const int B = (int)((r_x1 * r_y_1) * scaling);
-  const int C = (int)((r_x1 * r_y1) * scaling);
-  const int D = (int)((r_x_1 * r_y1) * scaling);
-  const int r_x_1_i = (int)(r_x_1 * scaling);
-  const int r_y_1_i = (int)(r_y_1 * scaling);
-  const int r_x1_i = (int)(r_x1 * scaling);
-  const int r_y1_i = (int)(r_y1 * scaling);
-
-  if (dx + dy > 2)
-  {
-    // now the calculation:
-    const uchar* ptr = image.ptr() + x_left + imagecols * y_top;
-    // first the corners:
-    ret_val = A * int(*ptr);
-    ptr += dx + 1;
-    ret_val += B * int(*ptr);
-    ptr += dy * imagecols + 1;
-    ret_val += C * int(*ptr);
-    ptr -= dx + 1;
-    ret_val += D * int(*ptr);
-
-    // next the edges:
-    const int* ptr_integral = integral.ptr<int>() + x_left + integralcols * y_top + 1;
-    // find a simple path through the different surface corners
-    const int tmp1 = (*ptr_integral);
-    ptr_integral += dx;
-    const int tmp2 = (*ptr_integral);
-    ptr_integral += integralcols;
-    const int tmp3 = (*ptr_integral);
-    ptr_integral++;
-    const int tmp4 = (*ptr_integral);
-    ptr_integral += dy * integralcols;
-    const int tmp5 = (*ptr_integral);
-    ptr_integral--;
-    const int tmp6 = (*ptr_integral);
-    ptr_integral += integralcols;
-    const int tmp7 = (*ptr_integral);
-    ptr_integral -= dx;
-    const int tmp8 = (*ptr_integral);
-    ptr_integral -= integralcols;
-    const int tmp9 = (*ptr_integral);
-    ptr_integral--;
-    const int tmp10 = (*ptr_integral);
-    ptr_integral -= dy * integralcols;
-    const int tmp11 = (*ptr_integral);
-    ptr_integral++;
-    const int tmp12 = (*ptr_integral);
-
-    // assign the weighted surface integrals:
-    const int upper = (tmp3 - tmp2 + tmp1 - tmp12) * r_y_1_i;
-    const int middle = (tmp6 - tmp3 + tmp12 - tmp9) * scaling;
-    const int left = (tmp9 - tmp12 + tmp11 - tmp10) * r_x_1_i;
-    const int right = (tmp5 - tmp4 + tmp3 - tmp6) * r_x1_i;
-    const int bottom = (tmp7 - tmp6 + tmp9 - tmp8) * r_y1_i;
-
-    return (ret_val + upper + middle + left + right + bottom + scaling2 / 2) / scaling2;
+    CV_Assert(shortPairs_[k].i < points_ && shortPairs_[k].j < points_);
+    shortPairsI_[k] = shortPairs_[k].i;
+    shortPairsJ_[k] = shortPairs_[k].j;
   }
 
-  // now the calculation:
-  const uchar* ptr = image.ptr() + x_left + imagecols * y_top;
-  // first row:
-  ret_val = A * int(*ptr);
-  ptr++;
-  const uchar* end1 = ptr + dx;
-  for (; ptr < end1; ptr++)
-  {
-    ret_val += r_y_1_i * int(*ptr);
-  }
-  ret_val += B * int(*ptr);
-  // middle ones:
-  ptr += imagecols - dx - 1;
-  const uchar* end_j = ptr + dy * imagecols;
-  for (; ptr < end_j; ptr += imagecols - dx - 1)
-  {
-    ret_val += r_x_1_i * int(*ptr);
-    ptr++;
-    const uchar* end2 = ptr + dx;
-    for (; ptr < end2; ptr++)
-    {
-      ret_val += int(*ptr) * scaling;
-    }
-    ret_val += r_x1_i * int(*ptr);
-  }
-  // last row:
-  ret_val += D * int(*ptr);
-  ptr++;
-  const uchar* end3 = ptr + dx;
-  for (; ptr < end3; ptr++)
-  {
-    ret_val += r_y1_i * int(*ptr);
-  }
-  ret_val += C * int(*ptr);
-
-  return (ret_val + scaling2 / 2) / scaling2;
+  // no bits:
+  strings_ = (int) ceil((float(noShortPairs_)) / 128.0) * 4 * 4;
 }
 
 inline bool
@@ -775,10 +664,9 @@ BRISK_Impl::computeDescriptorsAndOrOrientation(InputArray _image, InputArray _ma
     if (doOrientation)
     {
         // get the gray values in the unrotated pattern
-        for (unsigned int i = 0; i < points_; i++)
-        {
-            _values[i] = smoothedIntensity(image, _integral, x, y, scale, 0, i);
-        }
+        SmoothedIntensities(image.ptr(), image.cols, image.step, _integral.ptr<int>(), x, y,
+                            patternPoints_ + scale * n_rot_ * points_, &scaling_[scale * points_],
+                            &scaling2_[scale * points_], points_, _values);
 
         int direction0 = 0;
         int direction1 = 0;
@@ -827,37 +715,13 @@ BRISK_Impl::computeDescriptorsAndOrOrientation(InputArray _image, InputArray _ma
       kp.angle += 360.f;
 
     // now also extract the stuff for the actual direction:
-    // let us compute the smoothed values
-    int shifter = 0;
-
-    //unsigned int mean=0;
     // get the gray values in the rotated pattern
-    for (unsigned int i = 0; i < points_; i++)
-    {
-        _values[i] = smoothedIntensity(image, _integral, x, y, scale, theta, i);
-    }
+    SmoothedIntensities(image.ptr(), image.cols, image.step, _integral.ptr<int>(), x, y,
+                        patternPoints_ + scale * n_rot_ * points_ + theta * points_, &scaling_[scale * points_],
+                        &scaling2_[scale * points_], points_, _values);
 
-    // now iterate through all the pairings
-    unsigned int* ptr2 = (unsigned int*) ptr;
-    const BriskShortPair* max = shortPairs_ + noShortPairs_;
-    for (BriskShortPair* iter = shortPairs_; iter < max; ++iter)
-    {
-      CV_Assert(iter->i < points_ && iter->j < points_);
-      t1 = *(_values + iter->i);
-      t2 = *(_values + iter->j);
-      if (t1 > t2)
-      {
-        *ptr2 |= ((1) << shifter);
-
-      } // else already initialized with zero
-      // take care of the iterators:
-      ++shifter;
-      if (shifter == 32)
-      {
-        shifter = 0;
-        ++ptr2;
-      }
-    }
+    // now iterate through all the pairings, the bits already initialized with zero
+    PackComparisons(_values, shortPairsI_.data(), shortPairsJ_.data(), noShortPairs_, (unsigned int*) ptr);
 
     ptr += strings_;
   }
@@ -891,6 +755,33 @@ BRISK_Impl::computeKeypointsNoOrientation(InputArray _image, InputArray _mask, s
   KeyPointsFilter::runByPixelsMask(keypoints, mask);
 }
 
+void
+BRISK_Impl::prepareDetection(InputArray _image, int min_threshold)
+{
+  Mat image = _image.getMat();
+  if( image.type() != CV_8UC1 )
+      cvtColor(_image, image, COLOR_BGR2GRAY);
+
+  preparedScaleSpace_ = makePtr<BriskScaleSpace>(octaves);
+  preparedScaleSpace_->constructPyramid(image);
+  preparedScaleSpace_->getCorners(min_threshold);
+  preparedThreshold_ = min_threshold;
+}
+
+void
+BRISK_Impl::detectPrepared(int threshold_in, std::vector<KeyPoint>& keypoints)
+{
+  CV_Assert(!preparedScaleSpace_.empty() && threshold_in >= preparedThreshold_);
+  preparedScaleSpace_->getKeypointsFromCorners(threshold_in, keypoints);
+}
+
+void
+BRISK_Impl::getCornerScoreHistogram(std::vector<int>& histogram) const
+{
+  CV_Assert(!preparedScaleSpace_.empty());
+  preparedScaleSpace_->getCornerScoreHistogram(histogram);
+}
+
 // construct telling the octaves number:
 BriskScaleSpace::BriskScaleSpace(int _octaves)
 {
@@ -929,10 +820,6 @@ BriskScaleSpace::constructPyramid(const cv::Mat& image)
 void
 BriskScaleSpace::getKeypoints(const int threshold_, std::vector<cv::KeyPoint>& keypoints)
 {
-  // make sure keypoints is empty
-  keypoints.resize(0);
-  keypoints.reserve(2000);
-
   // assign thresholds
   int safeThreshold_ = (int)(threshold_ * safetyFactor_);
   std::vector<std::vector<cv::KeyPoint> > agastPoints;
@@ -946,6 +833,50 @@ BriskScaleSpace::getKeypoints(const int threshold_, std::vector<cv::KeyPoint>& k
     l.getAgastPoints(safeThreshold_, agastPoints[i]);
   }
 
+  refineKeypoints(threshold_, agastPoints, keypoints);
+}
+
+void
+BriskScaleSpace::getCorners(const int threshold_)
+{
+  int safeThreshold_ = (int)(threshold_ * safetyFactor_);
+  corners_.resize(layers_);
+  for (int i = 0; i < layers_; i++)
+    pyramid_[i].getAgastPoints(safeThreshold_, corners_[i]);
+}
+
+void
+BriskScaleSpace::getKeypointsFromCorners(const int threshold_, std::vector<cv::KeyPoint>& keypoints)
+{
+  // the corners the agast detector would find with this threshold, as it would leave the scores
+  int safeThreshold_ = (int)(threshold_ * safetyFactor_);
+  std::vector<std::vector<cv::KeyPoint> > agastPoints;
+  agastPoints.resize(layers_);
+  for (int i = 0; i < layers_; i++)
+    pyramid_[i].getAgastPoints(safeThreshold_, corners_[i], agastPoints[i]);
+
+  refineKeypoints(threshold_, agastPoints, keypoints);
+}
+
+void
+BriskScaleSpace::getCornerScoreHistogram(std::vector<int>& histogram) const
+{
+  histogram.assign(256, 0);
+  for (size_t i = 0; i < corners_.size(); i++)
+    for (size_t n = 0; n < corners_[i].size(); n++)
+      histogram[saturate_cast<uchar>(corners_[i][n].response)]++;
+}
+
+void
+BriskScaleSpace::refineKeypoints(const int threshold_, const std::vector<std::vector<cv::KeyPoint> >& agastPoints,
+                                 std::vector<cv::KeyPoint>& keypoints)
+{
+  // make sure keypoints is empty
+  keypoints.resize(0);
+  keypoints.reserve(2000);
+
+  int safeThreshold_ = (int)(threshold_ * safetyFactor_);
+
   if (layers_ == 1)
   {
     // just do a simple 2d subpixel refinement...
@@ -2168,8 +2099,26 @@ BriskLayer::BriskLayer(const BriskLayer& layer, int mode)
 void
 BriskLayer::getAgastPoints(int threshold, std::vector<KeyPoint>& keypoints)
 {
-  oast_9_16_->setThreshold(threshold);
-  oast_9_16_->detect(img_, keypoints);
+  if (threshold >= 1 && BriskKernelsVectorized() && img_.rows > 6 && img_.cols > 6)
+  {
+    // the same corners as the detector finds, in the same order, scoring a row at a time
+    keypoints.clear();
+    std::vector<uchar> row_scores(img_.cols - 6);
+    for (int y = 3; y < img_.rows - 3; y++)
+    {
+      OastScores9_16(img_.ptr<uchar>(y) + 3, pixel_9_16_, img_.cols - 6, row_scores.data());
+      for (int x = 3; x < img_.cols - 3; x++)
+      {
+        if (row_scores[x - 3] >= threshold)
+          keypoints.push_back(KeyPoint(Point2f((float)x, (float)y), 7.0f, -1, (float)row_scores[x - 3]));
+      }
+    }
+  }
+  else
+  {
+    oast_9_16_->setThreshold(threshold);
+    oast_9_16_->detect(img_, keypoints);
+  }
 
   // also write scores
   const size_t num = keypoints.size();
@@ -2178,6 +2127,24 @@ BriskLayer::getAgastPoints(int threshold, std::vector<KeyPoint>& keypoints)
     scores_((int)keypoints[i].pt.y, (int)keypoints[i].pt.x) = saturate_cast<uchar>(keypoints[i].response);
 }
 
+// a corner is found with a threshold exactly when its score is not below it, and
+// its score does not depend on the threshold it was found with
+void
+BriskLayer::getAgastPoints(int threshold, const std::vector<KeyPoint>& corners, std::vector<KeyPoint>& keypoints)
+{
+  // forget the scores computed since, with another threshold
+  scores_.setTo(0);
+
+  keypoints.clear();
+  for (size_t i = 0; i < corners.size(); i++)
+  {
+    if (corners[i].response < threshold)
+      continue;
+    keypoints.push_back(corners[i]);
+    scores_((int)corners[i].pt.y, (int)corners[i].pt.x) = saturate_cast<uchar>(corners[i].response);
+  }
+}
+
 inline int
 BriskLayer::getAgastScore(int x, int y, int threshold) const
 {
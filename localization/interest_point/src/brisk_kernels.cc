@@ -0,0 +1,466 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <interest_point/agast_score.h>
+#include <interest_point/brisk_kernels.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+// Not yet checked against the OpenCV the robot is built with, so only
+// with -DENABLE_BRISK_AVX2=ON
+#if defined(BRISK_AVX2) && (defined(__x86_64__) || defined(__i386__))
+#define BRISK_KERNELS_AVX2
+#include <immintrin.h>
+// The build does not enable AVX, so only these functions may use it, once
+// BriskKernelsVectorized() has checked the processor has it.
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+namespace interest_point {
+
+namespace {
+
+// The smoothed gray value at one point of the pattern. This is the
+// original BRISK code, with the factors for the sigma computed once.
+int SmoothedIntensity(const uchar* image, int imagecols, size_t step, const int* integral, float key_x,
+                      float key_y, const BriskPatternPoint& briskPoint, int scaling, int scaling2) {
+  // get the float position
+  const float xf = briskPoint.x + key_x;
+  const float yf = briskPoint.y + key_y;
+  const int x = static_cast<int>(xf);
+  const int y = static_cast<int>(yf);
+
+  // get the sigma:
+  const float sigma_half = briskPoint.sigma;
+
+  // calculate output:
+  int ret_val;
+  if (sigma_half < 0.5) {
+    // interpolation multipliers:
+    const int r_x = static_cast<int>((xf - x) * 1024);
+    const int r_y = static_cast<int>((yf - y) * 1024);
+    const int r_x_1 = (1024 - r_x);
+    const int r_y_1 = (1024 - r_y);
+    const uchar* ptr = image + y * step + x;
+    // just interpolate:
+    ret_val = r_x_1 * r_y_1 * ptr[0] + r_x * r_y_1 * ptr[1] +
+              r_x * r_y * ptr[step] + r_x_1 * r_y * ptr[step+1];
+    return (ret_val + 512) / 1024;
+  }
+
+  // the integral image is larger:
+  const int integralcols = imagecols + 1;
+
+  // calculate borders
+  const float x_1 = xf - sigma_half;
+  const float x1 = xf + sigma_half;
+  const float y_1 = yf - sigma_half;
+  const float y1 = yf + sigma_half;
+
+  const int x_left = static_cast<int>(x_1 + 0.5);
+  const int y_top = static_cast<int>(y_1 + 0.5);
+  const int x_right = static_cast<int>(x1 + 0.5);
+  const int y_bottom = static_cast<int>(y1 + 0.5);
+
+  // overlap area - multiplication factors:
+  const float r_x_1 = static_cast<float>(x_left) - x_1 + 0.5f;
+  const float r_y_1 = static_cast<float>(y_top) - y_1 + 0.5f;
+  const float r_x1 = x1 - static_cast<float>(x_right) + 0.5f;
+  const float r_y1 = y1 - static_cast<float>(y_bottom) + 0.5f;
+  const int dx = x_right - x_left - 1;
+  const int dy = y_bottom - y_top - 1;
+  const int A = static_cast<int>((r_x_1 * r_y_1) * scaling);
+  const int B = static_cast<int>((r_x1 * r_y_1) * scaling);
+  const int C = static_cast<int>((r_x1 * r_y1) * scaling);
+  const int D = static_cast<int>((r_x_1 * r_y1) * scaling);
+  const int r_x_1_i = static_cast<int>(r_x_1 * scaling);
+  const int r_y_1_i = static_cast<int>(r_y_1 * scaling);
+  const int r_x1_i = static_cast<int>(r_x1 * scaling);
+  const int r_y1_i = static_cast<int>(r_y1 * scaling);
+
+  if (dx + dy > 2) {
+    // now the calculation:
+    const uchar* ptr = image + x_left + imagecols * y_top;
+    // first the corners:
+    ret_val = A * static_cast<int>(*ptr);
+    ptr += dx + 1;
+    ret_val += B * static_cast<int>(*ptr);
+    ptr += dy * imagecols + 1;
+    ret_val += C * static_cast<int>(*ptr);
+    ptr -= dx + 1;
+    ret_val += D * static_cast<int>(*ptr);
+
+    // next the edges:
+    const int* ptr_integral = integral + x_left + integralcols * y_top + 1;
+    // find a simple path through the different surface corners
+    const int tmp1 = (*ptr_integral);
+    ptr_integral += dx;
+    const int tmp2 = (*ptr_integral);
+    ptr_integral += integralcols;
+    const int tmp3 = (*ptr_integral);
+    ptr_integral++;
+    const int tmp4 = (*ptr_integral);
+    ptr_integral += dy * integralcols;
+    const int tmp5 = (*ptr_integral);
+    ptr_integral--;
+    const int tmp6 = (*ptr_integral);
+    ptr_integral += integralcols;
+    const int tmp7 = (*ptr_integral);
+    ptr_integral -= dx;
+    const int tmp8 = (*ptr_integral);
+    ptr_integral -= integralcols;
+    const int tmp9 = (*ptr_integral);
+    ptr_integral--;
+    const int tmp10 = (*ptr_integral);
+    ptr_integral -= dy * integralcols;
+    const int tmp11 = (*ptr_integral);
+    ptr_integral++;
+    const int tmp12 = (*ptr_integral);
+
+    // assign the weighted surface integrals:
+    const int upper = (tmp3 - tmp2 + tmp1 - tmp12) * r_y_1_i;
+    const int middle = (tmp6 - tmp3 + tmp12 - tmp9) * scaling;
+    const int left = (tmp9 - tmp12 + tmp11 - tmp10) * r_x_1_i;
+    const int right = (tmp5 - tmp4 + tmp3 - tmp6) * r_x1_i;
+    const int bottom = (tmp7 - tmp6 + tmp9 - tmp8) * r_y1_i;
+
+    return (ret_val + upper + middle + left + right + bottom + scaling2 / 2) / scaling2;
+  }
+
+  // now the calculation:
+  const uchar* ptr = image + x_left + imagecols * y_top;
+  // first row:
+  ret_val = A * static_cast<int>(*ptr);
+  ptr++;
+  const uchar* end1 = ptr + dx;
+  for (; ptr < end1; ptr++)
+    ret_val += r_y_1_i * static_cast<int>(*ptr);
+  ret_val += B * static_cast<int>(*ptr);
+  // middle ones:
+  ptr += imagecols - dx - 1;
+  const uchar* end_j = ptr + dy * imagecols;
+  for (; ptr < end_j; ptr += imagecols - dx - 1) {
+    ret_val += r_x_1_i * static_cast<int>(*ptr);
+    ptr++;
+    const uchar* end2 = ptr + dx;
+    for (; ptr < end2; ptr++)
+      ret_val += static_cast<int>(*ptr) * scaling;
+    ret_val += r_x1_i * static_cast<int>(*ptr);
+  }
+  // last row:
+  ret_val += D * static_cast<int>(*ptr);
+  ptr++;
+  const uchar* end3 = ptr + dx;
+  for (; ptr < end3; ptr++)
+    ret_val += r_y1_i * static_cast<int>(*ptr);
+  ret_val += C * static_cast<int>(*ptr);
+
+  return (ret_val + scaling2 / 2) / scaling2;
+}
+
+#ifdef BRISK_KERNELS_AVX2
+
+// The largest, over the 16 arcs of 9 pixels of the circle, of the
+// smallest difference along the arc
+AVX2_FUNCTION __m256i ArcMax(const __m256i d[16]) {
+  __m256i m2[16], m4[16], m8[16];
+  for (int k = 0; k < 16; k++)
+    m2[k] = _mm256_min_epu8(d[k], d[(k + 1) & 15]);
+  for (int k = 0; k < 16; k++)
+    m4[k] = _mm256_min_epu8(m2[k], m2[(k + 2) & 15]);
+  for (int k = 0; k < 16; k++)
+    m8[k] = _mm256_min_epu8(m4[k], m4[(k + 4) & 15]);
+  __m256i result = _mm256_min_epu8(m8[0], d[8]);
+  for (int k = 1; k < 16; k++)
+    result = _mm256_max_epu8(result, _mm256_min_epu8(m8[k], d[(k + 8) & 15]));
+  return result;
+}
+
+// A pixel is a corner with threshold b when the 9 pixels of an arc are
+// all brighter than it by more than b, or all darker, so its score is
+// one less than the largest difference an arc has throughout.
+// There must be at least 32 pixels.
+AVX2_FUNCTION void OastScores9_16Avx2(const uchar* ptr, const int pixel[16], int n, uchar* scores) {
+  for (int i = 0; i < n; i += 32) {
+    // the last block overlaps the one before
+    if (i > n - 32)
+      i = n - 32;
+    const uchar* p = ptr + i;
+    const __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i brighter[16], darker[16];
+    for (int k = 0; k < 16; k++) {
+      __m256i circle = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + pixel[k]));
+      brighter[k] = _mm256_subs_epu8(circle, center);
+      darker[k] = _mm256_subs_epu8(center, circle);
+    }
+    __m256i best = _mm256_max_epu8(ArcMax(brighter), ArcMax(darker));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(scores + i), _mm256_subs_epu8(best, _mm256_set1_epi8(1)));
+  }
+}
+
+AVX2_FUNCTION inline __m256i Load(const int* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+// int(x + 0.5) computed in double, as the scalar code does, for x > -0.5
+AVX2_FUNCTION __m256i RoundHalfUp(__m256 x) {
+  __m256i truncated = _mm256_cvttps_epi32(x);
+  __m256 fraction = _mm256_sub_ps(x, _mm256_cvtepi32_ps(truncated));
+  __m256i up = _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ));
+  return _mm256_sub_epi32(truncated, up);
+}
+
+// n / d for 0 <= n < 2^31 and the result below 2^22, from a division in
+// float corrected by one either way
+AVX2_FUNCTION __m256i Divide(__m256i n, __m256i d) {
+  __m256i q = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(n), _mm256_cvtepi32_ps(d)));
+  __m256i r = _mm256_sub_epi32(n, _mm256_mullo_epi32(q, d));
+  q = _mm256_add_epi32(q, _mm256_cmpgt_epi32(_mm256_setzero_si256(), r));
+  q = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(r, _mm256_sub_epi32(d, _mm256_set1_epi32(1))));
+  return q;
+}
+
+// The values of the points interpolated, or summed pixel by pixel, and of
+// the last few, are left at -1 for the scalar code. Calling it from here
+// would mix AVX and SSE instructions, which is slow.
+AVX2_FUNCTION void SmoothedIntensitiesAvx2(const uchar* image, int image_cols, const int* integral, float key_x,
+                                           float key_y, const BriskPatternPoint* points, const int* scaling,
+                                           const int* scaling2, int num_points, int* values) {
+  const int integral_cols = image_cols + 1;
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256 half = _mm256_set1_ps(0.5f);
+
+  int i = 0;
+  for (; i + 8 <= num_points; i += 8) {
+    float point_x[8], point_y[8], point_sigma[8];
+    for (int k = 0; k < 8; k++) {
+      point_x[k] = points[i + k].x;
+      point_y[k] = points[i + k].y;
+      point_sigma[k] = points[i + k].sigma;
+    }
+    const __m256 sigma = _mm256_loadu_ps(point_sigma);
+    const __m256 xf = _mm256_add_ps(_mm256_loadu_ps(point_x), _mm256_set1_ps(key_x));
+    const __m256 yf = _mm256_add_ps(_mm256_loadu_ps(point_y), _mm256_set1_ps(key_y));
+    const __m256i s = Load(scaling + i);
+    const __m256i s2 = Load(scaling2 + i);
+    const __m256 sf = _mm256_cvtepi32_ps(s);
+
+    const __m256 x_1 = _mm256_sub_ps(xf, sigma);
+    const __m256 x1 = _mm256_add_ps(xf, sigma);
+    const __m256 y_1 = _mm256_sub_ps(yf, sigma);
+    const __m256 y1 = _mm256_add_ps(yf, sigma);
+    __m256i x_left = RoundHalfUp(x_1);
+    __m256i y_top = RoundHalfUp(y_1);
+    const __m256i x_right = RoundHalfUp(x1);
+    const __m256i y_bottom = RoundHalfUp(y1);
+
+    const __m256 r_x_1 = _mm256_add_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(x_left), x_1), half);
+    const __m256 r_y_1 = _mm256_add_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(y_top), y_1), half);
+    const __m256 r_x1 = _mm256_add_ps(_mm256_sub_ps(x1, _mm256_cvtepi32_ps(x_right)), half);
+    const __m256 r_y1 = _mm256_add_ps(_mm256_sub_ps(y1, _mm256_cvtepi32_ps(y_bottom)), half);
+    __m256i dx = _mm256_sub_epi32(_mm256_sub_epi32(x_right, x_left), one);
+    __m256i dy = _mm256_sub_epi32(_mm256_sub_epi32(y_bottom, y_top), one);
+
+    // the points interpolated, or summed pixel by pixel, are left for the scalar code
+    const __m256i scalar = _mm256_or_si256(
+      _mm256_castps_si256(_mm256_cmp_ps(sigma, half, _CMP_LT_OQ)),
+      _mm256_cmpgt_epi32(_mm256_set1_epi32(3), _mm256_add_epi32(dx, dy)));
+    if (_mm256_testc_si256(scalar, _mm256_set1_epi32(-1))) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), _mm256_set1_epi32(-1));
+      continue;
+    }
+    // and read the first pixels of the image for them meanwhile
+    x_left = _mm256_andnot_si256(scalar, x_left);
+    y_top = _mm256_andnot_si256(scalar, y_top);
+    dx = _mm256_andnot_si256(scalar, dx);
+    dy = _mm256_andnot_si256(scalar, dy);
+
+    const __m256i A = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x_1, r_y_1), sf));
+    const __m256i B = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x1, r_y_1), sf));
+    const __m256i C = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x1, r_y1), sf));
+    const __m256i D = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x_1, r_y1), sf));
+    const __m256i r_x_1_i = _mm256_cvttps_epi32(_mm256_mul_ps(r_x_1, sf));
+    const __m256i r_y_1_i = _mm256_cvttps_epi32(_mm256_mul_ps(r_y_1, sf));
+    const __m256i r_x1_i = _mm256_cvttps_epi32(_mm256_mul_ps(r_x1, sf));
+    const __m256i r_y1_i = _mm256_cvttps_epi32(_mm256_mul_ps(r_y1, sf));
+
+    // gathers are slow on many processors, so the pixels and sums are read one at a time,
+    // along the same path as the scalar code
+    int lane_x[8], lane_y[8], lane_dx[8], lane_dy[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_x), x_left);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_y), y_top);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_dx), dx);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_dy), dy);
+    int corners[4][8], sums[12][8];
+    for (int k = 0; k < 8; k++) {
+      const uchar* ptr = image + lane_x[k] + image_cols * lane_y[k];
+      const int dx_k = lane_dx[k], dy_k = lane_dy[k] * integral_cols;
+      corners[0][k] = ptr[0];
+      corners[1][k] = ptr[dx_k + 1];
+      corners[2][k] = ptr[dx_k + 1 + lane_dy[k] * image_cols + 1];
+      corners[3][k] = ptr[lane_dy[k] * image_cols + 1];
+      const int* q = integral + lane_x[k] + integral_cols * lane_y[k] + 1;
+      sums[0][k] = q[0];
+      sums[1][k] = q[dx_k];
+      sums[2][k] = q[dx_k + integral_cols];
+      sums[3][k] = q[dx_k + integral_cols + 1];
+      sums[4][k] = q[dx_k + integral_cols + 1 + dy_k];
+      sums[5][k] = q[dx_k + integral_cols + dy_k];
+      sums[6][k] = q[dx_k + 2 * integral_cols + dy_k];
+      sums[7][k] = q[2 * integral_cols + dy_k];
+      sums[8][k] = q[integral_cols + dy_k];
+      sums[9][k] = q[integral_cols + dy_k - 1];
+      sums[10][k] = q[integral_cols - 1];
+      sums[11][k] = q[integral_cols];
+    }
+    __m256i ret_val = _mm256_mullo_epi32(A, Load(corners[0]));
+    ret_val = _mm256_add_epi32(ret_val, _mm256_mullo_epi32(B, Load(corners[1])));
+    ret_val = _mm256_add_epi32(ret_val, _mm256_mullo_epi32(C, Load(corners[2])));
+    ret_val = _mm256_add_epi32(ret_val, _mm256_mullo_epi32(D, Load(corners[3])));
+    const __m256i tmp1 = Load(sums[0]), tmp2 = Load(sums[1]), tmp3 = Load(sums[2]), tmp4 = Load(sums[3]);
+    const __m256i tmp5 = Load(sums[4]), tmp6 = Load(sums[5]), tmp7 = Load(sums[6]), tmp8 = Load(sums[7]);
+    const __m256i tmp9 = Load(sums[8]), tmp10 = Load(sums[9]), tmp11 = Load(sums[10]), tmp12 = Load(sums[11]);
+    const __m256i upper = _mm256_mullo_epi32(
+      _mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp3, tmp2), tmp1), tmp12), r_y_1_i);
+    const __m256i middle = _mm256_mullo_epi32(
+      _mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp6, tmp3), tmp12), tmp9), s);
+    const __m256i left = _mm256_mullo_epi32(
+      _mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp9, tmp12), tmp11), tmp10), r_x_1_i);
+    const __m256i right = _mm256_mullo_epi32(
+      _mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp5, tmp4), tmp3), tmp6), r_x1_i);
+    const __m256i bottom = _mm256_mullo_epi32(
+      _mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp7, tmp6), tmp9), tmp8), r_y1_i);
+    ret_val = _mm256_add_epi32(ret_val, _mm256_add_epi32(_mm256_add_epi32(upper, middle),
+                                                         _mm256_add_epi32(left, right)));
+    ret_val = _mm256_add_epi32(_mm256_add_epi32(ret_val, bottom), _mm256_srli_epi32(s2, 1));
+    // the divisor of the points done one at a time may be 0
+    const __m256i divisor = _mm256_blendv_epi8(s2, one, scalar);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i),
+                        _mm256_blendv_epi8(Divide(ret_val, divisor), _mm256_set1_epi32(-1), scalar));
+  }
+  for (; i < num_points; i++)
+    values[i] = -1;
+}
+
+AVX2_FUNCTION void PackComparisonsAvx2(const int* values, const int* pairs_i, const int* pairs_j, int num_pairs,
+                                       unsigned int* descriptor) {
+  int k = 0;
+  for (; k + 8 <= num_pairs; k += 8) {
+    const __m256i t1 = _mm256_i32gather_epi32(values,
+                                              _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pairs_i + k)), 4);
+    const __m256i t2 = _mm256_i32gather_epi32(values,
+                                              _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pairs_j + k)), 4);
+    const unsigned int bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t1, t2)));
+    descriptor[k / 32] |= bits << (k % 32);
+  }
+  for (; k < num_pairs; k++) {
+    if (values[pairs_i[k]] > values[pairs_j[k]])
+      descriptor[k / 32] |= 1u << (k % 32);
+  }
+}
+
+#endif  // BRISK_KERNELS_AVX2
+
+}  // namespace
+
+bool BriskKernelsVectorized() {
+#if defined(BRISK_KERNELS_AVX2)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2 && cv::useOptimized();
+#else
+  return false;
+#endif
+}
+
+void OastScores9_16(const uchar* ptr, const int pixel[16], int n, uchar* scores) {
+#if defined(BRISK_KERNELS_AVX2)
+  if (n >= 32 && BriskKernelsVectorized())
+    return OastScores9_16Avx2(ptr, pixel, n, scores);
+#endif
+  OastScores9_16Scalar(ptr, pixel, n, scores);
+}
+
+void OastScores9_16Scalar(const uchar* ptr, const int pixel[16], int n, uchar* scores) {
+  for (int i = 0; i < n; i++)
+    scores[i] = static_cast<uchar>(agast_cornerScore<cv::AgastFeatureDetector::OAST_9_16>(ptr + i, pixel, 0));
+}
+
+void SmoothedIntensities(const uchar* image, int image_cols, size_t image_step, const int* integral,
+                         float key_x, float key_y, const BriskPatternPoint* points, const int* scaling,
+                         const int* scaling2, int num_points, int* values) {
+#if defined(BRISK_KERNELS_AVX2)
+  if (BriskKernelsVectorized()) {
+    SmoothedIntensitiesAvx2(image, image_cols, integral, key_x, key_y, points, scaling, scaling2, num_points,
+                            values);
+    for (int i = 0; i < num_points; i++) {
+      if (values[i] < 0)
+        values[i] = SmoothedIntensity(image, image_cols, image_step, integral, key_x, key_y, points[i],
+                                      scaling[i], scaling2[i]);
+    }
+    return;
+  }
+#endif
+  SmoothedIntensitiesScalar(image, image_cols, image_step, integral, key_x, key_y, points, scaling, scaling2,
+                            num_points, values);
+}
+
+void SmoothedIntensitiesScalar(const uchar* image, int image_cols, size_t image_step, const int* integral,
+                               float key_x, float key_y, const BriskPatternPoint* points, const int* scaling,
+                               const int* scaling2, int num_points, int* values) {
+  for (int i = 0; i < num_points; i++)
+    values[i] = SmoothedIntensity(image, image_cols, image_step, integral, key_x, key_y, points[i], scaling[i],
+                                  scaling2[i]);
+}
+
+void BriskScalingFactors(float sigma, int* scaling, int* scaling2) {
+  *scaling = 0;
+  *scaling2 = 0;
+  if (sigma < 0.5)
+    return;
+  const float area = 4.0f * sigma * sigma;
+  *scaling = static_cast<int>(4194304.0 / area);
+  *scaling2 = static_cast<int>(static_cast<float>(*scaling) * area / 1024.0);
+  CV_Assert(*scaling2 != 0);
+}
+
+void PackComparisons(const int* values, const int* pairs_i, const int* pairs_j, int num_pairs,
+                     unsigned int* descriptor) {
+#if defined(BRISK_KERNELS_AVX2)
+  if (BriskKernelsVectorized())
+    return PackComparisonsAvx2(values, pairs_i, pairs_j, num_pairs, descriptor);
+#endif
+  PackComparisonsScalar(values, pairs_i, pairs_j, num_pairs, descriptor);
+}
+
+void PackComparisonsScalar(const int* values, const int* pairs_i, const int* pairs_j, int num_pairs,
+                           unsigned int* descriptor) {
+  int shifter = 0;
+  for (int k = 0; k < num_pairs; k++) {
+    if (values[pairs_i[k]] > values[pairs_j[k]])
+      *descriptor |= 1u << shifter;
+    // take care of the iterators:
+    ++shifter;
+    if (shifter == 32) {
+      shifter = 0;
+      ++descriptor;
+    }
+  }
+}
+
+}  // namespace interest_point
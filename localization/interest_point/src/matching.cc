@@ -24,6 +24,9 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <vector>
 // Note: if any of these values are manually set by the user in
@@ -43,6 +46,10 @@ DEFINE_double(orgbrisk_pattern_scale, 1.0,
 // Customize the feature detectors.
 DEFINE_int32(detection_retries, 5,
              "Number of attempts to acquire the desired number of features with the detector.");
+DEFINE_bool(single_pass_detection, false,
+            "Detect features once with the lowest threshold, then pick the threshold from their scores, "
+            "rather than detecting again with each new threshold. The features should be the same as "
+            "detecting with the threshold picked. Not yet checked on real images.");
 // SURF detector
 DEFINE_int32(min_surf_features, 1000,
              "Minimum number of features to be computed using SURF.");
@@ -89,15 +96,20 @@ namespace interest_point {
     if (default_thresh_ <= 0)
       LOG(FATAL) << "The detector parameters have not been set.";
 
-    for (unsigned int i = 0; i < max_retries_; i++) {
+    if (FLAGS_single_pass_detection) {
       keypoints->clear();
-      DetectImpl(image, keypoints);
-      if (keypoints->size() < min_features_)
-        TooFew();
-      else if (keypoints->size() > max_features_)
-        TooMany();
-      else
-        break;
+      DetectSinglePass(image, keypoints);
+    } else {
+      for (unsigned int i = 0; i < max_retries_; i++) {
+        keypoints->clear();
+        DetectImpl(image, keypoints);
+        if (keypoints->size() < min_features_)
+          TooFew();
+        else if (keypoints->size() > max_features_)
+          TooMany();
+        else
+          break;
+      }
     }
     ComputeImpl(image, keypoints, keypoints_description);
   }
@@ -137,6 +149,46 @@ namespace interest_point {
         dynamic_thresh_ = min_thresh_;
       brisk_->setThreshold(dynamic_thresh_);
     }
+    virtual void SetDynamicThreshold(double thresh) {
+      dynamic_thresh_ = thresh;
+      brisk_->setThreshold(dynamic_thresh_);
+    }
+    virtual void DetectSinglePass(const cv::Mat& image, std::vector<cv::KeyPoint>* keypoints) {
+      // The thresholds are whole numbers, for backwards compatibility
+      int min_thresh = static_cast<int>(min_thresh_), max_thresh = static_cast<int>(max_thresh_);
+      int thresh = std::min(std::max(static_cast<int>(dynamic_thresh_), min_thresh), max_thresh);
+      brisk_->prepareDetection(image, min_thresh);
+
+      // How many corners have a score of at least each threshold
+      std::vector<int> histogram, corners(257, 0);
+      brisk_->getCornerScoreHistogram(histogram);
+      for (int t = 255; t >= 0; t--)
+        corners[t] = corners[t + 1] + histogram[t];
+
+      // Only the refinement of the corners is done again for each
+      // threshold. The next threshold is picked assuming the keypoints
+      // stay the same fraction of the corners.
+      double target = 0.5 * (min_features_ + max_features_);
+      for (unsigned int i = 0; ; i++) {
+        brisk_->detectPrepared(thresh, *keypoints);
+        bool too_few = keypoints->size() < min_features_, too_many = keypoints->size() > max_features_;
+        if ((!too_few && !too_many) || i + 1 >= max_retries_)
+          break;
+        double ratio = static_cast<double>(keypoints->size()) / std::max(corners[thresh], 1);
+        int next = thresh;
+        if (too_few) {
+          while (next > min_thresh && ratio * corners[next] < target)
+            next--;
+        } else {
+          while (next < max_thresh && ratio * corners[next] > target)
+            next++;
+        }
+        if (next == thresh)
+          break;
+        thresh = next;
+      }
+      SetDynamicThreshold(thresh);
+    }
 
    private:
     cv::Ptr<interest_point::BRISK> brisk_;
@@ -170,6 +222,38 @@ namespace interest_point {
         dynamic_thresh_ = min_thresh_;
       surf_->setHessianThreshold(static_cast<float>(dynamic_thresh_));
     }
+    virtual void SetDynamicThreshold(double thresh) {
+      dynamic_thresh_ = thresh;
+      surf_->setHessianThreshold(static_cast<float>(dynamic_thresh_));
+    }
+    virtual void DetectSinglePass(const cv::Mat& image, std::vector<cv::KeyPoint>* keypoints) {
+      // A higher threshold keeps exactly the keypoints with a higher
+      // response, as the neighbors of a maximum are not thresholded.
+      surf_->setHessianThreshold(static_cast<float>(min_thresh_));
+      surf_->detect(image, *keypoints);
+      std::vector<float> responses;
+      for (cv::KeyPoint const& key : *keypoints)
+        responses.push_back(key.response);
+      std::sort(responses.begin(), responses.end(), std::greater<float>());
+
+      double thresh = std::min(std::max(dynamic_thresh_, min_thresh_), max_thresh_);
+      size_t num = std::count_if(responses.begin(), responses.end(),
+                                 [thresh](float r) { return r > static_cast<float>(thresh); });
+      if (num > max_features_)
+        thresh = responses[max_features_];
+      else if (num < min_features_)
+        thresh = responses.size() < min_features_ ? min_thresh_ :
+          std::nextafter(responses[min_features_ - 1], 0.0f);
+      thresh = std::min(std::max(thresh, min_thresh_), max_thresh_);
+
+      std::vector<cv::KeyPoint> kept;
+      for (cv::KeyPoint const& key : *keypoints) {
+        if (key.response > static_cast<float>(thresh))
+          kept.push_back(key);
+      }
+      keypoints->swap(kept);
+      SetDynamicThreshold(thresh);
+    }
 
    private:
     cv::Ptr<cv::xfeatures2d::SURF> surf_;
@@ -192,6 +276,18 @@ namespace interest_point {
                                  min_thresh, default_thresh, max_thresh);
   }
 
+  double FeatureDetector::GetDynamicThreshold() const {
+    if (detector_ == NULL)
+      LOG(FATAL) << "The detector was not set.";
+    return detector_->GetDynamicThreshold();
+  }
+
+  void FeatureDetector::SetDynamicThreshold(double thresh) {
+    if (detector_ == NULL)
+      LOG(FATAL) << "The detector was not set.";
+    detector_->SetDynamicThreshold(thresh);
+  }
+
   FeatureDetector::~FeatureDetector(void) {
     if (detector_ != NULL) {
       delete detector_;
@@ -16,17 +16,41 @@
  * under the License.
  */
 
+#include <interest_point/agast_score.h>
+#include <interest_point/brisk.h>
+#include <interest_point/brisk_kernels.h>
 #include <interest_point/matching.h>
 
 #include <Eigen/Geometry>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <cmath>
 #include <string>
 #include <vector>
 
+DECLARE_bool(single_pass_detection);
+DECLARE_int32(orgbrisk_octaves);
+DECLARE_double(orgbrisk_pattern_scale);
+
+namespace {
+
+void ExpectSameKeypoints(std::vector<cv::KeyPoint> const& a, std::vector<cv::KeyPoint> const& b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].pt, b[i].pt);
+    EXPECT_EQ(a[i].size, b[i].size);
+    EXPECT_EQ(a[i].angle, b[i].angle);
+    EXPECT_EQ(a[i].response, b[i].response);
+    EXPECT_EQ(a[i].octave, b[i].octave);
+  }
+}
+
+}  // namespace
+
 class MatchingTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
@@ -73,3 +97,123 @@ TEST_F(MatchingTest, ORGBRISK) {
   EXPECT_EQ(64, descriptor1.cols);
   EXPECT_LT(50u, matches.size());
 }
+
+TEST_F(MatchingTest, BRISKPrepared) {
+  cv::Ptr<interest_point::BRISK> prepared = interest_point::BRISK::create(20, 4, 1.0);
+  prepared->prepareDetection(image1, 20);
+  // Going down again, the scores cached with a higher threshold must
+  // not be reused
+  for (int threshold : {20, 21, 45, 90, 110, 45, 20, 110, 110}) {
+    std::vector<cv::KeyPoint> expected, found;
+    interest_point::BRISK::create(threshold, 4, 1.0)->detect(image1, expected);
+    prepared->detectPrepared(threshold, found);
+    ExpectSameKeypoints(expected, found);
+  }
+}
+
+TEST_F(MatchingTest, ORGBRISKSinglePass) {
+  FLAGS_single_pass_detection = true;
+  interest_point::FeatureDetector ipdetect("ORGBRISK");
+  ipdetect.Detect(image1, &keypoints1, &descriptor1);
+  FLAGS_single_pass_detection = false;
+
+  // The same as detecting with the threshold picked
+  cv::Ptr<interest_point::BRISK> brisk =
+    interest_point::BRISK::create(ipdetect.GetDynamicThreshold(), FLAGS_orgbrisk_octaves,
+                                  FLAGS_orgbrisk_pattern_scale);
+  brisk->detect(image1, keypoints2);
+  brisk->compute(image1, keypoints2, descriptor2);
+  for (cv::KeyPoint& key : keypoints2) {
+    key.pt.x -= image1.cols / 2.0;
+    key.pt.y -= image1.rows / 2.0;
+  }
+  ExpectSameKeypoints(keypoints2, keypoints1);
+  ASSERT_EQ(descriptor2.size(), descriptor1.size());
+  EXPECT_EQ(0, cv::countNonZero(descriptor1 != descriptor2));
+}
+
+
+// Without ENABLE_BRISK_AVX2, or where the processor has no AVX2, these
+// compare the scalar code with itself.
+TEST_F(MatchingTest, BRISKKernels) {
+  // The corners are those the OpenCV detector finds
+  std::vector<cv::KeyPoint> expected, found;
+  cv::AgastFeatureDetector::create(20, false, cv::AgastFeatureDetector::OAST_9_16)->detect(image1, expected);
+  int pixel[16];
+  interest_point::makeAgastOffsets(pixel, image1.step, cv::AgastFeatureDetector::OAST_9_16);
+  std::vector<uchar> scores(image1.cols - 6), scalar_scores(image1.cols - 6);
+  for (int y = 3; y < image1.rows - 3; y++) {
+    interest_point::OastScores9_16(image1.ptr<uchar>(y) + 3, pixel, scores.size(), scores.data());
+    interest_point::OastScores9_16Scalar(image1.ptr<uchar>(y) + 3, pixel, scores.size(), scalar_scores.data());
+    ASSERT_TRUE(scores == scalar_scores);
+    for (int x = 3; x < image1.cols - 3; x++) {
+      if (scores[x - 3] >= 20)
+        found.push_back(cv::KeyPoint(cv::Point2f(x, y), 7.0f, -1, scores[x - 3]));
+    }
+  }
+  ExpectSameKeypoints(expected, found);
+
+  // The BRISK pattern at a few scales and rotations
+  cv::Mat integral;
+  cv::integral(image1, integral);
+  const float radii[] = {0.0f, 2.9f, 4.9f, 7.4f, 10.8f};
+  const int numbers[] = {1, 10, 14, 15, 20};
+  cv::RNG rng(0);
+  for (float scale : {0.3f, 0.8f, 1.0f, 1.7f, 4.0f}) {
+    for (int rot = 0; rot < 16; rot++) {
+      std::vector<interest_point::BriskPatternPoint> points;
+      std::vector<int> scaling, scaling2;
+      for (int ring = 0; ring < 5; ring++) {
+        for (int num = 0; num < numbers[ring]; num++) {
+          double angle = 2 * M_PI * (num / static_cast<double>(numbers[ring]) + rot / 16.0);
+          interest_point::BriskPatternPoint point;
+          point.x = scale * radii[ring] * std::cos(angle);
+          point.y = scale * radii[ring] * std::sin(angle);
+          point.sigma = ring == 0 ? 0.65f * scale : 1.3f * scale * radii[ring] * std::sin(M_PI / numbers[ring]);
+          points.push_back(point);
+          scaling.push_back(0);
+          scaling2.push_back(0);
+          interest_point::BriskScalingFactors(point.sigma, &scaling.back(), &scaling2.back());
+        }
+      }
+      int border = std::ceil(scale * (radii[4] + 1.3f * radii[4] * std::sin(M_PI / numbers[4]))) + 1;
+      for (int k = 0; k < 20; k++) {
+        float x = rng.uniform(static_cast<float>(border), static_cast<float>(image1.cols - border - 1));
+        float y = rng.uniform(static_cast<float>(border), static_cast<float>(image1.rows - border - 1));
+        std::vector<int> values(points.size()), scalar_values(points.size());
+        interest_point::SmoothedIntensities(image1.ptr(), image1.cols, image1.step, integral.ptr<int>(), x, y,
+                                            points.data(), scaling.data(), scaling2.data(), points.size(),
+                                            values.data());
+        interest_point::SmoothedIntensitiesScalar(image1.ptr(), image1.cols, image1.step, integral.ptr<int>(), x,
+                                                  y, points.data(), scaling.data(), scaling2.data(), points.size(),
+                                                  scalar_values.data());
+        ASSERT_TRUE(values == scalar_values);
+
+        // and a descriptor from them, with a number of pairs that is not a multiple of 32
+        std::vector<int> pairs_i, pairs_j;
+        for (size_t i = 1; i < points.size(); i++) {
+          for (size_t j = 0; j < i; j++) {
+            pairs_i.push_back(i);
+            pairs_j.push_back(j);
+          }
+        }
+        std::vector<unsigned int> bits(16, 0), scalar_bits(16, 0);
+        interest_point::PackComparisons(values.data(), pairs_i.data(), pairs_j.data(), 509, bits.data());
+        interest_point::PackComparisonsScalar(values.data(), pairs_i.data(), pairs_j.data(), 509,
+                                              scalar_bits.data());
+        ASSERT_TRUE(bits == scalar_bits);
+      }
+    }
+  }
+}
+
+TEST_F(MatchingTest, BRISKVectorized) {
+  cv::Ptr<interest_point::BRISK> brisk = interest_point::BRISK::create(20, 4, 1.0);
+  cv::setUseOptimized(false);
+  brisk->detectAndCompute(image1, cv::noArray(), keypoints1, descriptor1);
+  cv::setUseOptimized(true);
+  brisk->detectAndCompute(image1, cv::noArray(), keypoints2, descriptor2);
+  ExpectSameKeypoints(keypoints1, keypoints2);
+  ASSERT_EQ(descriptor1.size(), descriptor2.size());
+  EXPECT_EQ(0, cv::countNonZero(descriptor1 != descriptor2));
+}
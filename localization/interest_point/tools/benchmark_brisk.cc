@@ -0,0 +1,174 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/init.h>
+#include <interest_point/brisk.h>
+#include <interest_point/brisk_kernels.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Time each stage of BRISK over a sequence of images, with the scalar
+// code and with AVX2: building the scale space and finding the
+// AGAST corners, refining them into keypoints, and computing the
+// orientation and descriptor of each. Also checks the two give the same
+// keypoints and descriptors. The scalar run is with cv::setUseOptimized
+// off, which also turns off the optimized code of OpenCV itself, used
+// here to build the scale space.
+
+// Usage:
+// benchmark_brisk <images>
+// or
+// benchmark_brisk -image_list <file>
+
+DEFINE_string(image_list, "",
+              "Instead of the images being specified on the command line, read them from a file (one per line).");
+DEFINE_int32(threshold, 20,
+             "The AGAST threshold to detect with.");
+DEFINE_bool(histogram_equalization, false,
+            "If true, equalize the histogram of the images first, as when localizing with such a map.");
+
+DECLARE_int32(orgbrisk_octaves);         // defined in matching.cc
+DECLARE_double(orgbrisk_pattern_scale);
+
+namespace {
+
+// The time each stage took for each image, in seconds
+struct StageTimes {
+  std::vector<double> corners, refine, describe;
+};
+
+double Seconds(std::chrono::steady_clock::time_point const& start) {
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+void Run(std::vector<cv::Mat> const& images, StageTimes * times, std::vector<std::vector<cv::KeyPoint> > * keypoints,
+         std::vector<cv::Mat> * descriptors) {
+  cv::Ptr<interest_point::BRISK> brisk =
+    interest_point::BRISK::create(FLAGS_threshold, FLAGS_orgbrisk_octaves, FLAGS_orgbrisk_pattern_scale);
+  *times = StageTimes();
+  keypoints->resize(images.size());
+  descriptors->resize(images.size());
+  for (size_t i = 0; i < images.size(); i++) {
+    auto start = std::chrono::steady_clock::now();
+    brisk->prepareDetection(images[i], FLAGS_threshold);
+    times->corners.push_back(Seconds(start));
+    start = std::chrono::steady_clock::now();
+    brisk->detectPrepared(FLAGS_threshold, (*keypoints)[i]);
+    times->refine.push_back(Seconds(start));
+    start = std::chrono::steady_clock::now();
+    brisk->compute(images[i], (*keypoints)[i], (*descriptors)[i]);
+    times->describe.push_back(Seconds(start));
+  }
+}
+
+void Print(std::string const& name, std::vector<double> seconds) {
+  if (seconds.empty())
+    return;
+  std::sort(seconds.begin(), seconds.end());
+  double mean = 0;
+  for (size_t i = 0; i < seconds.size(); i++)
+    mean += seconds[i];
+  mean /= seconds.size();
+  printf("  %-9s mean %g median %g p90 %g max %g s\n", name.c_str(), mean, seconds[seconds.size() / 2],
+         seconds[static_cast<size_t>(0.9 * (seconds.size() - 1))], seconds.back());
+}
+
+void Print(std::string const& name, StageTimes const& times) {
+  printf("%s:\n", name.c_str());
+  Print("corners", times.corners);
+  Print("refine", times.refine);
+  Print("describe", times.describe);
+}
+
+bool SameKeypoints(std::vector<cv::KeyPoint> const& a, std::vector<cv::KeyPoint> const& b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].pt != b[i].pt || a[i].size != b[i].size || a[i].angle != b[i].angle ||
+        a[i].response != b[i].response || a[i].octave != b[i].octave)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  std::vector<std::string> files;
+  if (FLAGS_image_list == "") {
+    for (int i = 1; i < argc; i++)
+      files.push_back(argv[i]);
+  } else {
+    std::string file;
+    std::ifstream handle(FLAGS_image_list.c_str());
+    while (handle >> file)
+      files.push_back(file);
+  }
+  if (files.empty()) {
+    LOG(INFO) << "Usage: " << argv[0] << " [ <images> ] [ -image_list <file> ]";
+    return 0;
+  }
+
+  // Read all the images first, so only BRISK is timed
+  std::vector<cv::Mat> images;
+  for (size_t i = 0; i < files.size(); i++) {
+    cv::Mat image = cv::imread(files[i], CV_LOAD_IMAGE_GRAYSCALE);
+    if (image.rows == 0 || image.cols == 0)
+      LOG(FATAL) << "Found empty image in file: " << files[i];
+    if (FLAGS_histogram_equalization)
+      cv::equalizeHist(image, image);
+    images.push_back(image);
+  }
+
+  StageTimes scalar_times, vector_times;
+  std::vector<std::vector<cv::KeyPoint> > scalar_keypoints, vector_keypoints;
+  std::vector<cv::Mat> scalar_descriptors, vector_descriptors;
+  cv::setUseOptimized(false);
+  Run(images, &scalar_times, &scalar_keypoints, &scalar_descriptors);
+  cv::setUseOptimized(true);
+  if (!interest_point::BriskKernelsVectorized())
+    LOG(WARNING) << "Built without ENABLE_BRISK_AVX2, or this processor has no AVX2, so both runs are scalar.";
+  Run(images, &vector_times, &vector_keypoints, &vector_descriptors);
+  Print("scalar", scalar_times);
+  Print("vectorized", vector_times);
+
+  int num_different = 0;
+  for (size_t i = 0; i < images.size(); i++) {
+    if (!SameKeypoints(scalar_keypoints[i], vector_keypoints[i]) ||
+        scalar_descriptors[i].size() != vector_descriptors[i].size() ||
+        cv::countNonZero(scalar_descriptors[i] != vector_descriptors[i]) != 0)
+      num_different++;
+  }
+  printf("images with different keypoints or descriptors: %d / %d\n", num_different,
+         static_cast<int>(images.size()));
+
+  return num_different == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/init.h>
+#include <interest_point/matching.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Time feature detection over a sequence of images, such as nav cam
+// images extracted from a bag, detecting with retries and in a single
+// pass. As when localizing, the threshold found for each image is
+// where detection starts for the next one. The distribution of the
+// time per image, and how many images got a number of features out of
+// the desired range, are printed for each.
+
+// Usage:
+// benchmark_detection -detector ORGBRISK <images>
+// or
+// benchmark_detection -detector ORGBRISK -image_list <file>
+
+DEFINE_string(detector, "ORGBRISK",
+              "The feature detector to time, ORGBRISK or SURF.");
+DEFINE_string(image_list, "",
+              "Instead of the images being specified on the command line, read them from a file (one per line).");
+DEFINE_bool(histogram_equalization, false,
+            "If true, equalize the histogram of the images first, as when localizing with such a map.");
+
+DECLARE_bool(single_pass_detection);  // defined in matching.cc
+
+namespace {
+
+// The time to detect features in each image, in seconds, and whether it
+// got a number of features in the desired range
+void Run(std::vector<cv::Mat> const& images, std::vector<double> * seconds, int * num_out_of_range) {
+  interest_point::FeatureDetector detector(FLAGS_detector);
+  int min_features, max_features, max_retries;
+  double min_thresh, default_thresh, max_thresh;
+  detector.GetDetectorParams(min_features, max_features, max_retries, min_thresh, default_thresh, max_thresh);
+
+  seconds->clear();
+  *num_out_of_range = 0;
+  for (size_t i = 0; i < images.size(); i++) {
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    auto start = std::chrono::steady_clock::now();
+    detector.Detect(images[i], &keypoints, &descriptors);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    seconds->push_back(elapsed.count());
+    if (static_cast<int>(keypoints.size()) < min_features || static_cast<int>(keypoints.size()) > max_features)
+      (*num_out_of_range)++;
+  }
+}
+
+void Print(std::string const& name, std::vector<double> seconds, int num_out_of_range) {
+  if (seconds.empty())
+    return;
+  std::sort(seconds.begin(), seconds.end());
+  double mean = 0;
+  for (size_t i = 0; i < seconds.size(); i++)
+    mean += seconds[i];
+  mean /= seconds.size();
+  auto percentile = [&seconds](double p) { return seconds[static_cast<size_t>(p * (seconds.size() - 1))]; };
+  printf("%s: mean %g median %g p90 %g p99 %g max %g s, out of range %d / %d\n", name.c_str(), mean,
+         percentile(0.5), percentile(0.9), percentile(0.99), seconds.back(), num_out_of_range,
+         static_cast<int>(seconds.size()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  std::vector<std::string> files;
+  if (FLAGS_image_list == "") {
+    for (int i = 1; i < argc; i++)
+      files.push_back(argv[i]);
+  } else {
+    std::string file;
+    std::ifstream handle(FLAGS_image_list.c_str());
+    while (handle >> file)
+      files.push_back(file);
+  }
+  if (files.empty()) {
+    LOG(INFO) << "Usage: " << argv[0] << " -detector <detector> [ <images> ] [ -image_list <file> ]";
+    return 0;
+  }
+
+  // Read all the images first, so only detection is timed
+  std::vector<cv::Mat> images;
+  for (size_t i = 0; i < files.size(); i++) {
+    cv::Mat image = cv::imread(files[i], CV_LOAD_IMAGE_GRAYSCALE);
+    if (image.rows == 0 || image.cols == 0)
+      LOG(FATAL) << "Found empty image in file: " << files[i];
+    if (FLAGS_histogram_equalization)
+      cv::equalizeHist(image, image);
+    images.push_back(image);
+  }
+
+  std::vector<double> seconds;
+  int num_out_of_range;
+  FLAGS_single_pass_detection = false;
+  Run(images, &seconds, &num_out_of_range);
+  Print("retries", seconds, num_out_of_range);
+  FLAGS_single_pass_detection = true;
+  Run(images, &seconds, &num_out_of_range);
+  Print("single pass", seconds, num_out_of_range);
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_CHECKPOINT_H_
+#define SPARSE_MAPPING_CHECKPOINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace sparse_mapping {
+
+  // 64-bit FNV-1a hash of some bytes, continuing from hash
+  const uint64_t kHashSeed = 14695981039346656037ULL;
+  uint64_t HashBytes(void const* data, size_t size, uint64_t hash = kHashSeed);
+
+  // 64-bit FNV-1a hash of the contents of a file. Returns false if the
+  // file cannot be read.
+  bool HashFile(std::string const& filename, uint64_t * hash);
+
+  // Makes the directory and those above it, if missing
+  bool MakeDirectory(std::string const& dir);
+
+  // Copies a file, through a temporary file renamed at the end so dest is
+  // never left half written.
+  bool CopyFile(std::string const& src, std::string const& dest);
+
+  // Saved outputs of the stages of map building, in a directory. Each
+  // stage is saved with a key hashing the checkpoint version, the stage,
+  // the contents of its input files and its parameters, so a stage run
+  // again with the same key can restore its outputs instead of running.
+  class MapCheckpoints {
+   public:
+    // Increase when the outputs of a stage change for the same inputs
+    static const int kVersion = 1;
+
+    explicit MapCheckpoints(std::string const& dir);
+
+    // The key of a stage, or an empty key, which is never restored, if an
+    // input file cannot be read
+    std::string Key(std::string const& stage, std::vector<std::string> const& input_files,
+                    std::string const& params) const;
+
+    // If the stage was saved with this key, copies the saved outputs over
+    // output_files and returns true
+    bool Restore(std::string const& stage, std::string const& key,
+                 std::vector<std::string> const& output_files) const;
+
+    // Saves copies of the outputs of the stage under its key
+    bool Save(std::string const& stage, std::string const& key, std::string const& params,
+              std::vector<std::string> const& output_files) const;
+
+   private:
+    std::string KeyFile(std::string const& stage) const;
+    std::string SavedFile(std::string const& stage, std::string const& output_file) const;
+
+    std::string dir_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_CHECKPOINT_H_
@@ -0,0 +1,71 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_FEATURE_CACHE_H_
+#define SPARSE_MAPPING_FEATURE_CACHE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace cv {
+  class KeyPoint;
+  class Mat;
+}
+
+namespace sparse_mapping {
+
+  // Features detected in images, kept on disk so that detecting in the
+  // same image with the same detector again only reads them. An entry is
+  // found by a hash of the contents of the image file and of the detector
+  // parameters, so renamed or copied images are found too, and changed
+  // ones are not.
+  //
+  // Each entry is a file with a fixed header, the keypoints as float x, y
+  // pairs and the descriptor rows, which is read with mmap. An entry is
+  // written to a temporary file and renamed, so any number of processes
+  // can read and write the cache at the same time.
+  class FeatureCache {
+   public:
+    // Increase when the detectors change what they find
+    static const uint32_t kVersion = 1;
+
+    explicit FeatureCache(std::string const& dir);
+
+    // The key of the features of an image file with these contents,
+    // detected with these parameters
+    static uint64_t Key(std::vector<char> const& image_bytes, std::string const& params);
+
+    // Reads an entry, returns false if there is none. Only the positions
+    // of the keypoints are kept. end_threshold is the detector threshold
+    // after detection.
+    bool Read(uint64_t key, std::vector<cv::KeyPoint> * keypoints, cv::Mat * descriptors,
+              double * end_threshold) const;
+    bool Write(uint64_t key, std::vector<cv::KeyPoint> const& keypoints, cv::Mat const& descriptors,
+               double end_threshold) const;
+
+   private:
+    std::string File(uint64_t key) const;
+
+    std::string dir_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_FEATURE_CACHE_H_
@@ -0,0 +1,93 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_FLAT_VOCAB_DB_H_
+#define SPARSE_MAPPING_FLAT_VOCAB_DB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace cv {
+  class Mat;
+}
+
+namespace sparse_mapping {
+
+  // A copy of a DBoW2 binary vocabulary tree and its inverted file, laid
+  // out for querying. The nodes are stored breadth first, so the children
+  // of a node are contiguous, and their centroids are packed 64 bits at a
+  // time so the distance to a descriptor is a few popcounts. The inverted
+  // file is a compressed sparse row matrix, and image scores are summed
+  // into a dense array. Queries give the same results as DBoW2 with TF_IDF
+  // weighting and L1 scoring, which is what BuildDBforDBoW2 creates.
+  class FlatVocabDB {
+   public:
+    // descriptor_bytes is the size of a descriptor, num_entries the
+    // number of images in the database
+    FlatVocabDB(int descriptor_bytes, int num_words, int num_entries);
+
+    // Nodes must be added breadth first, starting with the root, whose
+    // centroid is ignored. Returns the index of the node.
+    int AddNode(uint8_t const* centroid, int word_id, double weight);
+    // The children of node are the count nodes starting at first
+    void SetChildren(int node, int first, int count);
+    // Entries must be added in increasing word_id, and for each word in
+    // the order of the DBoW2 inverted file
+    void AddEntry(int word_id, int entry_id, double weight);
+    // Call after adding everything, before querying
+    void Finish();
+
+    int NumNodes() const {return nodes_.size();}
+
+    // Returns the at most max_results entries most similar to the
+    // descriptors, one per row, best first. The scores are in [0, 1].
+    void Query(cv::Mat const& descriptors, int max_results,
+               std::vector<int> * entries,
+               std::vector<double> * scores = NULL) const;
+
+    // Hamming distance between the centroids of two nodes
+    int Distance(int node1, int node2) const;
+
+   private:
+    struct Node {
+      uint32_t first_child;  // 0 for a leaf, the root is never a child
+      uint32_t num_children;
+      int32_t word_id;
+      double weight;
+    };
+
+    template <int W>
+    int FindLeaf(uint64_t const* descriptor) const;
+    int FindLeaf(uint64_t const* descriptor) const;
+
+    int descriptor_bytes_;
+    int words_;  // 64 bit words in a centroid
+    int num_words_, num_entries_;
+    std::vector<Node> nodes_;
+    std::vector<uint64_t> centroids_;  // words_ per node
+    // inverted file, the entries of word w are [word_begin_[w], word_begin_[w + 1])
+    std::vector<uint32_t> word_begin_;
+    std::vector<uint32_t> entry_ids_;
+    std::vector<double> entry_weights_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_FLAT_VOCAB_DB_H_
@@ -0,0 +1,94 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_INCREMENTAL_BA_H_
+#define SPARSE_MAPPING_INCREMENTAL_BA_H_
+
+#include <Eigen/Geometry>
+
+#include <memory>
+#include <vector>
+
+namespace ceres {
+  class CostFunction;
+  class LossFunction;
+}
+
+namespace sparse_mapping {
+
+  class SparseMap;
+
+  // Adds the cameras of a map one at a time, in order, and after each one
+  // bundle adjusts the last several cameras, as IncrementalBA always did.
+  // The cameras, the points and the cost of each observation are kept from
+  // one camera to the next. A new camera only triangulates the tracks it
+  // extends, and the problem solved has only the points seen by the cameras
+  // optimized, so each camera costs about the same however many came
+  // before it.
+  class IncrementalBundleAdjuster {
+   public:
+    // The tracks, keypoints, focal length and user points are those of the
+    // map, which must outlive this.
+    explicit IncrementalBundleAdjuster(SparseMap const* map);
+    ~IncrementalBundleAdjuster();
+
+    // Adds the next camera at this initial pose and optimizes the cameras
+    // from first to the new one. The earlier cameras are held fixed.
+    void AddCamera(Eigen::Affine3d const& cam_t_global, int first);
+
+    int NumCameras() const {return cam_t_.size() / 3;}
+    Eigen::Affine3d Camera(int cid) const;
+
+   private:
+    struct Observation {
+      int cid, fid;
+      ceres::CostFunction* cost;  // made when first used
+    };
+
+    // Triangulates the track from the cameras added, returns false if the
+    // point is invalid
+    bool Triangulate(int pid);
+    void Optimize(int first, int last);
+    double* Translation(int cid) {return &cam_t_[3 * cid];}
+    double* Rotation(int cid) {return &cam_aa_[3 * cid];}
+
+    SparseMap const* map_;
+    double focal_length_;
+    std::unique_ptr<ceres::LossFunction> loss_;
+    // The cameras so far, as in BundleAdjust
+    std::vector<double> cam_t_, cam_aa_;
+    // The tracks, ordered by camera, and how much of each the cameras so
+    // far see
+    std::vector<std::vector<Observation> > tracks_;
+    std::vector<int> num_seen_;
+    std::vector<bool> active_;
+    // Marks the points added to the problem being made, all false between
+    // calls to Optimize so it does not clear the whole of it each time
+    std::vector<bool> in_problem_;
+    std::vector<double> xyz_;
+    // For each camera, its tracks and its position in each
+    std::vector<std::vector<std::pair<int, int> > > cid_to_pid_index_;
+    // Observations of the user points, with their costs
+    std::vector<std::vector<Observation> > user_tracks_;
+    std::vector<std::vector<std::pair<int, int> > > cid_to_user_pid_index_;
+    std::vector<double> user_xyz_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_INCREMENTAL_BA_H_
@@ -0,0 +1,65 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_KEYFRAME_INDEX_H_
+#define SPARSE_MAPPING_KEYFRAME_INDEX_H_
+
+#include <sparse_mapping/eigen_vectors.h>
+
+#include <Eigen/Geometry>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace sparse_mapping {
+
+  // Where the images of a map were taken from and which way they look,
+  // with the camera centers binned in a grid of cubes. Given a rough pose
+  // of a new image, as from the EKF, this finds the images of the map
+  // taken near it and looking about the same way, which are the only ones
+  // worth matching it to, without going through all of them.
+  class KeyframeIndex {
+   public:
+    KeyframeIndex() : cell_size_(1.0) {}
+
+    // Index the images with these poses, binning their centers in cubes
+    // with sides of cell_size meters.
+    void Build(std::vector<Eigen::Affine3d> const& cid_to_cam_t_global, double cell_size);
+
+    size_t Size() const { return centers_.size(); }
+
+    // The images whose center is within max_distance meters of the center
+    // of a camera with this pose, and whose viewing direction is within
+    // max_angle radians of its, the nearest first.
+    void Query(Eigen::Affine3d const& cam_t_global, double max_distance, double max_angle,
+               std::vector<int> * cids) const;
+
+   private:
+    typedef std::tuple<int, int, int> Cell;
+    Cell GetCell(Eigen::Vector3d const& center) const;
+
+    double cell_size_;
+    // The center and viewing direction of each image, in world coordinates
+    std::vector<Eigen::Vector3d> centers_, directions_;
+    std::map<Cell, std::vector<int> > cell_to_cids_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_KEYFRAME_INDEX_H_
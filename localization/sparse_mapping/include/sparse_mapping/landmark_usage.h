@@ -0,0 +1,74 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_LANDMARK_USAGE_H_
+#define SPARSE_MAPPING_LANDMARK_USAGE_H_
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+namespace sparse_mapping {
+
+  class SparseMap;
+
+  // Counts how often each landmark of a map is an inlier, or an outlier,
+  // of the poses found when localizing images against the map. PruneMap
+  // only removes features with no landmark, while many landmarks are
+  // matched but never inliers, or never matched at all, and only make
+  // the map bigger and matching slower. Those can then be removed, while
+  // each image of the map keeps enough landmarks to localize against.
+  class LandmarkUsage {
+   public:
+    // The map must outlive this
+    explicit LandmarkUsage(SparseMap * map);
+
+    // Localizes an image with these features against the map. If it
+    // localizes, counts each landmark matched to it as an inlier or an
+    // outlier, and notes the images of the map which see those landmarks
+    // as reached. Returns whether it localized, and how long that took.
+    bool Replay(cv::Mat const& descriptors, Eigen::Matrix2Xd const& keypoints, double * seconds);
+
+    int Inliers(int pid) const { return inliers_[pid]; }
+    int Outliers(int pid) const { return outliers_[pid]; }
+    bool Reached(int cid) const { return reached_[cid]; }
+
+    // Removes the landmarks which were inliers fewer than min_inliers
+    // times, or outliers more than max_outlier_ratio of the times they
+    // were matched. Only landmarks all of whose images were reached are
+    // judged, so the parts of the map the images replayed did not cover
+    // are left as they are. In each image which would then see fewer than
+    // min_landmarks_per_frame landmarks, the best of those are kept until
+    // it does. The features left with no landmark are removed, as by
+    // PruneMap, and the images are not changed. Returns how many
+    // landmarks were removed.
+    int Prune(int min_inliers, double max_outlier_ratio, int min_landmarks_per_frame);
+
+   private:
+    // Whether pid1 was more useful than pid2
+    bool Better(int pid1, int pid2) const;
+
+    SparseMap * map_;
+    std::vector<int> inliers_, outliers_;
+    std::vector<bool> reached_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_LANDMARK_USAGE_H_
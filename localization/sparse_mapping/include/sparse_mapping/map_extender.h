@@ -0,0 +1,84 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_MAP_EXTENDER_H_
+#define SPARSE_MAPPING_MAP_EXTENDER_H_
+
+#include <Eigen/Geometry>
+#include <opencv2/core/core.hpp>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sparse_mapping {
+
+  class SparseMap;
+
+  // Adds new images to a registered map with a vocab db, without
+  // rebuilding it. The new images are localized against the map, and
+  // those that localize become keyframes at the poses found. Their
+  // features are matched to the images most similar to them, in the map
+  // and among themselves, to extend the tracks of the map and make new
+  // ones. Bundle adjustment then refines only the new cameras and the
+  // points they see, with the cameras of the map seeing those points held
+  // fixed, and the new images are added to the vocab db. All of this costs
+  // time in proportion to the new images rather than to the map, except
+  // making the flat copy of the vocab db again, once per round.
+  class MapExtender {
+   public:
+    // The map must outlive this
+    explicit MapExtender(SparseMap * map);
+
+    // Adds those images which localize against the map, in rounds, so
+    // that images which only see what the images added before them see
+    // are added too. If prune is true, the features of the new images with
+    // no track are removed, as they are in a pruned map. Returns the number
+    // of images added, and the others in failed.
+    int AddImages(std::vector<std::string> const& images, bool prune,
+                  std::vector<std::string> * failed);
+
+    // Same as above, with the features of the images already detected
+    int AddImages(std::vector<std::string> const& images, std::vector<cv::Mat> const& descriptors,
+                  std::vector<Eigen::Matrix2Xd> const& keypoints, bool prune,
+                  std::vector<std::string> * failed);
+
+   private:
+    typedef std::map<int, int> Track;
+
+    // Appends the images as keyframes at these poses, then matches, makes
+    // the tracks and bundle adjusts
+    void AddKeyframes(std::vector<std::string> const& images,
+                      std::vector<Eigen::Affine3d> const& cam_t_global,
+                      std::vector<cv::Mat> const& descriptors,
+                      std::vector<Eigen::Matrix2Xd> const& keypoints, bool prune);
+    // Matches of features between the new cameras and the cameras most
+    // similar to them, which agree with the poses of both
+    void MatchNewCameras(int first_new, std::vector<std::pair<int, int> > * cid_pairs,
+                         std::vector<std::vector<std::pair<int, int> > > * fid_pairs) const;
+    // Whether the two features see a point in front of both cameras which
+    // projects within the reprojection threshold in both
+    bool Agree(int cid1, int fid1, int cid2, int fid2) const;
+
+    SparseMap * map_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_MAP_EXTENDER_H_
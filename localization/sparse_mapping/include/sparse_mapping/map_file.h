@@ -0,0 +1,105 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_MAP_FILE_H_
+#define SPARSE_MAPPING_MAP_FILE_H_
+
+#include <camera/camera_params.h>
+
+#include <Eigen/Geometry>
+
+#include <stddef.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cv {
+  class Mat;
+}
+
+namespace google {
+namespace protobuf {
+  class MessageLite;
+namespace io {
+  class ZeroCopyOutputStream;
+}  // namespace io
+}  // namespace protobuf
+}  // namespace google
+
+namespace sparse_mapping_protobuf {
+  class Map;
+  class Frame;
+  class Landmark;
+}  // namespace sparse_mapping_protobuf
+
+namespace sparse_mapping {
+
+  // A map file as written by SparseMap::Save, memory-mapped rather than
+  // loaded. Only the file names and poses of the images and where each
+  // frame and landmark starts in the file are kept in memory, and any
+  // frame or landmark is parsed from the file when asked for, so that
+  // maps much bigger than memory can be read. The vocab db, if any, is
+  // not read.
+  class MapFile {
+   public:
+    explicit MapFile(std::string const& filename);
+    ~MapFile();
+
+    sparse_mapping_protobuf::Map const& Header() const { return *header_; }
+    camera::CameraParameters GetCameraParameters() const;
+    int GetNumFrames() const { return frame_offsets_.size() - 1; }
+    int GetNumLandmarks() const { return landmark_offsets_.size() - 1; }
+    std::string const& GetFrameFilename(int cid) const { return cid_to_filename_[cid]; }
+    Eigen::Affine3d const& GetFrameGlobalTransform(int cid) const { return cid_to_cam_t_global_[cid]; }
+
+    void ReadFrame(int cid, sparse_mapping_protobuf::Frame * frame) const;
+    // The keypoints and descriptors of a frame, as SparseMap::Load makes them
+    void ReadFeatures(int cid, Eigen::Matrix2Xd * keypoints, cv::Mat * descriptors) const;
+    void ReadLandmark(int pid, Eigen::Vector3d * xyz, std::map<int, int> * cid_fid) const;
+
+    // For each of the given images, the track each of its features is
+    // in, in one pass over the landmarks
+    void FidToPid(std::vector<int> const& cids, std::vector<std::map<int, int> > * fid_to_pid) const;
+
+    // Writes a frame as it is in this file, without parsing it
+    void CopyFrame(int cid, google::protobuf::io::ZeroCopyOutputStream * output) const;
+
+   private:
+    MapFile(MapFile const&) = delete;
+    MapFile& operator=(MapFile const&) = delete;
+
+    // The message stored with its size before it, starting at begin
+    void Parse(size_t begin, size_t end, google::protobuf::MessageLite * message) const;
+    // Where the message starting at begin ends
+    size_t Skip(size_t begin) const;
+
+    std::string filename_;
+    char const* data_;
+    size_t size_;
+    std::unique_ptr<sparse_mapping_protobuf::Map> header_;
+    // One more offset than frames and landmarks, the end of the last one
+    std::vector<size_t> frame_offsets_, landmark_offsets_;
+    std::vector<std::string> cid_to_filename_;
+    std::vector<Eigen::Affine3d> cid_to_cam_t_global_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_MAP_FILE_H_
@@ -0,0 +1,80 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_MAP_REDUCER_H_
+#define SPARSE_MAPPING_MAP_REDUCER_H_
+
+#include <sparse_mapping/eigen_vectors.h>
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace sparse_mapping {
+
+  class SparseMap;
+
+  // Takes images out of a map as long as the images left still localize
+  // all the images of the map well, as tools/reduce_map.py does with
+  // extract_submap, build_map and localize_cams. Here the map is loaded
+  // once, the features of the images to localize are detected once, and
+  // each submap is made in memory and localized against on all threads.
+  class MapReducer {
+   public:
+    // The map must be unpruned, with all the features detected in its
+    // images, from which each submap builds its vocab db. It must outlive
+    // this. Detects the features of all its images to localize them later.
+    MapReducer(SparseMap * map, int db_depth, int db_branching_factor, int db_restarts);
+
+    // Same as above, with the features of the images of the map already
+    // detected
+    MapReducer(SparseMap * map, std::vector<cv::Mat> const& descriptors,
+               std::vector<Eigen::Matrix2Xd> const& keypoints,
+               int db_depth, int db_branching_factor, int db_restarts);
+
+    // The submap of the images with keep[cid], with no bundle adjustment,
+    // with a vocab db and pruned, as made by extract_submap and build_map
+    // -vocab_db
+    std::unique_ptr<SparseMap> Submap(std::vector<bool> const& keep) const;
+
+    // The position errors, in meters, of localizing each image of the map
+    // against the submap, or 1e+6 if localization fails
+    void LocalizationErrors(SparseMap * submap, std::vector<double> * errors) const;
+
+    // Starting with the images with keep[cid], puts back the images taken
+    // out which localize with an error bigger than localization_error,
+    // until none do, or at most max_iterations times. Writes to report how
+    // each iteration went. Returns the last submap, and its errors.
+    std::unique_ptr<SparseMap> Reduce(double localization_error, int max_iterations,
+                                      std::vector<bool> * keep, std::vector<double> * errors,
+                                      std::ostream * report) const;
+
+   private:
+    SparseMap * map_;
+    int db_depth_, db_branching_factor_, db_restarts_;
+    // The features of the images of the map, as when localizing them
+    std::vector<cv::Mat> descriptors_;
+    std::vector<Eigen::Matrix2Xd> keypoints_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_MAP_REDUCER_H_
@@ -44,6 +44,11 @@ namespace sparse_mapping {
 
   ceres::LossFunction* GetLossFunction(std::string cost_fun, double th);
 
+  // The error of projecting a point into a camera as BundleAdjust uses it,
+  // with parameter blocks camera translation, camera angle-axis rotation,
+  // point and focal length. The caller owns it.
+  ceres::CostFunction* CreateReprojectionError(Eigen::Vector2d const& observed);
+
 /**
  * Perform bundle adjustment.
  *
@@ -91,6 +96,9 @@ void BundleAdjust(std::vector<Eigen::Matrix2Xd> const& features_n,
 
 // Random integer between min (inclusive) and max (exclusive)
 int RandomInt(int min, int max);
+// Restarts the random integers of the calling thread, so a thread that
+// localizes several bags gives each the results it would get alone
+void ResetRandomInt(void);
 
 // Select a Random Observations
 void SelectRandomObservations(const std::vector<Eigen::Vector3d> & all_landmarks,
@@ -123,6 +131,7 @@ void EstimateCamera(camera::CameraModel * camera_estimate, std::vector<Eigen::Ve
  * point perspective algorithm, and does not use an initial guess for the camera pose.
  *
  * After the function is called, camera_estimate is updated to contain the results.
+ * On success, inlier_indices_out gets the indices of the inliers in landmarks.
  *
  * Returns zero on success, nonzero on failure.
  **/
@@ -131,7 +140,8 @@ int RansacEstimateCamera(const std::vector<Eigen::Vector3d> & landmarks,
                          int num_tries, int inlier_tolerance, camera::CameraModel * camera_estimate,
                          std::vector<Eigen::Vector3d> * inlier_landmarks_out = NULL,
                          std::vector<Eigen::Vector2d> * inlier_observations_out = NULL,
-                         bool verbose = false);
+                         bool verbose = false,
+                         std::vector<size_t> * inlier_indices_out = NULL);
 
 // ICP solver that given matching 3D points, finds an affine transform that
 // best fits in to out.
@@ -21,6 +21,7 @@
 
 #include <interest_point/matching.h>
 #include <sparse_mapping/eigen_vectors.h>
+#include <sparse_mapping/keyframe_index.h>
 #include <sparse_mapping/vocab_tree.h>
 #include <sparse_mapping/sparse_mapping.h>
 #include <camera/camera_model.h>
@@ -54,7 +55,9 @@ void InitializeCidFidToPid(int num_cid,
 /**
  * Estimate the camera pose for a set of image descriptors and keypoints.
  * Non-member function. We will invoke it both from within
- * the SparseMap class and from outside of it.
+ * the SparseMap class and from outside of it. If not NULL, matched_pids
+ * gets the landmarks matched to the image, and on success inlier_pids
+ * gets those of them that are inliers of the pose found.
  **/
 bool Localize(cv::Mat const& test_descriptors,
               Eigen::Matrix2Xd const& test_keypoints,
@@ -73,7 +76,9 @@ bool Localize(cv::Mat const& test_descriptors,
               std::vector<Eigen::Vector3d> const& pid_to_xyz,
               int num_ransac_iterations, int ransac_inlier_tolerance,
               int early_break_landmarks, int histogram_equalization,
-              std::vector<int> * cid_list);
+              std::vector<int> * cid_list,
+              std::vector<int> * matched_pids = NULL,
+              std::vector<int> * inlier_pids = NULL);
 
 /**
  * A class representing a sparse map, which consists of a collection
@@ -139,7 +144,21 @@ struct SparseMap {
                 camera::CameraModel* pose,
                 std::vector<Eigen::Vector3d>* inlier_landmarks,
                 std::vector<Eigen::Vector2d>* inlier_observations,
-                std::vector<int> * cid_list = NULL);
+                std::vector<int> * cid_list = NULL,
+                std::vector<int> * matched_pids = NULL,
+                std::vector<int> * inlier_pids = NULL);
+  /**
+   * Estimate the camera pose for an image, given a rough guess of it,
+   * as from the EKF. Only the images of the map taken near the guess
+   * and looking about the same way are matched to it, those the vocab
+   * db finds most similar first. If there are none, the whole map is
+   * searched, as the guess may be wrong.
+   **/
+  bool Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                Eigen::Affine3d const& prior_cam_t_global,
+                camera::CameraModel* pose,
+                std::vector<Eigen::Vector3d>* inlier_landmarks = NULL,
+                std::vector<Eigen::Vector2d>* inlier_observations = NULL);
   // access map frames
   /**
    * Get the number of keyframes in the map.
@@ -233,6 +252,7 @@ struct SparseMap {
    **/
   void ApplyTransform(Eigen::Affine3d const& T) {
     sparse_mapping::TransformCamerasAndPoints(T, &cid_to_cam_t_global_, &pid_to_xyz_);
+    InitializeKeyframeIndex();
   }
 
   // Load map. If localization is true, load only the parts of the map
@@ -242,7 +262,14 @@ struct SparseMap {
   // construct from pid_to_cid_fid
   void InitializeCidFidToPid();
 
-  // detect features with opencv
+  // construct from cid_to_cam_t_global, done on load, after bundle
+  // adjustment, and by ApplyTransform and MapExtender. Call it again
+  // after changing the poses of the images otherwise. Localizing with a
+  // prior makes it again if the number of images has changed.
+  void InitializeKeyframeIndex();
+
+  // detect features with opencv. With --feature_cache_dir, the features
+  // of image files are read from the cache when there.
   void DetectFeaturesFromFile(std::string const& filename,
                               bool multithreaded,
                               cv::Mat* descriptors,
@@ -253,6 +280,8 @@ struct SparseMap {
                       Eigen::Matrix2Xd* keypoints);
   // delete feature descriptors with no matching landmark
   void PruneMap(void);
+  // the same for one image
+  void PruneFrame(int cid);
 
   /**
    * Set the number of similar images queried by the VocabDB.
@@ -271,6 +300,7 @@ struct SparseMap {
   std::vector<cv::Mat> cid_to_descriptor_map_;
   // generated on load
   std::vector<std::map<int, int> > cid_fid_to_pid_;
+  KeyframeIndex keyframe_index_;
 
   interest_point::FeatureDetector detector_;
   camera::CameraParameters camera_params_;
@@ -305,6 +335,14 @@ struct SparseMap {
   SparseMap();
   SparseMap(SparseMap &);
   SparseMap& operator=(const SparseMap&);
+
+  // The features as the detector returns them, before undistortion, and
+  // the detector threshold after detection
+  void DetectRawFeatures(cv::Mat const& image, bool multithreaded, cv::Mat* descriptors,
+                         std::vector<cv::KeyPoint>* storage, double* end_threshold);
+  void UndistortKeypoints(std::vector<cv::KeyPoint> const& storage, Eigen::Matrix2Xd* keypoints);
+  // What the features detected in an image depend on besides the image
+  std::string DetectionParams(bool multithreaded);
 };
 }  // namespace sparse_mapping
 
@@ -111,6 +111,16 @@ namespace sparse_mapping {
                  std::string const& output_map,
                  sparse_mapping::SparseMap * C_out);
 
+  /**
+     Merge two maps as MergeMaps does, reading them from their files
+     as needed and writing the merged map as it is made, so that maps
+     bigger than memory can be merged.
+  **/
+  void MergeMapFiles(std::string const& A_file,
+                     std::string const& B_file,
+                     int num_image_overlaps_at_endpoints,
+                     std::string const& output_map);
+
   /**
      Take a map. Form a map with only a subset of the images.
      Bundle adjustment will happen later.
@@ -141,6 +151,11 @@ namespace sparse_mapping {
   void PrintTrackStats(std::vector<std::map<int, int> >const& pid_to_cid_fid,
                        std::string const& step);
 
+  // Join the tracks which go through the same feature of the same
+  // image, and remove the joined ones which go through two features
+  // of the same image.
+  void MergeTracks(std::vector<std::map<int, int> > * pid_to_cid_fid);
+
   void BuildMapFindEssentialAndInliers(const Eigen::Matrix2Xd & keypoints1,
                                        const Eigen::Matrix2Xd & keypoints2,
                                        const std::vector<cv::DMatch> & matches,
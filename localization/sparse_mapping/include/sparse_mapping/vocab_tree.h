@@ -69,6 +69,7 @@ namespace sparse_mapping {
   class SparseMap;
   class BinaryDB;
   class FloatDB;
+  class FlatVocabDB;
 
   // A class for holding a vocab database of features.
   struct VocabDB {
@@ -76,6 +77,8 @@ namespace sparse_mapping {
     // - DBoW2 binary descriptors (e.g., BRISK, BRIEF)
     // Only one of these is active at one time.
     BinaryDB  * binary_db;
+    // A copy of binary_db that is faster to query, if it could be made
+    FlatVocabDB * flat_db;
 
     int m_num_nodes;
     VocabDB();
@@ -91,8 +94,21 @@ namespace sparse_mapping {
                std::string const& descriptor,
                int depth, int branching_factor, int restarts);
 
+  // Same as above, for a map in memory, which is not saved
+  void BuildDB(sparse_mapping::SparseMap* map,
+               std::string const& descriptor,
+               int depth, int branching_factor, int restarts);
+
   void ResetDB(VocabDB* db);
 
+  // Adds images to the database, one per matrix of descriptors, after
+  // those already there. The vocabulary tree and its weights are kept.
+  // The flat copy is made again, which takes time in proportion to the
+  // whole database, so images are best added many at a time.
+  void AddToDB(std::string const& descriptor,
+               std::vector<cv::Mat> const& descriptors,
+               VocabDB * vocab_db);
+
   // Query similar images from database
   void QueryDB(std::string const& descriptor,
                VocabDB * vocab_db,
@@ -100,6 +116,15 @@ namespace sparse_mapping {
                cv::Mat const& descriptors,
                std::vector<int> * indices);
 
+  // Same as QueryDB, but always with DBoW2 rather than the flat copy
+  // of the database. Also returns the scores if not NULL.
+  void QueryDBoW2(std::string const& descriptor,
+                  VocabDB * vocab_db,
+                  int num_similar,
+                  cv::Mat const& descriptors,
+                  std::vector<int> * indices,
+                  std::vector<double> * scores = NULL);
+
   void BuildDBforDBoW2(sparse_mapping::SparseMap* map,
                        std::string const& descriptor,
                        int depth, int branching_factor, int restarts);
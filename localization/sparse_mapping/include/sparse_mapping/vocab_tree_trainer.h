@@ -0,0 +1,102 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_VOCAB_TREE_TRAINER_H_
+#define SPARSE_MAPPING_VOCAB_TREE_TRAINER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace cv {
+  class Mat;
+}
+
+namespace sparse_mapping {
+
+  // Builds a vocabulary tree of binary descriptors by hierarchical
+  // k-medians, like DBoW2's TemplatedVocabulary::create, but on several
+  // threads. The nodes of a level are clustered in parallel, and the
+  // assignment of descriptors to clusters is split among the threads when a
+  // level has fewer nodes than threads. Each node is seeded from the seed
+  // and its position in the tree, and the threads only ever add integers,
+  // so the tree is the same for any number of threads.
+  class VocabTreeTrainer {
+   public:
+    // Each node is clustered restarts times from a different k-means++
+    // start, keeping the clusters closest to their descriptors. Nodes
+    // with more than max_cluster_descriptors descriptors are clustered
+    // on that many of them picked at random, then all are assigned to the
+    // clusters found. 0 clusters all of them.
+    VocabTreeTrainer(int branching_factor, int depth, int restarts,
+                     int max_cluster_descriptors, int seed, int num_threads);
+    ~VocabTreeTrainer();
+
+    // The descriptors of all images, one per row
+    void Train(std::vector<cv::Mat> const& descriptors);
+
+    // The nodes, numbered as DBoW2 numbers them. The root is 0, and has
+    // no parent or centroid.
+    int NumNodes() const {return parents_.size();}
+    int Parent(int node) const {return parents_[node];}
+    // A row with the centroid of the node
+    cv::Mat Centroid(int node) const;
+
+   private:
+    class Workers;
+    struct Node {
+      int parent;
+      std::vector<int> children;
+      std::vector<uint64_t> centroid;
+    };
+    struct Task {
+      int node;
+      int level;
+      std::vector<uint32_t> rows;
+    };
+
+    // Clusters the rows of a task, giving the centroids and the rows of
+    // each cluster
+    void Cluster(Task const& task, int num_threads,
+                 std::vector<std::vector<uint64_t> > * centroids,
+                 std::vector<std::vector<uint32_t> > * groups) const;
+    // Assigns each row to its closest centroid, returns the sum of the distances
+    uint64_t Assign(std::vector<uint32_t> const& rows,
+                    std::vector<std::vector<uint64_t> > const& centroids,
+                    int num_threads, std::vector<int> * assignment) const;
+    uint64_t const* Row(uint32_t row) const {return &data_[static_cast<size_t>(row) * words_];}
+    int Distance(uint64_t const* a, uint64_t const* b) const;
+    void ParallelFor(int n, int num_threads, std::function<void(int, int)> f) const;
+
+    int branching_factor_, depth_, restarts_, max_cluster_descriptors_, seed_, num_threads_;
+    // the threads of ParallelFor, kept for the whole of Train
+    std::unique_ptr<Workers> workers_;
+    int bytes_, words_;  // of a descriptor
+    std::vector<uint64_t> data_;  // the descriptors, words_ each
+    std::vector<Node> nodes_;     // in the order they were made
+    // in DBoW2's order
+    std::vector<int> parents_;
+    std::vector<int> dbow_to_node_;
+  };
+
+}  // namespace sparse_mapping
+
+#endif  // SPARSE_MAPPING_VOCAB_TREE_TRAINER_H_
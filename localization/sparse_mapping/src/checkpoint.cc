@@ -0,0 +1,172 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/checkpoint.h>
+
+#include <glog/logging.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+void Hash(std::string const& s, uint64_t * hash) {
+  // The size first, so that consecutive strings can't run into each other
+  uint64_t size = s.size();
+  *hash = HashBytes(&size, sizeof(size), *hash);
+  *hash = HashBytes(s.data(), s.size(), *hash);
+}
+
+std::string Hex(uint64_t hash) {
+  char st[17];
+  snprintf(st, sizeof(st), "%016llx", static_cast<unsigned long long>(hash));  // NOLINT
+  return std::string(st);
+}
+
+std::string BaseName(std::string const& file) {
+  size_t pos = file.find_last_of('/');
+  return (pos == std::string::npos) ? file : file.substr(pos + 1);
+}
+
+}  // namespace
+
+uint64_t HashBytes(void const* data, size_t size, uint64_t hash) {
+  unsigned char const* bytes = static_cast<unsigned char const*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool HashFile(std::string const& filename, uint64_t * hash) {
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  if (!ifs.is_open())
+    return false;
+  *hash = kHashSeed;
+  std::vector<char> buffer(1 << 20);
+  while (ifs) {
+    ifs.read(buffer.data(), buffer.size());
+    *hash = HashBytes(buffer.data(), ifs.gcount(), *hash);
+  }
+  return !ifs.bad();
+}
+
+bool MakeDirectory(std::string const& dir) {
+  for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+    std::string sub = dir.substr(0, pos);
+    if (mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+    if (pos == std::string::npos)
+      return true;
+  }
+}
+
+bool CopyFile(std::string const& src, std::string const& dest) {
+  std::string tmp = dest + ".tmp";
+  {
+    std::ifstream ifs(src.c_str(), std::ios::binary);
+    std::ofstream ofs(tmp.c_str(), std::ios::binary);
+    if (!ifs.is_open() || !ofs.is_open())
+      return false;
+    ofs << ifs.rdbuf();
+    if (!ofs.good())
+      return false;
+  }
+  return rename(tmp.c_str(), dest.c_str()) == 0;
+}
+
+MapCheckpoints::MapCheckpoints(std::string const& dir) : dir_(dir) {
+  if (!MakeDirectory(dir_))
+    LOG(FATAL) << "Cannot make the checkpoint directory: " << dir_;
+}
+
+std::string MapCheckpoints::KeyFile(std::string const& stage) const {
+  return dir_ + "/" + stage + ".key";
+}
+
+std::string MapCheckpoints::SavedFile(std::string const& stage, std::string const& output_file) const {
+  return dir_ + "/" + stage + "." + BaseName(output_file);
+}
+
+std::string MapCheckpoints::Key(std::string const& stage, std::vector<std::string> const& input_files,
+                                std::string const& params) const {
+  uint64_t hash = kHashSeed;
+  Hash(std::to_string(kVersion), &hash);
+  Hash(stage, &hash);
+  for (std::string const& file : input_files) {
+    uint64_t file_hash;
+    if (!HashFile(file, &file_hash)) {
+      LOG(INFO) << "Cannot read " << file << ", stage " << stage << " will not be restored.";
+      return "";
+    }
+    hash = HashBytes(&file_hash, sizeof(file_hash), hash);
+  }
+  Hash(params, &hash);
+  return Hex(hash);
+}
+
+bool MapCheckpoints::Restore(std::string const& stage, std::string const& key,
+                             std::vector<std::string> const& output_files) const {
+  if (key.empty())
+    return false;
+  std::ifstream ifs(KeyFile(stage).c_str());
+  std::string saved_key;
+  if (!std::getline(ifs, saved_key) || saved_key != key)
+    return false;
+  for (std::string const& file : output_files) {
+    if (!CopyFile(SavedFile(stage, file), file)) {
+      LOG(WARNING) << "Cannot restore " << file << " from the checkpoint of stage " << stage << ".";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MapCheckpoints::Save(std::string const& stage, std::string const& key, std::string const& params,
+                          std::vector<std::string> const& output_files) const {
+  if (key.empty())
+    return false;
+  // The old key goes first, so that a checkpoint saved in part is never
+  // restored
+  std::remove(KeyFile(stage).c_str());
+  for (std::string const& file : output_files) {
+    if (!CopyFile(file, SavedFile(stage, file))) {
+      LOG(WARNING) << "Cannot save " << file << " in the checkpoint of stage " << stage << ".";
+      return false;
+    }
+  }
+  // The parameters are there for whoever looks at the checkpoint
+  std::string tmp = KeyFile(stage) + ".tmp";
+  {
+    std::ofstream ofs(tmp.c_str());
+    ofs << key << "\n" << params;
+    if (!ofs.good())
+      return false;
+  }
+  return rename(tmp.c_str(), KeyFile(stage).c_str()) == 0;
+}
+
+}  // namespace sparse_mapping
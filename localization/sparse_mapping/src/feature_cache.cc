@@ -0,0 +1,164 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/checkpoint.h>
+#include <sparse_mapping/feature_cache.h>
+
+#include <glog/logging.h>
+#include <opencv2/core/core.hpp>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+char const kMagic[8] = {'F', 'E', 'A', 'T', 'C', 'A', 'C', 'H'};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_keypoints;
+  uint64_t key;
+  int32_t descriptor_type;
+  uint32_t descriptor_cols;
+  double end_threshold;
+};
+
+size_t DescriptorBytes(Header const& header) {
+  if (header.num_keypoints == 0 || header.descriptor_cols == 0)
+    return 0;
+  return static_cast<size_t>(header.num_keypoints) * header.descriptor_cols *
+    CV_ELEM_SIZE(header.descriptor_type);
+}
+
+}  // namespace
+
+FeatureCache::FeatureCache(std::string const& dir) : dir_(dir) {}
+
+uint64_t FeatureCache::Key(std::vector<char> const& image_bytes, std::string const& params) {
+  uint32_t version = kVersion;
+  uint64_t hash = HashBytes(&version, sizeof(version));
+  hash = HashBytes(image_bytes.data(), image_bytes.size(), hash);
+  return HashBytes(params.data(), params.size(), hash);
+}
+
+std::string FeatureCache::File(uint64_t key) const {
+  char name[32];
+  // The first byte picks a subdirectory, to keep directories small
+  snprintf(name, sizeof(name), "%02x/%016llx", static_cast<unsigned>(key >> 56),
+           static_cast<unsigned long long>(key));  // NOLINT
+  return dir_ + "/" + name;
+}
+
+bool FeatureCache::Read(uint64_t key, std::vector<cv::KeyPoint> * keypoints, cv::Mat * descriptors,
+                        double * end_threshold) const {
+  std::string file = File(key);
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  void * data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  char const* bytes = static_cast<char const*>(data);
+  Header header;
+  memcpy(&header, bytes, sizeof(header));
+  size_t points_bytes = 2 * sizeof(float) * header.num_keypoints;
+  bool valid = memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion &&
+    header.key == key && size == sizeof(Header) + points_bytes + DescriptorBytes(header);
+  if (!valid) {
+    LOG(WARNING) << "Ignoring invalid feature cache entry: " << file;
+  } else {
+    float const* points = reinterpret_cast<float const*>(bytes + sizeof(Header));
+    keypoints->resize(header.num_keypoints);
+    for (size_t i = 0; i < keypoints->size(); i++)
+      (*keypoints)[i] = cv::KeyPoint(points[2 * i], points[2 * i + 1], 1);
+    if (DescriptorBytes(header) == 0) {
+      *descriptors = cv::Mat();
+    } else {
+      descriptors->create(header.num_keypoints, header.descriptor_cols, header.descriptor_type);
+      memcpy(descriptors->data, bytes + sizeof(Header) + points_bytes, DescriptorBytes(header));
+    }
+    *end_threshold = header.end_threshold;
+  }
+  munmap(data, size);
+  return valid;
+}
+
+bool FeatureCache::Write(uint64_t key, std::vector<cv::KeyPoint> const& keypoints, cv::Mat const& descriptors,
+                         double end_threshold) const {
+  if (!descriptors.empty() && static_cast<size_t>(descriptors.rows) != keypoints.size()) {
+    LOG(WARNING) << "Not caching " << descriptors.rows << " descriptors for " << keypoints.size() << " keypoints.";
+    return false;
+  }
+
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_keypoints = keypoints.size();
+  header.key = key;
+  header.descriptor_type = descriptors.empty() ? 0 : descriptors.type();
+  header.descriptor_cols = descriptors.empty() ? 0 : descriptors.cols;
+  header.end_threshold = end_threshold;
+  std::vector<float> points(2 * keypoints.size());
+  for (size_t i = 0; i < keypoints.size(); i++) {
+    points[2 * i] = keypoints[i].pt.x;
+    points[2 * i + 1] = keypoints[i].pt.y;
+  }
+  cv::Mat rows = descriptors.isContinuous() ? descriptors : descriptors.clone();
+
+  std::string file = File(key);
+  if (!MakeDirectory(file.substr(0, file.find_last_of('/'))))
+    return false;
+  // Unique to this process and thread
+  std::string tmp = file + ".tmp." + std::to_string(getpid()) + "." +
+    std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream ofs(tmp.c_str(), std::ios::binary);
+    ofs.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<char const*>(points.data()), points.size() * sizeof(float));
+    ofs.write(reinterpret_cast<char const*>(rows.data), DescriptorBytes(header));
+    if (!ofs.good()) {
+      ofs.close();
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+  return rename(tmp.c_str(), file.c_str()) == 0;
+}
+
+}  // namespace sparse_mapping
@@ -0,0 +1,231 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/flat_vocab_db.h>
+
+#include <glog/logging.h>
+#include <opencv2/core/core.hpp>
+
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+template <int W>
+inline int HammingDistance(uint64_t const* a, uint64_t const* b) {
+  int d = 0;
+  for (int i = 0; i < W; i++)
+    d += __builtin_popcountll(a[i] ^ b[i]);
+  return d;
+}
+
+inline int HammingDistance(uint64_t const* a, uint64_t const* b, int words) {
+  int d = 0;
+  for (int i = 0; i < words; i++)
+    d += __builtin_popcountll(a[i] ^ b[i]);
+  return d;
+}
+
+// Same as DBoW2::Result, which is sorted on the score alone. The ties are
+// then ordered by std::sort the same way as in DBoW2, as the input is in the
+// same order.
+struct Result {
+  uint32_t id;
+  double score;
+  bool operator<(Result const& r) const {return score < r.score;}
+};
+
+// Reused by the queries of each thread, the dense arrays are all zero
+// between queries
+struct QueryScratch {
+  std::vector<uint64_t> descriptors;
+  std::vector<double> bow;            // weight of each word
+  std::vector<uint32_t> bow_words;    // the words with a weight
+  std::vector<double> scores;         // of each entry
+  std::vector<uint32_t> scored;       // the entries with a score
+  std::vector<Result> results;
+};
+
+thread_local QueryScratch scratch;
+
+}  // namespace
+
+FlatVocabDB::FlatVocabDB(int descriptor_bytes, int num_words, int num_entries):
+  descriptor_bytes_(descriptor_bytes), words_((descriptor_bytes + 7) / 8),
+  num_words_(num_words), num_entries_(num_entries), word_begin_(num_words + 1, 0) {
+}
+
+int FlatVocabDB::AddNode(uint8_t const* centroid, int word_id, double weight) {
+  Node node;
+  node.first_child = 0;
+  node.num_children = 0;
+  node.word_id = word_id;
+  node.weight = weight;
+  nodes_.push_back(node);
+  // pad the last word with zeros, which the query descriptors are too
+  centroids_.resize(centroids_.size() + words_, 0);
+  if (centroid != NULL)
+    memcpy(&centroids_[centroids_.size() - words_], centroid, descriptor_bytes_);
+  return nodes_.size() - 1;
+}
+
+void FlatVocabDB::SetChildren(int node, int first, int count) {
+  nodes_[node].first_child = first;
+  nodes_[node].num_children = count;
+}
+
+void FlatVocabDB::AddEntry(int word_id, int entry_id, double weight) {
+  word_begin_[word_id + 1]++;
+  entry_ids_.push_back(entry_id);
+  entry_weights_.push_back(weight);
+}
+
+void FlatVocabDB::Finish() {
+  for (int w = 0; w < num_words_; w++)
+    word_begin_[w + 1] += word_begin_[w];
+}
+
+int FlatVocabDB::Distance(int node1, int node2) const {
+  return HammingDistance(&centroids_[node1 * words_], &centroids_[node2 * words_], words_);
+}
+
+// Goes down the tree to the closest child at each level, the first one on
+// ties, as DBoW2 does
+template <int W>
+int FlatVocabDB::FindLeaf(uint64_t const* descriptor) const {
+  uint32_t n = 0;
+  while (nodes_[n].num_children > 0) {
+    uint32_t first = nodes_[n].first_child, last = first + nodes_[n].num_children;
+    uint64_t const* centroid = &centroids_[first * W];
+    int best_d = HammingDistance<W>(descriptor, centroid);
+    n = first;
+    for (uint32_t c = first + 1; c < last; c++) {
+      centroid += W;
+      int d = HammingDistance<W>(descriptor, centroid);
+      if (d < best_d) {
+        best_d = d;
+        n = c;
+      }
+    }
+  }
+  return n;
+}
+
+int FlatVocabDB::FindLeaf(uint64_t const* descriptor) const {
+  uint32_t n = 0;
+  while (nodes_[n].num_children > 0) {
+    uint32_t first = nodes_[n].first_child, last = first + nodes_[n].num_children;
+    int best_d = HammingDistance(descriptor, &centroids_[first * words_], words_);
+    n = first;
+    for (uint32_t c = first + 1; c < last; c++) {
+      int d = HammingDistance(descriptor, &centroids_[c * words_], words_);
+      if (d < best_d) {
+        best_d = d;
+        n = c;
+      }
+    }
+  }
+  return n;
+}
+
+void FlatVocabDB::Query(cv::Mat const& descriptors, int max_results,
+                        std::vector<int> * entries, std::vector<double> * scores) const {
+  entries->clear();
+  if (scores != NULL)
+    scores->clear();
+  if (nodes_.empty() || descriptors.rows == 0)
+    return;
+  if (descriptors.cols > descriptor_bytes_)
+    LOG(FATAL) << "Descriptors of " << descriptors.cols << " bytes are larger than the vocabulary's.";
+
+  QueryScratch & s = scratch;
+  s.bow.resize(num_words_, 0);
+  s.scores.resize(num_entries_, 0);
+  s.bow_words.clear();
+  s.scored.clear();
+  s.results.clear();
+
+  // Copy the descriptors to whole words
+  s.descriptors.assign(descriptors.rows * words_, 0);
+  for (int r = 0; r < descriptors.rows; r++)
+    memcpy(&s.descriptors[r * words_], descriptors.ptr<uint8_t>(r), descriptors.cols);
+
+  // The bag of words, summed in the order of the descriptors like DBoW2
+  for (int r = 0; r < descriptors.rows; r++) {
+    uint64_t const* d = &s.descriptors[r * words_];
+    int leaf;
+    switch (words_) {
+      case 4: leaf = FindLeaf<4>(d); break;   // 256 bits, ORB
+      case 8: leaf = FindLeaf<8>(d); break;   // 512 bits, BRISK
+      default: leaf = FindLeaf(d); break;
+    }
+    Node const& node = nodes_[leaf];
+    if (node.weight > 0) {
+      if (s.bow[node.word_id] == 0)
+        s.bow_words.push_back(node.word_id);
+      s.bow[node.word_id] += node.weight;
+    }
+  }
+  // DBoW2 keeps the bag of words in a map, so normalize and score in word
+  // order to round the same way
+  std::sort(s.bow_words.begin(), s.bow_words.end());
+  double norm = 0;
+  for (uint32_t w : s.bow_words)
+    norm += fabs(s.bow[w]);
+
+  for (uint32_t w : s.bow_words) {
+    double q = s.bow[w];
+    if (norm > 0)
+      q /= norm;
+    s.bow[w] = 0;
+    for (uint32_t i = word_begin_[w]; i < word_begin_[w + 1]; i++) {
+      uint32_t e = entry_ids_[i];
+      double d = entry_weights_[i];
+      if (s.scores[e] == 0)
+        s.scored.push_back(e);
+      s.scores[e] += fabs(q - d) - fabs(q) - fabs(d);
+    }
+  }
+
+  // L1 scores are in [-2 best, 0 worst]
+  std::sort(s.scored.begin(), s.scored.end());
+  s.results.reserve(s.scored.size());
+  for (uint32_t e : s.scored) {
+    Result r;
+    r.id = e;
+    r.score = s.scores[e];
+    s.results.push_back(r);
+    s.scores[e] = 0;
+  }
+  std::sort(s.results.begin(), s.results.end());
+  if (max_results > 0 && static_cast<int>(s.results.size()) > max_results)
+    s.results.resize(max_results);
+
+  for (Result const& r : s.results) {
+    entries->push_back(r.id);
+    if (scores != NULL)
+      scores->push_back(-r.score / 2.0);
+  }
+}
+
+}  // namespace sparse_mapping
@@ -0,0 +1,203 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <camera/camera_model.h>
+#include <ff_common/thread.h>
+#include <sparse_mapping/incremental_ba.h>
+#include <sparse_mapping/reprojection.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <ceres/ceres.h>
+#include <glog/logging.h>
+
+#include <openMVG/multiview/projection.hpp>
+#include <openMVG/multiview/triangulation_nview.hpp>
+#include <openMVG/numeric/numeric.h>
+
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace sparse_mapping {
+
+IncrementalBundleAdjuster::IncrementalBundleAdjuster(SparseMap const* map)
+  : map_(map), focal_length_(map->camera_params_.GetFocalLength()), loss_(new ceres::CauchyLoss(0.5)) {
+  int num_cams = map->cid_to_keypoint_map_.size();
+  cid_to_pid_index_.resize(num_cams);
+  tracks_.resize(map->pid_to_cid_fid_.size());
+  for (size_t pid = 0; pid < tracks_.size(); pid++) {
+    for (std::pair<int, int> const& cid_fid : map->pid_to_cid_fid_[pid]) {
+      cid_to_pid_index_[cid_fid.first].push_back(std::make_pair(pid, tracks_[pid].size()));
+      tracks_[pid].push_back(Observation{cid_fid.first, cid_fid.second, NULL});
+    }
+  }
+  num_seen_.resize(tracks_.size(), 0);
+  active_.resize(tracks_.size(), false);
+  in_problem_.resize(tracks_.size(), false);
+  xyz_.resize(3 * tracks_.size(), 0.0);
+
+  cid_to_user_pid_index_.resize(num_cams);
+  user_tracks_.resize(map->user_pid_to_cid_fid_.size());
+  user_xyz_.resize(3 * user_tracks_.size());
+  for (size_t pid = 0; pid < user_tracks_.size(); pid++) {
+    for (std::pair<int, int> const& cid_fid : map->user_pid_to_cid_fid_[pid]) {
+      if (cid_fid.first >= num_cams)
+        continue;
+      cid_to_user_pid_index_[cid_fid.first].push_back(std::make_pair(pid, user_tracks_[pid].size()));
+      user_tracks_[pid].push_back(Observation{cid_fid.first, cid_fid.second, NULL});
+    }
+    for (int i = 0; i < 3; i++)
+      user_xyz_[3 * pid + i] = map->user_pid_to_xyz_[pid][i];
+  }
+}
+
+IncrementalBundleAdjuster::~IncrementalBundleAdjuster() {
+  for (std::vector<Observation> const& track : tracks_)
+    for (Observation const& obs : track)
+      delete obs.cost;
+  for (std::vector<Observation> const& track : user_tracks_)
+    for (Observation const& obs : track)
+      delete obs.cost;
+}
+
+Eigen::Affine3d IncrementalBundleAdjuster::Camera(int cid) const {
+  Eigen::Affine3d cam_t_global = Eigen::Affine3d::Identity();
+  Eigen::Matrix3d r;
+  camera::RodriguesToRotation(Eigen::Vector3d(cam_aa_[3 * cid], cam_aa_[3 * cid + 1], cam_aa_[3 * cid + 2]), &r);
+  cam_t_global.linear() = r;
+  cam_t_global.translation() = Eigen::Vector3d(cam_t_[3 * cid], cam_t_[3 * cid + 1], cam_t_[3 * cid + 2]);
+  return cam_t_global;
+}
+
+void IncrementalBundleAdjuster::AddCamera(Eigen::Affine3d const& cam_t_global, int first) {
+  int cid = NumCameras();
+  CHECK_LT(cid, static_cast<int>(cid_to_pid_index_.size())) << "The map has no more cameras.";
+  Eigen::Vector3d aa;
+  camera::RotationToRodrigues(cam_t_global.linear(), &aa);
+  for (int i = 0; i < 3; i++) {
+    cam_t_.push_back(cam_t_global.translation()[i]);
+    cam_aa_.push_back(aa[i]);
+  }
+
+  // Using tracks of length >= 3 only greatly increases the reliability,
+  // but there are none yet for the second camera.
+  size_t min_track_size = (cid == 1) ? 2 : 3;
+  if (cid == 2) {
+    for (size_t pid = 0; pid < tracks_.size(); pid++)
+      if (num_seen_[pid] < 3)
+        active_[pid] = false;
+  }
+
+  // Only the tracks this camera extends are triangulated again, the
+  // others keep the points optimized so far.
+  for (std::pair<int, int> const& pid_index : cid_to_pid_index_[cid]) {
+    int pid = pid_index.first;
+    num_seen_[pid] = pid_index.second + 1;
+    if (num_seen_[pid] >= static_cast<int>(min_track_size))
+      active_[pid] = Triangulate(pid);
+  }
+
+  if (cid > 0)
+    Optimize(first, cid);
+}
+
+bool IncrementalBundleAdjuster::Triangulate(int pid) {
+  Eigen::Matrix3d k;
+  k << focal_length_, 0, 0,
+    0, focal_length_, 0,
+    0, 0, 1;
+
+  // openMVG::Triangulation holds pointers to the cameras
+  std::vector<openMVG::Mat34> p(num_seen_[pid]);
+  openMVG::Triangulation tri;
+  for (int i = 0; i < num_seen_[pid]; i++) {
+    Observation const& obs = tracks_[pid][i];
+    Eigen::Affine3d cam_t_global = Camera(obs.cid);
+    openMVG::P_From_KRt(k, cam_t_global.linear(), cam_t_global.translation(), &p[i]);
+    tri.add(p[i], map_->cid_to_keypoint_map_[obs.cid].col(obs.fid));
+  }
+  Eigen::Vector3d solution = tri.compute();
+  if (std::isnan(solution[0]) || tri.minDepth() < 0)
+    return false;
+  for (int i = 0; i < 3; i++)
+    xyz_[3 * pid + i] = solution[i];
+  return true;
+}
+
+void IncrementalBundleAdjuster::Optimize(int first, int last) {
+  // The problem does not own the costs and the loss, so it can be made
+  // again for each camera, with only the points seen by the cameras
+  // optimized and all the observations of those points.
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+
+  std::vector<int> added;
+  for (int cid = first; cid <= last; cid++) {
+    for (std::pair<int, int> const& pid_index : cid_to_pid_index_[cid]) {
+      int pid = pid_index.first;
+      if (!active_[pid] || in_problem_[pid])
+        continue;
+      in_problem_[pid] = true;
+      added.push_back(pid);
+      for (int i = 0; i < num_seen_[pid]; i++) {
+        Observation & obs = tracks_[pid][i];
+        if (obs.cost == NULL)
+          obs.cost = CreateReprojectionError(map_->cid_to_keypoint_map_[obs.cid].col(obs.fid));
+        problem.AddResidualBlock(obs.cost, loss_.get(), Translation(obs.cid), Rotation(obs.cid),
+                                 &xyz_[3 * pid], &focal_length_);
+        if (obs.cid < first) {
+          problem.SetParameterBlockConstant(Translation(obs.cid));
+          problem.SetParameterBlockConstant(Rotation(obs.cid));
+        }
+      }
+    }
+  }
+  // Clear only what was set, the rest is still false
+  for (int pid : added)
+    in_problem_[pid] = false;
+
+  // The user points are measurements to register against, so they are
+  // fixed and use l2. Those seen by fixed cameras only change nothing.
+  for (int cid = first; cid <= last; cid++) {
+    for (std::pair<int, int> const& pid_index : cid_to_user_pid_index_[cid]) {
+      Observation & obs = user_tracks_[pid_index.first][pid_index.second];
+      if (obs.cost == NULL)
+        obs.cost = CreateReprojectionError(map_->user_cid_to_keypoint_map_[obs.cid].col(obs.fid));
+      problem.AddResidualBlock(obs.cost, NULL, Translation(cid), Rotation(cid),
+                               &user_xyz_[3 * pid_index.first], &focal_length_);
+      problem.SetParameterBlockConstant(&user_xyz_[3 * pid_index.first]);
+    }
+  }
+
+  if (problem.NumResidualBlocks() == 0)
+    return;
+  problem.SetParameterBlockConstant(&focal_length_);
+
+  ceres::Solver::Options options;
+  options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+  options.max_num_iterations = 500;
+  options.logging_type = ceres::SILENT;
+  options.num_threads = FLAGS_num_threads;
+  ceres::Solver::Summary summary;
+  ceres::Solve(options, &problem, &summary);
+}
+
+}  // namespace sparse_mapping
@@ -0,0 +1,91 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/keyframe_index.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+// The center of a camera and the direction it looks in, in world coordinates
+void CenterAndDirection(Eigen::Affine3d const& cam_t_global, Eigen::Vector3d * center, Eigen::Vector3d * direction) {
+  Eigen::Matrix3d global_r_cam = cam_t_global.linear().inverse();
+  *center = -global_r_cam * cam_t_global.translation();
+  *direction = (global_r_cam * Eigen::Vector3d::UnitZ()).normalized();
+}
+
+}  // namespace
+
+void KeyframeIndex::Build(std::vector<Eigen::Affine3d> const& cid_to_cam_t_global, double cell_size) {
+  if (cell_size <= 0)
+    LOG(FATAL) << "The cell size of the keyframe index must be positive.";
+  cell_size_ = cell_size;
+  centers_.resize(cid_to_cam_t_global.size());
+  directions_.resize(cid_to_cam_t_global.size());
+  cell_to_cids_.clear();
+  for (size_t cid = 0; cid < cid_to_cam_t_global.size(); cid++) {
+    CenterAndDirection(cid_to_cam_t_global[cid], &centers_[cid], &directions_[cid]);
+    cell_to_cids_[GetCell(centers_[cid])].push_back(cid);
+  }
+}
+
+void KeyframeIndex::Query(Eigen::Affine3d const& cam_t_global, double max_distance, double max_angle,
+                          std::vector<int> * cids) const {
+  cids->clear();
+  Eigen::Vector3d center, direction;
+  CenterAndDirection(cam_t_global, &center, &direction);
+  double min_cos = std::cos(max_angle);
+
+  // Only the cubes the ball of radius max_distance touches
+  Cell lo = GetCell(center - Eigen::Vector3d::Constant(max_distance));
+  Cell hi = GetCell(center + Eigen::Vector3d::Constant(max_distance));
+  std::vector<std::pair<double, int> > found;
+  for (int x = std::get<0>(lo); x <= std::get<0>(hi); x++) {
+    for (int y = std::get<1>(lo); y <= std::get<1>(hi); y++) {
+      for (int z = std::get<2>(lo); z <= std::get<2>(hi); z++) {
+        auto it = cell_to_cids_.find(Cell(x, y, z));
+        if (it == cell_to_cids_.end())
+          continue;
+        for (int cid : it->second) {
+          double distance = (centers_[cid] - center).norm();
+          if (distance <= max_distance && directions_[cid].dot(direction) >= min_cos)
+            found.push_back(std::make_pair(distance, cid));
+        }
+      }
+    }
+  }
+
+  std::sort(found.begin(), found.end());
+  for (size_t i = 0; i < found.size(); i++)
+    cids->push_back(found[i].second);
+}
+
+KeyframeIndex::Cell KeyframeIndex::GetCell(Eigen::Vector3d const& center) const {
+  return Cell(static_cast<int>(std::floor(center.x() / cell_size_)),
+              static_cast<int>(std::floor(center.y() / cell_size_)),
+              static_cast<int>(std::floor(center.z() / cell_size_)));
+}
+
+}  // namespace sparse_mapping
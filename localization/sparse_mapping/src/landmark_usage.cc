@@ -0,0 +1,133 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <camera/camera_model.h>
+#include <sparse_mapping/landmark_usage.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace sparse_mapping {
+
+LandmarkUsage::LandmarkUsage(SparseMap * map)
+  : map_(map), inliers_(map->pid_to_xyz_.size(), 0), outliers_(map->pid_to_xyz_.size(), 0),
+    reached_(map->GetNumFrames(), false) {}
+
+bool LandmarkUsage::Replay(cv::Mat const& descriptors, Eigen::Matrix2Xd const& keypoints, double * seconds) {
+  camera::CameraModel cam(Eigen::Vector3d(), Eigen::Matrix3d::Identity(), map_->GetCameraParameters());
+  std::vector<int> matched_pids, inlier_pids;
+  auto start = std::chrono::steady_clock::now();
+  bool localized = map_->Localize(descriptors, keypoints, &cam, NULL, NULL, NULL, &matched_pids, &inlier_pids);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  *seconds = elapsed.count();
+  if (!localized)
+    return false;
+
+  std::set<int> inlier_set(inlier_pids.begin(), inlier_pids.end());
+  for (size_t i = 0; i < matched_pids.size(); i++) {
+    if (inlier_set.find(matched_pids[i]) != inlier_set.end())
+      inliers_[matched_pids[i]]++;
+    else
+      outliers_[matched_pids[i]]++;
+    for (auto const& cid_fid : map_->pid_to_cid_fid_[matched_pids[i]])
+      reached_[cid_fid.first] = true;
+  }
+  return true;
+}
+
+bool LandmarkUsage::Better(int pid1, int pid2) const {
+  if (inliers_[pid1] != inliers_[pid2])
+    return inliers_[pid1] > inliers_[pid2];
+  if (outliers_[pid1] != outliers_[pid2])
+    return outliers_[pid1] < outliers_[pid2];
+  // Seen in more images
+  return map_->pid_to_cid_fid_[pid1].size() > map_->pid_to_cid_fid_[pid2].size();
+}
+
+int LandmarkUsage::Prune(int min_inliers, double max_outlier_ratio, int min_landmarks_per_frame) {
+  int num_pids = map_->pid_to_cid_fid_.size();
+  std::vector<bool> keep(num_pids);
+  for (int pid = 0; pid < num_pids; pid++) {
+    // A landmark seen from where no image was replayed can't be judged
+    bool reached = true;
+    for (auto const& cid_fid : map_->pid_to_cid_fid_[pid])
+      reached = reached && reached_[cid_fid.first];
+    int num_matched = inliers_[pid] + outliers_[pid];
+    keep[pid] = !reached ||
+      (inliers_[pid] >= min_inliers && outliers_[pid] <= max_outlier_ratio * num_matched);
+  }
+
+  // How many landmarks are kept in each image
+  std::vector<int> num_kept(map_->GetNumFrames(), 0);
+  for (int pid = 0; pid < num_pids; pid++) {
+    if (!keep[pid])
+      continue;
+    for (auto const& cid_fid : map_->pid_to_cid_fid_[pid])
+      num_kept[cid_fid.first]++;
+  }
+
+  // Keep the best landmarks of the images which would see too few
+  for (size_t cid = 0; cid < num_kept.size(); cid++) {
+    if (num_kept[cid] >= min_landmarks_per_frame)
+      continue;
+    std::vector<int> candidates;
+    for (auto const& fid_pid : map_->cid_fid_to_pid_[cid]) {
+      if (!keep[fid_pid.second])
+        candidates.push_back(fid_pid.second);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [this](int pid1, int pid2) { return Better(pid1, pid2); });
+    for (size_t i = 0; i < candidates.size() && num_kept[cid] < min_landmarks_per_frame; i++) {
+      keep[candidates[i]] = true;
+      for (auto const& cid_fid : map_->pid_to_cid_fid_[candidates[i]])
+        num_kept[cid_fid.first]++;
+    }
+  }
+
+  int num_removed = 0;
+  std::vector<std::map<int, int> > pid_to_cid_fid;
+  std::vector<Eigen::Vector3d> pid_to_xyz;
+  std::vector<int> inliers, outliers;
+  for (int pid = 0; pid < num_pids; pid++) {
+    if (!keep[pid]) {
+      num_removed++;
+      continue;
+    }
+    pid_to_cid_fid.push_back(map_->pid_to_cid_fid_[pid]);
+    pid_to_xyz.push_back(map_->pid_to_xyz_[pid]);
+    inliers.push_back(inliers_[pid]);
+    outliers.push_back(outliers_[pid]);
+  }
+  map_->pid_to_cid_fid_.swap(pid_to_cid_fid);
+  map_->pid_to_xyz_.swap(pid_to_xyz);
+  inliers_.swap(inliers);
+  outliers_.swap(outliers);
+
+  map_->InitializeCidFidToPid();
+  map_->PruneMap();
+  LOG(INFO) << "Removed " << num_removed << " of " << num_pids << " landmarks.";
+  return num_removed;
+}
+
+}  // namespace sparse_mapping
@@ -0,0 +1,429 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <camera/camera_model.h>
+#include <ff_common/thread.h>
+#include <interest_point/matching.h>
+#include <sparse_mapping/map_extender.h>
+#include <sparse_mapping/reprojection.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/sparse_mapping.h>
+#include <sparse_mapping/tensor.h>
+#include <sparse_mapping/vocab_tree.h>
+
+#include <ceres/ceres.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <openMVG/multiview/projection.hpp>
+#include <openMVG/multiview/triangulation_nview.hpp>
+#include <openMVG/numeric/numeric.h>
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+DECLARE_double(reproj_thresh);            // defined in tensor.cc
+DECLARE_int32(max_num_iterations);        // defined in tensor.cc
+DECLARE_string(cost_function);            // defined in tensor.cc
+DECLARE_double(cost_function_threshold);  // defined in tensor.cc
+DECLARE_double(min_valid_angle);          // defined in sparse_mapping.cc
+
+namespace sparse_mapping {
+
+namespace {
+
+// The distance in pixels from the projection of xyz to an observation,
+// as FilterPID measures it
+double PixelError(Eigen::Affine3d const& cam_t_global, double focal_length,
+                  Eigen::Vector2d const& observation, Eigen::Vector3d const& xyz) {
+  return (observation - (cam_t_global * xyz).hnormalized() * focal_length).norm();
+}
+
+// Union-find of features, each a pair of cid and fid
+class FeatureSets {
+ public:
+  int Id(int cid, int fid) {
+    auto it = ids_.insert(std::make_pair(std::make_pair(cid, fid), parent_.size()));
+    if (it.second) {
+      parent_.push_back(parent_.size());
+      features_.push_back(std::make_pair(cid, fid));
+    }
+    return it.first->second;
+  }
+  int Find(int id) {
+    while (parent_[id] != id)
+      id = parent_[id] = parent_[parent_[id]];
+    return id;
+  }
+  void Join(int id1, int id2) {parent_[Find(id1)] = Find(id2);}
+  // The sets, as lists of features
+  void Sets(std::vector<std::vector<std::pair<int, int> > > * sets) {
+    std::map<int, int> root_to_set;
+    sets->clear();
+    for (size_t id = 0; id < parent_.size(); id++) {
+      auto it = root_to_set.insert(std::make_pair(Find(id), sets->size()));
+      if (it.second)
+        sets->resize(sets->size() + 1);
+      (*sets)[it.first->second].push_back(features_[id]);
+    }
+  }
+
+ private:
+  std::map<std::pair<int, int>, int> ids_;
+  std::vector<int> parent_;
+  std::vector<std::pair<int, int> > features_;
+};
+
+}  // namespace
+
+MapExtender::MapExtender(SparseMap * map) : map_(map) {
+  if (map_->vocab_db_.binary_db == NULL)
+    LOG(FATAL) << "The map to add images to must have a vocab db.";
+  if (map_->vocab_db_.m_num_nodes != static_cast<int>(map_->GetNumFrames()))
+    LOG(FATAL) << "The vocab db of the map has " << map_->vocab_db_.m_num_nodes << " images rather than "
+               << map_->GetNumFrames() << ".";
+}
+
+int MapExtender::AddImages(std::vector<std::string> const& images, bool prune,
+                           std::vector<std::string> * failed) {
+  int num_images = images.size();
+  std::vector<cv::Mat> descriptors(num_images);
+  std::vector<Eigen::Matrix2Xd> keypoints(num_images);
+  ff_common::ThreadPool pool;
+  for (int i = 0; i < num_images; i++)
+    pool.AddTask(&SparseMap::DetectFeaturesFromFile, map_, std::ref(images[i]), true,
+                 &descriptors[i], &keypoints[i]);
+  pool.Join();
+  return AddImages(images, descriptors, keypoints, prune, failed);
+}
+
+int MapExtender::AddImages(std::vector<std::string> const& images, std::vector<cv::Mat> const& descriptors,
+                           std::vector<Eigen::Matrix2Xd> const& keypoints, bool prune,
+                           std::vector<std::string> * failed) {
+  int num_images = images.size();
+  std::vector<int> pending(num_images);
+  for (int i = 0; i < num_images; i++)
+    pending[i] = i;
+  int num_added = 0;
+  for (int round = 0; !pending.empty(); round++) {
+    // The map does not change while the images localize against it
+    std::vector<Eigen::Affine3d> cam_t_global(pending.size());
+    std::vector<char> localized(pending.size(), false);
+    {
+      ff_common::ThreadPool pool;
+      for (size_t i = 0; i < pending.size(); i++) {
+        pool.AddTask([&, i]() {
+            camera::CameraModel cam(Eigen::Vector3d(), Eigen::Matrix3d::Identity(),
+                                    map_->GetCameraParameters());
+            localized[i] = map_->Localize(descriptors[pending[i]], keypoints[pending[i]], &cam, NULL, NULL);
+            cam_t_global[i] = cam.GetTransform();
+          });
+      }
+      pool.Join();
+    }
+
+    std::vector<std::string> new_images;
+    std::vector<Eigen::Affine3d> new_cam_t_global;
+    std::vector<cv::Mat> new_descriptors;
+    std::vector<Eigen::Matrix2Xd> new_keypoints;
+    std::vector<int> still_pending;
+    for (size_t i = 0; i < pending.size(); i++) {
+      if (!localized[i]) {
+        still_pending.push_back(pending[i]);
+        continue;
+      }
+      new_images.push_back(images[pending[i]]);
+      new_cam_t_global.push_back(cam_t_global[i]);
+      new_descriptors.push_back(descriptors[pending[i]]);
+      new_keypoints.push_back(keypoints[pending[i]]);
+    }
+    LOG(INFO) << "Round " << round << ": " << new_images.size() << " of " << pending.size()
+              << " images localized.";
+    if (new_images.empty())
+      break;
+
+    AddKeyframes(new_images, new_cam_t_global, new_descriptors, new_keypoints, prune);
+    num_added += new_images.size();
+    pending.swap(still_pending);
+  }
+
+  failed->clear();
+  for (size_t i = 0; i < pending.size(); i++)
+    failed->push_back(images[pending[i]]);
+  return num_added;
+}
+
+void MapExtender::AddKeyframes(std::vector<std::string> const& images,
+                               std::vector<Eigen::Affine3d> const& cam_t_global,
+                               std::vector<cv::Mat> const& descriptors,
+                               std::vector<Eigen::Matrix2Xd> const& keypoints, bool prune) {
+  SparseMap & map = *map_;  // shorten
+  int first_new = map.GetNumFrames();
+  int num_new = images.size();
+  for (int i = 0; i < num_new; i++) {
+    map.cid_to_filename_.push_back(images[i]);
+    map.cid_to_cam_t_global_.push_back(cam_t_global[i]);
+    map.cid_to_descriptor_map_.push_back(descriptors[i]);
+    map.cid_to_keypoint_map_.push_back(keypoints[i]);
+  }
+  map.cid_fid_to_pid_.resize(map.GetNumFrames());
+
+  // All the features of the new images go in the database, as when it is
+  // built before pruning. The new images can then be found as similar to
+  // each other when matching.
+  AddToDB(map.GetDetectorName(), descriptors, &map.vocab_db_);
+
+  std::vector<std::pair<int, int> > cid_pairs;
+  std::vector<std::vector<std::pair<int, int> > > fid_pairs;
+  MatchNewCameras(first_new, &cid_pairs, &fid_pairs);
+
+  // Features matched to each other, directly or not, see the same point
+  FeatureSets sets;
+  for (size_t p = 0; p < cid_pairs.size(); p++) {
+    for (std::pair<int, int> const& fids : fid_pairs[p])
+      sets.Join(sets.Id(cid_pairs[p].first, fids.first), sets.Id(cid_pairs[p].second, fids.second));
+  }
+  std::vector<std::vector<std::pair<int, int> > > features;
+  sets.Sets(&features);
+
+  // A set of features either extends a track of the map, if some of them
+  // are already in it, or makes a new track. Sets which have two features
+  // in the same image, or which are in more than one track, are dropped.
+  std::map<int, Track> extensions;
+  std::vector<Track> new_tracks;
+  for (std::vector<std::pair<int, int> > const& set : features) {
+    Track track;
+    std::set<int> pids;
+    bool valid = true;
+    for (std::pair<int, int> const& cid_fid : set) {
+      if (!track.insert(cid_fid).second)
+        valid = false;
+      auto it = map.cid_fid_to_pid_[cid_fid.first].find(cid_fid.second);
+      if (it != map.cid_fid_to_pid_[cid_fid.first].end())
+        pids.insert(it->second);
+    }
+    if (!valid || pids.size() > 1)
+      continue;
+    if (pids.empty()) {
+      if (track.size() >= 2)
+        new_tracks.push_back(track);
+      continue;
+    }
+    int pid = *pids.begin();
+    Track & extension = extensions[pid];
+    for (std::pair<int, int> const& cid_fid : track) {
+      if (map.pid_to_cid_fid_[pid].count(cid_fid.first) == 0 && extension.count(cid_fid.first) == 0)
+        extension.insert(cid_fid);
+    }
+  }
+
+  // The local problem: the new cameras first, to optimize, then the
+  // cameras of the map seeing the same points, held fixed
+  std::vector<int> local_to_cid;
+  std::map<int, int> cid_to_local;
+  for (int cid = first_new; cid < first_new + num_new; cid++) {
+    cid_to_local[cid] = local_to_cid.size();
+    local_to_cid.push_back(cid);
+  }
+  auto local_cid = [&](int cid) {
+    auto it = cid_to_local.insert(std::make_pair(cid, local_to_cid.size()));
+    if (it.second)
+      local_to_cid.push_back(cid);
+    return it.first->second;
+  };
+  std::vector<Track> local_tracks;
+  std::vector<Eigen::Vector3d> local_xyz;
+  std::vector<int> extended_pids;
+  for (auto const& extension : extensions) {
+    if (extension.second.empty())
+      continue;
+    Track track;
+    for (std::pair<int, int> const& cid_fid : map.pid_to_cid_fid_[extension.first])
+      track[local_cid(cid_fid.first)] = cid_fid.second;
+    for (std::pair<int, int> const& cid_fid : extension.second)
+      track[local_cid(cid_fid.first)] = cid_fid.second;
+    local_tracks.push_back(track);
+    local_xyz.push_back(map.pid_to_xyz_[extension.first]);
+    extended_pids.push_back(extension.first);
+  }
+  for (Track const& new_track : new_tracks) {
+    Track track;
+    for (std::pair<int, int> const& cid_fid : new_track)
+      track[local_cid(cid_fid.first)] = cid_fid.second;
+    local_tracks.push_back(track);
+  }
+  int num_extended = extended_pids.size();
+
+  std::vector<Eigen::Affine3d> local_cam_t_global(local_to_cid.size());
+  std::vector<Eigen::Matrix2Xd> local_keypoints(local_to_cid.size());
+  for (size_t local = 0; local < local_to_cid.size(); local++) {
+    local_cam_t_global[local] = map.cid_to_cam_t_global_[local_to_cid[local]];
+    local_keypoints[local] = map.cid_to_keypoint_map_[local_to_cid[local]];
+  }
+
+  // Triangulate the new tracks from the poses found by localization
+  double focal_length = map.camera_params_.GetFocalLength();
+  {
+    std::vector<Track> tracks(local_tracks.begin() + num_extended, local_tracks.end());
+    std::vector<Eigen::Vector3d> xyz;
+    std::vector<Track> cid_fid_to_pid;
+    Triangulate(true, focal_length, local_cam_t_global, local_keypoints, &tracks, &xyz, &cid_fid_to_pid);
+    local_tracks.resize(num_extended);
+    local_tracks.insert(local_tracks.end(), tracks.begin(), tracks.end());
+    local_xyz.insert(local_xyz.end(), xyz.begin(), xyz.end());
+  }
+
+  if (!local_tracks.empty()) {
+    ceres::Solver::Options options;
+    options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+    options.num_threads = FLAGS_num_threads;
+    options.max_num_iterations = FLAGS_max_num_iterations;
+    ceres::Solver::Summary summary;
+    std::vector<Track> user_pid_to_cid_fid;
+    std::vector<Eigen::Matrix2Xd> user_cid_to_keypoint_map;
+    std::vector<Eigen::Vector3d> user_pid_to_xyz;
+    BundleAdjust(local_tracks, local_keypoints, focal_length, &local_cam_t_global, &local_xyz,
+                 user_pid_to_cid_fid, user_cid_to_keypoint_map, &user_pid_to_xyz,
+                 GetLossFunction(FLAGS_cost_function, FLAGS_cost_function_threshold),
+                 options, &summary, 0, num_new - 1);
+    LOG(INFO) << "Local bundle adjustment of " << num_new << " cameras and " << local_tracks.size()
+              << " points: " << summary.BriefReport();
+  }
+
+  // Observations in the new cameras which don't fit are dropped, then
+  // new tracks which are no longer seen twice, or seen at too small an
+  // angle
+  std::vector<Eigen::Vector3d> local_ctrs(local_to_cid.size());
+  for (size_t local = 0; local < local_to_cid.size(); local++)
+    local_ctrs[local] = local_cam_t_global[local].inverse().translation();
+  for (size_t pid = 0; pid < local_tracks.size(); pid++) {
+    Track & track = local_tracks[pid];
+    for (auto it = track.begin(); it != track.end(); ) {
+      Eigen::Affine3d const& cam = local_cam_t_global[it->first];
+      if (it->first < num_new &&
+          ((cam * local_xyz[pid])[2] <= 0 ||
+           PixelError(cam, focal_length, local_keypoints[it->first].col(it->second), local_xyz[pid]) >=
+           FLAGS_reproj_thresh))
+        it = track.erase(it);
+      else
+        ++it;
+    }
+    if (static_cast<int>(pid) >= num_extended &&
+        (track.size() < 2 || ComputeRaysAngle(pid, local_tracks, local_ctrs, local_xyz) < FLAGS_min_valid_angle))
+      track.clear();
+  }
+
+  // Write the results to the map
+  for (int local = 0; local < num_new; local++)
+    map.cid_to_cam_t_global_[local_to_cid[local]] = local_cam_t_global[local];
+  map.InitializeKeyframeIndex();
+  int num_observations = 0, num_added_tracks = 0;
+  for (size_t local_pid = 0; local_pid < local_tracks.size(); local_pid++) {
+    if (local_tracks[local_pid].empty())
+      continue;
+    int pid;
+    if (static_cast<int>(local_pid) < num_extended) {
+      pid = extended_pids[local_pid];
+    } else {
+      pid = map.pid_to_xyz_.size();
+      map.pid_to_cid_fid_.push_back(Track());
+      map.pid_to_xyz_.push_back(Eigen::Vector3d());
+      num_added_tracks++;
+    }
+    map.pid_to_xyz_[pid] = local_xyz[local_pid];
+    for (std::pair<int, int> const& local_fid : local_tracks[local_pid]) {
+      int cid = local_to_cid[local_fid.first];
+      if (map.pid_to_cid_fid_[pid].count(cid) != 0)
+        continue;
+      map.pid_to_cid_fid_[pid][cid] = local_fid.second;
+      map.cid_fid_to_pid_[cid][local_fid.second] = pid;
+      num_observations++;
+    }
+  }
+  LOG(INFO) << "Added " << num_new << " images, " << num_added_tracks << " new tracks, and "
+            << num_observations << " observations, extending " << num_extended << " tracks.";
+
+  if (prune) {
+    for (int cid = first_new; cid < first_new + num_new; cid++)
+      map.PruneFrame(cid);
+  }
+}
+
+void MapExtender::MatchNewCameras(int first_new, std::vector<std::pair<int, int> > * cid_pairs,
+                                  std::vector<std::vector<std::pair<int, int> > > * fid_pairs) const {
+  SparseMap & map = *map_;  // shorten
+  int num_frames = map.GetNumFrames();
+  std::set<std::pair<int, int> > pairs;
+  for (int cid = first_new; cid < num_frames; cid++) {
+    std::vector<int> indices;
+    QueryDB(map.GetDetectorName(), &map.vocab_db_, map.num_similar_, map.cid_to_descriptor_map_[cid], &indices);
+    for (int other : indices) {
+      if (other != cid)
+        pairs.insert(std::make_pair(std::min(cid, other), std::max(cid, other)));
+    }
+  }
+
+  cid_pairs->assign(pairs.begin(), pairs.end());
+  fid_pairs->clear();
+  fid_pairs->resize(cid_pairs->size());
+  ff_common::ThreadPool pool;
+  for (size_t p = 0; p < cid_pairs->size(); p++) {
+    pool.AddTask([&, p]() {
+        int cid1 = (*cid_pairs)[p].first, cid2 = (*cid_pairs)[p].second;
+        std::vector<cv::DMatch> matches;
+        interest_point::FindMatches(map.cid_to_descriptor_map_[cid1], map.cid_to_descriptor_map_[cid2], &matches);
+        for (cv::DMatch const& match : matches) {
+          if (Agree(cid1, match.queryIdx, cid2, match.trainIdx))
+            (*fid_pairs)[p].push_back(std::make_pair(match.queryIdx, match.trainIdx));
+        }
+      });
+  }
+  pool.Join();
+  LOG(INFO) << "Matched the new images to other images in " << cid_pairs->size() << " pairs.";
+}
+
+bool MapExtender::Agree(int cid1, int fid1, int cid2, int fid2) const {
+  double focal_length = map_->camera_params_.GetFocalLength();
+  Eigen::Matrix3d k;
+  k << focal_length, 0, 0,
+    0, focal_length, 0,
+    0, 0, 1;
+  Eigen::Affine3d const& cam1 = map_->cid_to_cam_t_global_[cid1];
+  Eigen::Affine3d const& cam2 = map_->cid_to_cam_t_global_[cid2];
+  openMVG::Mat34 p1, p2;
+  openMVG::P_From_KRt(k, cam1.linear(), cam1.translation(), &p1);
+  openMVG::P_From_KRt(k, cam2.linear(), cam2.translation(), &p2);
+  Eigen::Vector2d obs1 = map_->cid_to_keypoint_map_[cid1].col(fid1);
+  Eigen::Vector2d obs2 = map_->cid_to_keypoint_map_[cid2].col(fid2);
+
+  openMVG::Triangulation tri;
+  tri.add(p1, obs1);
+  tri.add(p2, obs2);
+  Eigen::Vector3d xyz = tri.compute();
+  if (std::isnan(xyz[0]) || tri.minDepth() <= 0)
+    return false;
+  return PixelError(cam1, focal_length, obs1, xyz) < FLAGS_reproj_thresh &&
+    PixelError(cam2, focal_length, obs2, xyz) < FLAGS_reproj_thresh;
+}
+
+}  // namespace sparse_mapping
@@ -0,0 +1,208 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/map_file.h>
+
+#include <sparse_map.pb.h>
+
+#include <glog/logging.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <opencv2/core/core.hpp>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+// A CodedInputStream takes at most this many bytes
+size_t ClampSize(size_t size) {
+  return std::min(size, static_cast<size_t>(std::numeric_limits<int>::max()));
+}
+
+}  // namespace
+
+MapFile::MapFile(std::string const& filename)
+  : filename_(filename), data_(NULL), size_(0), header_(new sparse_mapping_protobuf::Map) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    LOG(FATAL) << "Failed to open map file: " << filename;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+    LOG(FATAL) << "Failed to read map file: " << filename;
+  size_ = st.st_size;
+  void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    LOG(FATAL) << "Failed to map map file: " << filename;
+  data_ = static_cast<char const*>(data);
+
+  size_t offset = Skip(0);
+  Parse(0, offset, header_.get());
+
+  // Only the name and pose of each frame are kept
+  int num_frames = header_->num_frames();
+  frame_offsets_.push_back(offset);
+  cid_to_filename_.resize(num_frames);
+  cid_to_cam_t_global_.resize(num_frames, Eigen::Affine3d::Identity());
+  for (int cid = 0; cid < num_frames; cid++) {
+    offset = Skip(offset);
+    frame_offsets_.push_back(offset);
+
+    sparse_mapping_protobuf::Frame frame;
+    ReadFrame(cid, &frame);
+    if (frame.has_name())
+      cid_to_filename_[cid] = frame.name();
+    if (frame.has_pose()) {
+      sparse_mapping_protobuf::Affine3d const& pose = frame.pose();
+      cid_to_cam_t_global_[cid].translation() << pose.t0(), pose.t1(), pose.t2();
+      cid_to_cam_t_global_[cid].linear() <<
+        pose.r00(), pose.r01(), pose.r02(),
+        pose.r10(), pose.r11(), pose.r12(),
+        pose.r20(), pose.r21(), pose.r22();
+    }
+  }
+
+  int num_landmarks = header_->num_landmarks();
+  landmark_offsets_.reserve(num_landmarks + 1);
+  landmark_offsets_.push_back(offset);
+  for (int pid = 0; pid < num_landmarks; pid++) {
+    offset = Skip(offset);
+    landmark_offsets_.push_back(offset);
+  }
+}
+
+MapFile::~MapFile() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+camera::CameraParameters MapFile::GetCameraParameters() const {
+  sparse_mapping_protobuf::CameraModel const& camera = header_->camera();
+  if (camera.focal_length_size() != 2 || camera.optical_offset_size() != 2 ||
+      camera.distorted_image_size_size() != 2 || camera.undistorted_image_size_size() != 2)
+    LOG(FATAL) << "Malformed camera in map file: " << filename_;
+  // As SparseMap::Load makes them
+  camera::CameraParameters params(Eigen::Vector2i(-1, -1), Eigen::Vector2d::Constant(-1), Eigen::Vector2d(-1, -1));
+  params.SetFocalLength(Eigen::Vector2d(camera.focal_length(0), camera.focal_length(1)));
+  params.SetOpticalOffset(Eigen::Vector2d(camera.optical_offset(0), camera.optical_offset(1)));
+  params.SetDistortedSize(Eigen::Vector2i(camera.distorted_image_size(0), camera.distorted_image_size(1)));
+  params.SetUndistortedSize(Eigen::Vector2i(camera.undistorted_image_size(0), camera.undistorted_image_size(1)));
+  Eigen::VectorXd distortion(camera.distortion_size());
+  for (int i = 0; i < camera.distortion_size(); i++)
+    distortion[i] = camera.distortion(i);
+  params.SetDistortion(distortion);
+  return params;
+}
+
+void MapFile::ReadFrame(int cid, sparse_mapping_protobuf::Frame * frame) const {
+  Parse(frame_offsets_[cid], frame_offsets_[cid + 1], frame);
+}
+
+void MapFile::ReadFeatures(int cid, Eigen::Matrix2Xd * keypoints, cv::Mat * descriptors) const {
+  sparse_mapping_protobuf::Frame frame;
+  ReadFrame(cid, &frame);
+  int depth = header_->descriptor_depth();
+  keypoints->resize(Eigen::NoChange_t(), frame.feature_size());
+  if (frame.feature_size() == 0) {
+    descriptors->create(0, 0, depth);
+    return;
+  }
+  descriptors->create(frame.feature_size(), frame.feature(0).description().size() / cv::getElemSize(depth), depth);
+  for (int fid = 0; fid < frame.feature_size(); fid++) {
+    sparse_mapping_protobuf::Feature const& feature = frame.feature(fid);
+    keypoints->col(fid) << feature.x(), feature.y();
+    memcpy(descriptors->ptr<uint8_t>(fid), feature.description().data(), feature.description().size());
+  }
+}
+
+void MapFile::ReadLandmark(int pid, Eigen::Vector3d * xyz, std::map<int, int> * cid_fid) const {
+  sparse_mapping_protobuf::Landmark l;
+  Parse(landmark_offsets_[pid], landmark_offsets_[pid + 1], &l);
+  *xyz = Eigen::Vector3d(l.loc().x(), l.loc().y(), l.loc().z());
+  cid_fid->clear();
+  for (int j = 0; j < l.match_size(); j++)
+    (*cid_fid)[l.match(j).camera_id()] = l.match(j).feature_id();
+}
+
+void MapFile::FidToPid(std::vector<int> const& cids, std::vector<std::map<int, int> > * fid_to_pid) const {
+  // Where each wanted image is in cids
+  std::map<int, int> cid_to_pos;
+  for (size_t pos = 0; pos < cids.size(); pos++)
+    cid_to_pos[cids[pos]] = pos;
+
+  fid_to_pid->clear();
+  fid_to_pid->resize(cids.size());
+  for (int pid = 0; pid < GetNumLandmarks(); pid++) {
+    sparse_mapping_protobuf::Landmark l;
+    Parse(landmark_offsets_[pid], landmark_offsets_[pid + 1], &l);
+    for (int j = 0; j < l.match_size(); j++) {
+      auto it = cid_to_pos.find(l.match(j).camera_id());
+      if (it != cid_to_pos.end())
+        (*fid_to_pid)[it->second][l.match(j).feature_id()] = pid;
+    }
+  }
+}
+
+void MapFile::CopyFrame(int cid, google::protobuf::io::ZeroCopyOutputStream * output) const {
+  google::protobuf::io::CodedOutputStream coded_output(output);
+  coded_output.WriteRaw(data_ + frame_offsets_[cid], frame_offsets_[cid + 1] - frame_offsets_[cid]);
+  if (coded_output.HadError())
+    LOG(FATAL) << "Failed to write frame to file.";
+}
+
+void MapFile::Parse(size_t begin, size_t end, google::protobuf::MessageLite * message) const {
+  google::protobuf::io::CodedInputStream input(reinterpret_cast<uint8_t const*>(data_ + begin),
+                                               ClampSize(end - begin));
+  uint32_t size;
+  bool success = input.ReadVarint32(&size);
+  if (success) {
+    auto limit = input.PushLimit(size);
+    success = message->MergePartialFromCodedStream(&input) && input.ConsumedEntireMessage();
+    input.PopLimit(limit);
+  }
+  if (!success)
+    LOG(FATAL) << "Failed to parse map file: " << filename_;
+}
+
+size_t MapFile::Skip(size_t begin) const {
+  if (begin >= size_)
+    LOG(FATAL) << "Map file is truncated: " << filename_;
+  google::protobuf::io::CodedInputStream input(reinterpret_cast<uint8_t const*>(data_ + begin),
+                                               ClampSize(size_ - begin));
+  uint32_t size;
+  if (!input.ReadVarint32(&size))
+    LOG(FATAL) << "Failed to parse map file: " << filename_;
+  size_t end = begin + input.CurrentPosition() + size;
+  if (end > size_)
+    LOG(FATAL) << "Map file is truncated: " << filename_;
+  return end;
+}
+
+}  // namespace sparse_mapping
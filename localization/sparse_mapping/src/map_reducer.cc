@@ -0,0 +1,157 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <camera/camera_model.h>
+#include <ff_common/thread.h>
+#include <sparse_mapping/map_reducer.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/vocab_tree.h>
+
+#include <glog/logging.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+// The error of an image which does not localize, as in localize_cams
+const double kFailedError = 1e+6;
+
+}  // namespace
+
+MapReducer::MapReducer(SparseMap * map, int db_depth, int db_branching_factor, int db_restarts)
+  : map_(map), db_depth_(db_depth), db_branching_factor_(db_branching_factor), db_restarts_(db_restarts) {
+  int num_frames = map_->GetNumFrames();
+  descriptors_.resize(num_frames);
+  keypoints_.resize(num_frames);
+  LOG(INFO) << "Detecting features in " << num_frames << " images.";
+  ff_common::ThreadPool pool;
+  for (int cid = 0; cid < num_frames; cid++)
+    pool.AddTask(&SparseMap::DetectFeaturesFromFile, map_, std::ref(map_->cid_to_filename_[cid]),
+                 true, &descriptors_[cid], &keypoints_[cid]);
+  pool.Join();
+}
+
+MapReducer::MapReducer(SparseMap * map, std::vector<cv::Mat> const& descriptors,
+                       std::vector<Eigen::Matrix2Xd> const& keypoints,
+                       int db_depth, int db_branching_factor, int db_restarts)
+  : map_(map), db_depth_(db_depth), db_branching_factor_(db_branching_factor), db_restarts_(db_restarts),
+    descriptors_(descriptors), keypoints_(keypoints) {
+  if (descriptors_.size() != map_->GetNumFrames() || keypoints_.size() != map_->GetNumFrames())
+    LOG(FATAL) << "Need the features of each of the " << map_->GetNumFrames() << " images of the map.";
+}
+
+std::unique_ptr<SparseMap> MapReducer::Submap(std::vector<bool> const& keep) const {
+  std::vector<int> cid_to_sub(map_->GetNumFrames(), -1);
+  std::vector<std::string> filenames;
+  for (size_t cid = 0; cid < cid_to_sub.size(); cid++) {
+    if (!keep[cid])
+      continue;
+    cid_to_sub[cid] = filenames.size();
+    filenames.push_back(map_->cid_to_filename_[cid]);
+  }
+
+  std::unique_ptr<SparseMap> submap(new SparseMap(filenames, map_->GetDetectorName(),
+                                                  map_->GetCameraParameters()));
+  submap->SetHistogramEqualization(map_->GetHistogramEqualization());
+  submap->cid_to_cam_t_global_.resize(filenames.size());
+  for (size_t cid = 0; cid < cid_to_sub.size(); cid++) {
+    int sub = cid_to_sub[cid];
+    if (sub < 0)
+      continue;
+    submap->cid_to_cam_t_global_[sub] = map_->cid_to_cam_t_global_[cid];
+    submap->cid_to_keypoint_map_[sub] = map_->cid_to_keypoint_map_[cid];
+    submap->cid_to_descriptor_map_[sub] = map_->cid_to_descriptor_map_[cid];
+  }
+
+  // Keep the tracks still seen twice, with their points as they are, as
+  // extract_submap -skip_bundle_adjustment does
+  for (size_t pid = 0; pid < map_->pid_to_cid_fid_.size(); pid++) {
+    std::map<int, int> cid_fid;
+    for (auto const& obs : map_->pid_to_cid_fid_[pid]) {
+      if (cid_to_sub[obs.first] >= 0)
+        cid_fid[cid_to_sub[obs.first]] = obs.second;
+    }
+    if (cid_fid.size() <= 1)
+      continue;
+    submap->pid_to_cid_fid_.push_back(cid_fid);
+    submap->pid_to_xyz_.push_back(map_->pid_to_xyz_[pid]);
+  }
+  submap->InitializeCidFidToPid();
+
+  // The database is built from all the features, then the features
+  // with no track are removed, as in build_map -vocab_db
+  BuildDB(submap.get(), submap->GetDetectorName(), db_depth_, db_branching_factor_, db_restarts_);
+  submap->PruneMap();
+  return submap;
+}
+
+void MapReducer::LocalizationErrors(SparseMap * submap, std::vector<double> * errors) const {
+  int num_frames = map_->GetNumFrames();
+  errors->assign(num_frames, kFailedError);
+  ff_common::ThreadPool pool;
+  for (int cid = 0; cid < num_frames; cid++) {
+    pool.AddTask([this, submap, errors, cid]() {
+        camera::CameraModel localized_cam(Eigen::Vector3d(), Eigen::Matrix3d::Identity(),
+                                          submap->GetCameraParameters());
+        if (!submap->Localize(descriptors_[cid], keypoints_[cid], &localized_cam, NULL, NULL))
+          return;
+        camera::CameraModel source_cam(map_->GetFrameGlobalTransform(cid), map_->GetCameraParameters());
+        (*errors)[cid] = (localized_cam.GetPosition() - source_cam.GetPosition()).norm();
+      });
+  }
+  pool.Join();
+}
+
+std::unique_ptr<SparseMap> MapReducer::Reduce(double localization_error, int max_iterations,
+                                              std::vector<bool> * keep, std::vector<double> * errors,
+                                              std::ostream * report) const {
+  std::unique_ptr<SparseMap> submap;
+  for (int iter = 0; iter < max_iterations; iter++) {
+    submap = Submap(*keep);
+    LocalizationErrors(submap.get(), errors);
+
+    int num_bad = 0;
+    std::vector<int> add_back;
+    for (size_t cid = 0; cid < keep->size(); cid++) {
+      if ((*errors)[cid] <= localization_error)
+        continue;
+      num_bad++;
+      if (!(*keep)[cid])
+        add_back.push_back(cid);
+    }
+    *report << "Iteration " << iter << ": " << submap->GetNumFrames() << " images kept, "
+            << num_bad << " images localize with error > " << localization_error << " m, "
+            << add_back.size() << " of them taken out of the map.\n";
+
+    // The last submap is returned with the images it was made of
+    if (add_back.empty() || iter + 1 == max_iterations)
+      break;
+    LOG(INFO) << "Putting back in the map " << add_back.size() << " image(s).";
+    for (size_t i = 0; i < add_back.size(); i++)
+      (*keep)[add_back[i]] = true;
+  }
+  return submap;
+}
+
+}  // namespace sparse_mapping
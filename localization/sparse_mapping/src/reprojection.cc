@@ -93,6 +93,10 @@ struct ReprojectionError {
   Eigen::Vector2d observed;
 };
 
+ceres::CostFunction* CreateReprojectionError(Eigen::Vector2d const& observed) {
+  return ReprojectionError::Create(observed);
+}
+
 void BundleAdjust(std::vector<std::map<int, int> > const& pid_to_cid_fid,
                   std::vector<Eigen::Matrix2Xd > const& cid_to_keypoint_map,
                   double focal_length,
@@ -284,11 +288,23 @@ void EstimateCamera(camera::CameraModel* camera_estimate,
   camera_estimate->SetTransform(guess);
 }
 
+namespace {
+
+std::mt19937 & RandomGenerator(void) {
+  static thread_local std::mt19937 generator;
+  return generator;
+}
+
+}  // namespace
+
 // random intger in [min, max)
 int RandomInt(int min, int max) {
-  static std::mt19937 generator;  // should be thread_local for thread safe, gcc 4.6 doesn't support
   std::uniform_int_distribution<int> random_item(min, max - 1);
-  return random_item(generator);
+  return random_item(RandomGenerator());
+}
+
+void ResetRandomInt(void) {
+  RandomGenerator() = std::mt19937();
 }
 
 void SelectRandomObservations(const std::vector<Eigen::Vector3d> & all_landmarks,
@@ -355,7 +371,8 @@ int RansacEstimateCamera(const std::vector<Eigen::Vector3d> & landmarks,
                          int num_tries, int inlier_tolerance, camera::CameraModel * camera_estimate,
                          std::vector<Eigen::Vector3d> * inlier_landmarks_out,
                          std::vector<Eigen::Vector2d> * inlier_observations_out,
-                         bool verbose) {
+                         bool verbose,
+                         std::vector<size_t> * inlier_indices_out) {
   size_t best_inliers = 0;
   camera::CameraParameters params = camera_estimate->GetParameters();
 
@@ -446,6 +463,8 @@ int RansacEstimateCamera(const std::vector<Eigen::Vector3d> & landmarks,
     std::copy(inlier_observations.begin(), inlier_observations.end(),
         std::back_inserter(*inlier_observations_out));
   }
+  if (inlier_indices_out)
+    *inlier_indices_out = inliers;
 
   return 0;
 }
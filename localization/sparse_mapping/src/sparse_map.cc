@@ -21,6 +21,7 @@
 #include <ff_common/thread.h>
 #include <ff_common/utils.h>
 #include <interest_point/matching.h>
+#include <sparse_mapping/feature_cache.h>
 #include <sparse_mapping/reprojection.h>
 #include <sparse_mapping/sparse_mapping.h>
 #include <sparse_mapping/tensor.h>
@@ -38,9 +39,13 @@
 #include <sys/time.h>
 
 #include <fstream>
+#include <iterator>
 #include <queue>
 #include <set>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 #include <limits>
 
 DEFINE_int32(num_similar, 20,
@@ -58,6 +63,21 @@ DEFINE_int32(num_extra_localization_db_images, 0,
              "Match this many extra images from the Vocab DB, only keep num_similar.");
 DEFINE_bool(verbose_localization, false,
             "If true, list the images most similar to the one being localized.");
+DEFINE_double(keyframe_index_cell_size, 1.0,
+              "Bin the centers of the images of a map in cubes with sides of this many meters, to find "
+              "those near a guess of the pose of an image to localize.");
+DEFINE_double(prior_max_distance, 2.0,
+              "When localizing with a guess of the pose, match only the images of the map taken within "
+              "this many meters of it.");
+DEFINE_double(prior_max_angle, 60.0,
+              "When localizing with a guess of the pose, match only the images of the map looking within "
+              "this many degrees of the same way.");
+DEFINE_string(feature_cache_dir, "",
+              "Keep the features detected in images in this directory, and read them from there "
+              "when detecting again in the same image with the same detector parameters.");
+DECLARE_int32(orgbrisk_octaves);         // defined in interest_point/matching.cc
+DECLARE_double(orgbrisk_pattern_scale);  // defined in interest_point/matching.cc
+DECLARE_bool(single_pass_detection);     // defined in interest_point/matching.cc
 
 namespace sparse_mapping {
 
@@ -288,10 +308,10 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
 
   cid_to_filename_.resize(num_frames);
   cid_to_descriptor_map_.resize(num_frames);
-  if (!localization) {
+  // The poses are kept even for localization, for the keyframe index
+  cid_to_cam_t_global_.resize(num_frames);
+  if (!localization)
     cid_to_keypoint_map_.resize(num_frames);
-    cid_to_cam_t_global_.resize(num_frames);
-  }
 
   // load each frame
   for (int cid = 0; cid < num_frames; cid++) {
@@ -334,7 +354,7 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
     }
 
     // Load pose
-    if (frame.has_pose() && !localization) {
+    if (frame.has_pose()) {
       sparse_mapping_protobuf::Affine3d pose = frame.pose();
       cid_to_cam_t_global_[cid].translation()
         << pose.t0(), pose.t1(), pose.t2();
@@ -385,6 +405,8 @@ void SparseMap::Load(const std::string & protobuf_file, bool localization) {
   if (map.has_vocab_db())
     vocab_db_.LoadProtobuf(input, map.vocab_db());
 
+  InitializeKeyframeIndex();
+
   histogram_equalization_ = map.histogram_equalization();
 
   assert(histogram_equalization_ == 0 ||
@@ -555,21 +577,79 @@ void SparseMap::InitializeCidFidToPid() {
                                         &cid_fid_to_pid_);
 }
 
+void SparseMap::InitializeKeyframeIndex() {
+  keyframe_index_.Build(cid_to_cam_t_global_, FLAGS_keyframe_index_cell_size);
+}
+
 void SparseMap::DetectFeaturesFromFile(std::string const& filename,
                                        bool multithreaded,
                                        cv::Mat* descriptors,
                                        Eigen::Matrix2Xd* keypoints) {
-  cv::Mat image = cv::imread(filename, CV_LOAD_IMAGE_GRAYSCALE);
-  if (image.rows == 0 || image.cols == 0)
-    LOG(FATAL) << "Found empty image in file: " << filename;
+  if (FLAGS_feature_cache_dir == "") {
+    cv::Mat image = cv::imread(filename, CV_LOAD_IMAGE_GRAYSCALE);
+    if (image.rows == 0 || image.cols == 0)
+      LOG(FATAL) << "Found empty image in file: " << filename;
+
+    DetectFeatures(image, multithreaded, descriptors, keypoints);
+    return;
+  }
+
+  // The image file is read once, to find its features in the cache and
+  // to decode it if they are not there
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  FeatureCache cache(FLAGS_feature_cache_dir);
+  uint64_t key = FeatureCache::Key(bytes, DetectionParams(multithreaded));
+  std::vector<cv::KeyPoint> storage;
+  double end_threshold;
+  if (cache.Read(key, &storage, descriptors, &end_threshold)) {
+    // The next detection must start where this one ended
+    if (!multithreaded)
+      detector_.SetDynamicThreshold(end_threshold);
+  } else {
+    cv::Mat image = cv::imdecode(bytes, CV_LOAD_IMAGE_GRAYSCALE);
+    if (image.rows == 0 || image.cols == 0)
+      LOG(FATAL) << "Found empty image in file: " << filename;
 
-  DetectFeatures(image, multithreaded, descriptors, keypoints);
+    DetectRawFeatures(image, multithreaded, descriptors, &storage, &end_threshold);
+    if (!cache.Write(key, storage, *descriptors, end_threshold))
+      LOG(WARNING) << "Could not write the features of " << filename << " to " << FLAGS_feature_cache_dir;
+  }
+  UndistortKeypoints(storage, keypoints);
 }
 
 void SparseMap::DetectFeatures(const cv::Mat& image,
                                bool multithreaded,
                                cv::Mat* descriptors,
                                Eigen::Matrix2Xd* keypoints) {
+  std::vector<cv::KeyPoint> storage;
+  double end_threshold;
+  DetectRawFeatures(image, multithreaded, descriptors, &storage, &end_threshold);
+  UndistortKeypoints(storage, keypoints);
+}
+
+std::string SparseMap::DetectionParams(bool multithreaded) {
+  // A multithreaded detection uses a new detector, which starts from the
+  // default threshold, else the threshold is where the last one left it
+  int min_features, max_features, max_retries;
+  double min_thresh, default_thresh, max_thresh;
+  detector_.GetDetectorParams(min_features, max_features, max_retries,
+                              min_thresh, default_thresh, max_thresh);
+  double start_thresh = multithreaded ? default_thresh : detector_.GetDynamicThreshold();
+  std::ostringstream params;
+  params.precision(17);
+  params << detector_.GetDetectorName() << ' ' << min_features << ' ' << max_features << ' ' << max_retries
+         << ' ' << min_thresh << ' ' << default_thresh << ' ' << max_thresh << ' ' << start_thresh << ' '
+         << histogram_equalization_ << ' ' << FLAGS_orgbrisk_octaves << ' ' << FLAGS_orgbrisk_pattern_scale
+         << ' ' << FLAGS_single_pass_detection;
+  return params.str();
+}
+
+void SparseMap::DetectRawFeatures(const cv::Mat& image,
+                                  bool multithreaded,
+                                  cv::Mat* descriptors,
+                                  std::vector<cv::KeyPoint>* storage,
+                                  double* end_threshold) {
   // If using histogram equalization, need an extra image to store it
   cv::Mat * image_ptr = const_cast<cv::Mat*>(&image);
   cv::Mat hist_image;
@@ -590,9 +670,9 @@ void SparseMap::DetectFeatures(const cv::Mat& image,
   cv::imwrite(image_file, *image_ptr);
 #endif
 
-  std::vector<cv::KeyPoint> storage;
   if (!multithreaded) {
-    detector_.Detect(*image_ptr, &storage, descriptors);
+    detector_.Detect(*image_ptr, storage, descriptors);
+    *end_threshold = detector_.GetDynamicThreshold();
   } else {
     // When using multiple threads, need an individual detector
     // instance, to avoid a crash. This is being used only in
@@ -605,12 +685,15 @@ void SparseMap::DetectFeatures(const cv::Mat& image,
     interest_point::FeatureDetector local_detector(detector_.GetDetectorName(),
                                                    min_features, max_features, max_retries,
                                                    min_thresh, default_thresh, max_thresh);
-    local_detector.Detect(*image_ptr, &storage, descriptors);
+    local_detector.Detect(*image_ptr, storage, descriptors);
+    *end_threshold = local_detector.GetDynamicThreshold();
   }
 
   if (FLAGS_verbose_localization)
-    std::cout << "Features detected " << storage.size() << std::endl;
+    std::cout << "Features detected " << storage->size() << std::endl;
+}
 
+void SparseMap::UndistortKeypoints(std::vector<cv::KeyPoint> const& storage, Eigen::Matrix2Xd* keypoints) {
   keypoints->resize(2, storage.size());
   Eigen::Vector2d output;
 
@@ -640,7 +723,9 @@ bool Localize(cv::Mat const& test_descriptors,
               std::vector<Eigen::Vector3d> const& pid_to_xyz,
               int num_ransac_iterations, int ransac_inlier_tolerance,
               int early_break_landmarks, int histogram_equalization,
-              std::vector<int> * cid_list) {
+              std::vector<int> * cid_list,
+              std::vector<int> * matched_pids,
+              std::vector<int> * inlier_pids) {
   std::vector<int> indices;
   // Query the vocab tree.
   if (cid_list == NULL)
@@ -698,6 +783,7 @@ bool Localize(cv::Mat const& test_descriptors,
 
   std::vector<Eigen::Vector2d> observations;
   std::vector<Eigen::Vector3d> landmarks;
+  std::vector<int> landmark_ids;
   std::vector<int> highly_ranked = ff_common::rv_order(similarity_rank);
   int end = std::min(static_cast<int>(highly_ranked.size()), num_similar);
   std::set<int> seen_landmarks;
@@ -717,6 +803,7 @@ bool Localize(cv::Mat const& test_descriptors,
                           test_keypoints.col(matches->at(j).queryIdx)[1]);
       observations.push_back(obs);
       landmarks.push_back(pid_to_xyz[landmark_id]);
+      landmark_ids.push_back(landmark_id);
       seen_landmarks.insert(landmark_id);
       num_matches++;
     }
@@ -725,11 +812,21 @@ bool Localize(cv::Mat const& test_descriptors,
   }
   if (FLAGS_verbose_localization) std::cout << std::endl;
 
+  std::vector<size_t> inliers;
   int ret = RansacEstimateCamera(landmarks, observations,
                                  num_ransac_iterations,
                                  ransac_inlier_tolerance, pose,
                                  inlier_landmarks, inlier_observations,
-                                 FLAGS_verbose_localization);
+                                 FLAGS_verbose_localization, &inliers);
+  if (matched_pids)
+    *matched_pids = landmark_ids;
+  if (inlier_pids) {
+    inlier_pids->clear();
+    if (ret == 0) {
+      for (size_t i = 0; i < inliers.size(); i++)
+        inlier_pids->push_back(landmark_ids[inliers[i]]);
+    }
+  }
   return (ret == 0);
 }
 
@@ -763,6 +860,59 @@ bool SparseMap::Localize(std::string const& img_file,
 }
 
 // delete all the features that do not match to a landmark but are still around!
+void SparseMap::PruneFrame(int cid) {
+  std::vector<int> deleted_features;
+  for (int fid = 0; fid < cid_to_descriptor_map_[cid].rows; fid++) {
+    // delete if no matching landmark!
+    if (cid_fid_to_pid_[cid].count(fid) == 0) {
+      deleted_features.push_back(fid);
+    }
+  }
+  if (deleted_features.size() == 0)
+    return;
+  // create new descriptor map
+  cv::Mat next_descriptor_map;
+  next_descriptor_map.create(cid_to_descriptor_map_[cid].rows - deleted_features.size(),
+                             cid_to_descriptor_map_[cid].cols, cid_to_descriptor_map_[cid].depth());
+  int new_fid = 0;
+  for (int fid = 0; fid < cid_to_descriptor_map_[cid].rows; fid++) {
+    // delete if no matching landmark!
+    if (cid_fid_to_pid_[cid].count(fid) == 0) {
+      continue;
+    } else {
+      cid_to_descriptor_map_[cid].row(fid).copyTo(next_descriptor_map.row(new_fid));
+      // fix indexing
+      if (new_fid < fid) {
+        int pid = cid_fid_to_pid_[cid][fid];
+        // in localization mode this is empty
+        if (pid_to_cid_fid_.size() > 0)
+          pid_to_cid_fid_[pid][cid] = new_fid;
+        cid_fid_to_pid_[cid][new_fid] = pid;
+        cid_fid_to_pid_[cid].erase(fid);
+      }
+      new_fid++;
+    }
+  }
+  cid_to_descriptor_map_[cid] = next_descriptor_map;
+
+  // clean up other stuff
+  for (int i = static_cast<int>(deleted_features.size() - 1); i >= 0; i--) {
+    int fid = deleted_features[i];
+    // these may not always exist if localizing
+    if (cid_to_keypoint_map_.size() > 0) {
+      int rows = cid_to_keypoint_map_[cid].rows();  // must be equal to 2
+      int cols = cid_to_keypoint_map_[cid].cols();
+      // TODO(oalexan1): Copying blocks like this repeatedly is
+      // expensive.  It is simpler to just shift columns left one by
+      // one, as done above.
+      if (fid < cols - 1)
+        cid_to_keypoint_map_[cid].block(0, fid, rows, cols - 1 - fid) =
+          cid_to_keypoint_map_[cid].block(0, fid + 1, rows, cols - 1 - fid);
+      cid_to_keypoint_map_[cid].conservativeResize(rows, cols - 1);
+    }
+  }
+}
+
 void SparseMap::PruneMap(void) {
 #if 0
   // This is a good sanity check, print things before we start pruning
@@ -780,58 +930,8 @@ void SparseMap::PruneMap(void) {
   }
 #endif
 
-  for (unsigned int cid = 0; cid < cid_fid_to_pid_.size(); cid++) {
-    std::vector<int> deleted_features;
-    for (int fid = 0; fid < cid_to_descriptor_map_[cid].rows; fid++) {
-      // delete if no matching landmark!
-      if (cid_fid_to_pid_[cid].count(fid) == 0) {
-        deleted_features.push_back(fid);
-      }
-    }
-    if (deleted_features.size() == 0)
-      continue;
-    // create new descriptor map
-    cv::Mat next_descriptor_map;
-    next_descriptor_map.create(cid_to_descriptor_map_[cid].rows - deleted_features.size(),
-                               cid_to_descriptor_map_[cid].cols, cid_to_descriptor_map_[cid].depth());
-    int new_fid = 0;
-    for (int fid = 0; fid < cid_to_descriptor_map_[cid].rows; fid++) {
-      // delete if no matching landmark!
-      if (cid_fid_to_pid_[cid].count(fid) == 0) {
-        continue;
-      } else {
-        cid_to_descriptor_map_[cid].row(fid).copyTo(next_descriptor_map.row(new_fid));
-        // fix indexing
-        if (new_fid < fid) {
-          int pid = cid_fid_to_pid_[cid][fid];
-          // in localization mode this is empty
-          if (pid_to_cid_fid_.size() > 0)
-            pid_to_cid_fid_[pid][cid] = new_fid;
-          cid_fid_to_pid_[cid][new_fid] = pid;
-          cid_fid_to_pid_[cid].erase(fid);
-        }
-        new_fid++;
-      }
-    }
-    cid_to_descriptor_map_[cid] = next_descriptor_map;
-
-    // clean up other stuff
-    for (int i = static_cast<int>(deleted_features.size() - 1); i >= 0; i--) {
-      int fid = deleted_features[i];
-      // these may not always exist if localizing
-      if (cid_to_keypoint_map_.size() > 0) {
-        int rows = cid_to_keypoint_map_[cid].rows();  // must be equal to 2
-        int cols = cid_to_keypoint_map_[cid].cols();
-        // TODO(oalexan1): Copying blocks like this repeatedly is
-        // expensive.  It is simpler to just shift columns left one by
-        // one, as done above.
-        if (fid < cols - 1)
-          cid_to_keypoint_map_[cid].block(0, fid, rows, cols - 1 - fid) =
-            cid_to_keypoint_map_[cid].block(0, fid + 1, rows, cols - 1 - fid);
-        cid_to_keypoint_map_[cid].conservativeResize(rows, cols - 1);
-      }
-    }
-  }
+  for (unsigned int cid = 0; cid < cid_fid_to_pid_.size(); cid++)
+    PruneFrame(cid);
 
   // This is not strictly necessary as all book-keeping was already done
   InitializeCidFidToPid();
@@ -885,7 +985,9 @@ bool SparseMap::Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2X
                          camera::CameraModel* pose,
                          std::vector<Eigen::Vector3d>* inlier_landmarks,
                          std::vector<Eigen::Vector2d>* inlier_observations,
-                         std::vector<int> * cid_list) {
+                         std::vector<int> * cid_list,
+                         std::vector<int> * matched_pids,
+                         std::vector<int> * inlier_pids) {
   return sparse_mapping::Localize(test_descriptors, test_keypoints,
                                   std::cref(camera_params_),
                                   pose,
@@ -903,7 +1005,41 @@ bool SparseMap::Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2X
                                   ransac_inlier_tolerance_,
                                   early_break_landmarks_,
                                   histogram_equalization_,
-                                  cid_list);
+                                  cid_list, matched_pids, inlier_pids);
+}
+
+bool SparseMap::Localize(const cv::Mat & test_descriptors, const Eigen::Matrix2Xd & test_keypoints,
+                         Eigen::Affine3d const& prior_cam_t_global,
+                         camera::CameraModel* pose,
+                         std::vector<Eigen::Vector3d>* inlier_landmarks,
+                         std::vector<Eigen::Vector2d>* inlier_observations) {
+  // Images may have been added since the index was made
+  if (keyframe_index_.Size() != GetNumFrames())
+    InitializeKeyframeIndex();
+
+  std::vector<int> nearby;
+  keyframe_index_.Query(prior_cam_t_global, FLAGS_prior_max_distance, FLAGS_prior_max_angle * M_PI / 180.0,
+                        &nearby);
+  if (nearby.empty())
+    return Localize(test_descriptors, test_keypoints, pose, inlier_landmarks, inlier_observations);
+
+  // Match as many images as without the guess. Those near it which the
+  // vocab db finds similar go first, then the nearest others.
+  int num_images = num_similar_ + FLAGS_num_extra_localization_db_images;
+  std::vector<int> similar;
+  sparse_mapping::QueryDB(detector_.GetDetectorName(), &vocab_db_, num_images, test_descriptors, &similar);
+  std::set<int> nearby_set(nearby.begin(), nearby.end()), used;
+  std::vector<int> cid_list;
+  for (size_t i = 0; i < similar.size(); i++) {
+    if (nearby_set.count(similar[i]) > 0 && used.insert(similar[i]).second)
+      cid_list.push_back(similar[i]);
+  }
+  for (size_t i = 0; i < nearby.size() && static_cast<int>(cid_list.size()) < num_images; i++) {
+    if (used.insert(nearby[i]).second)
+      cid_list.push_back(nearby[i]);
+  }
+
+  return Localize(test_descriptors, test_keypoints, pose, inlier_landmarks, inlier_observations, &cid_list);
 }
 
 }  // namespace sparse_mapping
@@ -20,6 +20,8 @@
 #include <ff_common/thread.h>
 #include <ff_common/utils.h>
 #include <sparse_mapping/tensor.h>
+#include <sparse_mapping/incremental_ba.h>
+#include <sparse_mapping/map_file.h>
 #include <sparse_mapping/ransac.h>
 #include <sparse_mapping/reprojection.h>
 #include <sparse_mapping/sparse_mapping.h>
@@ -48,7 +50,12 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <sparse_map.pb.h>
+
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <set>
 #include <thread>
@@ -72,6 +79,11 @@ DEFINE_bool(skip_adding_new_matches_on_merging, false,
             "When merging maps, do not take advantage of performed matching to add new tracks.");
 DEFINE_bool(fast_merge, false,
             "When merging maps that have shared images, use those and skip doing additional matches among the images.");
+DEFINE_bool(out_of_core_merge, false,
+            "When merging maps, read the maps from their files as needed and write the merged map as it is made, "
+            "rather than loading them, to merge maps bigger than memory.");
+DEFINE_int32(merge_block_size, 10,
+             "When merging maps out of core, match this many images of one map to this many of the other at a time.");
 DEFINE_double(reproj_thresh, 5.0,
               "Filter points with re-projection error higher than this.");
 
@@ -88,6 +100,15 @@ DEFINE_int32(first_ba_index, 0,
              "Vary only cameras starting with this index during bundle adjustment.");
 DEFINE_int32(last_ba_index, std::numeric_limits<int>::max(),
              "Vary only cameras ending with this index during bundle adjustment.");
+DEFINE_bool(incremental_ba_local, false,
+            "In incremental bundle adjustment, keep the points and the problem from one camera to the "
+            "next and only triangulate and optimize what the new camera touches, instead of "
+            "triangulating all tracks and making the problem again for each camera. Faster on large "
+            "maps, where the time per camera otherwise grows with the map. Not yet the default, as it "
+            "remains to be checked with test_incremental_ba and incremental_ba_benchmark.");
+DEFINE_int32(incremental_ba_global_rate, 256,
+             "With -incremental_ba_local, optimize all cameras after adding this many. "
+             "Use 0 to never do that.");
 
 namespace sparse_mapping {
 // Two minor and local utility functions
@@ -365,30 +386,40 @@ void BuildTracks(bool rm_invalid_xyz,
   // PrintTrackStats(s->pid_to_cid_fid_, "track building");
 }
 
-// TODO(oalexan1): This very naive code can use serious performance
-// improvements.  Each time we add a new camera we triangulate all
-// points. We bundle-adjust the last several cameras, but while seeing
-// (and keeping fixed) all the earlier cameras. It is sufficient to
-// both triangulate and see during bundle adjustment only the several
-// most similar cameras. Fixing these would need careful testing for
-// both map quality and run-time before and after the fix.
-void IncrementalBA(std::string const& essential_file,
-                   sparse_mapping::SparseMap * s) {
-  // Do incremental bundle adjustment.
-
-  // Optimize only the last several cameras, their number varies
-  // between min_num_cams and max_num_cams.
+namespace {
 
+// The first camera to optimize when camera cid is added in incremental
+// bundle adjustment. Optimize only the last several cameras, their number
+// varies between min_num_cams and max_num_cams.
+int IncrementalBAFirst(int cid) {
   // TODO(oalexan1): Need to research how many previous cameras we
   // need for loop closure.
   int min_num_cams = 4;
   int max_num_cams = 128;
 
-  // Read in all the affine R|t combinations between cameras
-  sparse_mapping::CIDPairAffineMap relative_affines;
-  sparse_mapping::ReadAffineCSV(essential_file,
-                                &relative_affines);
+  // If cid+1 is divisible by 2^k, do at least 2^k cameras, ending
+  // with camera cid.  E.g., if current camera index is 23 = 3*8-1, do at
+  // least 8 cameras, so cameras 16, ..., 23. This way, we will try
+  // to occasionally do more than just several close cameras.
+  int val = cid+1;
+  int offset = 1;
+  while (val % 2 == 0) {
+    val /= 2;
+    offset *= 2;
+  }
+  offset = std::min(offset, max_num_cams);
+
+  int start = cid-offset+1;
+  start = std::min(cid-min_num_cams+1, start);
+  if (start < 0) start = 0;
+  return start;
+}
 
+// Incremental bundle adjustment as it was first done. Each time a camera
+// is added all points are triangulated, and the problem has all of them,
+// with the earlier cameras fixed.
+void IncrementalBARebuild(sparse_mapping::CIDPairAffineMap const& relative_affines,
+                          sparse_mapping::SparseMap * s) {
   int num_images = s->cid_to_filename_.size();
 
   // Track and camera info up to the current cid
@@ -409,7 +440,7 @@ void IncrementalBA(std::string const& essential_file,
     // the current camera is similar to the previous one.
     std::pair<int, int> P(cid-1, cid);
     if (relative_affines.find(P) != relative_affines.end())
-      cid_to_cam_t_local[cid] = relative_affines[P]*cid_to_cam_t_local[cid-1];
+      cid_to_cam_t_local[cid] = relative_affines.at(P)*cid_to_cam_t_local[cid-1];
     else
       cid_to_cam_t_local[cid] = cid_to_cam_t_local[cid-1];  // no choice
 
@@ -450,22 +481,7 @@ void IncrementalBA(std::string const& essential_file,
     ceres::Solver::Summary summary;
     ceres::LossFunction* loss = new ceres::CauchyLoss(0.5);
 
-    // If cid+1 is divisible by 2^k, do at least 2^k cameras, ending
-    // with camera cid.  E.g., if current camera index is 23 = 3*8-1, do at
-    // least 8 cameras, so cameras 16, ..., 23. This way, we will try
-    // to occasionally do more than just several close cameras.
-    int val = cid+1;
-    int offset = 1;
-    while (val % 2 == 0) {
-      val /= 2;
-      offset *= 2;
-    }
-    offset = std::min(offset, max_num_cams);
-
-    int start = cid-offset+1;
-    start = std::min(cid-min_num_cams+1, start);
-    if (start < 0) start = 0;
-
+    int start = IncrementalBAFirst(cid);
     LOG(INFO) << "Optimizing cameras from " << start << " to " << cid << " (total: "
         << cid-start+1 << ")";
 
@@ -482,8 +498,55 @@ void IncrementalBA(std::string const& essential_file,
     for (int c = 0; c <= cid; c++)
       s->cid_to_cam_t_global_[c] = cid_to_cam_t_local[c];
   }
+}
+
+}  // namespace
+
+// Incremental bundle adjustment. Cameras are added one at a time, and
+// after each one the last several are optimized, with the earlier ones
+// fixed. With incremental_ba_local the points are only triangulated again
+// when a new camera extends their track, and only the points seen by the
+// cameras optimized are in the problem, so the time per camera does not
+// grow with the map. Every incremental_ba_global_rate cameras all of them
+// are then optimized.
+void IncrementalBA(std::string const& essential_file,
+                   sparse_mapping::SparseMap * s) {
+  // Read in all the affine R|t combinations between cameras
+  sparse_mapping::CIDPairAffineMap relative_affines;
+  sparse_mapping::ReadAffineCSV(essential_file,
+                                &relative_affines);
+
+  if (!FLAGS_incremental_ba_local) {
+    IncrementalBARebuild(relative_affines, s);
+  } else {
+    int num_images = s->cid_to_filename_.size();
+    sparse_mapping::IncrementalBundleAdjuster adjuster(s);
+    for (int cid = 0; cid < num_images; cid++) {
+      // Add a new camera. Obtain it based on relative affines. Here we assume
+      // the current camera is similar to the previous one.
+      Eigen::Affine3d cam_t_global = s->cid_to_cam_t_global_[0];
+      if (cid > 0) {
+        cam_t_global = adjuster.Camera(cid - 1);  // no choice if no affine
+        std::pair<int, int> P(cid-1, cid);
+        if (relative_affines.find(P) != relative_affines.end())
+          cam_t_global = relative_affines[P] * cam_t_global;
+      }
+
+      int start = IncrementalBAFirst(cid);
+      if (FLAGS_incremental_ba_global_rate > 0 && (cid + 1) % FLAGS_incremental_ba_global_rate == 0)
+        start = 0;
+      if (cid > 0)
+        LOG(INFO) << "Optimizing cameras from " << start << " to " << cid << " (total: "
+                  << cid-start+1 << ")";
+      adjuster.AddCamera(cam_t_global, start);
+    }
+
+    for (int cid = 0; cid < num_images; cid++)
+      s->cid_to_cam_t_global_[cid] = adjuster.Camera(cid);
+  }
 
   // Triangulate all points
+  bool rm_invalid_xyz = true;
   sparse_mapping::Triangulate(rm_invalid_xyz,
                               s->camera_params_.GetFocalLength(),
                               s->cid_to_cam_t_global_,
@@ -491,6 +554,7 @@ void IncrementalBA(std::string const& essential_file,
                               &(s->pid_to_cid_fid_),
                               &(s->pid_to_xyz_),
                               &(s->cid_fid_to_pid_));
+  s->InitializeKeyframeIndex();
 
   // Wipe file that is no longer needed
   try {
@@ -643,6 +707,7 @@ void BundleAdjustment(sparse_mapping::SparseMap * s,
                                s->user_pid_to_cid_fid_, s->user_cid_to_keypoint_map_,
                                &(s->user_pid_to_xyz_),
                                loss, options, summary, first, last, fix_cameras);
+  s->InitializeKeyframeIndex();
 
   // First do BA, and only afterwards remove outliers.
   if (!FLAGS_skip_filtering) {
@@ -661,6 +726,21 @@ void AppendMapFile(std::string const& mapOut, std::string const& mapIn,
                    double outlier_factor, bool bundle_adjust) {
   LOG(INFO) << "Appending " << mapIn << " to " << mapOut << std::endl;
 
+  if (FLAGS_out_of_core_merge) {
+    // Write elsewhere first, as mapOut is read while merging
+    std::string merged_map = mapOut + ".merged.map";
+    sparse_mapping::MergeMapFiles(mapOut, mapIn, num_image_overlaps_at_endpoints, merged_map);
+    if (std::rename(merged_map.c_str(), mapOut.c_str()) != 0)
+      LOG(FATAL) << "Failed to rename " << merged_map << " to " << mapOut;
+    if (bundle_adjust) {
+      sparse_mapping::SparseMap C(mapOut);
+      bool fix_cameras = false;
+      sparse_mapping::BundleAdjust(fix_cameras, &C);
+      C.Save(mapOut);
+    }
+    return;
+  }
+
   sparse_mapping::SparseMap A(mapOut);
   sparse_mapping::SparseMap B(mapIn);
 
@@ -781,6 +861,58 @@ void TransformTracks(std::map<int, int> const& cid2cid,
   *pid_to_cid_fid = pid_to_cid_fid2;
 }
 
+// Tracks made separately, such as for different pairs of blocks of
+// images, are pieces of the same track when they go through the same
+// feature of the same image. Union such tracks. A union which goes
+// through two features of the same image is ambiguous and is removed,
+// as openMVG's track builder does.
+void MergeTracks(std::vector<std::map<int, int> > * pid_to_cid_fid) {
+  // Union-find over the tracks, with the first track seen through a
+  // feature standing for it
+  std::vector<int> parent(pid_to_cid_fid->size());
+  for (size_t pid = 0; pid < parent.size(); pid++)
+    parent[pid] = pid;
+  std::function<int(int)> find = [&parent, &find](int pid) {
+    if (parent[pid] != pid)
+      parent[pid] = find(parent[pid]);
+    return parent[pid];
+  };
+  std::map<std::pair<int, int>, int> cid_fid_to_pid;
+  for (size_t pid = 0; pid < pid_to_cid_fid->size(); pid++) {
+    auto const& cid_fid = (*pid_to_cid_fid)[pid];  // alias
+    for (auto it = cid_fid.begin(); it != cid_fid.end(); it++) {
+      auto res = cid_fid_to_pid.insert(std::make_pair(*it, static_cast<int>(pid)));
+      if (!res.second)
+        parent[find(pid)] = find(res.first->second);
+    }
+  }
+
+  std::map<int, int> root_to_merged;
+  std::vector<std::map<int, int> > merged;
+  std::vector<bool> ambiguous;
+  for (size_t pid = 0; pid < pid_to_cid_fid->size(); pid++) {
+    int root = find(pid);
+    auto res = root_to_merged.insert(std::make_pair(root, static_cast<int>(merged.size())));
+    if (res.second) {
+      merged.push_back(std::map<int, int>());
+      ambiguous.push_back(false);
+    }
+    int m = res.first->second;
+    auto const& cid_fid = (*pid_to_cid_fid)[pid];  // alias
+    for (auto it = cid_fid.begin(); it != cid_fid.end(); it++) {
+      auto ins = merged[m].insert(*it);
+      if (!ins.second && ins.first->second != it->second)
+        ambiguous[m] = true;
+    }
+  }
+
+  pid_to_cid_fid->clear();
+  for (size_t m = 0; m < merged.size(); m++) {
+    if (!ambiguous[m])
+      pid_to_cid_fid->push_back(merged[m]);
+  }
+}
+
 // As result of matching some images in A to some images in B, we must
 // now merge some tracks in A with some tracks in B, as those tracks
 // correspond physically to the same point in space. A track in
@@ -1135,6 +1267,61 @@ void TransformMap(std::map<int, int> & cid2cid,
   // C.Save(output_map + ".reduced.map");
 }
 
+// Estimate the transform from the xyz points of tracks in map B to
+// the points of the tracks in map A they are matched to, in the order
+// of A2B, using RANSAC. Remove from A2B and B2A the matches which are
+// outliers.
+Eigen::Affine3d findB2ATransform(std::vector<Eigen::Vector3d> const& A_vec,
+                                 std::vector<Eigen::Vector3d> const& B_vec,
+                                 std::map<int, int> * A2B,
+                                 std::map<int, int> * B2A) {
+  double inlier_threshold = estimateCloseDistance(A_vec);
+
+  // Estimate the transform from B_vec to A_vec using RANSAC.
+  // A lot of outliers are possible.
+  int  num_iterations = 1000;
+  int  min_num_output_inliers = A_vec.size()/2;
+  bool reduce_min_num_output_inliers_if_no_fit = true;  // If too many outliers
+  bool increase_threshold_if_no_fit = true;  // Coz our threshold was done by a heuristic
+  RandomSampleConsensus < TranslationRotationScaleFittingFunctor, TransformError>
+    ransac(TranslationRotationScaleFittingFunctor(), TransformError(), num_iterations,
+           inlier_threshold, min_num_output_inliers,
+           reduce_min_num_output_inliers_if_no_fit, increase_threshold_if_no_fit);
+  Eigen::Affine3d B2A_trans = ransac(B_vec, A_vec);
+  std::vector<size_t> inlier_indices = ransac.inlier_indices(B2A_trans, B_vec, A_vec);
+  std::set<int> inlier_set;
+  for (size_t it = 0; it < inlier_indices.size(); it++) {
+    inlier_set.insert(inlier_indices[it]);
+  }
+
+  // Remove from A2B and B2A the outliers
+  std::map<int, int> A2B_orig = *A2B;
+  int point_count = 0;
+  for (auto it = A2B_orig.begin(); it != A2B_orig.end(); it++) {
+    int pid_a = it->first;
+    int pid_b = it->second;
+    if (inlier_set.find(point_count) == inlier_set.end()) {
+      auto iter_a = A2B->find(pid_a);
+      if (iter_a == A2B->end())
+        LOG(FATAL) << "Bookkeeping error 1 in merging maps.";
+      A2B->erase(iter_a);
+
+      auto iter_b = B2A->find(pid_b);
+      if (iter_b == B2A->end())
+        LOG(FATAL) << "Bookkeeping error 2 in merging maps.";
+      B2A->erase(iter_b);
+    }
+    point_count++;
+  }
+
+  // LOG(INFO) does not do well with Eiegn.
+  std::cout << "Affine transform from second map to first map:\n";
+  std::cout << "Matrix:\n"      << B2A_trans.linear()       << "\n";
+  std::cout << "Translation:\n" << B2A_trans.translation()  << "\n";
+
+  return B2A_trans;
+}
+
 // Merge two maps. See merge_maps.cc. The merged map needs to be
 // bundle-adjusted. We need to have write-access to A and B to be able
 // to initialize some auxiliary structures in these maps.
@@ -1210,49 +1397,7 @@ void MergeMaps(sparse_mapping::SparseMap * A_in,
     B_vec[point_count] = B.pid_to_xyz_[pid_b];
     point_count++;
   }
-  double inlier_threshold = estimateCloseDistance(A_vec);
-
-  // Estimate the transform from B_vec to A_vec using RANSAC.
-  // A lot of outliers are possible.
-  int  num_iterations = 1000;
-  int  min_num_output_inliers = A_vec.size()/2;
-  bool reduce_min_num_output_inliers_if_no_fit = true;  // If too many outliers
-  bool increase_threshold_if_no_fit = true;  // Coz our threshold was done by a heuristic
-  RandomSampleConsensus < TranslationRotationScaleFittingFunctor, TransformError>
-    ransac(TranslationRotationScaleFittingFunctor(), TransformError(), num_iterations,
-           inlier_threshold, min_num_output_inliers,
-           reduce_min_num_output_inliers_if_no_fit, increase_threshold_if_no_fit);
-  Eigen::Affine3d B2A_trans = ransac(B_vec, A_vec);
-  std::vector<size_t> inlier_indices = ransac.inlier_indices(B2A_trans, B_vec, A_vec);
-  std::set<int> inlier_set;
-  for (size_t it = 0; it < inlier_indices.size(); it++) {
-    inlier_set.insert(inlier_indices[it]);
-  }
-
-  // Remove from A2B and B2A the outliers
-  std::map<int, int> A2B_orig = A2B;
-  point_count = 0;
-  for (auto it = A2B_orig.begin(); it != A2B_orig.end(); it++) {
-    int pid_a = it->first;
-    int pid_b = it->second;
-    if (inlier_set.find(point_count) == inlier_set.end()) {
-      auto iter_a = A2B.find(pid_a);
-      if (iter_a == A2B.end())
-        LOG(FATAL) << "Bookkeeping error 1 in merging maps.";
-      A2B.erase(iter_a);
-
-      auto iter_b = B2A.find(pid_b);
-      if (iter_b == B2A.end())
-        LOG(FATAL) << "Bookkeeping error 2 in merging maps.";
-      B2A.erase(iter_b);
-    }
-    point_count++;
-  }
-
-  // LOG(INFO) does not do well with Eiegn.
-  std::cout << "Affine transform from second map to first map:\n";
-  std::cout << "Matrix:\n"      << B2A_trans.linear()       << "\n";
-  std::cout << "Translation:\n" << B2A_trans.translation()  << "\n";
+  Eigen::Affine3d B2A_trans = findB2ATransform(A_vec, B_vec, &A2B, &B2A);
 
   // Bring the B map into the coordinate system of the A map
   B.ApplyTransform(B2A_trans);
@@ -1416,6 +1561,379 @@ void MergeMaps(sparse_mapping::SparseMap * A_in,
   return;
 }
 
+// Set the pose of a frame as SparseMap::Save does
+void setFramePose(Eigen::Affine3d const& cam_t_global, sparse_mapping_protobuf::Frame * frame) {
+  sparse_mapping_protobuf::Affine3d* a = frame->mutable_pose();
+  Eigen::Matrix4d c = cam_t_global.matrix();
+  a->set_r00(c(0, 0));
+  a->set_r01(c(0, 1));
+  a->set_r02(c(0, 2));
+  a->set_r10(c(1, 0));
+  a->set_r11(c(1, 1));
+  a->set_r12(c(1, 2));
+  a->set_r20(c(2, 0));
+  a->set_r21(c(2, 1));
+  a->set_r22(c(2, 2));
+  a->set_t0(c(0, 3));
+  a->set_t1(c(1, 3));
+  a->set_t2(c(2, 3));
+}
+
+void writeLandmark(Eigen::Vector3d const& xyz, std::map<int, int> const& cid_fid,
+                   google::protobuf::io::ZeroCopyOutputStream * output) {
+  sparse_mapping_protobuf::Landmark l;
+  l.mutable_loc()->set_x(xyz.x());
+  l.mutable_loc()->set_y(xyz.y());
+  l.mutable_loc()->set_z(xyz.z());
+  for (auto it = cid_fid.begin(); it != cid_fid.end(); it++) {
+    sparse_mapping_protobuf::Matching* m = l.add_match();
+    m->set_camera_id(it->first);
+    m->set_feature_id(it->second);
+  }
+  if (!WriteProtobufTo(l, output))
+    LOG(FATAL) << "Failed to write landmark to file.";
+}
+
+// Match the images A_search of map A to the images B_search of map B,
+// as findMatchingTracks does, a block of at most
+// FLAGS_merge_block_size images from each map at a time, so that only
+// the features of those images are in memory. In the tracks made,
+// the images of A_search come first, then those of B_search. The
+// tracks of all pairs of blocks are merged, so they are the tracks
+// matching all the images at once would give.
+void findMatchingTracksInBlocks(sparse_mapping::MapFile const& A,
+                                sparse_mapping::MapFile const& B,
+                                std::vector<int> const& A_search,
+                                std::vector<int> const& B_search,
+                                std::string const& output_map,
+                                std::vector<std::map<int, int> > * search_pid_to_cid_fid) {
+  search_pid_to_cid_fid->clear();
+  if (FLAGS_merge_block_size <= 0)
+    LOG(FATAL) << "Must have merge_block_size > 0.";
+  size_t block_size = FLAGS_merge_block_size;
+  int num_asearch = A_search.size();
+
+  // Must not try to match images of the same map
+  FREEFLYER_GFLAGS_NAMESPACE::SetCommandLineOption("num_subsequent_images", "0");
+
+  for (size_t a_begin = 0; a_begin < A_search.size(); a_begin += block_size) {
+    size_t a_end = std::min(a_begin + block_size, A_search.size());
+    for (size_t b_begin = 0; b_begin < B_search.size(); b_begin += block_size) {
+      size_t b_end = std::min(b_begin + block_size, B_search.size());
+
+      // A map of just the images of this block, with their place in the tracks
+      std::vector<std::string> filenames;
+      std::vector<int> cid_to_search;
+      for (size_t a = a_begin; a < a_end; a++) {
+        filenames.push_back(A.GetFrameFilename(A_search[a]));
+        cid_to_search.push_back(a);
+      }
+      for (size_t b = b_begin; b < b_end; b++) {
+        filenames.push_back(B.GetFrameFilename(B_search[b]));
+        cid_to_search.push_back(num_asearch + b);
+      }
+      sparse_mapping::SparseMap block(filenames, A.Header().detector_name(), A.GetCameraParameters());
+      int num_block_acid = a_end - a_begin;
+      for (size_t cid = 0; cid < filenames.size(); cid++) {
+        int search_cid = cid_to_search[cid];
+        if (search_cid < num_asearch)
+          A.ReadFeatures(A_search[search_cid], &block.cid_to_keypoint_map_[cid], &block.cid_to_descriptor_map_[cid]);
+        else
+          B.ReadFeatures(B_search[search_cid - num_asearch], &block.cid_to_keypoint_map_[cid],
+                         &block.cid_to_descriptor_map_[cid]);
+      }
+      for (int cid1 = 0; cid1 < num_block_acid; cid1++)
+        for (size_t cid2 = num_block_acid; cid2 < filenames.size(); cid2++)
+          block.cid_to_cid_[cid1].insert(cid2);
+
+      sparse_mapping::MatchFeatures(sparse_mapping::EssentialFile(output_map),
+                                    sparse_mapping::MatchesFile(output_map), &block);
+      bool rm_invalid_xyz = false;  // nothing is valid yet
+      sparse_mapping::BuildTracks(rm_invalid_xyz, sparse_mapping::MatchesFile(output_map), &block);
+
+      for (size_t pid = 0; pid < block.pid_to_cid_fid_.size(); pid++) {
+        std::map<int, int> cid_fid;
+        for (auto it = block.pid_to_cid_fid_[pid].begin(); it != block.pid_to_cid_fid_[pid].end(); it++)
+          cid_fid[cid_to_search[it->first]] = it->second;
+        search_pid_to_cid_fid->push_back(cid_fid);
+      }
+    }
+  }
+
+  // A feature seen from images in several blocks of the other map is
+  // in a track for each pair of blocks, so join those
+  MergeTracks(search_pid_to_cid_fid);
+
+  // Wipe files that are no longer needed
+  std::remove(sparse_mapping::EssentialFile(output_map).c_str());
+  std::remove(sparse_mapping::MatchesFile(output_map).c_str());
+}
+
+// Merge the map in file B_file into the map in file A_file, as
+// MergeMaps does, but without loading either. The maps are read with
+// MapFile, the images used to find the transform between the maps
+// are matched in blocks, and the merged map is written to output_map
+// one frame and one landmark at a time. So memory is needed only for
+// the names and poses of the images, and the tracks of the images
+// matched. The images of A keep their place, and those of B which
+// are not in A come after them. An image in both maps keeps its pose
+// in A. The merged map needs to be bundle-adjusted.
+void MergeMapFiles(std::string const& A_file,
+                   std::string const& B_file,
+                   int num_image_overlaps_at_endpoints,
+                   std::string const& output_map) {
+  sparse_mapping::MapFile A(A_file);
+  sparse_mapping::MapFile B(B_file);
+
+  // Basic sanity checks (not exhaustive)
+  if ( !(A.GetCameraParameters() == B.GetCameraParameters()) )
+    LOG(FATAL) << "The input maps don't have the same camera parameters.";
+  if (A.Header().detector_name() != B.Header().detector_name())
+    LOG(FATAL) << "The input maps don't have the same detector and/or descriptor.";
+
+  sparse_mapping::HistogramEqualizationCheck(A.Header().histogram_equalization(),
+                                             B.Header().histogram_equalization());
+
+  int num_acid = A.GetNumFrames();
+  int num_bcid = B.GetNumFrames();
+
+  // Where each image of B goes in the merged map
+  std::map<std::string, int> A_file_to_cid;
+  for (int cid = 0; cid < num_acid; cid++)
+    A_file_to_cid[A.GetFrameFilename(cid)] = cid;
+  std::vector<int> bcid_to_cid(num_bcid), cid_to_bcid(num_acid, -1);
+  std::vector<int> A_shared, B_shared;
+  for (int bcid = 0; bcid < num_bcid; bcid++) {
+    auto it = A_file_to_cid.find(B.GetFrameFilename(bcid));
+    if (it != A_file_to_cid.end()) {
+      bcid_to_cid[bcid] = it->second;
+      A_shared.push_back(it->second);
+      B_shared.push_back(bcid);
+    } else {
+      bcid_to_cid[bcid] = cid_to_bcid.size();
+      cid_to_bcid.push_back(bcid);
+    }
+  }
+  int num_ccid = cid_to_bcid.size();
+
+  // We really count during merging that if two maps have an image in
+  // common, the same keypoint map is computed for that image in both maps.
+  for (size_t i = 0; i < A_shared.size(); i++) {
+    Eigen::Matrix2Xd A_keypoints, B_keypoints;
+    cv::Mat descriptors;
+    A.ReadFeatures(A_shared[i], &A_keypoints, &descriptors);
+    B.ReadFeatures(B_shared[i], &B_keypoints, &descriptors);
+    if (A_keypoints.cols() != B_keypoints.cols() || A_keypoints != B_keypoints)
+      LOG(FATAL) << "The two input maps do not have the same features for same images. "
+                 << "Cannot merge them. Consider rebuilding them.";
+  }
+
+  // Find which tracks of A to merge with which tracks of B, and the
+  // tracks of matches between the maps
+  std::map<int, int> A2B, B2A;
+  std::vector<std::map<int, int> > search_pid_to_cid_fid;
+  std::vector<int> A_search, B_search;
+  std::vector<std::map<int, int> > A_fid_to_pid, B_fid_to_pid;
+  if (!FLAGS_fast_merge) {
+    std::set<int> A_set, B_set;  // use sets to avoid duplicates
+    int num = num_image_overlaps_at_endpoints;
+    for (int cid = 0; cid < num && cid < num_acid; cid++) {
+      A_set.insert(cid);
+      A_set.insert(num_acid - 1 - cid);
+    }
+    for (int cid = 0; cid < num && cid < num_bcid; cid++) {
+      B_set.insert(cid);
+      B_set.insert(num_bcid - 1 - cid);
+    }
+    A_search.assign(A_set.begin(), A_set.end());
+    B_search.assign(B_set.begin(), B_set.end());
+    A.FidToPid(A_search, &A_fid_to_pid);
+    B.FidToPid(B_search, &B_fid_to_pid);
+
+    findMatchingTracksInBlocks(A, B, A_search, B_search, output_map, &search_pid_to_cid_fid);
+    FindPidCorrespondences(A_fid_to_pid, B_fid_to_pid, search_pid_to_cid_fid,
+                           A_search.size(), &A2B, &B2A);
+  } else {
+    // Tracks through the same feature of a shared image are the same
+    A.FidToPid(A_shared, &A_fid_to_pid);
+    B.FidToPid(B_shared, &B_fid_to_pid);
+    for (size_t i = 0; i < A_shared.size(); i++) {
+      for (auto it_a = A_fid_to_pid[i].begin(); it_a != A_fid_to_pid[i].end(); it_a++) {
+        auto it_b = B_fid_to_pid[i].find(it_a->first);
+        if (it_b != B_fid_to_pid[i].end())
+          A2B[it_a->second] = it_b->second;
+      }
+    }
+    // Make it one-to-one, as findTracksForSharedImages does
+    for (auto it = A2B.begin(); it != A2B.end(); it++)
+      B2A[it->second] = it->first;
+    A2B.clear();
+    for (auto it = B2A.begin(); it != B2A.end(); it++)
+      A2B[it->second] = it->first;
+
+    LOG(INFO) << "Number of shared images in the two maps: " << A_shared.size() << std::endl;
+    LOG(INFO) << "Number of shared tracks: " << A2B.size() << std::endl;
+    if (A_shared.empty() || A2B.size() <= 5)
+      LOG(FATAL) << "Not enough shared images or features among the two maps. Run without the --fast option.";
+  }
+
+  // Find the transform from B to A
+  std::vector<Eigen::Vector3d> A_vec, B_vec;
+  std::map<int, int> cid_fid;
+  for (auto it = A2B.begin(); it != A2B.end(); it++) {
+    Eigen::Vector3d A_xyz, B_xyz;
+    A.ReadLandmark(it->first, &A_xyz, &cid_fid);
+    B.ReadLandmark(it->second, &B_xyz, &cid_fid);
+    A_vec.push_back(A_xyz);
+    B_vec.push_back(B_xyz);
+  }
+  Eigen::Affine3d B2A_trans = findB2ATransform(A_vec, B_vec, &A2B, &B2A);
+
+  // Bring the cameras of B into the coordinate system of A
+  std::vector<Eigen::Affine3d> B_cid_to_cam_t_global(num_bcid);
+  for (int bcid = 0; bcid < num_bcid; bcid++)
+    B_cid_to_cam_t_global[bcid] = B.GetFrameGlobalTransform(bcid);
+  std::vector<Eigen::Vector3d> no_xyz;
+  sparse_mapping::TransformCamerasAndPoints(B2A_trans, &B_cid_to_cam_t_global, &no_xyz);
+
+  // The tracks of matches between the maps which are in no track of
+  // either map are added, triangulated with the cameras they see.
+  std::vector<std::map<int, int> > new_pid_to_cid_fid;
+  std::vector<Eigen::Vector3d> new_pid_to_xyz;
+  if (!FLAGS_skip_adding_new_matches_on_merging && !search_pid_to_cid_fid.empty()) {
+    int num_asearch = A_search.size();
+    std::map<int, int> cid_to_local;
+    std::vector<int> local_to_cid;
+    for (size_t pid = 0; pid < search_pid_to_cid_fid.size(); pid++) {
+      bool is_new = false;
+      std::map<int, int> local_cid_fid;
+      for (auto it = search_pid_to_cid_fid[pid].begin(); it != search_pid_to_cid_fid[pid].end(); it++) {
+        int search_cid = it->first, fid = it->second, cid;
+        if (search_cid < num_asearch) {
+          is_new = is_new || A_fid_to_pid[search_cid].find(fid) == A_fid_to_pid[search_cid].end();
+          cid = A_search[search_cid];
+        } else {
+          auto const& fid_to_pid = B_fid_to_pid[search_cid - num_asearch];  // alias
+          is_new = is_new || fid_to_pid.find(fid) == fid_to_pid.end();
+          cid = bcid_to_cid[B_search[search_cid - num_asearch]];
+        }
+        if (cid_to_local.find(cid) == cid_to_local.end()) {
+          cid_to_local[cid] = local_to_cid.size();
+          local_to_cid.push_back(cid);
+        }
+        local_cid_fid[cid_to_local[cid]] = fid;
+      }
+      if (is_new && local_cid_fid.size() > 1)
+        new_pid_to_cid_fid.push_back(local_cid_fid);
+    }
+
+    std::vector<Eigen::Affine3d> local_to_cam_t_global(local_to_cid.size());
+    std::vector<Eigen::Matrix2Xd> local_to_keypoint_map(local_to_cid.size());
+    for (size_t local = 0; local < local_to_cid.size(); local++) {
+      int cid = local_to_cid[local];
+      cv::Mat descriptors;
+      if (cid < num_acid) {
+        local_to_cam_t_global[local] = A.GetFrameGlobalTransform(cid);
+        A.ReadFeatures(cid, &local_to_keypoint_map[local], &descriptors);
+      } else {
+        local_to_cam_t_global[local] = B_cid_to_cam_t_global[cid_to_bcid[cid]];
+        B.ReadFeatures(cid_to_bcid[cid], &local_to_keypoint_map[local], &descriptors);
+      }
+    }
+
+    LOG(INFO) << "Number of tracks found as result of matching images between the maps: "
+              << search_pid_to_cid_fid.size();
+
+    std::vector<std::map<int, int> > new_cid_fid_to_pid;
+    bool rm_invalid_xyz = true;
+    sparse_mapping::Triangulate(rm_invalid_xyz,
+                                A.GetCameraParameters().GetFocalLength(),
+                                local_to_cam_t_global,
+                                local_to_keypoint_map,
+                                &new_pid_to_cid_fid,
+                                &new_pid_to_xyz,
+                                &new_cid_fid_to_pid);
+    std::map<int, int> local2cid;
+    for (size_t local = 0; local < local_to_cid.size(); local++)
+      local2cid[local] = local_to_cid[local];
+    bool rm_tracks_of_len_one = false;  // one to one, so no track gets shorter
+    TransformTracks(local2cid, rm_tracks_of_len_one, &new_pid_to_cid_fid);
+
+    LOG(INFO) << "Of those, number of tracks that are new and will be added to the merged map: "
+              << new_pid_to_cid_fid.size();
+  }
+
+  // The merged map is written as it is made, first the header, then
+  // the images, then the tracks of A merged with those of B, then the
+  // rest of the tracks of B, then the new tracks.
+  int num_landmarks = A.GetNumLandmarks() + B.GetNumLandmarks() - B2A.size() + new_pid_to_cid_fid.size();
+  sparse_mapping_protobuf::Map header = A.Header();
+  header.set_num_frames(num_ccid);
+  header.set_num_landmarks(num_landmarks);
+  header.clear_vocab_db();
+
+  LOG(INFO) << "Writing: " << output_map;
+  int output_fd = open(output_map.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (output_fd < 0)
+    LOG(FATAL) << "Failed to open protobuf writing file.";
+  google::protobuf::io::FileOutputStream output(output_fd);
+  if (!WriteProtobufTo(header, &output))
+    LOG(FATAL) << "Failed to write map to file.";
+
+  for (int cid = 0; cid < num_acid; cid++)
+    A.CopyFrame(cid, &output);
+  for (int cid = num_acid; cid < num_ccid; cid++) {
+    int bcid = cid_to_bcid[cid];
+    sparse_mapping_protobuf::Frame frame;
+    B.ReadFrame(bcid, &frame);
+    setFramePose(B_cid_to_cam_t_global[bcid], &frame);
+    if (!WriteProtobufTo(frame, &output))
+      LOG(FATAL) << "Failed to write frame to file.";
+  }
+
+  int num_tracks_in_A_only = 0, num_tracks_in_A_and_B = 0, num_tracks_in_B_only = 0;
+  for (int pid_a = 0; pid_a < A.GetNumLandmarks(); pid_a++) {
+    Eigen::Vector3d xyz;
+    A.ReadLandmark(pid_a, &xyz, &cid_fid);
+    auto it = A2B.find(pid_a);
+    if (it != A2B.end()) {
+      // Merged map xyz will be the average of xyz's from both maps
+      Eigen::Vector3d B_xyz;
+      std::map<int, int> B_cid_fid;
+      B.ReadLandmark(it->second, &B_xyz, &B_cid_fid);
+      for (auto it_b = B_cid_fid.begin(); it_b != B_cid_fid.end(); it_b++)
+        cid_fid[bcid_to_cid[it_b->first]] = it_b->second;
+      xyz = (xyz + B2A_trans * B_xyz) / 2.0;
+      num_tracks_in_A_and_B++;
+    } else {
+      num_tracks_in_A_only++;
+    }
+    writeLandmark(xyz, cid_fid, &output);
+  }
+  for (int pid_b = 0; pid_b < B.GetNumLandmarks(); pid_b++) {
+    if (B2A.find(pid_b) != B2A.end())
+      continue;  // Track partially in A, done already
+    Eigen::Vector3d xyz;
+    std::map<int, int> B_cid_fid;
+    B.ReadLandmark(pid_b, &xyz, &B_cid_fid);
+    cid_fid.clear();
+    for (auto it_b = B_cid_fid.begin(); it_b != B_cid_fid.end(); it_b++)
+      cid_fid[bcid_to_cid[it_b->first]] = it_b->second;
+    writeLandmark(B2A_trans * xyz, cid_fid, &output);
+    num_tracks_in_B_only++;
+  }
+  for (size_t pid = 0; pid < new_pid_to_cid_fid.size(); pid++)
+    writeLandmark(new_pid_to_xyz[pid], new_pid_to_cid_fid[pid], &output);
+
+  if (!output.Close())
+    LOG(FATAL) << "Failed to write: " << output_map;
+
+  LOG(INFO) << "Number of tracks merged from both maps:    " << num_tracks_in_A_and_B;
+  LOG(INFO) << "Number of tracks from the first map only:  " << num_tracks_in_A_only;
+  LOG(INFO) << "Number of tracks from the second map only: " << num_tracks_in_B_only;
+  LOG(INFO) << "Total number of tracks in the merged map: " << num_landmarks;
+}
+
 // Take a map. Form a map with only a subset of the images.
 // Bundle adjustment will happen later.
 void ExtractSubmap(std::vector<std::string> * keep_ptr,
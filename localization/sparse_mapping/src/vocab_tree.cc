@@ -53,6 +53,8 @@
  */
 
 #include <sparse_mapping/vocab_tree.h>
+#include <sparse_mapping/flat_vocab_db.h>
+#include <sparse_mapping/vocab_tree_trainer.h>
 // TODO(bcoltin) remove circular dependency?
 #include <sparse_mapping/sparse_map.h>
 #include <sparse_mapping/sparse_mapping.h>
@@ -60,6 +62,8 @@
 #include <glog/logging.h>
 #include <opencv2/highgui/highgui.hpp>
 #include <ff_common/utils.h>
+#include <ff_common/thread.h>
+#include <gflags/gflags.h>
 
 // DBoW2 utils
 #pragma GCC diagnostic ignored "-Wdelete-non-virtual-dtor"
@@ -67,9 +71,20 @@
 #include <DBoW2/DBoW2.h>      // BoW db that works with both float and binary descriptors
 #pragma GCC diagnostic pop
 
+#include <algorithm>
+#include <functional>
 #include <vector>
 #include <string>
 
+DEFINE_bool(vocab_db_dbow2_trainer, true,
+            "Train the vocabulary tree with DBoW2 on one thread. If false, train it in parallel, "
+            "with the given number of restarts, which DBoW2 ignores.");
+DEFINE_int32(vocab_db_max_cluster_descriptors, 0,
+             "When training the vocabulary tree in parallel, cluster at most this many descriptors "
+             "picked at random at each node, then assign all of them to the clusters. 0 uses all.");
+DEFINE_int32(vocab_db_seed, 0,
+             "Seed of the parallel vocabulary tree training, the tree only depends on it and the descriptors.");
+
 namespace sparse_mapping {
 
 // extend vocabulary and database classes so we can save to protobuf.
@@ -84,6 +99,19 @@ class ProtobufVocabulary : public DBoW2::TemplatedVocabulary<TDescriptor, F> {
       DBoW2::TemplatedVocabulary<TDescriptor, F>() {LoadProtobuf(input);}
   void SaveProtobuf(google::protobuf::io::ZeroCopyOutputStream* output) const;
   void LoadProtobuf(google::protobuf::io::ZeroCopyInputStream* input);
+
+  // Makes the tree from the parent of each node, the root being 0, and the
+  // centroids of the nodes, then the words from its leaves
+  void SetTree(std::vector<int> const& parents, std::vector<TDescriptor> const& centroids);
+  // Weighs the words as create() does, from the word of each descriptor
+  // of each image
+  void SetWeights(std::vector<std::vector<DBoW2::WordId> > const& image_words);
+
+  // The nodes of any vocabulary, DBoW2 has no accessor for them
+  static std::vector<typename DBoW2::TemplatedVocabulary<TDescriptor, F>::Node> const&
+  Nodes(DBoW2::TemplatedVocabulary<TDescriptor, F> const& voc) {
+    return voc.*(&ProtobufVocabulary::m_nodes);
+  }
 };
 
 template<class TDescriptor, class F>
@@ -107,6 +135,8 @@ class BinaryDB : public BriefDatabase {
   explicit BinaryDB(google::protobuf::io::ZeroCopyInputStream* input) : BriefDatabase(input) {}
   BinaryDB(BinaryVocabulary const& voc, bool flag, int val):
        BriefDatabase(voc, flag, val){}
+  // Returns a copy in a FlatVocabDB, or NULL if it can't be queried that way
+  FlatVocabDB* Flatten() const;
 };
 
 template<class TDescriptor, class F>
@@ -197,6 +227,49 @@ void ProtobufDatabase<TDescriptor, F>::LoadProtobuf(google::protobuf::io::ZeroCo
   }
 }
 
+template<class TDescriptor, class F>
+void ProtobufVocabulary<TDescriptor, F>::SetTree(std::vector<int> const& parents,
+                                                std::vector<TDescriptor> const& centroids) {
+  this->m_words.clear();
+  this->m_nodes.clear();
+  this->m_nodes.resize(parents.size());
+  for (size_t i = 0; i < parents.size(); i++) {
+    this->m_nodes[i].id = i;
+    if (i == 0)
+      continue;
+    this->m_nodes[i].parent = parents[i];
+    this->m_nodes[i].descriptor = centroids[i];
+    this->m_nodes[parents[i]].children.push_back(i);
+  }
+  this->createWords();
+}
+
+template<class TDescriptor, class F>
+void ProtobufVocabulary<TDescriptor, F>::SetWeights(std::vector<std::vector<DBoW2::WordId> > const& image_words) {
+  size_t num_words = this->m_words.size();
+  if (this->m_weighting == DBoW2::TF || this->m_weighting == DBoW2::BINARY) {
+    for (size_t w = 0; w < num_words; w++)
+      this->m_words[w]->weight = 1;
+    return;
+  }
+  // The weight is the log of the number of images over the number of
+  // images with the word
+  std::vector<unsigned int> images_with_word(num_words, 0);
+  std::vector<bool> counted(num_words, false);
+  for (std::vector<DBoW2::WordId> const& words : image_words) {
+    std::fill(counted.begin(), counted.end(), false);
+    for (DBoW2::WordId w : words) {
+      if (!counted[w]) {
+        images_with_word[w]++;
+        counted[w] = true;
+      }
+    }
+  }
+  for (size_t w = 0; w < num_words; w++)
+    if (images_with_word[w] > 0)
+      this->m_words[w]->weight = log(static_cast<double>(image_words.size()) / images_with_word[w]);
+}
+
 template<class TDescriptor, class F>
 void ProtobufVocabulary<TDescriptor, F>::SaveProtobuf(google::protobuf::io::ZeroCopyOutputStream* output) const {
   sparse_mapping_protobuf::DBoWVocab vocab;
@@ -285,7 +358,7 @@ void ProtobufDatabase<TDescriptor, F>::SaveProtobuf(google::protobuf::io::ZeroCo
 
 // Constructor and destructor for VocabDB
 VocabDB::VocabDB():
-  binary_db(NULL), m_num_nodes(0) {
+  binary_db(NULL), flat_db(NULL), m_num_nodes(0) {
 }
 VocabDB::~VocabDB() {
   ResetDB(this);
@@ -303,6 +376,7 @@ void VocabDB::LoadProtobuf(google::protobuf::io::ZeroCopyInputStream* input, int
   ResetDB(this);
   if (db_type == sparse_mapping_protobuf::Map::BINARYDB) {
     binary_db = new BinaryDB(input);
+    flat_db = binary_db->Flatten();
     m_num_nodes = binary_db->size();
   } else {
     LOG(ERROR) << "Using unsupported database type.";
@@ -313,13 +387,19 @@ void BuildDB(std::string const& map_file,
                              std::string const& descriptor,
                              int depth, int branching_factor, int restarts) {
   SparseMap map(map_file);
+  BuildDB(&map, descriptor, depth, branching_factor, restarts);
+  map.Save(map_file);
+}
 
+void BuildDB(SparseMap* map,
+             std::string const& descriptor,
+             int depth, int branching_factor, int restarts) {
   // replace any existing database
-  ResetDB(&map.vocab_db_);
+  ResetDB(&map->vocab_db_);
 
   int total_features = 0;
-  for (size_t cid = 0; cid < map.GetNumFrames(); cid++)
-    total_features += map.GetFrameKeypoints(cid).outerSize();
+  for (size_t cid = 0; cid < map->GetNumFrames(); cid++)
+    total_features += map->GetFrameKeypoints(cid).outerSize();
   while (pow(branching_factor, depth) < total_features) {
     depth++;
     LOG(WARNING) << "Database not large enough, increasing depth.";
@@ -327,9 +407,7 @@ void BuildDB(std::string const& map_file,
   LOG(INFO) << "Total database capacity is " << pow(branching_factor, depth)
             << ", total features to insert are " << total_features << ".";
 
-  BuildDBforDBoW2(&map, descriptor, depth, branching_factor, restarts);
-
-  map.Save(map_file);
+  BuildDBforDBoW2(map, descriptor, depth, branching_factor, restarts);
 }
 
 void ResetDB(VocabDB* db) {
@@ -337,6 +415,10 @@ void ResetDB(VocabDB* db) {
     delete db->binary_db;
     db->binary_db = NULL;
   }
+  if (db->flat_db != NULL) {
+    delete db->flat_db;
+    db->flat_db = NULL;
+  }
 }
 
 // These are defined here, rather than in the header file,
@@ -374,13 +456,82 @@ void MatDescrToVec(cv::Mat const& mat, DBoW2::BriefDescriptor * brief) {
     brief->desc[c] = mat.at<uchar>(0, c);
 }
 
+FlatVocabDB* BinaryDB::Flatten() const {
+  typedef DBoW2::FBrief F;
+  auto const& nodes = BinaryVocabulary::Nodes(*this->m_voc);
+  if (nodes.size() < 2 || this->m_voc->getWeightingType() != DBoW2::TF_IDF ||
+      this->m_voc->getScoringType() != DBoW2::L1_NORM)
+    return NULL;
+
+  int num_bytes = F::toBytes(nodes[1].descriptor).size();
+  FlatVocabDB* flat = new FlatVocabDB(num_bytes, this->m_ifile.size(), this->m_nentries);
+
+  // Breadth first, keeping the order of the children. dbow_id is the
+  // DBoW2 node of each flat node.
+  std::vector<DBoW2::NodeId> dbow_id(1, 0);
+  flat->AddNode(NULL, -1, 0);
+  for (size_t i = 0; i < dbow_id.size(); i++) {
+    std::vector<DBoW2::NodeId> const& children = nodes[dbow_id[i]].children;
+    if (children.empty())
+      continue;
+    flat->SetChildren(i, flat->NumNodes(), children.size());
+    for (DBoW2::NodeId c : children) {
+      std::string bytes = F::toBytes(nodes[c].descriptor);
+      if (static_cast<int>(bytes.size()) != num_bytes ||
+          (nodes[c].isLeaf() && nodes[c].word_id >= this->m_ifile.size())) {
+        delete flat;
+        return NULL;
+      }
+      flat->AddNode(reinterpret_cast<uint8_t const*>(bytes.data()),
+                    nodes[c].isLeaf() ? nodes[c].word_id : -1, nodes[c].weight);
+      dbow_id.push_back(c);
+    }
+  }
+
+  for (size_t w = 0; w < this->m_ifile.size(); w++)
+    for (auto const& entry : this->m_ifile[w])
+      flat->AddEntry(w, entry.entry_id, entry.word_weight);
+  flat->Finish();
+
+  // The flat tree compares the bytes of the descriptors, so check that
+  // they are what the DBoW2 distance compares, and that they are laid out
+  // like the bytes of the descriptors that are queried.
+  for (size_t i = 1; i + 1 < dbow_id.size() && i < 64; i++) {
+    F::TDescriptor const& a = nodes[dbow_id[i]].descriptor;
+    F::TDescriptor const& b = nodes[dbow_id[i + 1]].descriptor;
+    std::string bytes = F::toBytes(a);
+    cv::Mat row(1, num_bytes, CV_8UC1, const_cast<char*>(bytes.data()));
+    F::TDescriptor a_query;
+    MatDescrToVec(row, &a_query);
+    if (F::distance(a, b) != flat->Distance(i, i + 1) || F::distance(a_query, a) != 0) {
+      LOG(WARNING) << "Querying the vocabulary database with DBoW2, its descriptors are stored differently.";
+      delete flat;
+      return NULL;
+    }
+  }
+  return flat;
+}
+
 // Query the database. Return the indices of the images
 // which are most similar to the current image. Return
 // at most num_similar such indices.
 void QueryDB(std::string const& descriptor, VocabDB * vocab_db,
              int num_similar, cv::Mat const& descriptors,
              std::vector<int> * indices) {
+  if (vocab_db->flat_db != NULL) {
+    assert(IsBinaryDescriptor(descriptor));
+    vocab_db->flat_db->Query(descriptors, num_similar, indices);
+    return;
+  }
+  QueryDBoW2(descriptor, vocab_db, num_similar, descriptors, indices);
+}
+
+void QueryDBoW2(std::string const& descriptor, VocabDB * vocab_db,
+                int num_similar, cv::Mat const& descriptors,
+                std::vector<int> * indices, std::vector<double> * scores) {
   indices->clear();
+  if (scores != NULL)
+    scores->clear();
 
   if (vocab_db->binary_db != NULL) {
     assert(IsBinaryDescriptor(descriptor));
@@ -398,6 +549,8 @@ void QueryDB(std::string const& descriptor, VocabDB * vocab_db,
 
     for (size_t j = 0; j < ret.size(); j++) {
       indices->push_back(ret[j].Id);
+      if (scores != NULL)
+        scores->push_back(ret[j].Score);
     }
   } else {
     // no database specified
@@ -407,6 +560,43 @@ void QueryDB(std::string const& descriptor, VocabDB * vocab_db,
   return;
 }
 
+void AddToDB(std::string const& descriptor, std::vector<cv::Mat> const& descriptors,
+             VocabDB * vocab_db) {
+  if (vocab_db->binary_db == NULL) {
+    LOG(ERROR) << "No database to add images to.";
+    return;
+  }
+  assert(IsBinaryDescriptor(descriptor));
+  BinaryDB & db = *(vocab_db->binary_db);  // shorten
+
+  for (size_t i = 0; i < descriptors.size(); i++) {
+    std::vector<DBoW2::BriefDescriptor> descriptors_vec(descriptors[i].rows);
+    for (int r = 0; r < descriptors[i].rows; r++)
+      MatDescrToVec(descriptors[i].row(r), &descriptors_vec[r]);
+    db.add(descriptors_vec);
+  }
+
+  // The flat copy can't grow, so it is made again
+  if (vocab_db->flat_db != NULL)
+    delete vocab_db->flat_db;
+  vocab_db->flat_db = db.Flatten();
+  vocab_db->m_num_nodes = db.size();
+}
+
+namespace {
+
+// Calls f on [begin, end) ranges that together cover [0, n) on
+// FLAGS_num_threads threads
+void ParallelForImages(int n, std::function<void(int, int)> f) {
+  int num_threads = std::max(1, std::min(FLAGS_num_threads, n));
+  ff_common::ThreadPool pool;
+  for (int t = 0; t < num_threads; t++)
+    pool.AddTask(f, t * n / num_threads, (t + 1) * n / num_threads);
+  pool.Join();
+}
+
+}  // namespace
+
 void BuildDBforDBoW2(SparseMap* map, std::string const& descriptor,
                      int depth, int branching_factor,
                      int restarts) {
@@ -414,7 +604,6 @@ void BuildDBforDBoW2(SparseMap* map, std::string const& descriptor,
 
   const DBoW2::WeightingType weight = DBoW2::TF_IDF;
   const DBoW2::ScoringType score = DBoW2::L1_NORM;
-  int num_features = 0;
 
   if (!IsBinaryDescriptor(descriptor)) {
     LOG(ERROR) << "Using unsupported vocabulary database type.";
@@ -422,27 +611,53 @@ void BuildDBforDBoW2(SparseMap* map, std::string const& descriptor,
     // Binary descriptors. For each image, copy them from a CV matrix
     // to a vector of vectors. Also extract individual bits from
     // each byte.
-    std::vector<std::vector<DBoW2::FBrief::TDescriptor > > features;
+    std::vector<std::vector<DBoW2::FBrief::TDescriptor > > features(num_frames);
+    std::vector<cv::Mat> rows(num_frames);
     for (int cid = 0; cid < num_frames; cid++) {
       int num_keys = map->GetFrameKeypoints(cid).outerSize();
-      num_features += num_keys;
-      std::vector<DBoW2::FBrief::TDescriptor> descriptors;
-      for (int i = 0; i < num_keys; i++) {
-        cv::Mat row = map->GetDescriptor(cid, i);
-        DBoW2::FBrief::TDescriptor descriptor;
-        MatDescrToVec(row, &descriptor);
-        descriptors.push_back(descriptor);
-      }
-      features.push_back(descriptors);
+      rows[cid] = map->cid_to_descriptor_map_[cid].rowRange(0, num_keys);
+      features[cid].resize(num_keys);
+      for (int i = 0; i < num_keys; i++)
+        MatDescrToVec(rows[cid].row(i), &features[cid][i]);
     }
     BinaryVocabulary voc(branching_factor, depth, weight, score);
-    voc.create(features);
+    if (FLAGS_vocab_db_dbow2_trainer) {
+      voc.create(features);
+    } else {
+      VocabTreeTrainer trainer(branching_factor, depth, restarts, FLAGS_vocab_db_max_cluster_descriptors,
+                               FLAGS_vocab_db_seed, FLAGS_num_threads);
+      trainer.Train(rows);
+      std::vector<int> parents(trainer.NumNodes());
+      std::vector<DBoW2::FBrief::TDescriptor> centroids(trainer.NumNodes());
+      for (int n = 0; n < trainer.NumNodes(); n++) {
+        parents[n] = trainer.Parent(n);
+        if (n > 0)
+          MatDescrToVec(trainer.Centroid(n), &centroids[n]);
+      }
+      voc.SetTree(parents, centroids);
+
+      std::vector<std::vector<DBoW2::WordId> > image_words(num_frames);
+      ParallelForImages(num_frames, [&](int begin, int end) {
+          for (int cid = begin; cid < end; cid++)
+            for (size_t i = 0; i < features[cid].size(); i++)
+              image_words[cid].push_back(voc.transform(features[cid][i]));
+        });
+      voc.SetWeights(image_words);
+    }
 
+    // The bags of words of the images are independent, only adding them
+    // to the database is done in order
+    std::vector<DBoW2::BowVector> bows(num_frames);
+    ParallelForImages(num_frames, [&](int begin, int end) {
+        for (int cid = begin; cid < end; cid++)
+          voc.transform(features[cid], bows[cid]);
+      });
     BinaryDB* db = new BinaryDB(voc, false, 0);
-    for (size_t i = 0; i < features.size(); i++)
-      db->add(features[i]);
+    for (int cid = 0; cid < num_frames; cid++)
+      db->add(bows[cid]);
 
     map->vocab_db_.binary_db = db;
+    map->vocab_db_.flat_db = db->Flatten();
     map->vocab_db_.m_num_nodes = db->size();
   }
 }
@@ -0,0 +1,403 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/vocab_tree_trainer.h>
+
+#include <glog/logging.h>
+#include <opencv2/core/core.hpp>
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace sparse_mapping {
+
+namespace {
+
+// k-medians stops earlier if no descriptor changes cluster
+const int kMaxIterations = 50;
+
+// Splitting fewer descriptors than this among threads is not worth it
+const int kMinParallelRows = 4096;
+
+uint64_t SplitMix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+}  // namespace
+
+// Threads that wait for the jobs of ParallelFor, so that the many small
+// loops of clustering don't each start and join their own threads
+class VocabTreeTrainer::Workers {
+ public:
+  explicit Workers(int num_threads) : job_(NULL), count_(0), pending_(0), generation_(0), stop_(false) {
+    for (int t = 1; t < num_threads; t++)
+      threads_.emplace_back(&Workers::Loop, this, t);
+  }
+
+  ~Workers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (std::thread & t : threads_)
+      t.join();
+  }
+
+  // Calls job(t) for each t in [0, count), job(0) on the calling thread, and
+  // returns when all are done. count is at most the number of threads.
+  void Run(int count, std::function<void(int)> const& job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      count_ = count;
+      pending_ = count - 1;
+      generation_++;
+    }
+    start_.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+ private:
+  void Loop(int t) {
+    uint64_t seen = 0;
+    while (true) {
+      std::function<void(int)> const* job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_)
+          return;
+        seen = generation_;
+        if (t >= count_)
+          continue;
+        job = job_;
+      }
+      (*job)(t);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0)
+        done_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_, done_;
+  std::function<void(int)> const* job_;
+  int count_, pending_;
+  uint64_t generation_;
+  bool stop_;
+};
+
+VocabTreeTrainer::VocabTreeTrainer(int branching_factor, int depth, int restarts,
+                                   int max_cluster_descriptors, int seed, int num_threads):
+  branching_factor_(branching_factor), depth_(depth), restarts_(std::max(restarts, 1)),
+  max_cluster_descriptors_(max_cluster_descriptors), seed_(seed),
+  num_threads_(std::max(num_threads, 1)), bytes_(0), words_(0) {
+  if (branching_factor_ < 2 || depth_ < 1)
+    LOG(FATAL) << "Invalid vocabulary tree branching factor " << branching_factor_ << " or depth " << depth_ << ".";
+  if (max_cluster_descriptors_ > 0 && max_cluster_descriptors_ < branching_factor_)
+    max_cluster_descriptors_ = branching_factor_;
+}
+
+VocabTreeTrainer::~VocabTreeTrainer() {}
+
+void VocabTreeTrainer::Train(std::vector<cv::Mat> const& descriptors) {
+  size_t num_rows = 0;
+  bytes_ = 0;
+  for (cv::Mat const& m : descriptors) {
+    if (m.rows == 0)
+      continue;
+    if (m.type() != CV_8UC1 || (bytes_ != 0 && m.cols != bytes_))
+      LOG(FATAL) << "The vocabulary tree can only be trained on binary descriptors of one size.";
+    bytes_ = m.cols;
+    num_rows += m.rows;
+  }
+  words_ = (bytes_ + 7) / 8;
+  data_.assign(num_rows * words_, 0);
+  size_t row = 0;
+  for (cv::Mat const& m : descriptors)
+    for (int r = 0; r < m.rows; r++, row++)
+      memcpy(&data_[row * words_], m.ptr<uint8_t>(r), bytes_);
+
+  nodes_.assign(1, Node());
+  nodes_[0].parent = -1;
+  workers_.reset(new Workers(num_threads_));
+
+  // Cluster a level at a time, the new nodes are made in the order of the
+  // tasks so their numbers don't depend on the threads
+  std::vector<Task> tasks(1);
+  tasks[0].node = 0;
+  tasks[0].level = 1;
+  tasks[0].rows.resize(num_rows);
+  for (size_t r = 0; r < num_rows; r++)
+    tasks[0].rows[r] = r;
+  if (num_rows == 0)
+    tasks.clear();
+
+  while (!tasks.empty()) {
+    std::vector<std::vector<std::vector<uint64_t> > > centroids(tasks.size());
+    std::vector<std::vector<std::vector<uint32_t> > > groups(tasks.size());
+    if (static_cast<int>(tasks.size()) >= num_threads_) {
+      // Each thread takes the next task to do
+      std::atomic<size_t> next(0);
+      ParallelFor(num_threads_, num_threads_, [&](int, int) {
+          for (size_t t = next++; t < tasks.size(); t = next++)
+            Cluster(tasks[t], 1, &centroids[t], &groups[t]);
+        });
+    } else {
+      for (size_t t = 0; t < tasks.size(); t++)
+        Cluster(tasks[t], num_threads_, &centroids[t], &groups[t]);
+    }
+
+    std::vector<Task> next_tasks;
+    for (size_t t = 0; t < tasks.size(); t++) {
+      for (size_t c = 0; c < centroids[t].size(); c++) {
+        int id = nodes_.size();
+        nodes_.push_back(Node());
+        nodes_[id].parent = tasks[t].node;
+        nodes_[id].centroid.swap(centroids[t][c]);
+        nodes_[tasks[t].node].children.push_back(id);
+        // A single descriptor would only make a chain of nodes
+        if (tasks[t].level < depth_ && groups[t][c].size() > 1) {
+          next_tasks.push_back(Task());
+          next_tasks.back().node = id;
+          next_tasks.back().level = tasks[t].level + 1;
+          next_tasks.back().rows.swap(groups[t][c]);
+        }
+      }
+    }
+    tasks.swap(next_tasks);
+  }
+  workers_.reset();
+
+  // DBoW2 numbers the children of a node, then numbers the subtree of each
+  // child in turn
+  parents_.assign(1, -1);
+  dbow_to_node_.assign(1, 0);
+  std::function<void(int, int)> number = [&](int node, int dbow_id) {
+    int first = parents_.size();
+    std::vector<int> const& children = nodes_[node].children;
+    for (int c : children) {
+      parents_.push_back(dbow_id);
+      dbow_to_node_.push_back(c);
+    }
+    for (size_t i = 0; i < children.size(); i++)
+      number(children[i], first + i);
+  };
+  number(0, 0);
+}
+
+cv::Mat VocabTreeTrainer::Centroid(int node) const {
+  cv::Mat row(1, bytes_, CV_8UC1, cv::Scalar(0));
+  std::vector<uint64_t> const& centroid = nodes_[dbow_to_node_[node]].centroid;
+  if (!centroid.empty())
+    memcpy(row.ptr<uint8_t>(0), &centroid[0], bytes_);
+  return row;
+}
+
+void VocabTreeTrainer::Cluster(Task const& task, int num_threads,
+                               std::vector<std::vector<uint64_t> > * centroids,
+                               std::vector<std::vector<uint32_t> > * groups) const {
+  std::vector<uint32_t> const& rows = task.rows;
+  centroids->clear();
+  groups->clear();
+
+  // Few enough for each to be a cluster, as DBoW2 does
+  if (static_cast<int>(rows.size()) <= branching_factor_) {
+    for (uint32_t r : rows) {
+      centroids->push_back(std::vector<uint64_t>(Row(r), Row(r) + words_));
+      groups->push_back(std::vector<uint32_t>(1, r));
+    }
+    return;
+  }
+
+  std::mt19937_64 rng(SplitMix(SplitMix(seed_) ^ task.node));
+
+  std::vector<uint32_t> sample_copy;
+  std::vector<uint32_t> const* sample = &rows;
+  if (max_cluster_descriptors_ > 0 && static_cast<int>(rows.size()) > max_cluster_descriptors_) {
+    sample_copy = rows;
+    for (int i = 0; i < max_cluster_descriptors_; i++)
+      std::swap(sample_copy[i], sample_copy[i + rng() % (sample_copy.size() - i)]);
+    sample_copy.resize(max_cluster_descriptors_);
+    sample = &sample_copy;
+  }
+  size_t n = sample->size();
+  int bits = 8 * bytes_;
+
+  std::vector<std::vector<uint64_t> > best;
+  uint64_t best_cost = std::numeric_limits<uint64_t>::max();
+  std::vector<int> assignment, last_assignment;
+  for (int restart = 0; restart < restarts_; restart++) {
+    // k-means++, each new center is picked with a probability
+    // proportional to its distance to the closest center so far
+    std::vector<std::vector<uint64_t> > c;
+    std::vector<int> min_dist(n, std::numeric_limits<int>::max());
+    uint32_t pick = (*sample)[rng() % n];
+    while (true) {
+      c.push_back(std::vector<uint64_t>(Row(pick), Row(pick) + words_));
+      if (static_cast<int>(c.size()) == branching_factor_)
+        break;
+      uint64_t const* center = &c.back()[0];
+      ParallelFor(n, n >= kMinParallelRows ? num_threads : 1, [&](int begin, int end) {
+          for (int i = begin; i < end; i++)
+            min_dist[i] = std::min(min_dist[i], Distance(Row((*sample)[i]), center));
+        });
+      uint64_t sum = 0;
+      for (int d : min_dist)
+        sum += d;
+      if (sum == 0)
+        break;
+      uint64_t cut = 1 + rng() % sum, seen = 0;
+      size_t i = 0;
+      for (; i + 1 < n; i++) {
+        seen += min_dist[i];
+        if (seen >= cut)
+          break;
+      }
+      pick = (*sample)[i];
+    }
+
+    // k-medians, each center becomes the majority of each bit of its
+    // descriptors
+    last_assignment.clear();
+    for (int iter = 0; iter < kMaxIterations; iter++) {
+      Assign(*sample, c, num_threads, &assignment);
+      if (assignment == last_assignment)
+        break;
+      last_assignment.swap(assignment);
+
+      int k = c.size();
+      int chunks = (n >= kMinParallelRows) ? num_threads : 1;
+      std::vector<std::vector<int> > counts(chunks, std::vector<int>(k * bits + k, 0));
+      ParallelFor(chunks, chunks, [&](int begin, int end) {
+          for (int chunk = begin; chunk < end; chunk++) {
+            std::vector<int> & count = counts[chunk];
+            for (size_t i = chunk * n / chunks; i < (chunk + 1) * n / chunks; i++) {
+              int cluster = last_assignment[i];
+              uint64_t const* d = Row((*sample)[i]);
+              int* cluster_count = &count[cluster * bits];
+              for (int w = 0; w < words_; w++)
+                for (uint64_t word = d[w]; word != 0; word &= word - 1)
+                  cluster_count[64 * w + __builtin_ctzll(word)]++;
+              count[k * bits + cluster]++;  // the size of the cluster
+            }
+          }
+        });
+      for (int chunk = 1; chunk < chunks; chunk++)
+        for (size_t i = 0; i < counts[0].size(); i++)
+          counts[0][i] += counts[chunk][i];
+      for (int cluster = 0; cluster < k; cluster++) {
+        int size = counts[0][k * bits + cluster];
+        if (size == 0)
+          continue;
+        std::fill(c[cluster].begin(), c[cluster].end(), 0);
+        for (int b = 0; b < bits; b++)
+          if (counts[0][cluster * bits + b] > size / 2)
+            c[cluster][b / 64] |= 1ull << (b % 64);
+      }
+    }
+
+    uint64_t cost = Assign(*sample, c, num_threads, &assignment);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best.swap(c);
+    }
+  }
+
+  // Put all the descriptors in the clusters, dropping the empty ones
+  Assign(rows, best, num_threads, &assignment);
+  std::vector<std::vector<uint32_t> > members(best.size());
+  for (size_t i = 0; i < rows.size(); i++)
+    members[assignment[i]].push_back(rows[i]);
+  for (size_t c = 0; c < best.size(); c++) {
+    if (members[c].empty())
+      continue;
+    centroids->push_back(std::vector<uint64_t>());
+    centroids->back().swap(best[c]);
+    groups->push_back(std::vector<uint32_t>());
+    groups->back().swap(members[c]);
+  }
+}
+
+uint64_t VocabTreeTrainer::Assign(std::vector<uint32_t> const& rows,
+                                  std::vector<std::vector<uint64_t> > const& centroids,
+                                  int num_threads, std::vector<int> * assignment) const {
+  size_t n = rows.size();
+  assignment->resize(n);
+  int chunks = (n >= kMinParallelRows) ? num_threads : 1;
+  std::vector<uint64_t> cost(chunks, 0);
+  ParallelFor(chunks, chunks, [&](int begin, int end) {
+      for (int chunk = begin; chunk < end; chunk++) {
+        for (size_t i = chunk * n / chunks; i < (chunk + 1) * n / chunks; i++) {
+          uint64_t const* d = Row(rows[i]);
+          int best = 0, best_d = Distance(d, &centroids[0][0]);
+          for (size_t c = 1; c < centroids.size(); c++) {
+            int dist = Distance(d, &centroids[c][0]);
+            if (dist < best_d) {
+              best_d = dist;
+              best = c;
+            }
+          }
+          (*assignment)[i] = best;
+          cost[chunk] += best_d;
+        }
+      }
+    });
+  uint64_t total = 0;
+  for (uint64_t c : cost)
+    total += c;
+  return total;
+}
+
+int VocabTreeTrainer::Distance(uint64_t const* a, uint64_t const* b) const {
+  int d = 0;
+  for (int i = 0; i < words_; i++)
+    d += __builtin_popcountll(a[i] ^ b[i]);
+  return d;
+}
+
+// Calls f on [begin, end) ranges that together cover [0, n), on at most
+// num_threads threads. Only called from the thread running Train.
+void VocabTreeTrainer::ParallelFor(int n, int num_threads, std::function<void(int, int)> f) const {
+  num_threads = std::min(num_threads, n);
+  if (num_threads <= 1) {
+    f(0, n);
+    return;
+  }
+  workers_->Run(num_threads, [&](int t) {
+      f(static_cast<int>(static_cast<int64_t>(t) * n / num_threads),
+        static_cast<int>(static_cast<int64_t>(t + 1) * n / num_threads));
+    });
+}
+
+}  // namespace sparse_mapping
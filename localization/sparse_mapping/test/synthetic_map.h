@@ -0,0 +1,165 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef SPARSE_MAPPING_TEST_SYNTHETIC_MAP_H_
+#define SPARSE_MAPPING_TEST_SYNTHETIC_MAP_H_
+
+// Maps made up for the tests, of points seen by cameras looking along z,
+// with exact poses and tracks, and the features of each image
+
+#include <camera/camera_params.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <Eigen/Geometry>
+#include <opencv2/core/core.hpp>
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace synthetic_map {
+
+const int kDescriptorBytes = 64;
+const double kFocalLength = 300;
+const double kHalfWidth = 320, kHalfHeight = 240;
+
+// Which points of the world to use
+typedef std::function<bool(int)> PointFilter;
+
+inline bool AllPoints(int) {
+  return true;
+}
+
+// Points, each with its own binary descriptor, which is the same in every
+// image that sees it
+struct World {
+  std::vector<Eigen::Vector3d> xyz;
+  std::vector<cv::Mat> descriptor;
+  std::map<std::string, int> descriptor_to_point;
+};
+
+// Adds num_points points to the world, uniformly in the box from low to high
+inline void AddPoints(int num_points, Eigen::Vector3d const& low, Eigen::Vector3d const& high,
+                      std::mt19937 * gen, World * w) {
+  std::uniform_real_distribution<double> x(low[0], high[0]), y(low[1], high[1]), z(low[2], high[2]);
+  std::uniform_int_distribution<int> byte(0, 255);
+  for (int p = 0; p < num_points; p++) {
+    Eigen::Vector3d xyz;
+    xyz[0] = x(*gen);
+    xyz[1] = y(*gen);
+    xyz[2] = z(*gen);
+    w->xyz.push_back(xyz);
+    cv::Mat d(1, kDescriptorBytes, CV_8U);
+    for (int b = 0; b < kDescriptorBytes; b++)
+      d.at<uchar>(0, b) = byte(*gen);
+    w->descriptor.push_back(d);
+    w->descriptor_to_point[std::string(d.ptr<char>(0), kDescriptorBytes)] = w->xyz.size() - 1;
+  }
+}
+
+inline camera::CameraParameters CameraParameters() {
+  return camera::CameraParameters(Eigen::Vector2i(2 * kHalfWidth, 2 * kHalfHeight),
+                                  Eigen::Vector2d::Constant(kFocalLength),
+                                  Eigen::Vector2d(kHalfWidth, kHalfHeight));
+}
+
+// The camera at x, looking along z with a turn of yaw about y
+inline Eigen::Affine3d Camera(double x, double yaw = 0) {
+  Eigen::Affine3d world_t_cam = Eigen::Affine3d::Identity();
+  world_t_cam.linear() = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY()).toRotationMatrix();
+  world_t_cam.translation() = Eigen::Vector3d(x, 0, 0);
+  return world_t_cam.inverse();
+}
+
+inline Eigen::Vector2d Project(Eigen::Affine3d const& cam_t_global, Eigen::Vector3d const& xyz) {
+  Eigen::Vector3d q = cam_t_global * xyz;
+  return kFocalLength * q.head<2>() / q[2];
+}
+
+// The features of the points of the filter the camera sees, and which
+// points those are. Noise of this standard deviation, in pixels, is added
+// to their positions.
+inline void SeePoints(World const& w, Eigen::Affine3d const& cam_t_global, PointFilter const& filter,
+                      double noise, std::mt19937 * gen,
+                      cv::Mat * descriptors, Eigen::Matrix2Xd * keypoints, std::vector<int> * points) {
+  std::normal_distribution<double> pixel_noise(0.0, noise > 0 ? noise : 1.0);
+  std::vector<Eigen::Vector2d> pixels;
+  points->clear();
+  for (size_t p = 0; p < w.xyz.size(); p++) {
+    if (!filter(p))
+      continue;
+    Eigen::Vector3d q = cam_t_global * w.xyz[p];
+    if (q[2] <= 0)
+      continue;
+    Eigen::Vector2d pix = kFocalLength * q.head<2>() / q[2];
+    if (std::abs(pix[0]) > kHalfWidth || std::abs(pix[1]) > kHalfHeight)
+      continue;
+    if (noise > 0)
+      pix += Eigen::Vector2d(pixel_noise(*gen), pixel_noise(*gen));
+    pixels.push_back(pix);
+    points->push_back(p);
+  }
+  keypoints->resize(2, pixels.size());
+  *descriptors = cv::Mat(pixels.size(), kDescriptorBytes, CV_8U);
+  for (size_t fid = 0; fid < pixels.size(); fid++) {
+    keypoints->col(fid) = pixels[fid];
+    w.descriptor[(*points)[fid]].copyTo(descriptors->row(fid));
+  }
+}
+
+// Which point of the world a feature of the map sees, or -1
+inline int PointOf(World const& w, sparse_mapping::SparseMap const& map, int cid, int fid) {
+  auto it = w.descriptor_to_point.find(std::string(map.cid_to_descriptor_map_[cid].ptr<char>(fid),
+                                                   kDescriptorBytes));
+  return it == w.descriptor_to_point.end() ? -1 : it->second;
+}
+
+// An unpruned map with no vocab db, with an image at each camera, whose
+// features are those of the points of the filter it sees. Each point seen
+// twice or more has a track, at its place in the world.
+inline sparse_mapping::SparseMap * MakeMap(World const& w, std::vector<Eigen::Affine3d> const& cams,
+                                           PointFilter const& filter, double noise, std::mt19937 * gen) {
+  std::vector<std::string> files;
+  for (size_t cid = 0; cid < cams.size(); cid++)
+    files.push_back("image" + std::to_string(cid) + ".jpg");
+  sparse_mapping::SparseMap * map = new sparse_mapping::SparseMap(files, "ORGBRISK", CameraParameters());
+  std::map<int, std::map<int, int> > point_to_cid_fid;
+  for (size_t cid = 0; cid < cams.size(); cid++) {
+    map->cid_to_cam_t_global_.push_back(cams[cid]);
+    std::vector<int> points;
+    SeePoints(w, cams[cid], filter, noise, gen, &map->cid_to_descriptor_map_[cid],
+              &map->cid_to_keypoint_map_[cid], &points);
+    for (size_t fid = 0; fid < points.size(); fid++)
+      point_to_cid_fid[points[fid]][cid] = fid;
+  }
+  for (auto const& track : point_to_cid_fid) {
+    if (track.second.size() < 2)
+      continue;
+    map->pid_to_cid_fid_.push_back(track.second);
+    map->pid_to_xyz_.push_back(w.xyz[track.first]);
+  }
+  map->InitializeCidFidToPid();
+  return map;
+}
+
+}  // namespace synthetic_map
+
+#endif  // SPARSE_MAPPING_TEST_SYNTHETIC_MAP_H_
@@ -106,6 +106,18 @@ void RunWithDB(std::string const& detector_name) {
   // Localize features with database.
   sparse_mapping::SparseMap map2(out_nvm);
   map2.SetNumSimilar(num_similar);
+
+  // The flat database must find the same images as DBoW2
+  EXPECT_TRUE(map2.vocab_db_.flat_db != NULL);
+  for (size_t cid = 0; cid < map2.GetNumFrames(); cid++) {
+    std::vector<int> flat_indices, dbow2_indices;
+    sparse_mapping::QueryDB(detector_name, &map2.vocab_db_, num_similar,
+                            map2.cid_to_descriptor_map_[cid], &flat_indices);
+    sparse_mapping::QueryDBoW2(detector_name, &map2.vocab_db_, num_similar,
+                               map2.cid_to_descriptor_map_[cid], &dbow2_indices);
+    EXPECT_EQ(flat_indices, dbow2_indices);
+  }
+
   LOG(INFO) << "\n\n================================================\n";
   LOG(INFO) << "\nLocalizing using the database\n";
 
@@ -0,0 +1,87 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/checkpoint.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+void WriteText(std::string const& file, std::string const& text) {
+  std::ofstream ofs(file.c_str());
+  ofs << text;
+}
+
+std::string ReadText(std::string const& file) {
+  std::ifstream ifs(file.c_str());
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return ss.str();
+}
+
+}  // namespace
+
+TEST(checkpoint, hash_file) {
+  uint64_t a, b, c;
+  WriteText("checkpoint_a.txt", "matches");
+  WriteText("checkpoint_b.txt", "matches");
+  ASSERT_TRUE(sparse_mapping::HashFile("checkpoint_a.txt", &a));
+  ASSERT_TRUE(sparse_mapping::HashFile("checkpoint_b.txt", &b));
+  EXPECT_EQ(a, b);
+  WriteText("checkpoint_b.txt", "matchez");
+  ASSERT_TRUE(sparse_mapping::HashFile("checkpoint_b.txt", &c));
+  EXPECT_NE(a, c);
+  EXPECT_FALSE(sparse_mapping::HashFile("checkpoint_missing.txt", &a));
+}
+
+TEST(checkpoint, save_restore) {
+  sparse_mapping::MapCheckpoints checkpoints("checkpoint_dir/nested");
+  WriteText("checkpoint_input.map", "features");
+  WriteText("checkpoint_output.map", "tracks");
+  WriteText("checkpoint_output.csv", "affines");
+
+  std::string key = checkpoints.Key("tracks", {"checkpoint_input.map"}, "min_valid=20\n");
+  ASSERT_FALSE(key.empty());
+  EXPECT_EQ(key, checkpoints.Key("tracks", {"checkpoint_input.map"}, "min_valid=20\n"));
+  EXPECT_NE(key, checkpoints.Key("tracks", {"checkpoint_input.map"}, "min_valid=30\n"));
+  EXPECT_NE(key, checkpoints.Key("matching", {"checkpoint_input.map"}, "min_valid=20\n"));
+  EXPECT_TRUE(checkpoints.Key("tracks", {"checkpoint_missing.map"}, "").empty());
+
+  std::vector<std::string> outputs = {"checkpoint_output.map", "checkpoint_output.csv"};
+  EXPECT_FALSE(checkpoints.Restore("tracks", key, outputs));
+  ASSERT_TRUE(checkpoints.Save("tracks", key, "min_valid=20\n", outputs));
+
+  // A later step overwrites the outputs, restoring brings them back
+  WriteText("checkpoint_output.map", "cameras");
+  std::remove("checkpoint_output.csv");
+  EXPECT_FALSE(checkpoints.Restore("tracks", checkpoints.Key("tracks", {"checkpoint_input.map"}, ""), outputs));
+  EXPECT_EQ("cameras", ReadText("checkpoint_output.map"));
+  ASSERT_TRUE(checkpoints.Restore("tracks", key, outputs));
+  EXPECT_EQ("tracks", ReadText("checkpoint_output.map"));
+  EXPECT_EQ("affines", ReadText("checkpoint_output.csv"));
+
+  // Changed inputs change the key
+  WriteText("checkpoint_input.map", "other features");
+  EXPECT_NE(key, checkpoints.Key("tracks", {"checkpoint_input.map"}, "min_valid=20\n"));
+}
@@ -0,0 +1,69 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/feature_cache.h>
+
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+TEST(feature_cache, read_write) {
+  // A new cache for each run
+  sparse_mapping::FeatureCache cache("feature_cache_test_" + std::to_string(getpid()));
+  std::vector<char> image = {'j', 'p', 'g', 1, 2, 3};
+  uint64_t key = sparse_mapping::FeatureCache::Key(image, "ORGBRISK 400 800");
+  EXPECT_EQ(key, sparse_mapping::FeatureCache::Key(image, "ORGBRISK 400 800"));
+  EXPECT_NE(key, sparse_mapping::FeatureCache::Key(image, "ORGBRISK 400 900"));
+  image.push_back(4);
+  EXPECT_NE(key, sparse_mapping::FeatureCache::Key(image, "ORGBRISK 400 800"));
+
+  std::vector<cv::KeyPoint> keypoints, keypoints2;
+  cv::Mat descriptors(3, 64, CV_8U), descriptors2;
+  for (int i = 0; i < descriptors.rows; i++) {
+    keypoints.push_back(cv::KeyPoint(10.5f * i - 320, 240 - 7.25f * i, 1));
+    for (int j = 0; j < descriptors.cols; j++)
+      descriptors.at<uchar>(i, j) = i * 64 + j;
+  }
+  double threshold;
+  EXPECT_FALSE(cache.Read(key, &keypoints2, &descriptors2, &threshold));
+  ASSERT_TRUE(cache.Write(key, keypoints, descriptors, 72));
+  ASSERT_TRUE(cache.Read(key, &keypoints2, &descriptors2, &threshold));
+
+  EXPECT_EQ(72, threshold);
+  ASSERT_EQ(keypoints.size(), keypoints2.size());
+  for (size_t i = 0; i < keypoints.size(); i++) {
+    EXPECT_EQ(keypoints[i].pt.x, keypoints2[i].pt.x);
+    EXPECT_EQ(keypoints[i].pt.y, keypoints2[i].pt.y);
+  }
+  ASSERT_EQ(descriptors.rows, descriptors2.rows);
+  ASSERT_EQ(descriptors.cols, descriptors2.cols);
+  ASSERT_EQ(descriptors.type(), descriptors2.type());
+  EXPECT_EQ(0, cv::norm(descriptors, descriptors2, cv::NORM_L1));
+
+  // No features is a valid entry too
+  uint64_t empty_key = sparse_mapping::FeatureCache::Key(image, "");
+  ASSERT_TRUE(cache.Write(empty_key, std::vector<cv::KeyPoint>(), cv::Mat(), 90));
+  ASSERT_TRUE(cache.Read(empty_key, &keypoints2, &descriptors2, &threshold));
+  EXPECT_TRUE(keypoints2.empty());
+  EXPECT_TRUE(descriptors2.empty());
+}
@@ -0,0 +1,159 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <camera/camera_params.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tensor.h>
+
+#include <Eigen/Geometry>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+DECLARE_bool(incremental_ba_local);  // defined in tensor.cc
+
+namespace {
+
+const int kNumImages = 40;
+const int kNumPoints = 1500;
+const double kStep = 0.05;
+const double kFocalLength = 300;
+const double kHalfWidth = 320, kHalfHeight = 240;
+
+// A camera moving along a corridor of points, with only the first camera
+// known and noisy relative poses of consecutive cameras, as after matching
+void MakeSequence(std::vector<Eigen::Affine3d> * cams, sparse_mapping::SparseMap ** map,
+                  sparse_mapping::CIDPairAffineMap * relative_affines) {
+  std::mt19937 gen(1);
+  std::normal_distribution<double> noise(0.0, 1.0);
+
+  // The camera looks along z and moves along x
+  cams->resize(kNumImages);
+  for (int cid = 0; cid < kNumImages; cid++) {
+    (*cams)[cid] = Eigen::Affine3d::Identity();
+    (*cams)[cid].translation() = Eigen::Vector3d(-cid * kStep, 0, 0);
+  }
+
+  camera::CameraParameters params(Eigen::Vector2i(2 * kHalfWidth, 2 * kHalfHeight),
+                                  Eigen::Vector2d::Constant(kFocalLength),
+                                  Eigen::Vector2d(kHalfWidth, kHalfHeight));
+  std::vector<std::string> files;
+  for (int cid = 0; cid < kNumImages; cid++)
+    files.push_back("image" + std::to_string(cid) + ".jpg");
+  *map = new sparse_mapping::SparseMap(files, "ORGBRISK", params);
+  sparse_mapping::SparseMap & s = **map;
+  s.cid_to_cam_t_global_.resize(kNumImages);
+  s.cid_to_cam_t_global_[0] = (*cams)[0];
+
+  std::uniform_real_distribution<double> along(-2.0, kNumImages * kStep + 2.0);
+  std::uniform_real_distribution<double> across(-1.5, 1.5);
+  std::uniform_real_distribution<double> depth(3.0, 8.0);
+  std::vector<std::vector<Eigen::Vector2d> > keypoints(kNumImages);
+  for (int p = 0; p < kNumPoints; p++) {
+    Eigen::Vector3d xyz(along(gen), across(gen), depth(gen));
+    std::map<int, int> track;
+    for (int cid = 0; cid < kNumImages; cid++) {
+      Eigen::Vector3d q = (*cams)[cid] * xyz;
+      Eigen::Vector2d pix = kFocalLength * q.head<2>() / q[2];
+      if (std::abs(pix[0]) > kHalfWidth || std::abs(pix[1]) > kHalfHeight)
+        continue;
+      pix += 0.5 * Eigen::Vector2d(noise(gen), noise(gen));
+      track[cid] = keypoints[cid].size();
+      keypoints[cid].push_back(pix);
+    }
+    if (track.size() > 1)
+      s.pid_to_cid_fid_.push_back(track);
+  }
+  for (int cid = 0; cid < kNumImages; cid++) {
+    s.cid_to_keypoint_map_[cid].resize(2, keypoints[cid].size());
+    for (size_t fid = 0; fid < keypoints[cid].size(); fid++)
+      s.cid_to_keypoint_map_[cid].col(fid) = keypoints[cid][fid];
+  }
+  s.pid_to_xyz_.resize(s.pid_to_cid_fid_.size());
+
+  for (int cid = 1; cid < kNumImages; cid++) {
+    Eigen::Affine3d rel = (*cams)[cid] * (*cams)[cid - 1].inverse();
+    Eigen::Vector3d aa = 0.01 * Eigen::Vector3d(noise(gen), noise(gen), noise(gen));
+    rel.linear() = Eigen::AngleAxisd(aa.norm(), aa.normalized()).toRotationMatrix() * rel.linear();
+    rel.translation() += 0.01 * kStep * Eigen::Vector3d(noise(gen), noise(gen), noise(gen));
+    (*relative_affines)[std::make_pair(cid - 1, cid)] = rel;
+  }
+}
+
+double MeanReprojectionError(sparse_mapping::SparseMap const& s) {
+  double total = 0;
+  int num = 0;
+  for (size_t pid = 0; pid < s.pid_to_cid_fid_.size(); pid++) {
+    for (std::pair<int, int> const& cid_fid : s.pid_to_cid_fid_[pid]) {
+      Eigen::Vector3d q = s.cid_to_cam_t_global_[cid_fid.first] * s.pid_to_xyz_[pid];
+      Eigen::Vector2d pix = kFocalLength * q.head<2>() / q[2];
+      total += (pix - s.cid_to_keypoint_map_[cid_fid.first].col(cid_fid.second)).norm();
+      num++;
+    }
+  }
+  return num > 0 ? total / num : 0;
+}
+
+Eigen::Vector3d Center(Eigen::Affine3d const& cam_t_global) {
+  return cam_t_global.inverse().translation();
+}
+
+}  // namespace
+
+// The incremental adjuster must find about the same cameras and points as
+// the default, which triangulates all tracks and makes the problem again
+// for each camera
+TEST(incremental_ba, local_matches_rebuild) {
+  std::string essential_file = "incremental_ba_test_essential.csv";
+  std::vector<Eigen::Affine3d> truth;
+  sparse_mapping::SparseMap * maps[2] = {NULL, NULL};
+  for (int local = 0; local < 2; local++) {
+    sparse_mapping::CIDPairAffineMap relative_affines;
+    MakeSequence(&truth, &maps[local], &relative_affines);
+    // IncrementalBA reads the relative poses from file, and removes it
+    sparse_mapping::WriteAffineCSV(relative_affines, essential_file);
+    FLAGS_incremental_ba_local = local;
+    sparse_mapping::IncrementalBA(essential_file, maps[local]);
+  }
+  FLAGS_incremental_ba_local = false;
+  sparse_mapping::SparseMap const& rebuild = *maps[0];
+  sparse_mapping::SparseMap const& local = *maps[1];
+
+  EXPECT_LT(MeanReprojectionError(rebuild), 1.0);
+  EXPECT_LT(MeanReprojectionError(local), 1.0);
+  EXPECT_NEAR(static_cast<double>(rebuild.pid_to_xyz_.size()), static_cast<double>(local.pid_to_xyz_.size()),
+              0.02 * rebuild.pid_to_xyz_.size());
+
+  ASSERT_EQ(rebuild.cid_to_cam_t_global_.size(), local.cid_to_cam_t_global_.size());
+  for (int cid = 0; cid < kNumImages; cid++) {
+    Eigen::Vector3d a = Center(rebuild.cid_to_cam_t_global_[cid]);
+    Eigen::Vector3d b = Center(local.cid_to_cam_t_global_[cid]);
+    EXPECT_LT((a - b).norm(), 0.02) << "camera " << cid;
+    EXPECT_LT((b - Center(truth[cid])).norm(), 0.1) << "camera " << cid;
+    Eigen::Matrix3d r = rebuild.cid_to_cam_t_global_[cid].linear().transpose() *
+      local.cid_to_cam_t_global_[cid].linear();
+    EXPECT_LT(Eigen::AngleAxisd(r).angle(), 0.01) << "camera " << cid;
+  }
+  delete maps[0];
+  delete maps[1];
+}
@@ -0,0 +1,87 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+#include <camera/camera_params.h>
+#include <sparse_mapping/keyframe_index.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A camera at center, looking along the z axis turned by yaw about the y axis
+Eigen::Affine3d Camera(Eigen::Vector3d const& center, double yaw) {
+  Eigen::Affine3d cam_t_global;
+  cam_t_global.linear() = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY()).matrix().transpose();
+  cam_t_global.translation() = -cam_t_global.linear() * center;
+  return cam_t_global;
+}
+
+}  // namespace
+
+TEST(keyframe_index, query) {
+  std::vector<Eigen::Affine3d> cid_to_cam_t_global;
+  // A row of cameras half a meter apart, all looking the same way
+  for (int cid = 0; cid < 10; cid++)
+    cid_to_cam_t_global.push_back(Camera(Eigen::Vector3d(0.5 * cid, 0, 0), 0));
+  // One near the start, looking the other way
+  cid_to_cam_t_global.push_back(Camera(Eigen::Vector3d(0.1, 0, 0), M_PI));
+
+  sparse_mapping::KeyframeIndex index;
+  index.Build(cid_to_cam_t_global, 0.7);
+  EXPECT_EQ(cid_to_cam_t_global.size(), index.Size());
+
+  std::vector<int> cids;
+  index.Query(Camera(Eigen::Vector3d(1.1, 0, 0), 0.1), 0.75, M_PI / 4, &cids);
+  EXPECT_EQ(std::vector<int>({2, 3, 1}), cids);
+
+  // Looking the other way
+  index.Query(Camera(Eigen::Vector3d(0, 0.2, 0), M_PI), 1.0, M_PI / 4, &cids);
+  EXPECT_EQ(std::vector<int>({10}), cids);
+
+  // Far from all
+  index.Query(Camera(Eigen::Vector3d(0, 5, 0), 0), 1.0, M_PI, &cids);
+  EXPECT_TRUE(cids.empty());
+
+  // Any direction, with negative coordinates
+  index.Query(Camera(Eigen::Vector3d(-0.3, 0, 0), M_PI / 2), 0.5, M_PI, &cids);
+  EXPECT_EQ(std::vector<int>({0, 10}), cids);
+}
+
+TEST(keyframe_index, follows_map) {
+  // The index of a map moves with its cameras
+  camera::CameraParameters params(Eigen::Vector2i(640, 480), Eigen::Vector2d::Constant(300),
+                                  Eigen::Vector2d(320, 240));
+  std::vector<std::string> files = {"image0.jpg", "image1.jpg"};
+  sparse_mapping::SparseMap map(files, "ORGBRISK", params);
+  map.cid_to_cam_t_global_.push_back(Camera(Eigen::Vector3d(0, 0, 0), 0));
+  map.cid_to_cam_t_global_.push_back(Camera(Eigen::Vector3d(0.5, 0, 0), 0));
+  map.InitializeKeyframeIndex();
+
+  Eigen::Affine3d shift = Eigen::Affine3d::Identity();
+  shift.translation() = Eigen::Vector3d(10, 0, 0);
+  map.ApplyTransform(shift);
+  std::vector<int> cids;
+  map.keyframe_index_.Query(Camera(Eigen::Vector3d(10.1, 0, 0), 0), 0.5, M_PI / 4, &cids);
+  EXPECT_EQ(std::vector<int>({0, 1}), cids);
+  map.keyframe_index_.Query(Camera(Eigen::Vector3d(0.1, 0, 0), 0), 0.5, M_PI / 4, &cids);
+  EXPECT_TRUE(cids.empty());
+}
@@ -0,0 +1,174 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/thread.h>
+#include <sparse_mapping/landmark_usage.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <Eigen/Geometry>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include <random>
+#include <vector>
+
+#include "synthetic_map.h"
+
+using synthetic_map::Camera;
+using synthetic_map::PointOf;
+
+namespace {
+
+const int kNumPoints = 400;
+// The second part of the map is this far from the first, and no image
+// replayed sees it
+const double kFar = 20;
+
+// Points in two parts of the map
+synthetic_map::World MakeWorld() {
+  std::mt19937 gen(7);
+  synthetic_map::World w;
+  for (double offset : {0.0, kFar})
+    synthetic_map::AddPoints(kNumPoints / 2, Eigen::Vector3d(offset - 1.5, -1.0, 3.0),
+                             Eigen::Vector3d(offset + 1.5, 1.0, 6.0), &gen, &w);
+  return w;
+}
+
+bool InFirstPart(int point) {
+  return point < kNumPoints / 2;
+}
+
+// Points the map has in the wrong place, so they are outliers whenever
+// they are matched
+bool Misplaced(int point) {
+  return point % 7 == 1;
+}
+
+// Points the images replayed don't see
+bool Hidden(int point) {
+  return point % 3 == 0;
+}
+
+bool Shown(int point) {
+  return !Hidden(point);
+}
+
+// Four images of each part of the map, pruned, with no vocab db, so
+// images localize against all of them
+sparse_mapping::SparseMap * MakeMap(synthetic_map::World const& w) {
+  std::vector<Eigen::Affine3d> cams;
+  for (double x : {0.0, 0.2, 0.4, 0.6, kFar, kFar + 0.2, kFar + 0.4, kFar + 0.6})
+    cams.push_back(Camera(x));
+  sparse_mapping::SparseMap * map = synthetic_map::MakeMap(w, cams, synthetic_map::AllPoints, 0, NULL);
+  for (size_t pid = 0; pid < map->pid_to_cid_fid_.size(); pid++) {
+    auto const& cid_fid = *map->pid_to_cid_fid_[pid].begin();
+    if (Misplaced(PointOf(w, *map, cid_fid.first, cid_fid.second)))
+      map->pid_to_xyz_[pid] += Eigen::Vector3d(0.5, -0.3, 0.4);
+  }
+  map->PruneMap();
+  return map;
+}
+
+// Localize images of the first part of the map only
+void Replay(synthetic_map::World const& w, sparse_mapping::LandmarkUsage * usage) {
+  for (double x : {0.1, 0.3, 0.5}) {
+    cv::Mat descriptors;
+    Eigen::Matrix2Xd keypoints;
+    std::vector<int> points;
+    synthetic_map::SeePoints(w, Camera(x), Shown, 0, NULL, &descriptors, &keypoints, &points);
+    double seconds;
+    EXPECT_TRUE(usage->Replay(descriptors, keypoints, &seconds)) << "image at " << x;
+  }
+}
+
+}  // namespace
+
+TEST(landmark_usage, prune) {
+  FLAGS_num_threads = 1;
+  synthetic_map::World w = MakeWorld();
+  sparse_mapping::SparseMap * map = MakeMap(w);
+  int num_frames = map->GetNumFrames();
+  int num_pids = map->pid_to_cid_fid_.size();
+  std::vector<int> num_features(num_frames);
+  for (int cid = 0; cid < num_frames; cid++)
+    num_features[cid] = map->cid_to_descriptor_map_[cid].rows;
+
+  sparse_mapping::LandmarkUsage usage(map);
+  Replay(w, &usage);
+  for (int cid = 0; cid < num_frames; cid++)
+    EXPECT_EQ(cid < num_frames / 2, usage.Reached(cid)) << "image " << cid;
+  int num_misplaced = 0, num_second_part_before = 0;
+  for (int pid = 0; pid < num_pids; pid++) {
+    int point = PointOf(w, *map, map->pid_to_cid_fid_[pid].begin()->first, map->pid_to_cid_fid_[pid].begin()->second);
+    num_second_part_before += !InFirstPart(point);
+    if (!InFirstPart(point) || Hidden(point)) {
+      EXPECT_EQ(0, usage.Inliers(pid) + usage.Outliers(pid)) << "point " << point;
+    } else if (Misplaced(point)) {
+      EXPECT_EQ(0, usage.Inliers(pid)) << "point " << point;
+      num_misplaced++;
+    }
+  }
+  EXPECT_GT(num_misplaced, 5);
+
+  int num_removed = usage.Prune(1, 0.5, 0);
+  ASSERT_EQ(static_cast<int>(map->pid_to_cid_fid_.size()), num_pids - num_removed);
+  ASSERT_EQ(map->pid_to_cid_fid_.size(), map->pid_to_xyz_.size());
+  EXPECT_GT(num_removed, 0);
+
+  // The landmarks left in the first part were all inliers, those of the
+  // second part are all there, and the images of the second part are as
+  // they were
+  int num_second_part = 0;
+  for (size_t pid = 0; pid < map->pid_to_cid_fid_.size(); pid++) {
+    int point = PointOf(w, *map, map->pid_to_cid_fid_[pid].begin()->first, map->pid_to_cid_fid_[pid].begin()->second);
+    for (auto const& cid_fid : map->pid_to_cid_fid_[pid])
+      EXPECT_EQ(point, PointOf(w, *map, cid_fid.first, cid_fid.second)) << "landmark " << pid;
+    if (!InFirstPart(point)) {
+      num_second_part++;
+      continue;
+    }
+    EXPECT_FALSE(Hidden(point)) << "point " << point;
+    EXPECT_FALSE(Misplaced(point)) << "point " << point;
+    EXPECT_GE(usage.Inliers(pid), 1) << "landmark " << pid;
+  }
+  EXPECT_EQ(num_second_part_before, num_second_part);
+  for (int cid = num_frames / 2; cid < num_frames; cid++)
+    EXPECT_EQ(num_features[cid], map->cid_to_descriptor_map_[cid].rows) << "image " << cid;
+
+  // The features of the images are those of the landmarks left
+  for (int cid = 0; cid < num_frames; cid++) {
+    EXPECT_EQ(map->cid_to_descriptor_map_[cid].rows, map->cid_to_keypoint_map_[cid].cols());
+    for (auto const& fid_pid : map->cid_fid_to_pid_[cid]) {
+      auto it = map->pid_to_cid_fid_[fid_pid.second].find(cid);
+      ASSERT_TRUE(it != map->pid_to_cid_fid_[fid_pid.second].end());
+      EXPECT_EQ(fid_pid.first, it->second);
+    }
+    if (cid < num_frames / 2) {
+      EXPECT_EQ(static_cast<int>(map->cid_fid_to_pid_[cid].size()), map->cid_to_descriptor_map_[cid].rows);
+    }
+  }
+  delete map;
+
+  // Asking for enough landmarks in each image keeps them all
+  map = MakeMap(w);
+  sparse_mapping::LandmarkUsage keep_all(map);
+  Replay(w, &keep_all);
+  EXPECT_EQ(0, keep_all.Prune(1, 0.5, kNumPoints));
+  EXPECT_EQ(num_pids, static_cast<int>(map->pid_to_cid_fid_.size()));
+  delete map;
+}
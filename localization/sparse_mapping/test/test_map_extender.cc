@@ -0,0 +1,193 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/thread.h>
+#include <sparse_mapping/map_extender.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/vocab_tree.h>
+
+#include <Eigen/Geometry>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "synthetic_map.h"
+
+DECLARE_double(reproj_thresh);  // defined in tensor.cc
+
+using synthetic_map::Camera;
+using synthetic_map::PointOf;
+
+namespace {
+
+const int kNumMapImages = 12;
+const int kNumPoints = 600;
+const double kStep = 0.2;
+const double kPixelNoise = 0.3;
+
+// Points along a corridor
+synthetic_map::World MakeWorld(std::mt19937 * gen) {
+  synthetic_map::World w;
+  synthetic_map::AddPoints(kNumPoints, Eigen::Vector3d(-2.0, -1.5, 3.0),
+                           Eigen::Vector3d(kNumMapImages * kStep + 2.0, 1.5, 8.0), gen, &w);
+  return w;
+}
+
+// Some points are in no track of the map and in none of its images, as
+// if pruned, so that images added later can make new tracks from them.
+bool InMap(int point) {
+  return point % 5 != 0;
+}
+
+// A map with exact poses and points, and a vocab db
+sparse_mapping::SparseMap * MakeMap(synthetic_map::World const& w, std::mt19937 * gen) {
+  std::vector<Eigen::Affine3d> cams;
+  for (int cid = 0; cid < kNumMapImages; cid++)
+    cams.push_back(Camera(cid * kStep));
+  sparse_mapping::SparseMap * map = synthetic_map::MakeMap(w, cams, InMap, kPixelNoise, gen);
+  sparse_mapping::BuildDB(map, "ORGBRISK", 4, 10, 1);
+  return map;
+}
+
+}  // namespace
+
+TEST(map_extender, add_images) {
+  // Need to be single thread for the safety of Bamboo CI
+  FLAGS_num_threads = 1;
+
+  for (int prune = 0; prune < 2; prune++) {
+    std::mt19937 gen(5);
+    synthetic_map::World w = MakeWorld(&gen);
+    sparse_mapping::SparseMap * map = MakeMap(w, &gen);
+    size_t num_map_tracks = map->pid_to_cid_fid_.size();
+    std::set<int> tracked;
+    for (size_t pid = 0; pid < num_map_tracks; pid++) {
+      auto const& cid_fid = *map->pid_to_cid_fid_[pid].begin();
+      tracked.insert(PointOf(w, *map, cid_fid.first, cid_fid.second));
+    }
+
+    // Three images between those of the map, looking a little aside, and
+    // one seeing nothing the map has seen
+    std::vector<Eigen::Affine3d> truth;
+    truth.push_back(Camera(2.5 * kStep, 0.05));
+    truth.push_back(Camera(5.5 * kStep, -0.05));
+    truth.push_back(Camera(8.5 * kStep, 0.1));
+    std::vector<std::string> images;
+    std::vector<cv::Mat> descriptors(truth.size() + 1);
+    std::vector<Eigen::Matrix2Xd> keypoints(truth.size() + 1);
+    for (size_t i = 0; i < truth.size(); i++) {
+      images.push_back("new" + std::to_string(i) + ".jpg");
+      std::vector<int> points;
+      synthetic_map::SeePoints(w, truth[i], synthetic_map::AllPoints, kPixelNoise, &gen, &descriptors[i],
+                               &keypoints[i], &points);
+    }
+    images.push_back("elsewhere.jpg");
+    synthetic_map::World elsewhere = MakeWorld(&gen);
+    std::vector<int> points;
+    synthetic_map::SeePoints(elsewhere, truth[0], synthetic_map::AllPoints, kPixelNoise, &gen, &descriptors.back(),
+                             &keypoints.back(), &points);
+
+    sparse_mapping::MapExtender extender(map);
+    std::vector<std::string> failed;
+    EXPECT_EQ(static_cast<int>(truth.size()), extender.AddImages(images, descriptors, keypoints, prune, &failed));
+    ASSERT_EQ(1u, failed.size());
+    EXPECT_EQ("elsewhere.jpg", failed[0]);
+
+    // The new images come after those of the map, at about their true poses
+    int num_frames = kNumMapImages + truth.size();
+    ASSERT_EQ(num_frames, static_cast<int>(map->GetNumFrames()));
+    EXPECT_EQ(num_frames, map->vocab_db_.m_num_nodes);
+    for (size_t i = 0; i < truth.size(); i++) {
+      int cid = kNumMapImages + i;
+      EXPECT_EQ(images[i], map->cid_to_filename_[cid]);
+      Eigen::Affine3d const& cam = map->cid_to_cam_t_global_[cid];
+      EXPECT_LT((cam.inverse().translation() - truth[i].inverse().translation()).norm(), 0.02) << "image " << i;
+      EXPECT_LT(Eigen::AngleAxisd(cam.linear().transpose() * truth[i].linear()).angle(), 0.005) << "image " << i;
+    }
+    for (int cid = 0; cid < kNumMapImages; cid++)
+      EXPECT_TRUE(map->cid_to_cam_t_global_[cid].isApprox(Camera(cid * kStep, 0))) << "camera " << cid;
+
+    // Every track sees a single point of the world, where it is, and no
+    // other track sees it. The new images extend tracks of the map, and
+    // make new ones, from points in their features and in features of the
+    // map which were in no track.
+    ASSERT_EQ(map->pid_to_cid_fid_.size(), map->pid_to_xyz_.size());
+    std::vector<int> observations(num_frames, 0);
+    std::set<int> points_seen;
+    int num_extended = 0;
+    for (size_t pid = 0; pid < map->pid_to_cid_fid_.size(); pid++) {
+      std::map<int, int> const& track = map->pid_to_cid_fid_[pid];
+      ASSERT_GE(track.size(), 2u) << "track " << pid;
+      int point = PointOf(w, *map, track.begin()->first, track.begin()->second);
+      ASSERT_GE(point, 0);
+      EXPECT_TRUE(points_seen.insert(point).second) << "track " << pid;
+      bool new_cid = false;
+      for (auto const& cid_fid : track) {
+        EXPECT_EQ(point, PointOf(w, *map, cid_fid.first, cid_fid.second)) << "track " << pid;
+        observations[cid_fid.first]++;
+        new_cid = new_cid || cid_fid.first >= kNumMapImages;
+      }
+      EXPECT_LT((map->pid_to_xyz_[pid] - w.xyz[point]).norm(), 0.1) << "track " << pid;
+      if (pid < num_map_tracks) {
+        num_extended += new_cid;
+      } else {
+        EXPECT_EQ(0u, tracked.count(point)) << "track " << pid;
+        EXPECT_TRUE(new_cid);
+      }
+    }
+    EXPECT_GT(num_extended, 100);
+    EXPECT_GT(map->pid_to_cid_fid_.size(), num_map_tracks + 20);
+    for (size_t i = 0; i < truth.size(); i++)
+      EXPECT_GT(observations[kNumMapImages + i], 100) << "image " << i;
+
+    // The lookup from features to tracks is the inverse of the tracks,
+    // and each image has a descriptor for each keypoint. A pruned image
+    // has only the features in tracks.
+    ASSERT_EQ(static_cast<size_t>(num_frames), map->cid_fid_to_pid_.size());
+    for (int cid = 0; cid < num_frames; cid++) {
+      EXPECT_EQ(observations[cid], static_cast<int>(map->cid_fid_to_pid_[cid].size())) << "camera " << cid;
+      EXPECT_EQ(map->cid_to_descriptor_map_[cid].rows, map->cid_to_keypoint_map_[cid].cols());
+      for (auto const& fid_pid : map->cid_fid_to_pid_[cid]) {
+        ASSERT_LT(fid_pid.second, static_cast<int>(map->pid_to_cid_fid_.size()));
+        auto it = map->pid_to_cid_fid_[fid_pid.second].find(cid);
+        ASSERT_TRUE(it != map->pid_to_cid_fid_[fid_pid.second].end()) << "camera " << cid;
+        EXPECT_EQ(fid_pid.first, it->second);
+      }
+      if (prune && cid >= kNumMapImages) {
+        EXPECT_EQ(observations[cid], map->cid_to_descriptor_map_[cid].rows) << "camera " << cid;
+      }
+    }
+
+    // And the new observations fit
+    for (size_t pid = 0; pid < map->pid_to_cid_fid_.size(); pid++) {
+      for (auto const& cid_fid : map->pid_to_cid_fid_[pid]) {
+        if (cid_fid.first < kNumMapImages)
+          continue;
+        Eigen::Vector2d pix = synthetic_map::Project(map->cid_to_cam_t_global_[cid_fid.first], map->pid_to_xyz_[pid]);
+        EXPECT_LT((pix - map->cid_to_keypoint_map_[cid_fid.first].col(cid_fid.second)).norm(), FLAGS_reproj_thresh);
+      }
+    }
+    delete map;
+  }
+}
@@ -0,0 +1,81 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+#include <camera/camera_params.h>
+#include <sparse_mapping/map_file.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+TEST(map_file, read) {
+  camera::CameraParameters params(Eigen::Vector2i(640, 480), Eigen::Vector2d::Constant(300),
+                                  Eigen::Vector2d(320, 240));
+  std::vector<std::string> filenames = {"a.jpg", "b.jpg", "c.jpg"};
+  sparse_mapping::SparseMap map(filenames, "ORGBRISK", params);
+  map.cid_to_cam_t_global_.resize(filenames.size());
+  for (size_t cid = 0; cid < filenames.size(); cid++) {
+    map.cid_to_cam_t_global_[cid].linear() = Eigen::AngleAxisd(0.1 * cid, Eigen::Vector3d::UnitZ()).matrix();
+    map.cid_to_cam_t_global_[cid].translation() = Eigen::Vector3d(cid, 2.0 * cid, -1.0);
+    int num_features = 4 + cid;
+    map.cid_to_keypoint_map_[cid].resize(2, num_features);
+    map.cid_to_descriptor_map_[cid].create(num_features, 64, CV_8U);
+    for (int fid = 0; fid < num_features; fid++) {
+      map.cid_to_keypoint_map_[cid].col(fid) << 10.5 * fid - 320, 240 - 7.25 * fid - cid;
+      for (int j = 0; j < 64; j++)
+        map.cid_to_descriptor_map_[cid].at<uchar>(fid, j) = cid + fid * 64 + j;
+    }
+  }
+  map.pid_to_cid_fid_ = {{{0, 1}, {1, 2}}, {{1, 0}, {2, 3}}, {{0, 3}, {1, 1}, {2, 5}}};
+  map.pid_to_xyz_ = {Eigen::Vector3d(1, 2, 3), Eigen::Vector3d(-1, 0, 4), Eigen::Vector3d(0.5, 0.25, 8)};
+  map.InitializeCidFidToPid();
+  map.Save("map_file_test.map");
+
+  sparse_mapping::MapFile file("map_file_test.map");
+  EXPECT_TRUE(file.GetCameraParameters() == params);
+  ASSERT_EQ(3, file.GetNumFrames());
+  ASSERT_EQ(3, file.GetNumLandmarks());
+  for (int cid = 0; cid < file.GetNumFrames(); cid++) {
+    EXPECT_EQ(filenames[cid], file.GetFrameFilename(cid));
+    EXPECT_NEAR(0, (file.GetFrameGlobalTransform(cid).matrix() - map.cid_to_cam_t_global_[cid].matrix()).norm(),
+                1e-12);
+    Eigen::Matrix2Xd keypoints;
+    cv::Mat descriptors;
+    file.ReadFeatures(cid, &keypoints, &descriptors);
+    ASSERT_EQ(map.cid_to_keypoint_map_[cid].cols(), keypoints.cols());
+    EXPECT_EQ(0, (keypoints - map.cid_to_keypoint_map_[cid]).norm());
+    ASSERT_EQ(map.cid_to_descriptor_map_[cid].size(), descriptors.size());
+    EXPECT_EQ(0, cv::norm(map.cid_to_descriptor_map_[cid], descriptors, cv::NORM_L1));
+  }
+  for (int pid = 0; pid < file.GetNumLandmarks(); pid++) {
+    Eigen::Vector3d xyz;
+    std::map<int, int> cid_fid;
+    file.ReadLandmark(pid, &xyz, &cid_fid);
+    EXPECT_EQ(map.pid_to_xyz_[pid], xyz);
+    EXPECT_EQ(map.pid_to_cid_fid_[pid], cid_fid);
+  }
+
+  std::vector<std::map<int, int> > fid_to_pid;
+  file.FidToPid({2, 0}, &fid_to_pid);
+  ASSERT_EQ(2u, fid_to_pid.size());
+  EXPECT_EQ(map.cid_fid_to_pid_[2], fid_to_pid[0]);
+  EXPECT_EQ(map.cid_fid_to_pid_[0], fid_to_pid[1]);
+}
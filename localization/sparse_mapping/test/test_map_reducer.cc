@@ -0,0 +1,182 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/thread.h>
+#include <sparse_mapping/map_reducer.h>
+#include <sparse_mapping/sparse_map.h>
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "synthetic_map.h"
+
+using synthetic_map::Camera;
+using synthetic_map::PointOf;
+using synthetic_map::Project;
+
+namespace {
+
+// Two rooms, far apart. The first is seen by kNumFirst images, the
+// second by the others.
+const int kNumFirst = 8, kNumFrames = 11;
+const int kNumFirstPoints = 300, kNumSecondPoints = 150;
+const double kStep = 0.2, kFar = 20;
+const double kLocalizationError = 0.05;
+
+synthetic_map::World MakeWorld() {
+  std::mt19937 gen(11);
+  synthetic_map::World w;
+  synthetic_map::AddPoints(kNumFirstPoints, Eigen::Vector3d(-1.5, -1.0, 3.0), Eigen::Vector3d(3.0, 1.0, 7.0),
+                           &gen, &w);
+  synthetic_map::AddPoints(kNumSecondPoints, Eigen::Vector3d(kFar - 1.5, -1.0, 3.0),
+                           Eigen::Vector3d(kFar + 3.0, 1.0, 7.0), &gen, &w);
+  return w;
+}
+
+Eigen::Affine3d CameraOf(int cid) {
+  return Camera(cid < kNumFirst ? cid * kStep : kFar + (cid - kNumFirst) * kStep);
+}
+
+// An unpruned map with exact poses and points, with a track for each
+// point seen twice, and the features of its images
+sparse_mapping::SparseMap * MakeMap(synthetic_map::World const& w) {
+  std::vector<Eigen::Affine3d> cams;
+  for (int cid = 0; cid < kNumFrames; cid++)
+    cams.push_back(CameraOf(cid));
+  return synthetic_map::MakeMap(w, cams, synthetic_map::AllPoints, 0, NULL);
+}
+
+std::vector<bool> Keep(std::set<int> const& out) {
+  std::vector<bool> keep(kNumFrames);
+  for (int cid = 0; cid < kNumFrames; cid++)
+    keep[cid] = out.count(cid) == 0;
+  return keep;
+}
+
+}  // namespace
+
+TEST(map_reducer, submap) {
+  FLAGS_num_threads = 1;
+  synthetic_map::World w = MakeWorld();
+  std::unique_ptr<sparse_mapping::SparseMap> map(MakeMap(w));
+  size_t num_tracks = map->pid_to_cid_fid_.size();
+  sparse_mapping::MapReducer reducer(map.get(), map->cid_to_descriptor_map_, map->cid_to_keypoint_map_, 4, 10, 1);
+
+  // The images kept, in order, with their poses
+  std::vector<bool> keep = Keep({1, 4, 5, 9});
+  std::vector<int> sub_to_cid;
+  for (int cid = 0; cid < kNumFrames; cid++)
+    if (keep[cid])
+      sub_to_cid.push_back(cid);
+  std::unique_ptr<sparse_mapping::SparseMap> submap = reducer.Submap(keep);
+  int num_sub = sub_to_cid.size();
+  ASSERT_EQ(num_sub, static_cast<int>(submap->GetNumFrames()));
+  EXPECT_EQ(num_sub, submap->vocab_db_.m_num_nodes);
+  for (int sub = 0; sub < num_sub; sub++) {
+    EXPECT_EQ(map->cid_to_filename_[sub_to_cid[sub]], submap->cid_to_filename_[sub]);
+    EXPECT_TRUE(submap->cid_to_cam_t_global_[sub].isApprox(CameraOf(sub_to_cid[sub]))) << "image " << sub;
+  }
+
+  // The tracks of the submap are those of the map seen by two images kept
+  // or more, through just those images, each with its point as it was
+  std::map<int, std::set<int> > expected;
+  for (size_t pid = 0; pid < num_tracks; pid++) {
+    std::set<int> subs;
+    for (int sub = 0; sub < num_sub; sub++)
+      if (map->pid_to_cid_fid_[pid].count(sub_to_cid[sub]))
+        subs.insert(sub);
+    auto const& cid_fid = *map->pid_to_cid_fid_[pid].begin();
+    if (subs.size() >= 2)
+      expected[PointOf(w, *map, cid_fid.first, cid_fid.second)] = subs;
+  }
+  ASSERT_EQ(submap->pid_to_cid_fid_.size(), submap->pid_to_xyz_.size());
+  EXPECT_EQ(expected.size(), submap->pid_to_cid_fid_.size());
+  std::set<int> points_seen;
+  for (size_t pid = 0; pid < submap->pid_to_cid_fid_.size(); pid++) {
+    std::map<int, int> const& track = submap->pid_to_cid_fid_[pid];
+    int point = PointOf(w, *submap, track.begin()->first, track.begin()->second);
+    EXPECT_TRUE(points_seen.insert(point).second) << "track " << pid;
+    ASSERT_EQ(1u, expected.count(point)) << "track " << pid;
+    std::set<int> subs;
+    for (auto const& cid_fid : track) {
+      subs.insert(cid_fid.first);
+      EXPECT_EQ(point, PointOf(w, *submap, cid_fid.first, cid_fid.second)) << "track " << pid;
+      EXPECT_LT((Project(submap->cid_to_cam_t_global_[cid_fid.first], submap->pid_to_xyz_[pid])
+                 - submap->cid_to_keypoint_map_[cid_fid.first].col(cid_fid.second)).norm(), 1e-6);
+    }
+    EXPECT_TRUE(expected[point] == subs) << "track " << pid;
+    EXPECT_TRUE(submap->pid_to_xyz_[pid] == w.xyz[point]) << "track " << pid;
+  }
+
+  // The submap is pruned, and the map is left as it was
+  for (int sub = 0; sub < num_sub; sub++) {
+    EXPECT_EQ(submap->cid_to_descriptor_map_[sub].rows, submap->cid_to_keypoint_map_[sub].cols());
+    EXPECT_EQ(static_cast<int>(submap->cid_fid_to_pid_[sub].size()), submap->cid_to_descriptor_map_[sub].rows)
+      << "image " << sub;
+  }
+  EXPECT_EQ(kNumFrames, static_cast<int>(map->GetNumFrames()));
+  EXPECT_EQ(num_tracks, map->pid_to_cid_fid_.size());
+}
+
+TEST(map_reducer, reduce) {
+  FLAGS_num_threads = 1;
+  synthetic_map::World w = MakeWorld();
+  std::unique_ptr<sparse_mapping::SparseMap> map(MakeMap(w));
+  sparse_mapping::MapReducer reducer(map.get(), map->cid_to_descriptor_map_, map->cid_to_keypoint_map_, 4, 10, 1);
+
+  // Without two images of the second room its tracks are gone and none
+  // of its images localize. The images taken out of the first room
+  // localize against their neighbors.
+  std::set<int> out = {1, 3, 5, kNumFirst + 1, kNumFirst + 2};
+  std::vector<bool> keep = Keep(out);
+  std::vector<double> errors;
+  std::ostringstream report;
+  std::unique_ptr<sparse_mapping::SparseMap> submap = reducer.Reduce(kLocalizationError, 1, &keep, &errors, &report);
+  EXPECT_TRUE(keep == Keep(out));
+  EXPECT_EQ(kNumFrames - static_cast<int>(out.size()), static_cast<int>(submap->GetNumFrames()));
+  ASSERT_EQ(kNumFrames, static_cast<int>(errors.size()));
+  for (int cid = 0; cid < kNumFrames; cid++) {
+    if (cid < kNumFirst) {
+      EXPECT_LT(errors[cid], kLocalizationError) << "image " << cid;
+    } else {
+      EXPECT_GT(errors[cid], 1000) << "image " << cid;
+    }
+  }
+  EXPECT_EQ("Iteration 0: 6 images kept, 3 images localize with error > 0.05 m, 2 of them taken out of the map.\n",
+            report.str());
+
+  // With another iteration the images of the second room are put back,
+  // and all images localize against the submap of the images kept
+  keep = Keep(out);
+  report.str("");
+  submap = reducer.Reduce(kLocalizationError, 5, &keep, &errors, &report);
+  EXPECT_TRUE(keep == Keep({1, 3, 5}));
+  EXPECT_EQ(kNumFrames - 3, static_cast<int>(submap->GetNumFrames()));
+  for (int cid = 0; cid < kNumFrames; cid++)
+    EXPECT_LT(errors[cid], kLocalizationError) << "image " << cid;
+  EXPECT_EQ("Iteration 0: 6 images kept, 3 images localize with error > 0.05 m, 2 of them taken out of the map.\n"
+            "Iteration 1: 8 images kept, 0 images localize with error > 0.05 m, 0 of them taken out of the map.\n",
+            report.str());
+}
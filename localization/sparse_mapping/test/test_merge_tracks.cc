@@ -0,0 +1,124 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <sparse_mapping/tensor.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+
+const int kNumA = 7, kNumB = 6;
+const int kNumPoints = 300;
+
+// Points seen in some of the images of A (cid < kNumA) and of B, each
+// with its own feature in each image that sees it, as when all the
+// images of A are matched to all those of B at once
+std::vector<std::map<int, int> > MakeTracks() {
+  std::mt19937 gen(3);
+  std::bernoulli_distribution seen(0.4);
+  std::vector<int> num_fid(kNumA + kNumB, 0);
+  std::vector<std::map<int, int> > tracks;
+  for (int p = 0; p < kNumPoints; p++) {
+    std::map<int, int> track;
+    bool in_a = false, in_b = false;
+    for (int cid = 0; cid < kNumA + kNumB; cid++) {
+      if (!seen(gen))
+        continue;
+      track[cid] = num_fid[cid]++;
+      (cid < kNumA ? in_a : in_b) = true;
+    }
+    if (in_a && in_b)
+      tracks.push_back(track);
+  }
+  return tracks;
+}
+
+// The tracks findMatchingTracksInBlocks gets for each pair of a block of
+// images of A and a block of images of B, before they are merged
+std::vector<std::map<int, int> > SplitInBlocks(std::vector<std::map<int, int> > const& tracks,
+                                               int block_size) {
+  std::vector<std::map<int, int> > pieces;
+  for (int a_begin = 0; a_begin < kNumA; a_begin += block_size) {
+    for (int b_begin = kNumA; b_begin < kNumA + kNumB; b_begin += block_size) {
+      for (auto const& track : tracks) {
+        std::map<int, int> piece;
+        bool in_a = false, in_b = false;
+        for (auto const& cid_fid : track) {
+          int cid = cid_fid.first;
+          if (cid >= a_begin && cid < std::min(a_begin + block_size, kNumA)) {
+            piece.insert(cid_fid);
+            in_a = true;
+          } else if (cid >= b_begin && cid < std::min(b_begin + block_size, kNumA + kNumB)) {
+            piece.insert(cid_fid);
+            in_b = true;
+          }
+        }
+        if (in_a && in_b)
+          pieces.push_back(piece);
+      }
+    }
+  }
+  return pieces;
+}
+
+std::set<std::map<int, int> > AsSet(std::vector<std::map<int, int> > const& tracks) {
+  return std::set<std::map<int, int> >(tracks.begin(), tracks.end());
+}
+
+}  // namespace
+
+// However the images are split in blocks, merging the tracks of all
+// pairs of blocks must give the tracks of matching all images at once
+TEST(merge_tracks, blocks_give_whole_tracks) {
+  std::vector<std::map<int, int> > tracks = MakeTracks();
+  ASSERT_GT(tracks.size(), 100u);
+  for (int block_size = 1; block_size <= kNumA; block_size++) {
+    std::vector<std::map<int, int> > merged = SplitInBlocks(tracks, block_size);
+    if (block_size < kNumA) {
+      EXPECT_GT(merged.size(), tracks.size()) << "block size " << block_size;
+    }
+    sparse_mapping::MergeTracks(&merged);
+    EXPECT_EQ(tracks.size(), merged.size()) << "block size " << block_size;
+    EXPECT_TRUE(AsSet(tracks) == AsSet(merged)) << "block size " << block_size;
+  }
+}
+
+TEST(merge_tracks, ambiguous_removed) {
+  // Two pieces which share feature 4 of image 0 but see image 8 through
+  // different features can't be one track, and a third piece joined to
+  // them is removed too. Separate tracks are kept as they are.
+  std::vector<std::map<int, int> > tracks = {
+    {{0, 4}, {8, 1}},
+    {{0, 4}, {8, 2}},
+    {{8, 2}, {3, 5}},
+    {{1, 0}, {9, 0}},
+    {{1, 0}, {10, 3}},
+    {{2, 6}, {9, 1}}};
+  sparse_mapping::MergeTracks(&tracks);
+  std::vector<std::map<int, int> > expected = {
+    {{1, 0}, {9, 0}, {10, 3}},
+    {{2, 6}, {9, 1}}};
+  EXPECT_TRUE(AsSet(expected) == AsSet(tracks));
+  EXPECT_EQ(expected.size(), tracks.size());
+}
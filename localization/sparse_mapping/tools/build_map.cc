@@ -20,6 +20,7 @@
 #include <ff_common/utils.h>
 #include <config_reader/config_reader.h>
 #include <camera/camera_params.h>
+#include <sparse_mapping/checkpoint.h>
 #include <sparse_mapping/sparse_map.h>
 #include <sparse_mapping/reprojection.h>
 #include <sparse_mapping/tensor.h>
@@ -36,7 +37,11 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 // outputs
 DEFINE_string(output_map, "",
@@ -48,6 +53,9 @@ DEFINE_int32(sample_rate, 1,
 DEFINE_bool(save_individual_maps, false,
             "Save separately the maps after detection, matching, track building, "
             "incremental bundle adjustment, and global bundle adjustment.");
+DEFINE_string(checkpoint_dir, "",
+              "Save the output of each map-building step in this directory. A step whose input files "
+              "and parameters are the same as when it was saved is skipped, and its output restored.");
 
 // output map parameters
 DEFINE_string(detector, "SURF",
@@ -114,6 +122,59 @@ DEFINE_string(undistorted_camera_params, "",
 
 bool g_pruning_was_done = false;  // If we already pruned the map, don't prune it again
 
+// The flags each step depends on, besides its input files
+const std::vector<std::string> kDetectionFlags = {
+  "histogram_equalization", "orgbrisk_octaves", "orgbrisk_pattern_scale", "detection_retries",
+  "single_pass_detection",
+  "min_surf_features", "max_surf_features", "min_surf_threshold", "default_surf_threshold",
+  "max_surf_threshold", "min_brisk_features", "max_brisk_features", "min_brisk_threshold",
+  "default_brisk_threshold", "max_brisk_threshold"};
+const std::vector<std::string> kMatchingFlags = {
+  "num_subsequent_images", "match_all_rate", "min_valid", "max_pairwise_matches", "hamming_distance",
+  "goodness_ratio", "num_similar", "num_ransac_iterations", "ransac_inlier_tolerance"};
+const std::vector<std::string> kBundleAdjustmentFlags = {
+  "cost_function", "cost_function_threshold", "first_ba_index", "last_ba_index", "max_num_iterations",
+  "num_ba_passes", "reproj_thresh", "skip_filtering", "min_valid_angle"};
+
+// The values of the flags, one per line
+std::string FlagValues(std::vector<std::string> const& names) {
+  std::string values;
+  for (std::string const& name : names) {
+    std::string value;
+    if (!google::GetCommandLineOption(name.c_str(), &value))
+      LOG(FATAL) << "Unknown flag: " << name;
+    values += name + "=" + value + "\n";
+  }
+  return values;
+}
+
+// Runs a step of map building. With --checkpoint_dir, if the step was
+// saved with the same input files and parameters its output files are
+// restored instead, and the input files it would have removed are
+// removed. Else it runs and its output files are saved.
+void RunStep(std::string const& step, std::vector<std::string> const& input_files, std::string const& params,
+             std::vector<std::string> const& output_files, std::vector<std::string> const& removed_files,
+             std::function<void()> run) {
+  if (FLAGS_checkpoint_dir == "") {
+    run();
+    return;
+  }
+
+  sparse_mapping::MapCheckpoints checkpoints(FLAGS_checkpoint_dir);
+  std::string key = checkpoints.Key(step, input_files, params);
+  if (checkpoints.Restore(step, key, output_files)) {
+    LOG(INFO) << "Skipping " << step << ", its inputs and parameters are unchanged. Restored its output from "
+              << FLAGS_checkpoint_dir << ".";
+    for (std::string const& file : removed_files)
+      std::remove(file.c_str());
+    return;
+  }
+
+  run();
+  if (!key.empty() && !checkpoints.Save(step, key, params, output_files))
+    LOG(WARNING) << "Could not save the output of " << step << " in " << FLAGS_checkpoint_dir << ".";
+}
+
 void DetectAllFeatures(int argc, char** argv) {
   // Check for user mistakes
   if (argc <= 1) {
@@ -169,71 +230,98 @@ void DetectAllFeatures(int argc, char** argv) {
   FLAGS_num_repeat_images = std::min(FLAGS_num_repeat_images, static_cast<int>(files.size()));
   for (int i = 0; i < FLAGS_num_repeat_images; i++) files.push_back(files[i]);
 
-  // This will invoke a detection process
-  sparse_mapping::SparseMap map(files, FLAGS_detector, cam_params);
-  map.DetectFeatures();
-
-  map.Save(FLAGS_output_map);
-  if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".detect.map");
+  // The images are inputs, and their names and the camera parameters
+  std::ostringstream params;
+  params.precision(17);
+  params << "detector=" << FLAGS_detector << "\n" << FlagValues(kDetectionFlags)
+         << "camera=" << cam_params.GetDistortedSize().transpose() << ' '
+         << cam_params.GetUndistortedSize().transpose() << ' ' << cam_params.GetFocalVector().transpose() << ' '
+         << cam_params.GetOpticalOffset().transpose() << ' ' << cam_params.GetDistortion().transpose() << "\n";
+  for (std::string const& file : files)
+    params << "image=" << file << "\n";
+
+  RunStep("detection", files, params.str(), {FLAGS_output_map}, {}, [&]() {
+      // This will invoke a detection process
+      sparse_mapping::SparseMap map(files, FLAGS_detector, cam_params);
+      map.DetectFeatures();
+
+      map.Save(FLAGS_output_map);
+      if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".detect.map");
+    });
 }
 
 void MatchFeatures() {
   LOG(INFO) << "Matching features.";
 
-  sparse_mapping::SparseMap map(FLAGS_output_map);
-  sparse_mapping::MatchFeatures(sparse_mapping::EssentialFile(FLAGS_output_map),
-                                sparse_mapping::MatchesFile(FLAGS_output_map), &map);
-  map.Save(FLAGS_output_map);
-  if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".match.map");
+  std::string essential_file = sparse_mapping::EssentialFile(FLAGS_output_map);
+  std::string matches_file = sparse_mapping::MatchesFile(FLAGS_output_map);
+  RunStep("matching", {FLAGS_output_map}, FlagValues(kMatchingFlags),
+          {FLAGS_output_map, essential_file, matches_file}, {}, [&]() {
+      sparse_mapping::SparseMap map(FLAGS_output_map);
+      sparse_mapping::MatchFeatures(essential_file, matches_file, &map);
+      map.Save(FLAGS_output_map);
+      if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".match.map");
+    });
 }
 
 void BuildTracks() {
   LOG(INFO) << "Building tracks.";
 
-  sparse_mapping::SparseMap map(FLAGS_output_map);
-  bool rm_invalid_xyz = false;  // we don't have valid cameras, so can't rm xyz
-  sparse_mapping::BuildTracks(rm_invalid_xyz,
-                              sparse_mapping::MatchesFile(FLAGS_output_map),
-                              &map);
-  map.Save(FLAGS_output_map);
-  if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".track.map");
+  std::string matches_file = sparse_mapping::MatchesFile(FLAGS_output_map);
+  RunStep("tracks", {FLAGS_output_map, matches_file}, "", {FLAGS_output_map}, {matches_file}, [&]() {
+      sparse_mapping::SparseMap map(FLAGS_output_map);
+      bool rm_invalid_xyz = false;  // we don't have valid cameras, so can't rm xyz
+      sparse_mapping::BuildTracks(rm_invalid_xyz, matches_file, &map);
+      map.Save(FLAGS_output_map);
+      if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".track.map");
+    });
 }
 
 void IncrementalBA() {
   LOG(INFO) << "Beginning incremental bundle adjustment.";
 
-  sparse_mapping::SparseMap map(FLAGS_output_map);
+  std::string essential_file = sparse_mapping::EssentialFile(FLAGS_output_map);
+  RunStep("incremental_ba", {FLAGS_output_map, essential_file},
+          FlagValues({"incremental_ba_local", "incremental_ba_global_rate"}), {FLAGS_output_map},
+          {essential_file}, [&]() {
+      sparse_mapping::SparseMap map(FLAGS_output_map);
 
-  sparse_mapping::IncrementalBA(sparse_mapping::EssentialFile(FLAGS_output_map), &map);
+      sparse_mapping::IncrementalBA(essential_file, &map);
 
-  map.Save(FLAGS_output_map);
-  if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".incremental.map");
+      map.Save(FLAGS_output_map);
+      if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".incremental.map");
+    });
 }
 
 void CloseLoop() {
   LOG(INFO) << "Beginning loop closure.";
 
-  sparse_mapping::SparseMap map(FLAGS_output_map);
+  RunStep("loop_closure", {FLAGS_output_map}, FlagValues(kBundleAdjustmentFlags), {FLAGS_output_map}, {}, [&]() {
+      sparse_mapping::SparseMap map(FLAGS_output_map);
 
-  sparse_mapping::CloseLoop(&map);
-  map.Save(FLAGS_output_map);
-  if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".closed.map");
+      sparse_mapping::CloseLoop(&map);
+      map.Save(FLAGS_output_map);
+      if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".closed.map");
+    });
 }
 
 void BundleAdjust() {
   LOG(INFO) << "Performing bundle adjustment.";
-  sparse_mapping::SparseMap map(FLAGS_output_map);
 
-  bool fix_cameras = FLAGS_fix_cameras;
-  sparse_mapping::BundleAdjust(fix_cameras, &map);
+  RunStep("bundle_adjustment", {FLAGS_output_map}, FlagValues(kBundleAdjustmentFlags) + FlagValues({"fix_cameras"}),
+          {FLAGS_output_map}, {}, [&]() {
+      sparse_mapping::SparseMap map(FLAGS_output_map);
 
-  map.Save(FLAGS_output_map);
-  if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".bundle.map");
+      bool fix_cameras = FLAGS_fix_cameras;
+      sparse_mapping::BundleAdjust(fix_cameras, &map);
+
+      map.Save(FLAGS_output_map);
+      if (FLAGS_save_individual_maps) map.Save(FLAGS_output_map + ".bundle.map");
+    });
 }
 
 // rebuilds with a different descriptor and detector
-void Rebuild() {
-  LOG(INFO) << "Rebuilding map with " << FLAGS_rebuild_detector << " detector.";
+void RebuildMap() {
   sparse_mapping::SparseMap original(FLAGS_output_map);
 
   camera::CameraParameters params = original.GetCameraParameters();
@@ -312,6 +400,18 @@ void Rebuild() {
                                            FLAGS_rebuild_detector + ".map");
 }
 
+void Rebuild() {
+  LOG(INFO) << "Rebuilding map with " << FLAGS_rebuild_detector << " detector.";
+
+  std::string params = FlagValues({"rebuild_detector", "rebuild_replace_camera", "rebuild_refloat_cameras",
+                                   "robot_camera"}) + FlagValues(kDetectionFlags) + FlagValues(kMatchingFlags) +
+    FlagValues(kBundleAdjustmentFlags);
+  char * bot_ptr = getenv("ASTROBEE_ROBOT");
+  if (FLAGS_rebuild_replace_camera && bot_ptr != NULL)
+    params += std::string("ASTROBEE_ROBOT=") + bot_ptr + "\n";
+  RunStep("rebuild", {FLAGS_output_map}, params, {FLAGS_output_map}, {}, RebuildMap);
+}
+
 // Prune the map leaving the vocab db unchanged
 void PruneMap() {
   if (g_pruning_was_done)
@@ -338,21 +438,26 @@ void VocabDB() {
   else
     branching_factor = 10;
 
-  std::string detector;
-  {
-    // Temporarily load the map to guess the descriptor
-    sparse_mapping::SparseMap m(FLAGS_output_map);
-    detector = m.detector_.GetDetectorName();
-  }
+  std::string params = FlagValues({"db_depth", "db_branching_factor", "db_restarts", "vocab_db_dbow2_trainer",
+                                   "vocab_db_max_cluster_descriptors", "vocab_db_seed"});
+  RunStep("vocab_db", {FLAGS_output_map}, params, {FLAGS_output_map}, {}, [&]() {
+      std::string detector;
+      {
+        // Temporarily load the map to guess the descriptor
+        sparse_mapping::SparseMap m(FLAGS_output_map);
+        detector = m.detector_.GetDetectorName();
+      }
 
-  sparse_mapping::BuildDB(FLAGS_output_map,
-                          detector, depth, branching_factor,
-                          FLAGS_db_restarts);
+      sparse_mapping::BuildDB(FLAGS_output_map,
+                              detector, depth, branching_factor,
+                              FLAGS_db_restarts);
 
-  // Pruning must always happen after the database is built, as the
-  // full set of features (so without pruning) is necessary to later
-  // effectively find similar images.
-  PruneMap();
+      // Pruning must always happen after the database is built, as the
+      // full set of features (so without pruning) is necessary to later
+      // effectively find similar images.
+      PruneMap();
+    });
+  g_pruning_was_done = true;  // also when the pruned map was restored
 }
 
 // Do either registration or verification
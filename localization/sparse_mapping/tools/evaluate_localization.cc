@@ -24,8 +24,17 @@
 #include <glog/logging.h>
 
 #include <sys/time.h>
+#include <random>
 #include <thread>
 
+DEFINE_bool(use_pose_prior, false,
+            "Localize each image given its true pose, perturbed as below, as the guess the EKF would give, "
+            "so that only the images of the map near it are matched.");
+DEFINE_double(prior_position_noise, 0.0,
+              "Perturb the position of the guess by normal noise with this standard deviation, in meters.");
+DEFINE_double(prior_angle_noise, 0.0,
+              "Rotate the guess about a random axis by normal noise with this standard deviation, in degrees.");
+
 int main(int argc, char** argv) {
   ff_common::InitFreeFlyerApplication(&argc, &argv);
   if (argc < 3) {
@@ -42,6 +51,10 @@ int main(int argc, char** argv) {
   int failures = 0;
   int trials = 0;
 
+  // Fixed seed, so that runs with and without the prior see the same guesses
+  std::mt19937 generator(0);
+  std::normal_distribution<double> noise(0.0, 1.0);
+
   double pos_error_sum     = 0.0;
   double pos_error_sum_2   = 0.0;
   double angle_error_sum   = 0.0;
@@ -68,7 +81,23 @@ int main(int argc, char** argv) {
     camera::CameraModel camera(Eigen::Vector3d(), Eigen::Matrix3d::Identity(), map.GetCameraParameters());
     struct timeval a, b;
     gettimeofday(&a, NULL);
-    if (!map.Localize(name, &camera)) {
+    bool localized;
+    if (FLAGS_use_pose_prior) {
+      Eigen::Vector3d offset(noise(generator), noise(generator), noise(generator));
+      offset *= FLAGS_prior_position_noise;
+      Eigen::Vector3d axis(noise(generator), noise(generator), noise(generator));
+      double angle = noise(generator) * FLAGS_prior_angle_noise * M_PI / 180.0;
+      Eigen::Affine3d prior;
+      prior.linear() = rot * Eigen::AngleAxisd(angle, axis.normalized()).matrix();
+      prior.translation() = -prior.linear() * (pos + offset);
+      cv::Mat descriptors;
+      Eigen::Matrix2Xd keypoints;
+      map.DetectFeaturesFromFile(name, false, &descriptors, &keypoints);
+      localized = map.Localize(descriptors, keypoints, prior, &camera);
+    } else {
+      localized = map.Localize(name, &camera);
+    }
+    if (!localized) {
       printf("%s Failure\n", name);
       failures++;
       continue;
@@ -0,0 +1,101 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/init.h>
+#include <sparse_mapping/map_extender.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/sparse_mapping.h>
+
+#include <sparse_map.pb.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Add new images to a registered BRISK map with a vocab db, without
+// rebuilding it. The images which localize against the map, or against
+// the images added before them, become keyframes with new and extended
+// tracks, and only they and the points they see are bundle adjusted.
+// The new images are added to the vocab db of the map.
+
+// Usage:
+// extend_map -input_map <input map> -output_map <output map> <images>
+// or
+// extend_map -input_map <input map> -output_map <output map> -image_list <file>
+
+DEFINE_string(input_map, "",
+              "Input registered BRISK map with vocab db.");
+DEFINE_string(output_map, "",
+              "Output map, with the images added.");
+DEFINE_string(image_list, "",
+              "Instead of the images being specified on the command line, "
+              "read them from a file (one per line).");
+DEFINE_string(failed_list, "",
+              "Write the images which could not be added to this file.");
+DEFINE_bool(skip_pruning, false,
+            "Keep the features of the new images that are in no track, as for an unpruned map.");
+
+DECLARE_bool(histogram_equalization);  // its value will be pulled from sparse_map.cc
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  if (FLAGS_input_map == "" || FLAGS_output_map == "" || (argc <= 1 && FLAGS_image_list == "")) {
+    LOG(INFO) << "Usage: " << argv[0]
+              << " -input_map <input map> -output_map <output map> [ <images> ] [ -image_list <file> ]";
+    return 0;
+  }
+
+  std::vector<std::string> images;
+  if (FLAGS_image_list == "") {
+    for (int i = 1; i < argc; i++)
+      images.push_back(argv[i]);
+  } else {
+    std::string image;
+    std::ifstream image_handle(FLAGS_image_list);
+    while (image_handle >> image)
+      images.push_back(image);
+  }
+
+  sparse_mapping::SparseMap map(FLAGS_input_map);
+  sparse_mapping::HistogramEqualizationCheck(map.GetHistogramEqualization(),
+                                             FLAGS_histogram_equalization);
+
+  sparse_mapping::MapExtender extender(&map);
+  std::vector<std::string> failed;
+  int num_added = extender.AddImages(images, !FLAGS_skip_pruning, &failed);
+  LOG(INFO) << "Added " << num_added << " of " << images.size() << " images to the map, which now has "
+            << map.GetNumFrames() << " images.";
+
+  if (FLAGS_failed_list != "") {
+    std::ofstream ofs(FLAGS_failed_list.c_str());
+    for (size_t i = 0; i < failed.size(); i++)
+      ofs << failed[i] << "\n";
+  }
+  for (size_t i = 0; i < failed.size(); i++)
+    LOG(WARNING) << "Could not localize: " << failed[i];
+
+  map.Save(FLAGS_output_map);
+
+  google::protobuf::ShutdownProtobufLibrary();
+  return 0;
+}
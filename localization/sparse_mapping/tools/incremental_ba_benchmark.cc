@@ -0,0 +1,168 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Runs incremental bundle adjustment on made up sequences of images, a
+// camera moving along a corridor of points, with the problem made again
+// for each camera and with the incremental adjuster, and compares the time
+// and the reprojection error of the map. With sequences of several lengths
+// it shows how the time per image grows with the map: it should stay about
+// the same with the incremental adjuster.
+
+#include <camera/camera_params.h>
+#include <ff_common/init.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/tensor.h>
+
+#include <Eigen/Geometry>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <stdio.h>
+
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+DEFINE_string(num_images, "250,500,1000", "Numbers of images in the sequences, separated by commas.");
+DEFINE_int32(num_points_per_image, 20, "Number of points along the corridor, per image.");
+DEFINE_double(step, 0.05, "Distance between consecutive cameras, in meters.");
+DEFINE_double(pixel_noise, 0.5, "Standard deviation of the noise of the features, in pixels.");
+DEFINE_double(affine_noise, 0.01, "Standard deviation of the noise of the relative poses.");
+DEFINE_int32(seed, 1, "Seed of the made up sequence.");
+DEFINE_bool(skip_rebuild, false, "Do not run with the problem made again for each camera, which is slow.");
+DECLARE_bool(incremental_ba_local);  // defined in tensor.cc
+
+namespace {
+
+double const kFocalLength = 300;
+double const kHalfWidth = 320, kHalfHeight = 240;
+
+// The map, with only the first camera known, and the relative poses of
+// consecutive cameras, as after matching
+void MakeSequence(int num_images, sparse_mapping::SparseMap ** map,
+                  sparse_mapping::CIDPairAffineMap * relative_affines) {
+  std::mt19937 gen(FLAGS_seed);
+  std::normal_distribution<double> noise(0.0, 1.0);
+
+  // The camera looks along z and moves along x
+  std::vector<Eigen::Affine3d> cams(num_images);
+  for (int cid = 0; cid < num_images; cid++) {
+    cams[cid] = Eigen::Affine3d::Identity();
+    cams[cid].translation() = Eigen::Vector3d(-cid * FLAGS_step, 0, 0);
+  }
+
+  camera::CameraParameters params(Eigen::Vector2i(2 * kHalfWidth, 2 * kHalfHeight),
+                                  Eigen::Vector2d::Constant(kFocalLength),
+                                  Eigen::Vector2d(kHalfWidth, kHalfHeight));
+  std::vector<std::string> files;
+  for (int cid = 0; cid < num_images; cid++)
+    files.push_back("image" + std::to_string(cid) + ".jpg");
+  *map = new sparse_mapping::SparseMap(files, "ORGBRISK", params);
+  sparse_mapping::SparseMap & s = **map;
+  s.cid_to_cam_t_global_.resize(num_images);
+  s.cid_to_cam_t_global_[0] = cams[0];
+
+  // Points on the walls of the corridor, each seen by the cameras in
+  // whose field of view it is
+  std::uniform_real_distribution<double> along(-2.0, num_images * FLAGS_step + 2.0);
+  std::uniform_real_distribution<double> across(-1.5, 1.5);
+  std::uniform_real_distribution<double> depth(3.0, 8.0);
+  std::vector<std::vector<Eigen::Vector2d> > keypoints(num_images);
+  for (int p = 0; p < FLAGS_num_points_per_image * num_images; p++) {
+    Eigen::Vector3d xyz(along(gen), across(gen), depth(gen));
+    std::map<int, int> track;
+    for (int cid = 0; cid < num_images; cid++) {
+      Eigen::Vector3d q = cams[cid] * xyz;
+      Eigen::Vector2d pix = kFocalLength * q.head<2>() / q[2];
+      if (std::abs(pix[0]) > kHalfWidth || std::abs(pix[1]) > kHalfHeight)
+        continue;
+      pix += FLAGS_pixel_noise * Eigen::Vector2d(noise(gen), noise(gen));
+      track[cid] = keypoints[cid].size();
+      keypoints[cid].push_back(pix);
+    }
+    if (track.size() > 1)
+      s.pid_to_cid_fid_.push_back(track);
+  }
+  for (int cid = 0; cid < num_images; cid++) {
+    s.cid_to_keypoint_map_[cid].resize(2, keypoints[cid].size());
+    for (size_t fid = 0; fid < keypoints[cid].size(); fid++)
+      s.cid_to_keypoint_map_[cid].col(fid) = keypoints[cid][fid];
+  }
+  s.pid_to_xyz_.resize(s.pid_to_cid_fid_.size());
+
+  for (int cid = 1; cid < num_images; cid++) {
+    Eigen::Affine3d rel = cams[cid] * cams[cid - 1].inverse();
+    Eigen::Vector3d aa = FLAGS_affine_noise * Eigen::Vector3d(noise(gen), noise(gen), noise(gen));
+    rel.linear() = Eigen::AngleAxisd(aa.norm(), aa.normalized()).toRotationMatrix() * rel.linear();
+    rel.translation() += FLAGS_affine_noise * FLAGS_step * Eigen::Vector3d(noise(gen), noise(gen), noise(gen));
+    (*relative_affines)[std::make_pair(cid - 1, cid)] = rel;
+  }
+}
+
+double MeanReprojectionError(sparse_mapping::SparseMap const& s) {
+  double total = 0;
+  int num = 0;
+  for (size_t pid = 0; pid < s.pid_to_cid_fid_.size(); pid++) {
+    for (std::pair<int, int> const& cid_fid : s.pid_to_cid_fid_[pid]) {
+      Eigen::Vector3d q = s.cid_to_cam_t_global_[cid_fid.first] * s.pid_to_xyz_[pid];
+      Eigen::Vector2d pix = kFocalLength * q.head<2>() / q[2];
+      total += (pix - s.cid_to_keypoint_map_[cid_fid.first].col(cid_fid.second)).norm();
+      num++;
+    }
+  }
+  return num > 0 ? total / num : 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  std::vector<int> sizes;
+  std::istringstream list(FLAGS_num_images);
+  std::string size;
+  while (std::getline(list, size, ','))
+    sizes.push_back(std::stoi(size));
+
+  std::string essential_file = "incremental_ba_benchmark_essential.csv";
+  printf("%-11s %7s %10s %12s %10s %10s\n", "mode", "images", "time_s", "ms_per_image", "points", "reproj_px");
+  for (int num_images : sizes) {
+    for (bool rebuild : {true, false}) {
+      if (rebuild && FLAGS_skip_rebuild)
+        continue;
+      sparse_mapping::SparseMap * map = NULL;
+      sparse_mapping::CIDPairAffineMap relative_affines;
+      MakeSequence(num_images, &map, &relative_affines);
+      // IncrementalBA reads the relative poses from file, and removes it
+      sparse_mapping::WriteAffineCSV(relative_affines, essential_file);
+
+      FLAGS_incremental_ba_local = !rebuild;
+      auto start = std::chrono::steady_clock::now();
+      sparse_mapping::IncrementalBA(essential_file, map);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      printf("%-11s %7d %10.2f %12.2f %10zu %10.3f\n", rebuild ? "rebuild" : "incremental", num_images, seconds,
+             1000 * seconds / num_images, map->pid_to_xyz_.size(), MeanReprojectionError(*map));
+      delete map;
+    }
+  }
+  return 0;
+}
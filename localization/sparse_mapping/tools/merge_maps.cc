@@ -29,9 +29,12 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <sys/resource.h>
+
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
 #include <thread>
 
 // Merge n maps by merging second into the first, then the third into
@@ -42,6 +45,10 @@
 // maps are merged, as the bundle-adjustment that is required during
 // merging may move things around a bit.
 
+// With -out_of_core_merge, the maps are not loaded, and the merged map
+// is bundle-adjusted only once, at the end. The time each merge takes
+// and the peak memory use are printed, to compare the two modes.
+
 // outputs
 DEFINE_string(output_map, "",
               "Output file containing the merged map.");
@@ -59,6 +66,15 @@ DEFINE_double(outlier_factor, 3.0,
 DEFINE_bool(skip_bundle_adjustment, false,
             "If true, do not bundle adjust the merged map.");
 
+DECLARE_bool(out_of_core_merge);  // its value will be pulled from tensor.cc
+
+// Peak resident memory of this process so far, in MB
+double PeakMemory() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;  // Linux reports KB
+}
+
 int main(int argc, char** argv) {
   ff_common::InitFreeFlyerApplication(&argc, &argv);
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -81,18 +97,39 @@ int main(int argc, char** argv) {
     LOG(FATAL) << "Must have num_image_overlaps_at_endpoints > 0.";
 
   // The merged map starts as the first map.
-  {
+  LOG(INFO) << "Initializing " << FLAGS_output_map << " using " << argv[1] << std::endl;
+  if (!FLAGS_out_of_core_merge) {
     sparse_mapping::SparseMap A(argv[1]);
-    LOG(INFO) << "Initializing " << FLAGS_output_map << " using " << argv[1] << std::endl;
     A.Save(FLAGS_output_map);
+  } else {
+    std::ifstream src(argv[1], std::ios::binary);
+    std::ofstream dst(FLAGS_output_map.c_str(), std::ios::binary);
+    dst << src.rdbuf();
+    if (!src || !dst)
+      LOG(FATAL) << "Failed to copy " << argv[1] << " to " << FLAGS_output_map;
   }
 
   int last_index = argc - 1;
   for (int i = 2; i <= last_index; i++) {
+    auto start = std::chrono::steady_clock::now();
     sparse_mapping::AppendMapFile(FLAGS_output_map, argv[i],
                                   FLAGS_num_image_overlaps_at_endpoints,
                                   FLAGS_outlier_factor,
-                                  !FLAGS_skip_bundle_adjustment);
+                                  !FLAGS_skip_bundle_adjustment && !FLAGS_out_of_core_merge);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    LOG(INFO) << "Merged " << argv[i] << " in " << elapsed.count() << " seconds. "
+              << "Peak memory use so far: " << PeakMemory() << " MB.";
+  }
+
+  if (FLAGS_out_of_core_merge && !FLAGS_skip_bundle_adjustment && last_index >= 2) {
+    auto start = std::chrono::steady_clock::now();
+    sparse_mapping::SparseMap C(FLAGS_output_map);
+    bool fix_cameras = false;
+    sparse_mapping::BundleAdjust(fix_cameras, &C);
+    C.Save(FLAGS_output_map);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    LOG(INFO) << "Bundle-adjusted the merged map in " << elapsed.count() << " seconds. "
+              << "Peak memory use so far: " << PeakMemory() << " MB.";
   }
 
   google::protobuf::ShutdownProtobufLibrary();
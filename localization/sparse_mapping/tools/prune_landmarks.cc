@@ -0,0 +1,232 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/init.h>
+#include <ff_common/thread.h>
+#include <sparse_mapping/landmark_usage.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/sparse_mapping.h>
+
+#include <sparse_map.pb.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Remove the landmarks of a map which localization does not use. The
+// given images, for example those extracted from a bag with
+// extract_image_bag, are localized against the map, counting how often
+// each landmark is an inlier or an outlier of the poses found. The
+// landmarks which are rarely inliers are then removed, except that each
+// image of the map keeps its most used landmarks, and the features left
+// with no landmark are removed too. The images are localized again
+// against the smaller map, and a report compares the size of the map, the
+// time to localize and how many images localize before and after.
+
+// Usage:
+// prune_landmarks -input_map <input map> -output_map <output map> <images>
+// or
+// prune_landmarks -input_map <input map> -output_map <output map> -image_list <file>
+
+DEFINE_string(input_map, "",
+              "Input registered map with vocab db.");
+DEFINE_string(output_map, "",
+              "Output map, with the landmarks removed.");
+DEFINE_string(image_list, "",
+              "Instead of the images to localize being specified on the command line, "
+              "read them from a file (one per line).");
+DEFINE_string(eval_image_list, "",
+              "Compare localization before and after with these images (one per line) rather than "
+              "with the images used to count how the landmarks are used.");
+DEFINE_string(report, "",
+              "Write the comparison to this file. Default: <output map>.report.txt.");
+DEFINE_int32(min_inliers, 1,
+             "Remove the landmarks which were inliers fewer times than this.");
+DEFINE_double(max_outlier_ratio, 1.0,
+              "Remove the landmarks which were outliers more than this fraction of the times "
+              "they were matched.");
+DEFINE_int32(min_landmarks_per_frame, 100,
+             "Keep at least this many landmarks in each image of the map, if it has them.");
+
+DECLARE_bool(histogram_equalization);  // its value will be pulled from sparse_map.cc
+
+namespace {
+
+std::vector<std::string> ReadList(std::string const& file) {
+  std::vector<std::string> images;
+  std::string image;
+  std::ifstream image_handle(file.c_str());
+  while (image_handle >> image)
+    images.push_back(image);
+  return images;
+}
+
+// How big a map is
+struct MapSize {
+  size_t landmarks = 0, observations = 0, features = 0, bytes = 0;
+};
+
+MapSize GetMapSize(sparse_mapping::SparseMap const& map, std::string const& file) {
+  MapSize size;
+  size.landmarks = map.pid_to_cid_fid_.size();
+  for (size_t pid = 0; pid < map.pid_to_cid_fid_.size(); pid++)
+    size.observations += map.pid_to_cid_fid_[pid].size();
+  for (size_t cid = 0; cid < map.GetNumFrames(); cid++)
+    size.features += map.cid_to_descriptor_map_[cid].rows;
+  struct stat st;
+  if (stat(file.c_str(), &st) == 0)
+    size.bytes = st.st_size;
+  return size;
+}
+
+// How localizing some images went
+struct LocalizationStats {
+  int num_localized = 0;
+  std::vector<double> seconds;
+};
+
+LocalizationStats Replay(sparse_mapping::LandmarkUsage * usage, std::vector<cv::Mat> const& descriptors,
+                         std::vector<Eigen::Matrix2Xd> const& keypoints) {
+  LocalizationStats stats;
+  stats.seconds.resize(descriptors.size());
+  for (size_t i = 0; i < descriptors.size(); i++) {
+    if (usage->Replay(descriptors[i], keypoints[i], &stats.seconds[i]))
+      stats.num_localized++;
+  }
+  return stats;
+}
+
+void Detect(sparse_mapping::SparseMap * map, std::vector<std::string> const& images,
+            std::vector<cv::Mat> * descriptors, std::vector<Eigen::Matrix2Xd> * keypoints) {
+  descriptors->resize(images.size());
+  keypoints->resize(images.size());
+  ff_common::ThreadPool pool;
+  for (size_t i = 0; i < images.size(); i++)
+    pool.AddTask(&sparse_mapping::SparseMap::DetectFeaturesFromFile, map, std::ref(images[i]),
+                 true, &(*descriptors)[i], &(*keypoints)[i]);
+  pool.Join();
+}
+
+void WriteMapSize(std::ofstream & report, std::string const& name, MapSize const& size) {
+  report << name << " " << size.landmarks << " " << size.observations << " " << size.features << " "
+         << size.bytes << "\n";
+}
+
+void WriteStats(std::ofstream & report, std::string const& name, LocalizationStats const& stats) {
+  std::vector<double> seconds = stats.seconds;
+  std::sort(seconds.begin(), seconds.end());
+  double mean = 0, median = 0;
+  if (!seconds.empty()) {
+    for (size_t i = 0; i < seconds.size(); i++)
+      mean += seconds[i];
+    mean /= seconds.size();
+    median = seconds[seconds.size() / 2];
+  }
+  report << name << " " << seconds.size() << " " << stats.num_localized << " " << mean << " " << median << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  if (FLAGS_input_map == "" || FLAGS_output_map == "" || (argc <= 1 && FLAGS_image_list == "")) {
+    LOG(INFO) << "Usage: " << argv[0]
+              << " -input_map <input map> -output_map <output map> [ <images> ] [ -image_list <file> ]";
+    return 0;
+  }
+  if (FLAGS_report == "")
+    FLAGS_report = FLAGS_output_map + ".report.txt";
+
+  std::vector<std::string> images;
+  if (FLAGS_image_list == "") {
+    for (int i = 1; i < argc; i++)
+      images.push_back(argv[i]);
+  } else {
+    images = ReadList(FLAGS_image_list);
+  }
+
+  sparse_mapping::SparseMap map(FLAGS_input_map);
+  sparse_mapping::HistogramEqualizationCheck(map.GetHistogramEqualization(),
+                                             FLAGS_histogram_equalization);
+  MapSize size_before = GetMapSize(map, FLAGS_input_map);
+
+  LOG(INFO) << "Detecting features in " << images.size() << " images.";
+  std::vector<cv::Mat> descriptors, eval_descriptors;
+  std::vector<Eigen::Matrix2Xd> keypoints, eval_keypoints;
+  Detect(&map, images, &descriptors, &keypoints);
+  if (FLAGS_eval_image_list != "")
+    Detect(&map, ReadList(FLAGS_eval_image_list), &eval_descriptors, &eval_keypoints);
+
+  sparse_mapping::LandmarkUsage usage(&map);
+  LOG(INFO) << "Localizing " << images.size() << " images.";
+  LocalizationStats stats_before = Replay(&usage, descriptors, keypoints);
+  if (FLAGS_eval_image_list != "") {
+    // Count these apart, so only the images given decide what is pruned
+    sparse_mapping::LandmarkUsage eval_usage(&map);
+    stats_before = Replay(&eval_usage, eval_descriptors, eval_keypoints);
+  }
+
+  int num_never_matched = 0, num_never_inliers = 0;
+  for (size_t pid = 0; pid < size_before.landmarks; pid++) {
+    if (usage.Inliers(pid) + usage.Outliers(pid) == 0)
+      num_never_matched++;
+    if (usage.Inliers(pid) == 0)
+      num_never_inliers++;
+  }
+  int num_reached = 0;
+  for (size_t cid = 0; cid < map.GetNumFrames(); cid++)
+    num_reached += usage.Reached(cid);
+
+  usage.Prune(FLAGS_min_inliers, FLAGS_max_outlier_ratio, FLAGS_min_landmarks_per_frame);
+  map.Save(FLAGS_output_map);
+  MapSize size_after = GetMapSize(map, FLAGS_output_map);
+
+  LOG(INFO) << "Localizing again against the pruned map.";
+  sparse_mapping::LandmarkUsage usage_after(&map);
+  LocalizationStats stats_after = FLAGS_eval_image_list == "" ? Replay(&usage_after, descriptors, keypoints) :
+    Replay(&usage_after, eval_descriptors, eval_keypoints);
+
+  std::ofstream report(FLAGS_report.c_str());
+  if (!report.is_open())
+    LOG(FATAL) << "Cannot write: " << FLAGS_report;
+  report << "# Pruning " << FLAGS_input_map << " into " << FLAGS_output_map << " using " << images.size()
+         << " images.\n";
+  report << "# Of " << size_before.landmarks << " landmarks, " << num_never_matched << " were never matched and "
+         << num_never_inliers << " were never inliers.\n";
+  report << "# Of " << map.GetNumFrames() << " images of the map, " << num_reached
+         << " see a landmark matched. Only landmarks seen by no other image can be pruned.\n";
+  report << "# Map size: landmarks observations features bytes\n";
+  WriteMapSize(report, "before", size_before);
+  WriteMapSize(report, "after", size_after);
+  report << "# Localization: images localized mean_seconds median_seconds\n";
+  WriteStats(report, "before", stats_before);
+  WriteStats(report, "after", stats_after);
+  LOG(INFO) << "Wrote " << FLAGS_output_map << " and " << FLAGS_report;
+
+  google::protobuf::ShutdownProtobufLibrary();
+  return 0;
+}
@@ -0,0 +1,152 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ff_common/init.h>
+#include <sparse_mapping/map_reducer.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/sparse_mapping.h>
+
+#include <sparse_map.pb.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Remove images from a map that appear redundant, as reduce_map.py
+// does, within one process. Randomly take out a fraction of the images
+// of the map, localize all images of the map against the images left,
+// and put back those which localize with too big an error. Repeat until
+// none need putting back. That is one attempt, and each attempt starts
+// from the images the one before kept.
+
+// The input map must be registered, unpruned, and made of BRISK
+// features. The output map is pruned, with a vocab db.
+
+// Usage:
+// reduce_map -input_map <input map> -output_map <output map> [ -sample_rate <val> ]
+//            [ -localization_error <val> ] [ -attempts <val> ] [ -image_list <file> ]
+
+DEFINE_string(input_map, "",
+              "Input registered, unpruned, BRISK map.");
+DEFINE_string(output_map, "",
+              "Output registered, pruned, BRISK map with vocab db.");
+DEFINE_string(report, "",
+              "Write how each attempt went, and the localization errors of the images "
+              "with the output map, to this file. Default: <output map>.report.txt.");
+DEFINE_double(sample_rate, 0.25,
+              "The fraction of images to try to remove from the map at once.");
+DEFINE_double(localization_error, 0.02,
+              "An image that has localization error bigger than this, in meters, "
+              "is considered hard to localize.");
+DEFINE_int32(attempts, 2,
+             "How many times to try to reduce the map.");
+DEFINE_int32(max_iterations, 10,
+             "At most how many times to put images back in the map in each attempt.");
+DEFINE_string(image_list, "",
+              "Instead of taking out images of the map randomly, start with a submap with "
+              "the images from this list (one per line), and make one attempt.");
+DEFINE_int32(random_seed, 0,
+             "The seed of the random choice of the images to take out.");
+DEFINE_int32(db_restarts, 1, "Number of restarts when building the tree.");
+DEFINE_int32(db_depth, 6, "Depth of the tree to build.");
+DEFINE_int32(db_branching_factor, 10, "Branching factor of the tree to build.");
+
+DECLARE_bool(histogram_equalization);  // its value will be pulled from sparse_map.cc
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  if (FLAGS_input_map == "" || FLAGS_output_map == "")
+    LOG(FATAL) << "Must specify the input and output maps.";
+  if (FLAGS_max_iterations < 1)
+    LOG(FATAL) << "Must make at least one iteration.";
+  if (FLAGS_report == "")
+    FLAGS_report = FLAGS_output_map + ".report.txt";
+
+  sparse_mapping::SparseMap map(FLAGS_input_map);
+  sparse_mapping::HistogramEqualizationCheck(map.GetHistogramEqualization(),
+                                             FLAGS_histogram_equalization);
+  int num_frames = map.GetNumFrames();
+
+  // Start with all images, or with those in the list
+  std::vector<bool> keep(num_frames, true);
+  if (FLAGS_image_list != "") {
+    std::map<std::string, int> image2cid;
+    for (int cid = 0; cid < num_frames; cid++)
+      image2cid[map.cid_to_filename_[cid]] = cid;
+    keep.assign(num_frames, false);
+    std::string image;
+    std::ifstream image_handle(FLAGS_image_list);
+    while (image_handle >> image) {
+      auto it = image2cid.find(image);
+      if (it == image2cid.end())
+        LOG(FATAL) << "The images in " << FLAGS_image_list << " must be all in the input map: "
+                   << FLAGS_input_map;
+      keep[it->second] = true;
+    }
+    LOG(INFO) << "Using just one attempt, hence only trying to add to the input list.";
+    FLAGS_attempts = 1;
+  }
+
+  std::ofstream report(FLAGS_report.c_str());
+  if (!report.is_open())
+    LOG(FATAL) << "Cannot write: " << FLAGS_report;
+  report << "# Reducing " << FLAGS_input_map << " with " << num_frames << " images.\n";
+
+  sparse_mapping::MapReducer reducer(&map, FLAGS_db_depth, FLAGS_db_branching_factor, FLAGS_db_restarts);
+  std::mt19937 generator(FLAGS_random_seed);
+  std::unique_ptr<sparse_mapping::SparseMap> submap;
+  std::vector<double> errors;
+  for (int attempt = 0; attempt < FLAGS_attempts; attempt++) {
+    if (FLAGS_image_list == "") {
+      // Take out a random sample of the images kept so far
+      std::vector<int> kept;
+      for (int cid = 0; cid < num_frames; cid++)
+        if (keep[cid])
+          kept.push_back(cid);
+      std::shuffle(kept.begin(), kept.end(), generator);
+      int num_out = static_cast<int>(kept.size() * FLAGS_sample_rate);
+      for (int i = 0; i < num_out; i++)
+        keep[kept[i]] = false;
+      LOG(INFO) << "Attempt " << attempt << ": randomly excluding " << num_out << " images from the map.";
+    }
+
+    report << "# Attempt " << attempt << "\n";
+    submap = reducer.Reduce(FLAGS_localization_error, FLAGS_max_iterations, &keep, &errors, &report);
+    LOG(INFO) << "The reduced map for attempt " << attempt << " has " << submap->GetNumFrames() << " images.";
+  }
+
+  if (submap) {
+    submap->Save(FLAGS_output_map);
+    report << "# Image, localization error with the output map, and whether it is kept:\n";
+    for (int cid = 0; cid < num_frames; cid++)
+      report << map.cid_to_filename_[cid] << " " << errors[cid] << " " << keep[cid] << "\n";
+    LOG(INFO) << "Wrote " << FLAGS_output_map << " and " << FLAGS_report;
+  }
+
+  google::protobuf::ShutdownProtobufLibrary();
+  return 0;
+}
@@ -166,6 +166,8 @@ def find_hard_to_localize_images(args, ref_map, source_map, out_file):
            '-num_ransac_iterations', str(args.num_ransac_iterations)]
     if args.histogram_equalization:
         cmd.append('-histogram_equalization')
+    if args.feature_cache_dir != "":
+        cmd += ['-feature_cache_dir', args.feature_cache_dir]
 
     full_log = out_file + ".log";
     print("Writing the log of localization to: " + full_log)
@@ -231,6 +233,9 @@ def parse_args():
                         help = "Break early when we have this many landmarks during localization.")
     parser.add_argument('-histogram_equalization', dest='histogram_equalization',
                         action='store_true', required = False)
+    parser.add_argument("-feature_cache_dir", type=str, required = False, default = "",
+                        help = "Keep the features of the images in this directory, so that " + \
+                        "each localization attempt does not detect them again.")
     
     parser.add_argument("-num_similar", type=int, required = False, default = 20,
                         help = "Use in localization this many images which " + \
@@ -0,0 +1,141 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Queries the vocabulary database of a map with the descriptors of each of
+// its images, with the flat database and with DBoW2, and compares the time
+// per image and the images found.
+
+#include <ff_common/init.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/flat_vocab_db.h>
+#include <sparse_mapping/vocab_tree.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+DEFINE_int32(passes, 3, "Number of times to query each image.");
+DECLARE_int32(num_similar);  // defined in sparse_map.cc
+
+namespace {
+
+struct Times {
+  std::vector<double> us;
+
+  template <typename F>
+  void Time(F query) {
+    auto start = std::chrono::steady_clock::now();
+    query();
+    us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+  }
+
+  void Print(const char* name) {
+    if (us.empty())
+      return;
+    std::sort(us.begin(), us.end());
+    double mean = 0;
+    for (double t : us)
+      mean += t;
+    mean /= us.size();
+    printf("%-6s %10.1f %10.1f %10.1f %10.1f\n", name, mean, us[us.size() / 2],
+           us[std::min(us.size() - 1, static_cast<size_t>(0.99 * us.size()))], us.back());
+  }
+};
+
+// The same images with the same scores, in any order among equal scores
+bool SameUpToTies(std::vector<int> const& a, std::vector<double> const& a_scores,
+                  std::vector<int> const& b, std::vector<double> const& b_scores) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a_scores[i] != b_scores[i])
+      return false;
+    if (a[i] == b[i])
+      continue;
+    // a[i] must be in b, with the same score
+    bool found = false;
+    for (size_t j = 0; j < b.size() && !found; j++)
+      found = (b[j] == a[i] && b_scores[j] == a_scores[i]);
+    if (!found)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  if (argc < 2) {
+    LOG(ERROR) << "Usage: " << argv[0] << " [--passes n] [--num_similar k] map.map";
+    return 1;
+  }
+
+  sparse_mapping::SparseMap map(argv[1]);
+  sparse_mapping::VocabDB & db = map.vocab_db_;
+  if (map.GetNumFrames() == 0 || db.binary_db == NULL) {
+    LOG(ERROR) << argv[1] << " has no vocabulary database.";
+    return 1;
+  }
+  if (db.flat_db == NULL) {
+    LOG(ERROR) << "The vocabulary database of " << argv[1] << " could not be flattened.";
+    return 1;
+  }
+  std::string detector = map.GetDetectorName();
+  LOG(INFO) << "Querying " << map.GetNumFrames() << " images for the " << FLAGS_num_similar
+            << " most similar, vocabulary of " << db.flat_db->NumNodes() << " nodes.";
+
+  Times flat_times, dbow2_times;
+  int same = 0, same_up_to_ties = 0, different = 0;
+  for (int pass = 0; pass < FLAGS_passes; pass++) {
+    for (size_t cid = 0; cid < map.GetNumFrames(); cid++) {
+      cv::Mat const& descriptors = map.cid_to_descriptor_map_[cid];
+      std::vector<int> flat, dbow2;
+      std::vector<double> flat_scores, dbow2_scores;
+      flat_times.Time([&]() { db.flat_db->Query(descriptors, FLAGS_num_similar, &flat, &flat_scores); });
+      dbow2_times.Time([&]() {
+          sparse_mapping::QueryDBoW2(detector, &db, FLAGS_num_similar, descriptors, &dbow2, &dbow2_scores);
+        });
+      if (pass > 0)
+        continue;
+      if (flat == dbow2 && flat_scores == dbow2_scores) {
+        same++;
+      } else if (SameUpToTies(flat, flat_scores, dbow2, dbow2_scores)) {
+        same_up_to_ties++;
+      } else {
+        different++;
+        LOG(WARNING) << "Image " << cid << " " << map.GetFrameFilename(cid)
+                     << " finds different images with the flat database.";
+      }
+    }
+  }
+
+  printf("%-6s %10s %10s %10s %10s\n", "", "mean_us", "p50_us", "p99_us", "max_us");
+  flat_times.Print("flat");
+  dbow2_times.Print("dbow2");
+  printf("images with the same top %d: %d, same up to ties: %d, different: %d\n", FLAGS_num_similar, same,
+         same_up_to_ties, different);
+  return different == 0 ? 0 : 1;
+}
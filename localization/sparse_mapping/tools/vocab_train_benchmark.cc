@@ -0,0 +1,132 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Builds the vocabulary database of a map with DBoW2's trainer and with the
+// parallel one, and compares the build time and how well each finds the
+// images that see the same landmarks as the image queried. The map is not
+// changed.
+
+#include <ff_common/init.h>
+#include <ff_common/thread.h>
+#include <sparse_mapping/sparse_map.h>
+#include <sparse_mapping/vocab_tree.h>
+#include <sparse_mapping/flat_vocab_db.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+DEFINE_int32(db_depth, 6, "Depth of the tree to build.");
+DEFINE_int32(db_branching_factor, 10, "Branching factor of the tree to build.");
+DEFINE_int32(db_restarts, 1, "Number of restarts when building the tree.");
+DEFINE_int32(min_shared_landmarks, 10,
+             "Images that see this many of the same landmarks as the image queried should be found.");
+DECLARE_int32(num_similar);  // defined in sparse_map.cc
+DECLARE_bool(vocab_db_dbow2_trainer);  // defined in vocab_tree.cc
+
+namespace {
+
+struct Quality {
+  int queries = 0;
+  int self_first = 0;     // the image queried is the best match
+  double precision = 0;   // of the other images found, how many see the same landmarks
+  double recall = 0;      // of the images that see the same landmarks, how many were found
+};
+
+Quality Evaluate(sparse_mapping::SparseMap* map, std::vector<std::set<int> > const& overlapping) {
+  Quality q;
+  std::string detector = map->GetDetectorName();
+  for (size_t cid = 0; cid < map->GetNumFrames(); cid++) {
+    std::vector<int> indices;
+    sparse_mapping::QueryDB(detector, &map->vocab_db_, FLAGS_num_similar + 1,
+                            map->cid_to_descriptor_map_[cid], &indices);
+    q.queries++;
+    if (!indices.empty() && indices[0] == static_cast<int>(cid))
+      q.self_first++;
+    int found = 0, others = 0;
+    for (int i : indices) {
+      if (i == static_cast<int>(cid))
+        continue;
+      others++;
+      found += overlapping[cid].count(i);
+    }
+    if (others > 0)
+      q.precision += static_cast<double>(found) / others;
+    if (!overlapping[cid].empty())
+      q.recall += static_cast<double>(found) / std::min<size_t>(overlapping[cid].size(), FLAGS_num_similar);
+  }
+  if (q.queries > 0) {
+    q.precision /= q.queries;
+    q.recall /= q.queries;
+  }
+  return q;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  if (argc < 2) {
+    LOG(ERROR) << "Usage: " << argv[0] << " [--db_depth d] [--db_branching_factor k] "
+               << "[--num_threads t] map.map";
+    return 1;
+  }
+
+  sparse_mapping::SparseMap map(argv[1]);
+  std::string detector = map.GetDetectorName();
+
+  // The images that see at least min_shared_landmarks of the same landmarks
+  std::vector<std::map<int, int> > shared(map.GetNumFrames());
+  for (std::map<int, int> const& track : map.pid_to_cid_fid_)
+    for (auto const& a : track)
+      for (auto const& b : track)
+        if (a.first != b.first)
+          shared[a.first][b.first]++;
+  std::vector<std::set<int> > overlapping(map.GetNumFrames());
+  for (size_t cid = 0; cid < shared.size(); cid++)
+    for (auto const& s : shared[cid])
+      if (s.second >= FLAGS_min_shared_landmarks)
+        overlapping[cid].insert(s.first);
+
+  LOG(INFO) << "Building vocabulary databases of depth " << FLAGS_db_depth << " and branching factor "
+            << FLAGS_db_branching_factor << " for " << map.GetNumFrames() << " images on "
+            << FLAGS_num_threads << " threads.";
+  printf("%-9s %10s %8s %10s %10s %10s\n", "trainer", "build_s", "nodes", "self_top1", "precision", "recall");
+  for (bool dbow2 : {true, false}) {
+    FLAGS_vocab_db_dbow2_trainer = dbow2;
+    sparse_mapping::ResetDB(&map.vocab_db_);
+    auto start = std::chrono::steady_clock::now();
+    sparse_mapping::BuildDBforDBoW2(&map, detector, FLAGS_db_depth, FLAGS_db_branching_factor,
+                                    FLAGS_db_restarts);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Quality q = Evaluate(&map, overlapping);
+    int nodes = (map.vocab_db_.flat_db != NULL) ? map.vocab_db_.flat_db->NumNodes() : 0;
+    printf("%-9s %10.2f %8d %9.1f%% %9.1f%% %9.1f%%\n", dbow2 ? "dbow2" : "parallel", seconds, nodes,
+           100.0 * q.self_first / std::max(q.queries, 1), 100.0 * q.precision, 100.0 * q.recall);
+  }
+  return 0;
+}
@@ -139,6 +139,19 @@ class PlannerImplementation : public ff_util::FreeFlyerNodelet {
     }
     return false;
   }
+  // Only return the obstacles inside the bounding box [min, max]
+  bool GetObstacleMap(pcl::PointCloud<pcl::PointXYZ> *points, float *resolution,
+                      geometry_msgs::Point const& min, geometry_msgs::Point const& max) {
+    ff_msgs::GetMap srv;
+    srv.request.bbx_min = min;
+    srv.request.bbx_max = max;
+    if (client_o_.Call(srv)) {
+      pcl::fromROSMsg(srv.response.points, *points);
+      *resolution = srv.response.resolution;
+      return true;
+    }
+    return false;
+  }
 
  private:
   void Initialize(ros::NodeHandle *nh) {
@@ -35,6 +35,9 @@
 #include <ff_msgs/SetZones.h>
 #include <ff_msgs/GetZones.h>
 
+// Zone spatial index
+#include <choreographer/zone_index.h>
+
 // STL includes
 #include <string>
 
@@ -66,14 +69,12 @@ class Validator {
     ff_msgs::FlightMode const& flight_mode, bool face_forward);
 
  protected:
+  // Rebuild the spatial index after the zones changed
+  void IndexZones();
+
   // Markers for keep in / keep out zones
   void PublishMarkers();
 
-  // Check if a point is inside a cuboid
-  bool PointInsideCuboid(geometry_msgs::Point const& x,
-                         geometry_msgs::Vector3 const& cubemin,
-                         geometry_msgs::Vector3 const& cubemax);
-
   // Callback to get the keep in/out zones
   bool GetZonesCallback(ff_msgs::GetZones::Request& req,
                        ff_msgs::GetZones::Response& res);
@@ -86,6 +87,8 @@ class Validator {
   std::string zone_file_;                             // Zone file path
   bool overwrite_;                                    // New zones overwrite
   ff_msgs::SetZones::Request zones_;                  // Zones
+  ZoneIndex keepin_;                                  // Keep-in index
+  ZoneIndex keepout_;                                 // Keep-out index
   ros::Publisher pub_zones_;                          // Zone publisher
   ros::ServiceServer get_zones_srv_;                  // Set zone service
   ros::ServiceServer set_zones_srv_;                  // Set zone service
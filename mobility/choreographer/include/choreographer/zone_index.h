@@ -0,0 +1,92 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef CHOREOGRAPHER_ZONE_INDEX_H_
+#define CHOREOGRAPHER_ZONE_INDEX_H_
+
+// FSW messages
+#include <ff_msgs/Zone.h>
+
+// Eigen
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+// STL includes
+#include <utility>
+#include <vector>
+
+namespace choreographer {
+
+// Bounding volume hierarchy over the cuboids of one zone type. It is built
+// once when the zones change and answers exact queries about the straight
+// segment between two consecutive setpoints, so nothing can slip through
+// between samples.
+class ZoneIndex {
+ public:
+  // Index the zones of the given type, dropping any previous content
+  void Build(std::vector<ff_msgs::Zone> const& zones, uint8_t type);
+
+  // Whether there are no zones of the indexed type
+  bool Empty() const { return boxes_.empty(); }
+
+  // Whether the segment from a to b touches any zone (boundaries included)
+  bool Intersects(Eigen::Vector3d const& a, Eigen::Vector3d const& b) const;
+
+  // Whether every point of the segment from a to b lies inside the union of
+  // the zones (boundaries included)
+  bool Covers(Eigen::Vector3d const& a, Eigen::Vector3d const& b) const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  // Axis aligned box
+  struct Box {
+    Eigen::Vector3d min, max;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Node of the hierarchy. Leaves reference a run of boxes_, inner nodes
+  // their two children, which are stored next to each other.
+  struct Node {
+    Box bounds;
+    int first;    // First box (leaf) or first child (inner)
+    int count;    // Number of boxes, zero for inner nodes
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Fill node index with boxes_[first, first + count), splitting recursively
+  void BuildNode(int index, int first, int count);
+
+  // Parameter interval [t0, t1] of the segment a + t (b - a), t in [0, 1],
+  // that lies inside the box. Returns false if the segment misses the box.
+  static bool Clip(Box const& box, Eigen::Vector3d const& a,
+                   Eigen::Vector3d const& d, double *t0, double *t1);
+
+  // Call f with the clipped interval of every box the segment touches. The
+  // traversal stops as soon as f returns true, which is then returned.
+  template <typename Function>
+  bool Visit(Eigen::Vector3d const& a, Eigen::Vector3d const& b,
+             Function f) const;
+
+  std::vector<Box, Eigen::aligned_allocator<Box>> boxes_;
+  std::vector<Node, Eigen::aligned_allocator<Node>> nodes_;
+};
+
+}  // namespace choreographer
+
+#endif  // CHOREOGRAPHER_ZONE_INDEX_H_
@@ -18,24 +18,11 @@
 
 #include <choreographer/validator.h>
 
+#include <algorithm>
 #include <vector>
 
 namespace choreographer {
 
-// Check if a point is inside a cuboid
-bool Validator::PointInsideCuboid(geometry_msgs::Point const& x,
-                                      geometry_msgs::Vector3 const& cubemin,
-                                      geometry_msgs::Vector3 const& cubemax) {
-  if (x.x < std::min(cubemin.x, cubemax.x) ||
-      x.y < std::min(cubemin.y, cubemax.y) ||
-      x.z < std::min(cubemin.z, cubemax.z) ||
-      x.x > std::max(cubemin.x, cubemax.x) ||
-      x.y > std::max(cubemin.y, cubemax.y) ||
-      x.z > std::max(cubemin.z, cubemax.z))
-    return false;
-  return true;
-}
-
 // Check that we are within a keep in and outside all keep out zones
 Validator::Response Validator::CheckSegment(ff_util::Segment const& msg,
   ff_msgs::FlightMode const& flight_mode, bool face_forward) {
@@ -71,32 +58,32 @@ Validator::Response Validator::CheckSegment(ff_util::Segment const& msg,
   default:
     break;
   }
-  // Now, check each setpoint in the segment against the zones
-  ff_util::Segment::const_iterator it;
-  for (it = seg.begin(); it != seg.end(); it++) {
-    std::vector<ff_msgs::Zone>::iterator jt;
-    // We must visit at least one keepin to be valid
-    bool point_exists_within_keepin = false;
-    for (jt = zones_.zones.begin(); jt != zones_.zones.end(); jt++) {
-      if (jt->type == ff_msgs::Zone::KEEPIN)
-        if (PointInsideCuboid(it->pose.position, jt->min, jt->max))
-          point_exists_within_keepin = true;
-      if (jt->type == ff_msgs::Zone::KEEPOUT) {
-        if (PointInsideCuboid(it->pose.position, jt->min, jt->max)) {
-          ROS_DEBUG_STREAM("KEEPOUT violation at time" << it->when.toSec());
-          ROS_DEBUG_STREAM(it->pose.position);
-          ROS_DEBUG_STREAM(zones_);
-          return VIOLATES_KEEP_OUT;
-        }
-      }
+  // Now, sweep the straight path between consecutive setpoints through the
+  // zones, so that no violation can hide between two samples
+  for (size_t i = 0; i < seg.size(); i++) {
+    size_t j = std::min(i + 1, seg.size() - 1);
+    geometry_msgs::Point const& p = seg[i].pose.position;
+    geometry_msgs::Point const& q = seg[j].pose.position;
+    Eigen::Vector3d a(p.x, p.y, p.z), b(q.x, q.y, q.z);
+    if (keepout_.Intersects(a, b)) {
+      ROS_DEBUG_STREAM("KEEPOUT violation at time" << seg[i].when.toSec());
+      ROS_DEBUG_STREAM(p);
+      ROS_DEBUG_STREAM(zones_);
+      return VIOLATES_KEEP_OUT;
     }
-    // Check that we are in a keepin
-    if (!point_exists_within_keepin)
+    // We must stay within the union of the keepins to be valid
+    if (!keepin_.Covers(a, b))
       return VIOLATES_KEEP_IN;
   }
   return SUCCESS;
 }
 
+// Rebuild the spatial index of the zones
+void Validator::IndexZones() {
+  keepin_.Build(zones_.zones, ff_msgs::Zone::KEEPIN);
+  keepout_.Build(zones_.zones, ff_msgs::Zone::KEEPOUT);
+}
+
 // Load the keep in and keepout zones into memory
 bool Validator::Init(ros::NodeHandle *nh, ff_util::ConfigServer & cfg) {
   // Create the zone publisher and service getter/setter
@@ -114,6 +101,7 @@ bool Validator::Init(ros::NodeHandle *nh, ff_util::ConfigServer & cfg) {
   if (!ff_util::Serialization::ReadFile(zone_file_, zones_)) {
     ROS_WARN_STREAM("Cannot open zone file " << zone_file_);
   } else {
+    IndexZones();
     PublishMarkers();
   }
   // Success
@@ -187,6 +175,7 @@ bool Validator::SetZonesCallback(
   ff_msgs::SetZones::Request &req, ff_msgs::SetZones::Response &res) {
   // Update the zones
   zones_ = req;
+  IndexZones();
   // If we should write the new zones to a file and use them by default
   if (overwrite_ && !ff_util::Serialization::WriteFile(zone_file_, zones_))
     ROS_WARN_STREAM("Cannot write zone file " << zone_file_);
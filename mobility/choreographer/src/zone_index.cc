@@ -0,0 +1,156 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <choreographer/zone_index.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace choreographer {
+
+namespace {
+
+// Boxes per leaf, below this a linear scan is faster than descending further
+constexpr int kLeafSize = 4;
+
+// Tolerance when checking that the keep-in intervals leave no gap
+constexpr double kGap = 1e-9;
+
+}  // namespace
+
+void ZoneIndex::Build(std::vector<ff_msgs::Zone> const& zones, uint8_t type) {
+  boxes_.clear();
+  nodes_.clear();
+  for (auto const& zone : zones) {
+    if (zone.type != type) continue;
+    // Zone corners are not guaranteed to be ordered
+    Box box;
+    box.min << std::min(zone.min.x, zone.max.x),
+      std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
+    box.max << std::max(zone.min.x, zone.max.x),
+      std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
+    boxes_.push_back(box);
+  }
+  if (boxes_.empty()) return;
+  nodes_.resize(1);
+  BuildNode(0, 0, boxes_.size());
+}
+
+void ZoneIndex::BuildNode(int index, int first, int count) {
+  Box bounds = boxes_[first];
+  Eigen::Vector3d cmin = 0.5 * (bounds.min + bounds.max), cmax = cmin;
+  for (int i = first; i < first + count; i++) {
+    bounds.min = bounds.min.cwiseMin(boxes_[i].min);
+    bounds.max = bounds.max.cwiseMax(boxes_[i].max);
+    Eigen::Vector3d c = 0.5 * (boxes_[i].min + boxes_[i].max);
+    cmin = cmin.cwiseMin(c);
+    cmax = cmax.cwiseMax(c);
+  }
+  nodes_[index].bounds = bounds;
+  if (count <= kLeafSize) {
+    nodes_[index].first = first;
+    nodes_[index].count = count;
+    return;
+  }
+  // Median split along the axis where the box centers spread the most
+  int axis;
+  (cmax - cmin).maxCoeff(&axis);
+  const int half = count / 2;
+  std::nth_element(boxes_.begin() + first, boxes_.begin() + first + half,
+    boxes_.begin() + first + count, [axis](Box const& l, Box const& r) {
+      return l.min(axis) + l.max(axis) < r.min(axis) + r.max(axis);
+    });
+  // Both children are allocated together, so only the first one is stored
+  const int left = nodes_.size();
+  nodes_.resize(nodes_.size() + 2);
+  nodes_[index].first = left;
+  nodes_[index].count = 0;
+  BuildNode(left, first, half);
+  BuildNode(left + 1, first + half, count - half);
+}
+
+bool ZoneIndex::Clip(Box const& box, Eigen::Vector3d const& a,
+                     Eigen::Vector3d const& d, double *t0, double *t1) {
+  *t0 = 0.0;
+  *t1 = 1.0;
+  for (int i = 0; i < 3; i++) {
+    if (d(i) == 0.0) {
+      if (a(i) < box.min(i) || a(i) > box.max(i)) return false;
+      continue;
+    }
+    double lo = (box.min(i) - a(i)) / d(i);
+    double hi = (box.max(i) - a(i)) / d(i);
+    if (lo > hi) std::swap(lo, hi);
+    *t0 = std::max(*t0, lo);
+    *t1 = std::min(*t1, hi);
+    if (*t0 > *t1) return false;
+  }
+  return true;
+}
+
+template <typename Function>
+bool ZoneIndex::Visit(Eigen::Vector3d const& a, Eigen::Vector3d const& b,
+                      Function f) const {
+  if (nodes_.empty()) return false;
+  const Eigen::Vector3d d = b - a;
+  double t0, t1;
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    Node const& node = nodes_[stack[--top]];
+    if (!Clip(node.bounds, a, d, &t0, &t1)) continue;
+    if (node.count == 0) {
+      stack[top++] = node.first;
+      stack[top++] = node.first + 1;
+      continue;
+    }
+    for (int i = node.first; i < node.first + node.count; i++)
+      if (Clip(boxes_[i], a, d, &t0, &t1) && f(t0, t1))
+        return true;
+  }
+  return false;
+}
+
+bool ZoneIndex::Intersects(Eigen::Vector3d const& a,
+                           Eigen::Vector3d const& b) const {
+  return Visit(a, b, [](double, double) { return true; });
+}
+
+bool ZoneIndex::Covers(Eigen::Vector3d const& a,
+                       Eigen::Vector3d const& b) const {
+  // In the usual case a single zone holds the whole segment
+  std::vector<std::pair<double, double>> intervals;
+  if (Visit(a, b, [&intervals](double t0, double t1) {
+      intervals.emplace_back(t0, t1);
+      return t0 <= kGap && t1 >= 1.0 - kGap;
+    }))
+    return true;
+  // Otherwise the union of the pieces must leave no gap
+  std::sort(intervals.begin(), intervals.end());
+  double reached = 0.0;
+  for (auto const& interval : intervals) {
+    if (interval.first > reached + kGap) return false;
+    reached = std::max(reached, interval.second);
+    if (reached >= 1.0 - kGap) return true;
+  }
+  return false;
+}
+
+}  // namespace choreographer
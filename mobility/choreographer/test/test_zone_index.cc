@@ -0,0 +1,179 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Required for the test framework
+#include <gtest/gtest.h>
+
+// Class under test
+#include <choreographer/zone_index.h>
+
+// C++ STL includes
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+ff_msgs::Zone MakeZone(uint8_t type, Eigen::Vector3d const& a,
+                       Eigen::Vector3d const& b) {
+  ff_msgs::Zone zone;
+  zone.type = type;
+  zone.min.x = a.x();
+  zone.min.y = a.y();
+  zone.min.z = a.z();
+  zone.max.x = b.x();
+  zone.max.y = b.y();
+  zone.max.z = b.z();
+  return zone;
+}
+
+bool Inside(ff_msgs::Zone const& zone, Eigen::Vector3d const& p) {
+  return p.x() >= std::min(zone.min.x, zone.max.x) &&
+         p.x() <= std::max(zone.min.x, zone.max.x) &&
+         p.y() >= std::min(zone.min.y, zone.max.y) &&
+         p.y() <= std::max(zone.min.y, zone.max.y) &&
+         p.z() >= std::min(zone.min.z, zone.max.z) &&
+         p.z() <= std::max(zone.min.z, zone.max.z);
+}
+
+// Sample the segment densely and test every sample against every zone, as
+// the validator did before it had an index
+void BruteForce(std::vector<ff_msgs::Zone> const& zones, uint8_t type,
+                Eigen::Vector3d const& a, Eigen::Vector3d const& b,
+                bool *intersects, bool *covers) {
+  static constexpr int kSamples = 1000;
+  *intersects = false;
+  *covers = true;
+  for (int i = 0; i <= kSamples; i++) {
+    Eigen::Vector3d p = a + (b - a) * i / kSamples;
+    bool inside = false;
+    for (auto const& zone : zones)
+      if (zone.type == type && Inside(zone, p)) inside = true;
+    *intersects |= inside;
+    *covers &= inside;
+  }
+}
+
+}  // namespace
+
+TEST(ZoneIndex, Empty) {
+  choreographer::ZoneIndex index;
+  EXPECT_TRUE(index.Empty());
+  EXPECT_FALSE(index.Intersects(Eigen::Vector3d(0, 0, 0),
+                                Eigen::Vector3d(1, 1, 1)));
+  EXPECT_FALSE(index.Covers(Eigen::Vector3d(0, 0, 0),
+                            Eigen::Vector3d(1, 1, 1)));
+  // Zones of other types are not indexed
+  std::vector<ff_msgs::Zone> zones = {
+    MakeZone(ff_msgs::Zone::KEEPOUT, Eigen::Vector3d(0, 0, 0),
+             Eigen::Vector3d(1, 1, 1))};
+  index.Build(zones, ff_msgs::Zone::KEEPIN);
+  EXPECT_TRUE(index.Empty());
+}
+
+TEST(ZoneIndex, SingleBox) {
+  // Corners given in the wrong order must still make a valid box
+  std::vector<ff_msgs::Zone> zones = {
+    MakeZone(ff_msgs::Zone::KEEPIN, Eigen::Vector3d(1, 1, 1),
+             Eigen::Vector3d(-1, -1, -1))};
+  choreographer::ZoneIndex index;
+  index.Build(zones, ff_msgs::Zone::KEEPIN);
+  ASSERT_FALSE(index.Empty());
+  // Inside, crossing the boundary, outside, and touching it
+  EXPECT_TRUE(index.Covers(Eigen::Vector3d(-0.5, 0, 0),
+                           Eigen::Vector3d(0.5, 0.5, 0)));
+  EXPECT_TRUE(index.Intersects(Eigen::Vector3d(0, 0, 0),
+                               Eigen::Vector3d(2, 0, 0)));
+  EXPECT_FALSE(index.Covers(Eigen::Vector3d(0, 0, 0),
+                            Eigen::Vector3d(2, 0, 0)));
+  EXPECT_FALSE(index.Intersects(Eigen::Vector3d(2, 2, 2),
+                                Eigen::Vector3d(3, 2, 2)));
+  EXPECT_TRUE(index.Intersects(Eigen::Vector3d(1, 1, 1),
+                               Eigen::Vector3d(2, 2, 2)));
+  // A segment with both ends outside that cuts across a corner
+  EXPECT_TRUE(index.Intersects(Eigen::Vector3d(-2, 0.9, 0),
+                               Eigen::Vector3d(0.9, -2, 0)));
+  // A point segment
+  EXPECT_TRUE(index.Covers(Eigen::Vector3d(0, 0, 0),
+                           Eigen::Vector3d(0, 0, 0)));
+}
+
+TEST(ZoneIndex, CoversAcrossAdjacentBoxes) {
+  // Two keep-ins that share a face cover a segment crossing it, while a
+  // small gap between them does not
+  std::vector<ff_msgs::Zone> zones = {
+    MakeZone(ff_msgs::Zone::KEEPIN, Eigen::Vector3d(0, 0, 0),
+             Eigen::Vector3d(1, 1, 1)),
+    MakeZone(ff_msgs::Zone::KEEPIN, Eigen::Vector3d(1, 0, 0),
+             Eigen::Vector3d(2, 1, 1)),
+    MakeZone(ff_msgs::Zone::KEEPIN, Eigen::Vector3d(2.01, 0, 0),
+             Eigen::Vector3d(3, 1, 1))};
+  choreographer::ZoneIndex index;
+  index.Build(zones, ff_msgs::Zone::KEEPIN);
+  EXPECT_TRUE(index.Covers(Eigen::Vector3d(0.5, 0.5, 0.5),
+                           Eigen::Vector3d(1.5, 0.5, 0.5)));
+  EXPECT_FALSE(index.Covers(Eigen::Vector3d(1.5, 0.5, 0.5),
+                            Eigen::Vector3d(2.5, 0.5, 0.5)));
+  EXPECT_TRUE(index.Intersects(Eigen::Vector3d(1.5, 0.5, 0.5),
+                               Eigen::Vector3d(2.5, 0.5, 0.5)));
+}
+
+TEST(ZoneIndex, MatchesBruteForce) {
+  // Enough boxes for a hierarchy several levels deep, with random segments
+  // checked against dense sampling. Sampling can miss a segment that only
+  // grazes a box between two samples, so a few disagreements are allowed,
+  // but only in the direction the index is exact.
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> pos(-5.0, 5.0), size(0.1, 2.0);
+  std::vector<ff_msgs::Zone> zones;
+  for (int i = 0; i < 60; i++) {
+    Eigen::Vector3d a(pos(rng), pos(rng), pos(rng));
+    Eigen::Vector3d b = a + Eigen::Vector3d(size(rng), size(rng), size(rng));
+    zones.push_back(MakeZone(i % 3 == 0 ? ff_msgs::Zone::KEEPOUT
+                                        : ff_msgs::Zone::KEEPIN, a, b));
+  }
+  for (uint8_t type : {ff_msgs::Zone::KEEPOUT, ff_msgs::Zone::KEEPIN}) {
+    choreographer::ZoneIndex index;
+    index.Build(zones, type);
+    int checked = 0;
+    for (int i = 0; i < 200; i++) {
+      Eigen::Vector3d a(pos(rng), pos(rng), pos(rng));
+      Eigen::Vector3d b = a + 0.5 * Eigen::Vector3d(pos(rng), pos(rng),
+                                                    pos(rng));
+      bool intersects, covers;
+      BruteForce(zones, type, a, b, &intersects, &covers);
+      if (intersects) {
+        EXPECT_TRUE(index.Intersects(a, b)) << "segment " << i;
+      }
+      if (!covers) {
+        EXPECT_FALSE(index.Covers(a, b)) << "segment " << i;
+      }
+      if (index.Intersects(a, b) == intersects &&
+          index.Covers(a, b) == covers)
+        checked++;
+    }
+    // Almost all segments agree exactly
+    EXPECT_GT(checked, 195);
+  }
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
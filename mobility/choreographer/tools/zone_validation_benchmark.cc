@@ -0,0 +1,162 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Measures zone validation of long segments against the number of zones. The
+// legacy check (every 10Hz setpoint against every zone) is compared with the
+// sweep of the straight path between setpoints through the zone index. The
+// number of segments each one accepts is reported too: the sweep may accept
+// fewer, as it also catches the corners the legacy check misses between
+// samples.
+
+#include <choreographer/zone_index.h>
+#include <ff_common/init.h>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+DEFINE_int32(segments, 50, "Number of random segments per zone set");
+DEFINE_int32(setpoints, 600, "Setpoints per segment, at 10Hz");
+DEFINE_int32(max_zones, 2000, "Largest number of zones");
+DEFINE_double(side, 20.0, "Side of the cube containing the zones, in meters");
+
+DECLARE_bool(logtostderr);
+
+namespace {
+
+typedef std::vector<Eigen::Vector3d,
+  Eigen::aligned_allocator<Eigen::Vector3d>> Path;
+
+double Millis(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> dt =
+    std::chrono::steady_clock::now() - start;
+  return dt.count();
+}
+
+bool Inside(Eigen::Vector3d const& p, ff_msgs::Zone const& z) {
+  return !(p.x() < std::min(z.min.x, z.max.x) ||
+           p.y() < std::min(z.min.y, z.max.y) ||
+           p.z() < std::min(z.min.z, z.max.z) ||
+           p.x() > std::max(z.min.x, z.max.x) ||
+           p.y() > std::max(z.min.y, z.max.y) ||
+           p.z() > std::max(z.min.z, z.max.z));
+}
+
+// The check the validator used to run on every setpoint
+bool LegacyValid(Path const& path, std::vector<ff_msgs::Zone> const& zones) {
+  for (auto const& p : path) {
+    bool keepin = false;
+    for (auto const& z : zones) {
+      if (z.type == ff_msgs::Zone::KEEPIN && Inside(p, z))
+        keepin = true;
+      if (z.type == ff_msgs::Zone::KEEPOUT && Inside(p, z))
+        return false;
+    }
+    if (!keepin) return false;
+  }
+  return true;
+}
+
+bool SweepValid(Path const& path, choreographer::ZoneIndex const& keepin,
+                choreographer::ZoneIndex const& keepout) {
+  for (size_t i = 0; i + 1 < path.size(); i++) {
+    if (keepout.Intersects(path[i], path[i + 1])) return false;
+    if (!keepin.Covers(path[i], path[i + 1])) return false;
+  }
+  return true;
+}
+
+ff_msgs::Zone Zone(uint8_t type, Eigen::Vector3d const& min,
+                   Eigen::Vector3d const& max) {
+  ff_msgs::Zone zone;
+  zone.type = type;
+  zone.min.x = min.x();
+  zone.min.y = min.y();
+  zone.min.z = min.z();
+  zone.max.x = max.x();
+  zone.max.y = max.y();
+  zone.max.z = max.z();
+  return zone;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = true;
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  const double side = FLAGS_side;
+
+  printf("%8s %10s %12s %12s %12s %12s\n", "zones", "build_ms",
+         "legacy_ms", "sweep_ms", "legacy_ok", "sweep_ok");
+  for (int n = 16; n <= FLAGS_max_zones; n *= 2) {
+    // Overlapping keep-in slabs that tile the volume, then small keep-outs
+    std::vector<ff_msgs::Zone> zones;
+    const int num_keepin = n / 4;
+    const double slab = side / num_keepin;
+    for (int i = 0; i < num_keepin; i++)
+      zones.push_back(Zone(ff_msgs::Zone::KEEPIN,
+        Eigen::Vector3d(i * slab - 0.01, 0.0, 0.0),
+        Eigen::Vector3d((i + 1) * slab + 0.01, side, side)));
+    while (static_cast<int>(zones.size()) < n) {
+      Eigen::Vector3d c(side * unit(gen), side * unit(gen), side * unit(gen));
+      Eigen::Vector3d h(0.05 + 0.2 * unit(gen), 0.05 + 0.2 * unit(gen),
+                        0.05 + 0.2 * unit(gen));
+      zones.push_back(Zone(ff_msgs::Zone::KEEPOUT, c - h, c + h));
+    }
+
+    // Random walks at up to half a meter per second, sampled at 10Hz
+    std::vector<Path> paths(FLAGS_segments);
+    for (auto &path : paths) {
+      Eigen::Vector3d p(side * unit(gen), side * unit(gen), side * unit(gen));
+      Eigen::Vector3d v = Eigen::Vector3d::Zero();
+      for (int i = 0; i < FLAGS_setpoints; i++) {
+        v += 0.01 * Eigen::Vector3d(unit(gen) - 0.5, unit(gen) - 0.5,
+                                    unit(gen) - 0.5);
+        if (v.norm() > 0.5) v *= 0.5 / v.norm();
+        p += 0.1 * v;
+        path.push_back(p);
+      }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    choreographer::ZoneIndex keepin, keepout;
+    keepin.Build(zones, ff_msgs::Zone::KEEPIN);
+    keepout.Build(zones, ff_msgs::Zone::KEEPOUT);
+    double build_ms = Millis(start);
+
+    int legacy_ok = 0, sweep_ok = 0;
+    start = std::chrono::steady_clock::now();
+    for (auto const& path : paths) legacy_ok += LegacyValid(path, zones);
+    double legacy_ms = Millis(start) / paths.size();
+    start = std::chrono::steady_clock::now();
+    for (auto const& path : paths) sweep_ok += SweepValid(path, keepin, keepout);
+    double sweep_ms = Millis(start) / paths.size();
+
+    printf("%8d %10.3f %12.3f %12.3f %12d %12d\n", n, build_ms, legacy_ms,
+           sweep_ms, legacy_ok, sweep_ok);
+  }
+  return 0;
+}
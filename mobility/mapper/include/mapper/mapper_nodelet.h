@@ -143,6 +143,11 @@ class MapperNodelet : public ff_util::FreeFlyerNodelet {
   bool GetObstacleMapCallback(ff_msgs::GetMap::Request& req,
                               ff_msgs::GetMap::Response& res);
 
+  // Shared implementation of the map services
+  void ExportMap(ff_msgs::GetMap::Request const& req,
+                 bool free,
+                 ff_msgs::GetMap::Response &res);
+
   // Threads (see threads.cpp for implementation) -----------------
   // Thread for fading memory of the octomap
   void FadeTask(ros::TimerEvent const& event);
@@ -95,6 +95,15 @@ class OctoClass{
                           sensor_msgs::PointCloud2* obstacles_cloud,
                           sensor_msgs::PointCloud2* free_cloud);
   // void freeVisMarkers(visualization_msgs::MarkerArray* marker_array);
+
+  // Export methods: write the centers of the occupied (or free) leaves of the
+  // inflated tree straight into a cloud, without building any markers
+  void InflatedMapCloud(const bool occupied,
+                        sensor_msgs::PointCloud2* cloud);
+  void InflatedMapCloud(const bool occupied,
+                        const Eigen::Vector3d &box_min,
+                        const Eigen::Vector3d &box_max,
+                        sensor_msgs::PointCloud2* cloud);
   // void inflatedFreeVisMarkers(visualization_msgs::MarkerArray* marker_array);
 
   // Useful methods
@@ -150,6 +159,10 @@ class OctoClass{
   float inflate_radius_;
   std::vector<Eigen::Vector3d> sphere_;  // Discretized sphere used in map inflation
   std::vector<double> depth_volumes_;     // Volume per depth in the tree
+  std::vector<float> export_buffer_;      // Reused storage for map exports
+
+  // Copies the export buffer into a xyz point cloud message
+  void ExportBufferToCloud(sensor_msgs::PointCloud2* cloud);
 
   // Methods
   double VectorNormSquared(const double &x,
@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <vector>
 #include <limits>
+#include <cstring>
 
 namespace octoclass {
 
@@ -625,6 +626,70 @@ void OctoClass::InflatedVisMarkers(visualization_msgs::MarkerArray* obstacles,
   obstacles_cloud->header.frame_id = "world";
 }
 
+// Export the centers of all occupied/free leaves of the inflated tree
+void OctoClass::InflatedMapCloud(const bool occupied,
+                                 sensor_msgs::PointCloud2* cloud) {
+  // The buffer keeps its capacity between calls, so after the first export
+  // the only allocation left is the message payload itself
+  export_buffer_.clear();
+  for (octomap::OcTree::leaf_iterator it = tree_inflated_.begin_leafs(),
+                                     end= tree_inflated_.end_leafs();
+                                     it!= end; ++it) {
+    if (tree_inflated_.isNodeOccupied(*it) != occupied)
+      continue;
+    export_buffer_.push_back(it.getX());
+    export_buffer_.push_back(it.getY());
+    export_buffer_.push_back(it.getZ());
+    export_buffer_.push_back(0.0f);  // Padding, same layout as pcl::PointXYZ
+  }
+  ExportBufferToCloud(cloud);
+}
+
+// Export the centers of the occupied/free leaves inside a bounding box
+void OctoClass::InflatedMapCloud(const bool occupied,
+                                 const Eigen::Vector3d &box_min,
+                                 const Eigen::Vector3d &box_max,
+                                 sensor_msgs::PointCloud2* cloud) {
+  export_buffer_.clear();
+  const octomap::point3d bbx_min(box_min[0], box_min[1], box_min[2]);
+  const octomap::point3d bbx_max(box_max[0], box_max[1], box_max[2]);
+  for (octomap::OcTree::leaf_bbx_iterator it = tree_inflated_.begin_leafs_bbx(bbx_min, bbx_max),
+                                         end = tree_inflated_.end_leafs_bbx();
+                                         it != end; ++it) {
+    if (tree_inflated_.isNodeOccupied(*it) != occupied)
+      continue;
+    export_buffer_.push_back(it.getX());
+    export_buffer_.push_back(it.getY());
+    export_buffer_.push_back(it.getZ());
+    export_buffer_.push_back(0.0f);
+  }
+  ExportBufferToCloud(cloud);
+}
+
+void OctoClass::ExportBufferToCloud(sensor_msgs::PointCloud2* cloud) {
+  // Same fields and point step that pcl::toROSMsg produces for pcl::PointXYZ
+  static const char* names[3] = {"x", "y", "z"};
+  cloud->fields.resize(3);
+  for (uint i = 0; i < 3; i++) {
+    cloud->fields[i].name = names[i];
+    cloud->fields[i].offset = i * sizeof(float);
+    cloud->fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+    cloud->fields[i].count = 1;
+  }
+  const uint32_t n_points = export_buffer_.size() / 4;
+  cloud->header.stamp = ros::Time::now();
+  cloud->header.frame_id = "world";
+  cloud->height = 1;
+  cloud->width = n_points;
+  cloud->is_bigendian = false;
+  cloud->is_dense = true;
+  cloud->point_step = 4 * sizeof(float);
+  cloud->row_step = cloud->point_step * n_points;
+  cloud->data.resize(cloud->row_step);
+  if (n_points > 0)
+    memcpy(&cloud->data[0], &export_buffer_[0], cloud->row_step);
+}
+
 // Returns -1 if node is unknown, 0 if its free and 1 if its occupied
 int OctoClass::CheckOccupancy(const octomap::point3d &p) {
   static octomap::OcTreeKey key;
@@ -61,34 +61,35 @@ bool MapperNodelet::ResetMap(std_srvs::Trigger::Request &req,
   return true;
 }
 
-bool MapperNodelet::GetFreeMapCallback(ff_msgs::GetMap::Request &req,
-                                       ff_msgs::GetMap::Response &res) {
-  visualization_msgs::MarkerArray om, fm;
-  sensor_msgs::PointCloud2 oc, fc;
+// Fill a map response with the free or occupied voxels of the inflated map,
+// restricted to the requested bounding box when one is given
+void MapperNodelet::ExportMap(ff_msgs::GetMap::Request const& req,
+                              bool free,
+                              ff_msgs::GetMap::Response &res) {
+  const Eigen::Vector3d box_min(req.bbx_min.x, req.bbx_min.y, req.bbx_min.z);
+  const Eigen::Vector3d box_max(req.bbx_max.x, req.bbx_max.y, req.bbx_max.z);
+  const bool use_bbx = (box_max.array() > box_min.array()).all();
 
   mutexes_.octomap.lock();
-  globals_.octomap.InflatedVisMarkers(&om, &fm, &oc, &fc);
+  if (use_bbx)
+    globals_.octomap.InflatedMapCloud(!free, box_min, box_max, &res.points);
+  else
+    globals_.octomap.InflatedMapCloud(!free, &res.points);
+  res.resolution = globals_.octomap.GetResolution();
   mutexes_.octomap.unlock();
 
-  res.points = fc;
-  res.resolution = globals_.octomap.GetResolution();
-  res.free = true;
+  res.free = free;
+}
 
+bool MapperNodelet::GetFreeMapCallback(ff_msgs::GetMap::Request &req,
+                                       ff_msgs::GetMap::Response &res) {
+  ExportMap(req, true, res);
   return true;
 }
+
 bool MapperNodelet::GetObstacleMapCallback(ff_msgs::GetMap::Request &req,
                                        ff_msgs::GetMap::Response &res) {
-  visualization_msgs::MarkerArray om, fm;
-  sensor_msgs::PointCloud2 oc, fc;
-
-  mutexes_.octomap.lock();
-  globals_.octomap.InflatedVisMarkers(&om, &fm, &oc, &fc);
-  mutexes_.octomap.unlock();
-
-  res.points = oc;
-  res.resolution = globals_.octomap.GetResolution();
-  res.free = false;
-
+  ExportMap(req, false, res);
   return true;
 }
 
@@ -0,0 +1,95 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Measures the latency of the get map services against the size of the map.
+// The legacy path (building all markers and both clouds) is compared with the
+// direct export, both for the whole map and for a planning bounding box.
+
+#include <ff_common/init.h>
+#include <mapper/octoclass.h>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+DEFINE_double(resolution, 0.05, "Map resolution in meters");
+DEFINE_int32(repetitions, 20, "Number of calls per measurement");
+DEFINE_int32(max_obstacles, 200000, "Largest number of random obstacle voxels");
+DEFINE_double(side, 10.0, "Side of the cube containing the map, in meters");
+DEFINE_double(bbx_side, 2.0, "Side of the planning bounding box, in meters");
+
+DECLARE_bool(logtostderr);
+
+namespace {
+
+// Average time in milliseconds of a call to f
+template <typename Function>
+double Time(Function f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < FLAGS_repetitions; i++)
+    f();
+  std::chrono::duration<double, std::milli> dt =
+    std::chrono::steady_clock::now() - start;
+  return dt.count() / FLAGS_repetitions;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = true;
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+  ros::Time::init();
+
+  const Eigen::Vector3d box_min = -0.5 * FLAGS_bbx_side * Eigen::Vector3d::Ones();
+  const Eigen::Vector3d box_max = 0.5 * FLAGS_bbx_side * Eigen::Vector3d::Ones();
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> coord(-0.5 * FLAGS_side, 0.5 * FLAGS_side);
+
+  printf("%10s %10s %12s %12s %12s\n", "obstacles", "leaves",
+         "markers_ms", "export_ms", "bbx_ms");
+  for (int n = 1000; n <= FLAGS_max_obstacles; n *= 2) {
+    octoclass::OctoClass octomap(FLAGS_resolution);
+    // Alternate free and occupied voxels so both services have work to do
+    for (int i = 0; i < 2 * n; i++) {
+      octomap::point3d p(coord(gen), coord(gen), coord(gen));
+      octomap.tree_inflated_.updateNode(p, (i % 2) == 0);
+    }
+
+    visualization_msgs::MarkerArray om, fm;
+    sensor_msgs::PointCloud2 oc, fc, cloud;
+    double t_markers = Time([&]() {
+      octomap.InflatedVisMarkers(&om, &fm, &oc, &fc);
+    });
+    double t_export = Time([&]() {
+      octomap.InflatedMapCloud(true, &cloud);
+    });
+    CHECK_EQ(cloud.width, oc.width) << "Exported obstacles differ from markers";
+    double t_bbx = Time([&]() {
+      octomap.InflatedMapCloud(true, box_min, box_max, &cloud);
+    });
+
+    printf("%10d %10zu %12.3f %12.3f %12.3f\n", n,
+           octomap.tree_inflated_.getNumLeafNodes(), t_markers, t_export, t_bbx);
+  }
+
+  return 0;
+}
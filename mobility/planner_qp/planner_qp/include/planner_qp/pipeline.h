@@ -0,0 +1,93 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PLANNER_QP_PIPELINE_H_
+#define PLANNER_QP_PIPELINE_H_
+
+#include <planner_qp/planning_map.h>
+
+#include <decomp_util/ellipse_decomp.h>
+#include <jps3d/planner/jps_3d_util.h>
+
+#include <traj_opt_pro/nonlinear_trajectory.h>
+#include <traj_opt_pro/problem_io.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace planner_qp {
+
+// The stages of a QP plan: jump point search on the planning map, safe flight
+// corridor decomposition of the path and trajectory optimization inside the
+// corridor. There are no ROS dependencies, so the same code runs in the
+// nodelet and in the offline benchmark.
+class Pipeline {
+ public:
+  typedef std::vector<std::pair<traj_opt::MatD, traj_opt::VecD> > Corridor;
+
+  // Settings of the optimization stage
+  struct Options {
+    bool time_opt{false};          // Non-convex time allocation
+    bool uniform_time{false};      // Same initial duration for all segments
+    double gap{1e-8};              // Duality gap threshold
+    int max_its{200};              // Maximum solver iterations
+    traj_opt::KKTBackend backend{traj_opt::KKTBackend::LU};
+  };
+
+  // The map is filled by the caller, then Refresh rebuilds the search and
+  // decomposition structures if its revision changed since the last call
+  PlanningMap& Map() { return map_; }
+  PlanningMap const& Map() const { return map_; }
+  bool Refresh();
+
+  // Collision free path from start to goal. When both are within a cell of
+  // each other the path is the straight line and close is set.
+  bool Search(traj_opt::Vec3 const& start, traj_opt::Vec3 const& goal,
+              vec_Vec3f *path, bool *close);
+
+  // One convex polytope per path segment, in the 4D (x, y, z, yaw) space of
+  // the optimizer. The polytopes are unconstrained when close is set.
+  void Decompose(vec_Vec3f const& path, bool close, Corridor *corridor);
+
+  // Optimization problem through the corridor between two rest states
+  static traj_opt::OptimizationProblem Problem(
+    traj_opt::Vec4 const& start, traj_opt::Vec4 const& goal,
+    vec_Vec3f const& path, Corridor const& corridor, Options const& options);
+
+  // Solve the problem, warm starting from previous if not null. If time
+  // optimization does not converge the problem is solved again without it
+  // and relaxed is set. Throws on numerical failure.
+  static boost::shared_ptr<traj_opt::NonlinearTrajectory> Solve(
+    traj_opt::OptimizationProblem const& problem,
+    traj_opt::NonlinearTrajectory const* previous,
+    traj_opt::KKTBackend backend, bool *relaxed = NULL);
+
+ private:
+  PlanningMap map_;                               // Persistent voxel map
+  uint64_t revision_{0};                          // Revision of the utils
+  std::shared_ptr<JPS::VoxelMapUtil> map_util_;
+  std::unique_ptr<JPS::JPS3DUtil> jps_;
+  std::unique_ptr<EllipseDecomp> decomp_;
+};
+
+}  // namespace planner_qp
+
+#endif  // PLANNER_QP_PIPELINE_H_
@@ -0,0 +1,109 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PLANNER_QP_PLANNING_MAP_H_
+#define PLANNER_QP_PLANNING_MAP_H_
+
+#include <ff_msgs/Zone.h>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include <cstdint>
+#include <vector>
+
+namespace planner_qp {
+
+// Voxel map searched by the jump point search planner. It persists between
+// plans: the keep-in and keep-out zones are only rasterized when they change,
+// and the mapper obstacles are applied as the difference to the previous set.
+// Occupied cells are already dilated by the robot radius.
+class PlanningMap {
+ public:
+  typedef std::vector<Eigen::Vector3d,
+    Eigen::aligned_allocator<Eigen::Vector3d>> Points;
+
+  // Cell values, same convention as JPS::VoxelMapUtil
+  static constexpr signed char FREE = 0;
+  static constexpr signed char OCCUPIED = 100;
+
+  // Rebuild the zone layer if the zones, the resolution or the robot radius
+  // changed since the last call. Returns false if there are no keep-in zones.
+  bool SetZones(std::vector<ff_msgs::Zone> const& zones,
+                double resolution, double radius);
+
+  // Replace the set of obstacle points, only touching the cells that changed
+  void SetObstacles(Points const& points);
+
+  // Whether SetZones succeeded at least once
+  bool Valid() const { return !map_.empty(); }
+
+  // Incremented every time the content of the map changes
+  uint64_t Revision() const { return revision_; }
+
+  // Union of the keep-in zones, which bounds the obstacles of interest
+  Eigen::Vector3d const& KeepinMin() const { return keepin_min_; }
+  Eigen::Vector3d const& KeepinMax() const { return keepin_max_; }
+
+  // Grid description, as expected by JPS::VoxelMapUtil::setMap
+  Eigen::Vector3d const& Origin() const { return origin_; }
+  Eigen::Vector3i const& Dim() const { return dim_; }
+  double Resolution() const { return resolution_; }
+  double Radius() const { return radius_; }
+  std::vector<signed char> const& Map() const { return map_; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  // Cell helpers, same discretization as JPS::VoxelMapUtil
+  Eigen::Vector3i ToCell(Eigen::Vector3d const& pt) const;
+  bool Inside(Eigen::Vector3i const& cell) const;
+  int Index(Eigen::Vector3i const& cell) const;
+  Eigen::Vector3i Cell(int index) const;
+
+  // Whether the zone set differs from the one that was last rasterized
+  bool ZonesChanged(std::vector<ff_msgs::Zone> const& zones,
+                    double resolution, double radius) const;
+
+  // Mark a cell and its dilation footprint in the zone layer
+  void DilateZone(Eigen::Vector3i const& cell);
+
+  // Add (+1) or remove (-1) the footprint of an obstacle cell
+  void UpdateObstacle(int index, int delta);
+
+  // Recompute the combined value of a cell from both layers
+  void Refresh(int index);
+
+  std::vector<ff_msgs::Zone> zones_;              // Zones last rasterized
+  double radius_ = 0.0;                           // Robot radius
+  double resolution_ = 0.0;                       // Cell size
+  Eigen::Vector3d origin_ = Eigen::Vector3d::Zero();
+  Eigen::Vector3i dim_ = Eigen::Vector3i::Zero();
+  Eigen::Vector3d keepin_min_ = Eigen::Vector3d::Zero();
+  Eigen::Vector3d keepin_max_ = Eigen::Vector3d::Zero();
+  std::vector<Eigen::Vector3i> footprint_;        // Dilation offsets
+  std::vector<bool> zone_layer_;                  // Dilated zone cells
+  std::vector<uint16_t> obstacle_layer_;          // Footprints per cell
+  std::vector<int> obstacle_cells_;               // Sorted obstacle cells
+  std::vector<signed char> map_;                  // Combined layers
+  uint64_t revision_ = 0;
+};
+
+}  // namespace planner_qp
+
+#endif  // PLANNER_QP_PLANNING_MAP_H_
@@ -0,0 +1,60 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PLANNER_QP_PLANNING_PROBLEM_H_
+#define PLANNER_QP_PLANNING_PROBLEM_H_
+
+#include <planner_qp/pipeline.h>
+#include <planner_qp/planning_map.h>
+
+#include <ff_msgs/Zone.h>
+
+#include <Eigen/Dense>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace planner_qp {
+
+// Everything a plan depends on, as seen by the nodelet when it was asked to
+// plan: the zones, the mapper obstacles, the start and goal and the settings.
+// Recorded during real runs and replayed by the planner benchmark.
+struct PlanningProblem {
+  std::vector<ff_msgs::Zone> zones;
+  PlanningMap::Points obstacles;
+  Eigen::Vector4d start = Eigen::Vector4d::Zero();  // x, y, z and yaw offset
+  Eigen::Vector4d goal = Eigen::Vector4d::Zero();
+  double resolution{0.5};                           // Map resolution
+  double radius{0.16};                              // Robot radius
+  double max_vel{0.2};                              // Soft velocity limit
+  double max_accel{0.0175};                         // Soft accel limit
+  Pipeline::Options options;
+
+  // plain text, full precision
+  bool Write(std::ostream &os) const;
+  bool Read(std::istream &is);
+  bool Save(std::string const& filename) const;
+  bool Load(std::string const& filename);
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}  // namespace planner_qp
+
+#endif  // PLANNER_QP_PLANNING_PROBLEM_H_
@@ -0,0 +1,142 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <planner_qp/pipeline.h>
+
+#include <boost/make_shared.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace planner_qp {
+
+bool Pipeline::Refresh() {
+  if (!map_.Valid()) return false;
+
+  // nothing changed since the last plan, so the search structures are reused
+  if (jps_ && map_.Revision() == revision_)
+    return true;
+
+  map_util_.reset(new JPS::VoxelMapUtil());
+  map_util_->setMap(map_.Origin(), map_.Dim(), map_.Map(), map_.Resolution());
+
+  jps_.reset(new JPS::JPS3DUtil(false));
+  jps_->setMapUtil(map_util_.get());
+
+  decomp_.reset(new EllipseDecomp(
+      map_util_->getOrigin(),
+      map_util_->getDim().cast<decimal_t>() * map_util_->getRes(), false));
+  decomp_->set_obstacles(map_util_->getCloud());
+  revision_ = map_.Revision();
+  return true;
+}
+
+bool Pipeline::Search(traj_opt::Vec3 const& start, traj_opt::Vec3 const& goal,
+                      vec_Vec3f *path, bool *close) {
+  traj_opt::Vec3 diff = (goal - start).cwiseAbs();
+  diff -= traj_opt::Vec3::Ones() * map_.Resolution();
+  path->clear();
+  *close = (diff(0) < 0 && diff(1) < 0 && diff(2) < 0);
+  if (*close) {
+    path->push_back(start);
+    path->push_back(goal);
+    return true;
+  }
+  if (!jps_ || !jps_->plan(start, goal))
+    return false;
+  *path = jps_->getPath();
+  return true;
+}
+
+void Pipeline::Decompose(vec_Vec3f const& path, bool close,
+                         Corridor *corridor) {
+  decomp_->decomp(path);
+
+  // repackage as dynamic sized arrays with a free yaw column
+  vec_LinearConstraint3f cons_3d = decomp_->get_constraints();
+  corridor->clear();
+  for (auto &ci : cons_3d) {
+    traj_opt::MatD A = traj_opt::MatD::Zero(ci.first.rows(), 4);
+    traj_opt::VecD b = traj_opt::VecD::Zero(ci.second.rows(), ci.second.cols());
+    if (!close) {
+      A.block(0, 0, ci.first.rows(), ci.first.cols()) = ci.first;
+      b.block(0, 0, ci.second.rows(), ci.second.cols()) = ci.second;
+    }
+    corridor->push_back(std::make_pair(A, b));
+  }
+}
+
+traj_opt::OptimizationProblem Pipeline::Problem(
+  traj_opt::Vec4 const& start, traj_opt::Vec4 const& goal,
+  vec_Vec3f const& path, Corridor const& corridor, Options const& options) {
+  traj_opt::OptimizationProblem problem;
+
+  // Package higher order waypoints
+  traj_opt::Waypoint start_way, goal_way;
+  start_way.pos = start;
+  start_way.use_pos = true;
+  start_way.use_vel = true;
+  start_way.use_acc = true;
+  start_way.use_jrk = true;
+  start_way.knot_id = 0;
+
+  goal_way.pos = goal;
+  goal_way.use_pos = true;
+  goal_way.use_vel = true;
+  goal_way.use_acc = true;
+  goal_way.use_jrk = true;
+  goal_way.knot_id = -1;
+
+  problem.waypoints.push_back(start_way);
+  problem.waypoints.push_back(goal_way);
+  problem.cons = corridor;
+
+  // initial durations proportional to the length of each segment
+  problem.ds.assign(corridor.size(), 1.0);
+  if (!options.uniform_time)
+    for (size_t i = 1; i < path.size() && i <= corridor.size(); i++)
+      problem.ds.at(i - 1) = (path.at(i) - path.at(i - 1)).norm();
+
+  problem.time_opt = options.time_opt;
+  problem.gap = options.gap;
+  problem.max_its = options.max_its;
+  return problem;
+}
+
+boost::shared_ptr<traj_opt::NonlinearTrajectory> Pipeline::Solve(
+  traj_opt::OptimizationProblem const& problem,
+  traj_opt::NonlinearTrajectory const* previous,
+  traj_opt::KKTBackend backend, bool *relaxed) {
+  auto ds = boost::make_shared<std::vector<traj_opt::decimal_t> >(problem.ds);
+  boost::shared_ptr<traj_opt::NonlinearTrajectory> trajectory(
+    new traj_opt::NonlinearTrajectory(
+      problem.waypoints, problem.cons, 7, 3, ds,
+      boost::shared_ptr<traj_opt::VecDVec>(), problem.time_opt, problem.gap,
+      problem.max_its, previous, backend));
+  if (relaxed != NULL) *relaxed = false;
+  if (problem.time_opt && !trajectory->isSolved()) {
+    trajectory.reset(new traj_opt::NonlinearTrajectory(
+      problem.waypoints, problem.cons, 7, 3, ds,
+      boost::shared_ptr<traj_opt::VecDVec>(), false, problem.gap,
+      problem.max_its, NULL, backend));
+    if (relaxed != NULL) *relaxed = true;
+  }
+  return trajectory;
+}
+
+}  // namespace planner_qp
@@ -21,6 +21,7 @@
 
 #include <ff_util/config_server.h>
 #include <ff_util/ff_nodelet.h>
+#include <ff_util/perf_timer.h>
 
 // For plugin loading
 #include <nodelet/nodelet.h>
@@ -35,6 +36,7 @@
 // Trajectory solving files
 #include <traj_opt_basic/types.h>
 #include <traj_opt_pro/nonlinear_trajectory.h>
+#include <traj_opt_pro/problem_io.h>
 #include <traj_opt_ros/ros_bridge.h>
 
 #include <decomp_util/ellipse_decomp.h>
@@ -43,11 +45,15 @@
 #include <mapper/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <planner_qp/pipeline.h>
+#include <planner_qp/planning_problem.h>
+
 #include <tf/tf.h>
 #include <visualization_msgs/MarkerArray.h>
 
 #include <algorithm>
 #include <functional>
+#include <string>
 
 #define DEBUG false
 #define OUTPUT_DEBUG NODELET_DEBUG_STREAM
@@ -117,6 +123,11 @@ class Planner : public planner::PlannerImplementation {
     timer_fb_ = nh->createTimer(ros::Duration(ros::Rate(1.5*DEFAULT_DIAGNOSTICS_RATE)),
       &Planner::SendFeedback, this, false, false);
 
+    pt_map_.Initialize("planner_qp_map");
+    pt_jps_.Initialize("planner_qp_jps");
+    pt_decomp_.Initialize("planner_qp_decomp");
+    pt_opt_.Initialize("planner_qp_opt");
+
     // cloud_pub_ = nh->advertise<pcl::PointCloud<pcl::PointXYZ> >
     // ("obs_points", 5, true);
     // Success
@@ -381,9 +392,17 @@ class Planner : public planner::PlannerImplementation {
   double map_res_{0.5};     // map resolution
 
  private:
-  std::shared_ptr<JPS::VoxelMapUtil> jps_map_util_;
-  std::unique_ptr<EllipseDecomp> decomp_util_;
-  std::unique_ptr<JPS::JPS3DUtil> jps_planner_;
+  Pipeline pipeline_;                     // search, corridor and solver
+  std::vector<ff_msgs::Zone> zones_;      // zones of the last plan
+
+  // per stage timing of the planning pipeline
+  ff_util::PerfTimer pt_map_, pt_jps_, pt_decomp_, pt_opt_;
+
+  // solver options
+  bool warm_start_{false};          // start from the previous solution
+  traj_opt::KKTBackend kkt_backend_{traj_opt::KKTBackend::LU};
+  std::string record_directory_;    // where to store the problems, if set
+  uint record_count_{0};
 
   double norm_vector3(const geometry_msgs::Vector3 &vec) {
     return std::sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
@@ -520,7 +539,8 @@ class Planner : public planner::PlannerImplementation {
                            ff_msgs::PlanResult *result) {
     OUTPUT_DEBUG("PlannerQP: Planning from " << start.transpose()
                                              << " to: " << goal.transpose());
-    // clear trajectory
+    // clear trajectory, keeping the last one to warm start the solver
+    boost::shared_ptr<traj_opt::NonlinearTrajectory> previous = trajectory_;
     trajectory_ = boost::shared_ptr<traj_opt::NonlinearTrajectory>();
 
     if (!cfg_.Get<bool>("time_optimization", time_optiization_))
@@ -532,101 +552,88 @@ class Planner : public planner::PlannerImplementation {
       gap_threshold_ = 1e-8;
     if (!cfg_.Get<int>("maximum_iterations", max_iterations_))
       max_iterations_ = 200;
+    if (!cfg_.Get<bool>("warm_start", warm_start_))
+      warm_start_ = false;
+    bool kkt_ldlt;
+    if (!cfg_.Get<bool>("kkt_ldlt", kkt_ldlt))
+      kkt_ldlt = false;
+    kkt_backend_ = kkt_ldlt ? traj_opt::KKTBackend::LDLT
+                            : traj_opt::KKTBackend::LU;
+    if (!cfg_.Get<std::string>("record_directory", record_directory_))
+      record_directory_ = "";
+    if (!warm_start_) previous.reset();
 
     // try to get zones
+    pt_map_.Tick();
     if (!load_map()) {
       ROS_ERROR("Planner::QP: Planner failed to load keepins and keepouts");
       return false;
     }
+    pt_map_.Tock();
+    pt_map_.Send();
 
     traj_opt::Vec3 start3 = start.block<3, 1>(0, 0);
     traj_opt::Vec3 goal3 = goal.block<3, 1>(0, 0);
 
-    traj_opt::Vec3 diff = goal3 - start3;
-    diff << std::abs(diff(0)), std::abs(diff(1)), std::abs(diff(2));
-    diff -= traj_opt::Vec3::Ones() * map_res_;
-
     vec_Vec3f path;
     bool close = false;
-
-    if (diff(0) < 0 && diff(1) < 0 && diff(2) < 0) {
-      ROS_INFO_STREAM(
-          "Start and goal are within map resolution: " << diff.transpose());
-      path.push_back(start3);
-      path.push_back(goal3);
-      close = true;
-      // result->response = RESPONSE::ALREADY_THERE;
-    } else {
-      OUTPUT_DEBUG("PlannerQP: JPS running");
-      if (!jps_planner_->plan(start3, goal3)) {
-        ROS_ERROR("Planner::QP: Jump point search failed!");
-        return false;
-      }
-      path = jps_planner_->getPath();
+    OUTPUT_DEBUG("PlannerQP: JPS running");
+    pt_jps_.Tick();
+    if (!pipeline_.Search(start3, goal3, &path, &close)) {
+      ROS_ERROR("Planner::QP: Jump point search failed!");
+      return false;
     }
+    pt_jps_.Tock();
+    pt_jps_.Send();
+    if (close)
+      ROS_INFO_STREAM("Start and goal are within map resolution: "
+                      << start3.transpose() << " " << goal3.transpose());
+
     // get constraints and repackage as dynamic sized arrays
     OUTPUT_DEBUG("PlannerQP: decomp running on path length " << path.size());
-    decomp_util_->decomp(path);
-
+    pt_decomp_.Tick();
+    Pipeline::Corridor cons;
+    pipeline_.Decompose(path, close, &cons);
+    pt_decomp_.Tock();
+    pt_decomp_.Send();
     for (auto &p : path) OUTPUT_DEBUG("PlannerQP: Path: " << p.transpose());
-    vec_LinearConstraint3f cons_3d = decomp_util_->get_constraints();
-    std::vector<std::pair<traj_opt::MatD, traj_opt::VecD> > cons;
-    for (auto &ci : cons_3d) {
-      traj_opt::MatD A = traj_opt::MatD::Zero(ci.first.rows(), 4);
-      traj_opt::VecD b =
-          traj_opt::VecD::Zero(ci.second.rows(), ci.second.cols());
-      // OUTPUT_DEBUG("PlannerQP: Ci size " << ci.second.rows() << " "<<
-      // ci.second.cols() );
-      if (!close) {
-        A.block(0, 0, ci.first.rows(), ci.first.cols()) = ci.first;
-        b.block(0, 0, ci.second.rows(), ci.second.cols()) = ci.second;
-      }
-      OUTPUT_DEBUG("PlannerQP: A: " << A);
-      OUTPUT_DEBUG("PlannerQP: b: " << b.transpose());
-      cons.push_back(std::pair<traj_opt::MatD, traj_opt::VecD>(A, b));
-    }
 
-    // Package higher order waypoints
-    traj_opt::Waypoint start_way, goal_way;
-    start_way.pos = start;
-    start_way.use_pos = true;
-    start_way.use_vel = true;
-    start_way.use_acc = true;
-    start_way.use_jrk = true;
-    start_way.knot_id = 0;
-
-    goal_way.pos = goal;
-    goal_way.use_pos = true;
-    goal_way.use_vel = true;
-    goal_way.use_acc = true;
-    goal_way.use_jrk = true;
-    goal_way.knot_id = -1;
-
-    std::vector<traj_opt::Waypoint> con;
-    con.push_back(start_way);
-    con.push_back(goal_way);
-
-    boost::shared_ptr<std::vector<double> > ds =
-        boost::make_shared<std::vector<double> >(cons.size(), 1.0);
-
-    for (uint i = 1; i < path.size(); i++) {
-      if (!uniform_time_) ds->at(i - 1) = (path.at(i) - path.at(i - 1)).norm();
-      traj_opt::VecD p1(traj_opt::VecD::Zero(4, 1));
-      traj_opt::VecD p2(traj_opt::VecD::Zero(4, 1));
-      p1.block<3, 1>(0, 0) = path.at(i - 1);
-      p2.block<3, 1>(0, 0) = path.at(i);
-      traj_opt::VecD diff1 = cons.at(i - 1).first * p1 - cons.at(i - 1).second;
-      traj_opt::VecD diff2 = cons.at(i - 1).first * p2 - cons.at(i - 1).second;
-      OUTPUT_DEBUG("i: " << i << " diff1: " << diff1.maxCoeff()
-                         << " diff2: " << diff2.maxCoeff());
-      // OUTPUT_DEBUG("i: " << i << " diff1: " << diff1.transpose() << "
-      // diff2: " << diff2.transpose());
+    Pipeline::Options options;
+    options.time_opt = time_optiization_;
+    options.uniform_time = uniform_time_;
+    options.gap = gap_threshold_;
+    options.max_its = max_iterations_;
+    options.backend = kkt_backend_;
+    traj_opt::OptimizationProblem problem =
+      Pipeline::Problem(start, goal, path, cons, options);
+
+    // store the problems so that they can be solved again offline
+    if (!record_directory_.empty()) {
+      std::string id = std::to_string(record_count_++);
+      PlanningProblem plan;
+      plan.zones = zones_;
+      plan.obstacles = PlanningMap::Points(mapper_points_.begin(),
+                                           mapper_points_.end());
+      plan.start = start;
+      plan.goal = goal;
+      plan.resolution = map_res_;
+      plan.radius = pipeline_.Map().Radius();
+      plan.max_vel = desired_vel_;
+      plan.max_accel = desired_accel_;
+      plan.options = options;
+      std::string file = record_directory_ + "/plan_" + id + ".txt";
+      if (!plan.Save(file))
+        ROS_WARN_STREAM("Planner::QP: could not record plan to " << file);
+      file = record_directory_ + "/problem_" + id + ".txt";
+      if (!problem.save(file))
+        ROS_WARN_STREAM("Planner::QP: could not record problem to " << file);
     }
 
+    pt_opt_.Tick();
+    bool relaxed = false;
     try {
-      trajectory_.reset(new traj_opt::NonlinearTrajectory(
-          con, cons, 7, 3, ds, boost::shared_ptr<traj_opt::VecDVec>(),
-          time_optiization_, gap_threshold_, max_iterations_));
+      trajectory_ = Pipeline::Solve(problem, previous.get(), kkt_backend_,
+                                    &relaxed);
     } catch (std::runtime_error &e) {
       ROS_ERROR_STREAM("QP::Planner failed with error: " << e.what());
       return false;
@@ -634,21 +641,11 @@ class Planner : public planner::PlannerImplementation {
       ROS_ERROR_STREAM("QP::Planner failed with unknown error");
       return false;
     }
-
-    if (time_optiization_ && !trajectory_->isSolved()) {
+    if (relaxed)
       ROS_WARN_STREAM("Time optimization diverged, re running with out it");
-      try {
-        trajectory_.reset(new traj_opt::NonlinearTrajectory(
-            con, cons, 7, 3, ds, boost::shared_ptr<traj_opt::VecDVec>(),
-            false, gap_threshold_, max_iterations_));
-      } catch (std::runtime_error &e) {
-        ROS_ERROR_STREAM("QP::Planner failed with error: " << e.what());
-        return false;
-      } catch (...) {
-        ROS_ERROR_STREAM("QP::Planner failed with unknown error");
-        return false;
-      }
-    }
+
+    pt_opt_.Tock();
+    pt_opt_.Send();
 
     std::string pass = trajectory_->isSolved() ? "solved" : "failed";
     // viz topics
@@ -866,10 +863,32 @@ class Planner : public planner::PlannerImplementation {
     }
   }
   bool load_map() {
-    // get points from mapper
+    // get zones
+    std::vector<ff_msgs::Zone> &zones = zones_;
+    bool got = GetZones(zones);
+    if (!got) return false;
+
+    double radius;
+    if (!cfg_.Get<double>("robot_radius", radius)) radius = 0.16;
+
+    // zones are only rasterized again when they change
+    PlanningMap &map = pipeline_.Map();
+    if (!map.SetZones(zones, map_res_, radius)) {
+      ROS_ERROR("Zero keepin zones!! Plan failed");
+      return false;
+    }
+
+    // get points from mapper, only obstacles inside the keepins matter
+    geometry_msgs::Point bbx_min, bbx_max;
+    bbx_min.x = map.KeepinMin()(0);
+    bbx_min.y = map.KeepinMin()(1);
+    bbx_min.z = map.KeepinMin()(2);
+    bbx_max.x = map.KeepinMax()(0);
+    bbx_max.y = map.KeepinMax()(1);
+    bbx_max.z = map.KeepinMax()(2);
     float resf;
     pcl::PointCloud<pcl::PointXYZ> points;
-    if (!GetObstacleMap(&points, &resf)) {
+    if (!GetObstacleMap(&points, &resf, bbx_min, bbx_max)) {
       ROS_ERROR_STREAM("PlannerQP: Failed to get points from mapper service");
       return false;
     }
@@ -880,143 +899,23 @@ class Planner : public planner::PlannerImplementation {
       mapper_points_.push_back(Vec3f(p.x, p.y, p.z));
     }
 
-    map_res_ = static_cast<double>(resf);
-
-    // get zones
-    std::vector<ff_msgs::Zone> zones;
-    bool got = GetZones(zones);
-    if (!got) return false;
-
-    Vec3f min, max, zmin, zmax;
-    min << 1000.0, 1000.0, 1000.0;
-    max << -1000.0, -1000.0, -1000.0;
-    uint num_keepin = 0;
-    for (auto &zone : zones) {
-      if (zone.type == ff_msgs::Zone::KEEPIN) {
-        zmin << zone.min.x, zone.min.y, zone.min.z;
-        zmax << zone.max.x, zone.max.y, zone.max.z;
-        for (int i = 0; i < 3; i++) {
-          min(i) = std::min(min(i), zmin(i));
-          min(i) = std::min(min(i), zmax(i));
-          max(i) = std::max(max(i), zmin(i));
-          max(i) = std::max(max(i), zmax(i));
-        }
-        num_keepin++;
-      }
-    }
-    if (num_keepin == 0) {
-      ROS_ERROR("Zero keepin zones!! Plan failed");
-      return false;
-    }
-    min -= Vec3f::Ones() * map_res_ * 2.0;
-    max += Vec3f::Ones() * map_res_ * 2.0;
-
-    Vec3f origin = min;
-    Vec3f dimf = (max - min) / map_res_;
-    Vec3i dim(std::ceil(dimf(0)), std::ceil(dimf(1)), std::ceil(dimf(2)));
-    int num_cell = dim(0) * dim(1) * dim(2);
-
-    std::vector<signed char> map(num_cell, 0);
-
-    jps_map_util_.reset(new JPS::VoxelMapUtil());
-    jps_map_util_->setMap(origin, dim, map, map_res_);
-
-    vec_Vec3f keepout_points_mapper = mapper_points_;
-    vec_Vec3f keepout_points_zones;
-
-    // add contour
-    for (auto &zone : zones) {
-      zmin << std::min(zone.min.x, zone.max.x),
-          std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
-      zmax << std::max(zone.min.x, zone.max.x),
-          std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
-      Vec3f tmp = Vec3f::Zero();
-      for (int i = 0; i < 3; i++) {
-        int j = (i + 1) % 3;
-        int k = (i + 2) % 3;
-        if (zone.type == ff_msgs::Zone::KEEPIN) {
-          for (auto zx = zmin(j); zx <= zmax(j); zx += map_res_) {
-            for (auto zy = zmin(k); zy <= zmax(k); zy += map_res_) {
-              tmp(j) = zx;
-              tmp(k) = zy;
-              tmp(i) = zmin(i) - map_res_ * 1.001;
-              map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
-                  100;
-              tmp(i) = zmax(i) + map_res_ * 1.001;
-              map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
-                  100;
-            }
-          }
-        }
-      }
-    }
-
-    for (auto &zone : zones) {
-      zmin << std::min(zone.min.x, zone.max.x),
-          std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
-      zmax << std::max(zone.min.x, zone.max.x),
-          std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
-      // add points on surface
-      Vec3f tmp = Vec3f::Zero();
-      for (int i = 0; i < 3; i++) {
-        int j = (i + 1) % 3;
-        int k = (i + 2) % 3;
-        for (auto zx = zmin(j); zx <= zmax(j); zx += map_res_)
-          for (auto zy = zmin(k); zy <= zmax(k); zy += map_res_) {
-            if (zone.type == ff_msgs::Zone::KEEPOUT) {
-              tmp(j) = zx;
-              tmp(k) = zy;
-              tmp(i) = zmin(i);
-              keepout_points_zones.push_back(tmp);
-              tmp(i) = zmax(i);
-              keepout_points_zones.push_back(tmp);
-            } else {
-              for (auto zz = zmin(i); zz <= zmax(i); zz += map_res_) {
-                tmp(j) = zx;
-                tmp(k) = zy;
-                tmp(i) = zz;
-                map[jps_map_util_->getIndex(jps_map_util_->floatToInt(tmp))] =
-                    0;
-              }
-            }
-          }
-      }
-      OUTPUT_DEBUG("PlannerQP: Keepout: " << zmin.transpose() << " to "
-                                          << zmax.transpose());
+    // the grid follows the resolution of the mapper
+    if (static_cast<double>(resf) != map_res_) {
+      map_res_ = static_cast<double>(resf);
+      map.SetZones(zones, map_res_, radius);
     }
-    // reset map
-    jps_map_util_->setMap(origin, dim, map, map_res_);
-    // for(auto &p:keepout_points)
-    // OUTPUT_DEBUG("PlannerQP: Keepout point: " << p.transpose());
-    OUTPUT_DEBUG("PlannerQP: add3DPoints zones: " << keepout_points_zones.size()
-                                    << " mapper: " << keepout_points_mapper.size());
-    // dialate
-    double radius;
-    if (!cfg_.Get<double>("robot_radius", radius)) radius = 0.16;
-
-    jps_map_util_->freeUnKnown();
-    jps_map_util_->dilate(radius, radius);
-    OUTPUT_DEBUG("PlannerQP: Dilating");
-    jps_map_util_->dilating();
-    // keepout add point includes dilating
-    jps_map_util_->add3DPoints(keepout_points_zones);
-    jps_map_util_->add3DPoints(keepout_points_mapper);
-    OUTPUT_DEBUG("PlannerQP: Map origin " << origin.transpose() << " dim "
-                                          << dim.transpose() << " resolution "
-                                          << map_res_);
-
-    jps_planner_.reset(new JPS::JPS3DUtil(false));
-    jps_planner_->setMapUtil(jps_map_util_.get());
 
-    decomp_util_.reset(new EllipseDecomp(
-        jps_map_util_->getOrigin(),
-        jps_map_util_->getDim().cast<decimal_t>() * jps_map_util_->getRes(),
-        false));
-    decomp_util_->set_obstacles(jps_map_util_->getCloud());
-
-    // debugCloud();
-
-    return true;
+    // obstacles are applied as the difference to the previous plan
+    map.SetObstacles(
+      PlanningMap::Points(mapper_points_.begin(), mapper_points_.end()));
+    OUTPUT_DEBUG("PlannerQP: mapper points: " << mapper_points_.size()
+                 << " map revision: " << map.Revision());
+    OUTPUT_DEBUG("PlannerQP: Map origin " << map.Origin().transpose()
+                 << " dim " << map.Dim().transpose()
+                 << " resolution " << map_res_);
+
+    // nothing changed since the last plan, so the search structures are reused
+    return pipeline_.Refresh();
   }
   /*  void debugCloud(){
       // vec_Vec3f free = jps_map_util_->getFreeCloud();
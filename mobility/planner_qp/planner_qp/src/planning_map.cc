@@ -0,0 +1,226 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <planner_qp/planning_map.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <vector>
+
+namespace planner_qp {
+
+constexpr signed char PlanningMap::FREE;
+constexpr signed char PlanningMap::OCCUPIED;
+
+bool PlanningMap::SetZones(std::vector<ff_msgs::Zone> const& zones,
+                           double resolution, double radius) {
+  if (Valid() && !ZonesChanged(zones, resolution, radius))
+    return true;
+
+  // Bounds of the union of the keep-in zones
+  Eigen::Vector3d min, max, zmin, zmax;
+  min << 1000.0, 1000.0, 1000.0;
+  max << -1000.0, -1000.0, -1000.0;
+  uint num_keepin = 0;
+  for (auto &zone : zones) {
+    if (zone.type != ff_msgs::Zone::KEEPIN) continue;
+    zmin << zone.min.x, zone.min.y, zone.min.z;
+    zmax << zone.max.x, zone.max.y, zone.max.z;
+    min = min.cwiseMin(zmin).cwiseMin(zmax);
+    max = max.cwiseMax(zmin).cwiseMax(zmax);
+    num_keepin++;
+  }
+  if (num_keepin == 0) {
+    map_.clear();
+    return false;
+  }
+  zones_ = zones;
+  resolution_ = resolution;
+  radius_ = radius;
+  keepin_min_ = min;
+  keepin_max_ = max;
+
+  // Grid covering the keep-ins with a margin for their contour
+  origin_ = min - Eigen::Vector3d::Ones() * resolution_ * 2.0;
+  Eigen::Vector3d dimf = (max - min) / resolution_
+                       + Eigen::Vector3d::Ones() * 4.0;
+  dim_ << std::ceil(dimf(0)), std::ceil(dimf(1)), std::ceil(dimf(2));
+  const int num_cell = dim_(0) * dim_(1) * dim_(2);
+
+  // Footprint of the robot: a cylinder of the robot radius and height
+  footprint_.clear();
+  const int rn = std::ceil(radius_ / resolution_);
+  for (int i = -rn; i <= rn; i++)
+    for (int j = -rn; j <= rn; j++)
+      for (int k = -rn; k <= rn; k++)
+        if (i * i + j * j <= rn * rn)
+          footprint_.push_back(Eigen::Vector3i(i, j, k));
+
+  // The contour of every keep-in is occupied, unless it lies inside another
+  // keep-in. Keep-out zones only occupy their surface.
+  std::vector<bool> walls(num_cell, false);
+  std::vector<int> surfaces;
+  for (auto &zone : zones_) {
+    zmin << std::min(zone.min.x, zone.max.x),
+      std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
+    zmax << std::max(zone.min.x, zone.max.x),
+      std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
+    Eigen::Vector3d tmp = Eigen::Vector3d::Zero();
+    for (int i = 0; i < 3; i++) {
+      int j = (i + 1) % 3;
+      int k = (i + 2) % 3;
+      for (auto zx = zmin(j); zx <= zmax(j); zx += resolution_) {
+        for (auto zy = zmin(k); zy <= zmax(k); zy += resolution_) {
+          tmp(j) = zx;
+          tmp(k) = zy;
+          if (zone.type == ff_msgs::Zone::KEEPIN) {
+            tmp(i) = zmin(i) - resolution_ * 1.001;
+            walls[Index(ToCell(tmp))] = true;
+            tmp(i) = zmax(i) + resolution_ * 1.001;
+            walls[Index(ToCell(tmp))] = true;
+          } else {
+            tmp(i) = zmin(i);
+            if (Inside(ToCell(tmp))) surfaces.push_back(Index(ToCell(tmp)));
+            tmp(i) = zmax(i);
+            if (Inside(ToCell(tmp))) surfaces.push_back(Index(ToCell(tmp)));
+          }
+        }
+      }
+    }
+  }
+  for (auto &zone : zones_) {
+    if (zone.type != ff_msgs::Zone::KEEPIN) continue;
+    zmin << std::min(zone.min.x, zone.max.x),
+      std::min(zone.min.y, zone.max.y), std::min(zone.min.z, zone.max.z);
+    zmax << std::max(zone.min.x, zone.max.x),
+      std::max(zone.min.y, zone.max.y), std::max(zone.min.z, zone.max.z);
+    Eigen::Vector3i cmin = ToCell(zmin), cmax = ToCell(zmax);
+    for (int x = cmin(0); x <= cmax(0); x++)
+      for (int y = cmin(1); y <= cmax(1); y++)
+        for (int z = cmin(2); z <= cmax(2); z++)
+          walls[Index(Eigen::Vector3i(x, y, z))] = false;
+  }
+
+  // Dilate everything by the robot radius
+  zone_layer_.assign(num_cell, false);
+  for (int n = 0; n < num_cell; n++)
+    if (walls[n]) DilateZone(Cell(n));
+  for (auto &n : surfaces)
+    DilateZone(Cell(n));
+
+  // The grid changed, so the obstacles must be applied from scratch
+  obstacle_layer_.assign(num_cell, 0);
+  obstacle_cells_.clear();
+  map_.resize(num_cell);
+  for (int n = 0; n < num_cell; n++)
+    Refresh(n);
+  revision_++;
+  return true;
+}
+
+void PlanningMap::SetObstacles(Points const& points) {
+  if (!Valid()) return;
+
+  // Occupied cells of the new obstacle set
+  std::vector<int> cells;
+  cells.reserve(points.size());
+  for (auto &p : points) {
+    Eigen::Vector3i c = ToCell(p);
+    if (Inside(c)) cells.push_back(Index(c));
+  }
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+  // Only the cells that appeared or disappeared need any work
+  std::vector<int> added, removed;
+  std::set_difference(cells.begin(), cells.end(),
+    obstacle_cells_.begin(), obstacle_cells_.end(), std::back_inserter(added));
+  std::set_difference(obstacle_cells_.begin(), obstacle_cells_.end(),
+    cells.begin(), cells.end(), std::back_inserter(removed));
+  if (added.empty() && removed.empty())
+    return;
+  for (auto &n : removed)
+    UpdateObstacle(n, -1);
+  for (auto &n : added)
+    UpdateObstacle(n, 1);
+  obstacle_cells_.swap(cells);
+  revision_++;
+}
+
+Eigen::Vector3i PlanningMap::ToCell(Eigen::Vector3d const& pt) const {
+  Eigen::Vector3d c = (pt - origin_) / resolution_;
+  return Eigen::Vector3i(std::floor(c(0)), std::floor(c(1)), std::floor(c(2)));
+}
+
+bool PlanningMap::Inside(Eigen::Vector3i const& cell) const {
+  return (cell.array() >= 0).all() && (cell.array() < dim_.array()).all();
+}
+
+int PlanningMap::Index(Eigen::Vector3i const& cell) const {
+  return cell(0) + dim_(0) * cell(1) + dim_(0) * dim_(1) * cell(2);
+}
+
+Eigen::Vector3i PlanningMap::Cell(int index) const {
+  const int plane = dim_(0) * dim_(1);
+  return Eigen::Vector3i(index % dim_(0), (index % plane) / dim_(0),
+                         index / plane);
+}
+
+bool PlanningMap::ZonesChanged(std::vector<ff_msgs::Zone> const& zones,
+                               double resolution, double radius) const {
+  if (resolution != resolution_ || radius != radius_
+    || zones.size() != zones_.size())
+    return true;
+  for (size_t i = 0; i < zones.size(); i++) {
+    ff_msgs::Zone const& a = zones[i];
+    ff_msgs::Zone const& b = zones_[i];
+    if (a.type != b.type
+      || a.min.x != b.min.x || a.min.y != b.min.y || a.min.z != b.min.z
+      || a.max.x != b.max.x || a.max.y != b.max.y || a.max.z != b.max.z)
+      return true;
+  }
+  return false;
+}
+
+void PlanningMap::DilateZone(Eigen::Vector3i const& cell) {
+  for (auto &offset : footprint_) {
+    Eigen::Vector3i c = cell + offset;
+    if (Inside(c)) zone_layer_[Index(c)] = true;
+  }
+}
+
+void PlanningMap::UpdateObstacle(int index, int delta) {
+  const Eigen::Vector3i cell = Cell(index);
+  for (auto &offset : footprint_) {
+    Eigen::Vector3i c = cell + offset;
+    if (!Inside(c)) continue;
+    const int n = Index(c);
+    obstacle_layer_[n] += delta;
+    // The combined value only changes when the count crosses zero
+    if (obstacle_layer_[n] == (delta > 0 ? 1 : 0))
+      Refresh(n);
+  }
+}
+
+void PlanningMap::Refresh(int index) {
+  map_[index] = (zone_layer_[index] || obstacle_layer_[index] > 0)
+              ? OCCUPIED : FREE;
+}
+
+}  // namespace planner_qp
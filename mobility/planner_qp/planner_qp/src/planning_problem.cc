@@ -0,0 +1,105 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <planner_qp/planning_problem.h>
+
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+
+namespace planner_qp {
+
+namespace {
+
+bool Expect(std::istream &is, std::string const& tag) {
+  std::string word;
+  return (is >> word) && word == tag;
+}
+
+}  // namespace
+
+bool PlanningProblem::Write(std::ostream &os) const {
+  os << std::setprecision(std::numeric_limits<double>::max_digits10);
+  os << "planning_problem 1" << std::endl;
+  os << "start " << start(0) << " " << start(1) << " " << start(2) << " "
+     << start(3) << std::endl;
+  os << "goal " << goal(0) << " " << goal(1) << " " << goal(2) << " "
+     << goal(3) << std::endl;
+  os << "map " << resolution << " " << radius << std::endl;
+  os << "limits " << max_vel << " " << max_accel << std::endl;
+  os << "options " << options.time_opt << " " << options.uniform_time << " "
+     << options.gap << " " << options.max_its << " "
+     << static_cast<int>(options.backend) << std::endl;
+  os << "zones " << zones.size() << std::endl;
+  for (auto &z : zones)
+    os << static_cast<int>(z.type) << " " << z.min.x << " " << z.min.y << " "
+       << z.min.z << " " << z.max.x << " " << z.max.y << " " << z.max.z
+       << std::endl;
+  os << "obstacles " << obstacles.size() << std::endl;
+  for (auto &p : obstacles)
+    os << p(0) << " " << p(1) << " " << p(2) << std::endl;
+  return static_cast<bool>(os);
+}
+
+bool PlanningProblem::Read(std::istream &is) {
+  int version;
+  if (!Expect(is, "planning_problem") || !(is >> version) || version != 1)
+    return false;
+  if (!Expect(is, "start")
+    || !(is >> start(0) >> start(1) >> start(2) >> start(3)))
+    return false;
+  if (!Expect(is, "goal") || !(is >> goal(0) >> goal(1) >> goal(2) >> goal(3)))
+    return false;
+  if (!Expect(is, "map") || !(is >> resolution >> radius))
+    return false;
+  if (!Expect(is, "limits") || !(is >> max_vel >> max_accel))
+    return false;
+  int backend;
+  if (!Expect(is, "options") || !(is >> options.time_opt
+    >> options.uniform_time >> options.gap >> options.max_its >> backend))
+    return false;
+  options.backend = static_cast<traj_opt::KKTBackend>(backend);
+  size_t n;
+  if (!Expect(is, "zones") || !(is >> n)) return false;
+  zones.resize(n);
+  for (auto &z : zones) {
+    int type;
+    if (!(is >> type >> z.min.x >> z.min.y >> z.min.z
+                     >> z.max.x >> z.max.y >> z.max.z))
+      return false;
+    z.type = type;
+  }
+  if (!Expect(is, "obstacles") || !(is >> n)) return false;
+  obstacles.resize(n);
+  for (auto &p : obstacles)
+    if (!(is >> p(0) >> p(1) >> p(2))) return false;
+  return true;
+}
+
+bool PlanningProblem::Save(std::string const& filename) const {
+  std::ofstream ofs(filename.c_str());
+  return ofs.is_open() && Write(ofs);
+}
+
+bool PlanningProblem::Load(std::string const& filename) {
+  std::ifstream ifs(filename.c_str());
+  return ifs.is_open() && Read(ifs);
+}
+
+}  // namespace planner_qp
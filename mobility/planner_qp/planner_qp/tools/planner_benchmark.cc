@@ -0,0 +1,247 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Replays planning problems recorded by the QP planner (see its
+// record_directory option) through the same pipeline as the nodelet: map
+// update, jump point search, corridor decomposition and optimization. One CSV
+// row per plan goes to stdout, a summary with the median and 95th percentile
+// of every stage goes to stderr. Given the CSV of an earlier run as baseline,
+// the exit code is non zero if a stage median or the success rate regressed.
+
+#include <ff_common/init.h>
+#include <planner_qp/pipeline.h>
+#include <planner_qp/planning_problem.h>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+DEFINE_int32(runs, 1, "Number of passes over the problem sequence");
+DEFINE_bool(persistent_map, true,
+            "Keep the planning map between plans, as the nodelet does");
+DEFINE_bool(warm_start, false,
+            "Warm start the solver from the previous plan, off as in the planner");
+DEFINE_string(backend, "recorded",
+              "KKT backend: recorded, lu or ldlt");
+DEFINE_string(baseline, "", "CSV output of an earlier run to compare with");
+DEFINE_double(max_regression, 0.2,
+              "Allowed relative increase of any stage median over baseline");
+
+DECLARE_bool(logtostderr);
+
+namespace {
+
+// Stages reported per plan, in CSV order
+const std::vector<std::string> kStages = {"map_ms", "jps_ms", "decomp_ms",
+                                          "opt_ms", "total_ms"};
+
+class Stopwatch {
+ public:
+  Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+  // milliseconds since the previous lap
+  double Lap() {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> dt = now - start_;
+    start_ = now;
+    return dt.count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+double Percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0.0;
+  std::sort(v.begin(), v.end());
+  size_t i = std::min(v.size() - 1,
+                      static_cast<size_t>(std::ceil(p * v.size())) - 1);
+  return v[i];
+}
+
+// Time stretch needed to respect the linear limits, as in the nodelet
+double TimeScale(traj_opt::NonlinearTrajectory *trajectory,
+                 planner_qp::PlanningProblem const& problem) {
+  double vel = 0.0, acc = 0.0;
+  traj_opt::MatD state;
+  for (double t = 0; t <= trajectory->getTotalTime(); t += 0.01) {
+    trajectory->getCommand(t, 3, state);
+    vel = std::max(vel, state.block<3, 1>(0, 1).norm());
+    acc = std::max(acc, state.block<3, 1>(0, 2).norm());
+  }
+  return std::max(vel / problem.max_vel,
+                  std::sqrt(acc) / std::sqrt(problem.max_accel));
+}
+
+// Columns of a CSV file produced by this tool, by name
+bool ReadColumns(std::string const& file,
+                 std::map<std::string, std::vector<double>> *columns) {
+  std::ifstream ifs(file.c_str());
+  std::string line, cell;
+  if (!ifs.is_open() || !std::getline(ifs, line)) return false;
+  std::vector<std::string> names;
+  std::stringstream header(line);
+  while (std::getline(header, cell, ',')) names.push_back(cell);
+  while (std::getline(ifs, line)) {
+    std::stringstream row(line);
+    for (size_t i = 0; i < names.size() && std::getline(row, cell, ','); i++)
+      if (i > 0) (*columns)[names[i]].push_back(std::atof(cell.c_str()));
+  }
+  return true;
+}
+
+double Mean(std::vector<double> const& v) {
+  double sum = 0.0;
+  for (auto &x : v) sum += x;
+  return v.empty() ? 0.0 : sum / v.size();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = true;
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+  if (argc < 2)
+    LOG(FATAL) << "Usage: " << argv[0] << " [flags] plan_0.txt [plan_1.txt ...]";
+
+  std::vector<std::string> names;
+  std::vector<planner_qp::PlanningProblem,
+    Eigen::aligned_allocator<planner_qp::PlanningProblem>> problems;
+  for (int i = 1; i < argc; i++) {
+    planner_qp::PlanningProblem problem;
+    if (!problem.Load(argv[i]))
+      LOG(FATAL) << "Could not read planning problem " << argv[i];
+    names.push_back(argv[i]);
+    problems.push_back(problem);
+  }
+
+  std::map<std::string, std::vector<double>> columns;
+  printf("problem,run,solved,%s,%s,%s,%s,%s,"
+         "path_points,segments,iterations,cost,duration,time_scale\n",
+         kStages[0].c_str(), kStages[1].c_str(), kStages[2].c_str(),
+         kStages[3].c_str(), kStages[4].c_str());
+  for (int run = 0; run < FLAGS_runs; run++) {
+    std::unique_ptr<planner_qp::Pipeline> pipeline;
+    boost::shared_ptr<traj_opt::NonlinearTrajectory> previous;
+    for (size_t i = 0; i < problems.size(); i++) {
+      planner_qp::PlanningProblem const& p = problems[i];
+      planner_qp::Pipeline::Options options = p.options;
+      if (FLAGS_backend == "lu")
+        options.backend = traj_opt::KKTBackend::LU;
+      else if (FLAGS_backend == "ldlt")
+        options.backend = traj_opt::KKTBackend::LDLT;
+      if (!pipeline || !FLAGS_persistent_map)
+        pipeline.reset(new planner_qp::Pipeline());
+
+      std::vector<double> ms(kStages.size(), 0.0);
+      bool solved = false;
+      vec_Vec3f path;
+      planner_qp::Pipeline::Corridor corridor;
+      boost::shared_ptr<traj_opt::NonlinearTrajectory> trajectory;
+      Stopwatch watch;
+      do {
+        // map
+        if (!pipeline->Map().SetZones(p.zones, p.resolution, p.radius))
+          break;
+        pipeline->Map().SetObstacles(p.obstacles);
+        if (!pipeline->Refresh()) break;
+        ms[0] = watch.Lap();
+        // search
+        bool close;
+        if (!pipeline->Search(p.start.head<3>(), p.goal.head<3>(), &path,
+                              &close))
+          break;
+        ms[1] = watch.Lap();
+        // corridor
+        pipeline->Decompose(path, close, &corridor);
+        ms[2] = watch.Lap();
+        // optimization, the solver reports progress on std::cout
+        traj_opt::OptimizationProblem problem = planner_qp::Pipeline::Problem(
+          p.start, p.goal, path, corridor, options);
+        std::streambuf* cout_buf = std::cout.rdbuf(NULL);
+        try {
+          trajectory = planner_qp::Pipeline::Solve(problem,
+            FLAGS_warm_start ? previous.get() : NULL, options.backend);
+        } catch (std::exception &e) {
+          trajectory.reset();
+        }
+        std::cout.rdbuf(cout_buf);
+        std::cout.clear();
+        ms[3] = watch.Lap();
+        solved = trajectory && trajectory->isSolved();
+      } while (false);
+      for (size_t s = 0; s < 4; s++) ms[4] += ms[s];
+
+      traj_opt::SolverInfo info;
+      double cost = 0.0, duration = 0.0, scale = 0.0;
+      if (solved) {
+        info = trajectory->getInfo();
+        cost = trajectory->getCost();
+        duration = trajectory->getTotalTime();
+        scale = TimeScale(trajectory.get(), p);
+        previous = trajectory;
+      }
+      printf("%s,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%zu,%zu,%d,%.9g,%.6f,%.6f\n",
+             names[i].c_str(), run, solved, ms[0], ms[1], ms[2], ms[3], ms[4],
+             path.size(), corridor.size(), info.iterations, cost, duration,
+             scale);
+      columns["solved"].push_back(solved);
+      for (size_t s = 0; s < kStages.size(); s++)
+        columns[kStages[s]].push_back(ms[s]);
+    }
+  }
+
+  fprintf(stderr, "success rate: %.3f\n", Mean(columns["solved"]));
+  for (auto &stage : kStages)
+    fprintf(stderr, "%-10s median %9.3f p95 %9.3f\n", stage.c_str(),
+            Percentile(columns[stage], 0.5), Percentile(columns[stage], 0.95));
+  if (FLAGS_baseline.empty())
+    return 0;
+
+  // Regression gate against an earlier run
+  std::map<std::string, std::vector<double>> baseline;
+  if (!ReadColumns(FLAGS_baseline, &baseline))
+    LOG(FATAL) << "Could not read baseline " << FLAGS_baseline;
+  bool regressed = false;
+  if (Mean(columns["solved"]) < Mean(baseline["solved"])) {
+    fprintf(stderr, "REGRESSION success rate %.3f < %.3f\n",
+            Mean(columns["solved"]), Mean(baseline["solved"]));
+    regressed = true;
+  }
+  for (auto &stage : kStages) {
+    double now = Percentile(columns[stage], 0.5);
+    double before = Percentile(baseline[stage], 0.5);
+    if (now > before * (1.0 + FLAGS_max_regression)) {
+      fprintf(stderr, "REGRESSION %s median %.3f > %.3f\n", stage.c_str(),
+              now, before);
+      regressed = true;
+    }
+  }
+  return regressed ? 1 : 0;
+}
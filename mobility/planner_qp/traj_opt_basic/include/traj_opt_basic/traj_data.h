@@ -75,6 +75,9 @@ struct SolverInfo {
   std::vector<float> gap_history;
   std::vector<float> cost_history;
   int iterations{0};
+  int analyses{0};        // symbolic analyses of the KKT system
+  int factorizations{0};  // numeric factorizations of the KKT system
+  bool warm_started{false};
   std::vector<float> slack;
   float cost;
   float gap;
@@ -122,6 +122,35 @@ class CostFunction {
   friend class NonlinearSolver;
 };
 
+// Linear algebra backend of the interior point iterations
+enum class KKTBackend {
+  LU,   // general sparse LU on the full KKT system
+  LDLT  // sparse LDLT on the quasi-definite system with the slacks eliminated
+};
+
+// Factorization of the KKT system. The fill reducing ordering and the
+// symbolic analysis are only computed when the sparsity pattern changes,
+// which never happens within a solve, so every iteration only pays for the
+// numeric factorization. It can be shared by solvers of problems with the
+// same structure.
+class KKTFactorization {
+ public:
+  bool factorize(const SpMat &M, KKTBackend backend);
+  VecD solve(const VecD &b) const;
+  int analyses() const { return analyses_; }
+  int factorizations() const { return factorizations_; }
+
+ private:
+  bool same_pattern(const SpMat &M, KKTBackend backend) const;
+
+  KKTBackend backend_{KKTBackend::LU};
+  std::vector<int> outer_, inner_;  // pattern of the last analysis
+  Eigen::SparseLU<SpMat> lu_;
+  Eigen::SimplicialLDLT<SpMat> ldlt_;
+  int analyses_{0};
+  int factorizations_{0};
+};
+
 class NonlinearSolver {
  private:
   std::vector<Variable> vars;
@@ -138,6 +167,12 @@ class NonlinearSolver {
   void updateInfo(std::vector<Variable *> times = std::vector<Variable *>());
 
   void draw_matrix(const SpMat &mat);
+  VecD solve_kkt(const ETV &sym, const ETV &slack, const VecD &b, bool refactor);
+  boost::shared_ptr<KKTFactorization> kkt_{
+      boost::make_shared<KKTFactorization>()};
+  KKTBackend backend_{KKTBackend::LU};
+  SpMat reduced_;  // unregularized system of the LDLT backend
+  static constexpr int kRefinementSteps = 2;
   bool presolved_{false};
   decimal_t epsilon_;
   decimal_t centering_;
@@ -163,6 +198,12 @@ class NonlinearSolver {
   void addConstraint(std::vector<EqConstraint::EqPair> con, decimal_t rhs);
 
   void setCost(boost::shared_ptr<CostFunction> func) { cost = func; }
+  void setBackend(KKTBackend backend) { backend_ = backend; }
+
+  // Start from the primal solution of a previously solved problem with the
+  // same structure, reusing its symbolic factorization. Returns false, and
+  // leaves the solver untouched, if the structures differ.
+  bool warmStart(const NonlinearSolver &prev);
 
   bool solve(bool verbose = false, decimal_t epsilon = 1e-8,
              std::vector<Variable *> times = std::vector<Variable *>(),
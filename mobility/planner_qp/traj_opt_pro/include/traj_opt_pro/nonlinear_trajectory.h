@@ -86,7 +86,9 @@ class NonlinearTrajectory : public Trajectory {
       int min_dim = 3, boost::shared_ptr<std::vector<decimal_t> > ds =
                            boost::shared_ptr<std::vector<decimal_t> >(),
       boost::shared_ptr<VecDVec> path = boost::shared_ptr<VecDVec>(),
-      bool time_opt = false, decimal_t gap = 1e-8, int max_it = 200);
+      bool time_opt = false, decimal_t gap = 1e-8, int max_it = 200,
+      const NonlinearTrajectory *warm = NULL,
+      KKTBackend backend = KKTBackend::LU);
   // nonconvex pointcloud test
   NonlinearTrajectory(const std::vector<Waypoint> &waypoints,
                       const Vec3Vec &points, int segs, decimal_t dt);
@@ -0,0 +1,49 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef TRAJ_OPT_PRO_PROBLEM_IO_H_
+#define TRAJ_OPT_PRO_PROBLEM_IO_H_
+
+#include <traj_opt_pro/trajectory_solver.h>
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace traj_opt {
+
+// Inputs of a NonlinearTrajectory solve, so that problems met while planning
+// can be stored and solved again offline
+struct OptimizationProblem {
+  std::vector<Waypoint> waypoints;
+  std::vector<std::pair<MatD, VecD> > cons;  // corridor of every segment
+  std::vector<decimal_t> ds;                 // initial segment durations
+  bool time_opt{false};
+  decimal_t gap{1e-8};
+  int max_its{200};
+
+  // plain text, full precision
+  bool write(std::ostream &os) const;
+  bool read(std::istream &is);
+  bool save(const std::string &filename) const;
+  bool load(const std::string &filename);
+};
+
+}  // namespace traj_opt
+#endif  // TRAJ_OPT_PRO_PROBLEM_IO_H_
@@ -175,9 +175,9 @@ bool NonlinearSolver::iterate() {
   int total_v = vars.size();
   // int num_z = total_v - 2*num_u - num_v;
 
-  SpMat M(total_v, total_v);
-  SpMat b(total_v, 1);
-  ETV coeffs;
+  SpMat bs(total_v, 1);
+  ETV coeffs;   // symmetric part: hessians, A and G
+  ETV scoeffs;  // complementarity part: S, I and Z
   ETV bcoeffs;
 
   VecD nu = VecD::Zero(num_u);
@@ -204,10 +204,10 @@ bool NonlinearSolver::iterate() {
     bcoeffs.push_back(ineq->slack());
     bcoeffs.push_back(ineq->sports_util(nu(ineq->id)));
     // S,I and Z
-    coeffs.push_back(
+    scoeffs.push_back(
         ET(ineq->var_s->id, ineq->var_u->id, ineq->var_s->val));  // S
-    coeffs.push_back(ET(ineq->var_u->id, ineq->var_s->id, 1.0));  // I
-    coeffs.push_back(
+    scoeffs.push_back(ET(ineq->var_u->id, ineq->var_s->id, 1.0));  // I
+    scoeffs.push_back(
         ET(ineq->var_s->id, ineq->var_s->id, ineq->var_u->val));  // Z
   }
   ETV GT = transpose(G);
@@ -238,31 +238,22 @@ bool NonlinearSolver::iterate() {
   }
 
   // pack non summands
-  M.setFromTriplets(coeffs.begin(), coeffs.end());
-  b.setFromTriplets(bcoeffs.begin(), bcoeffs.end());
+  bs.setFromTriplets(bcoeffs.begin(), bcoeffs.end());
+  VecD b = bs.toDense();
 
   // pass to backend
 
   //    std::cout << "Frontend took " << tm.toc() << std::endl;
   //    tm.tic();
 
-  // backend bottleneck
-  Eigen::SparseLU<SpMat> solver;
-  //    Eigen::SparseQR<SpMat,Eigen::COLAMDOrdering<int> > solver;
-  //    Eigen::PardisoLU<SpMat> solver;
-
-  //        std::cout << "M: " << M << std::endl;
-  //        std::cout << "b: " << b << std::endl;
-  //    draw_matrix(M);
-  solver.compute(M);
+  // backend bottleneck, only the numeric factorization is redone here
+  VecD delta_x = solve_kkt(coeffs, scoeffs, b, true);
   //    std::cout << "Back end took " << tm.toc() << std::endl;
 
-  if (solver.info() != Eigen::Success) {
+  if (delta_x.rows() != total_v) {
     std::cout << "Back end failed" << std::endl;
-    //        std::cout << M << std::endl;
     return false;
   }
-  VecD delta_x = solver.solve(b);
 
   //    VecD err = M*delta_x;
   //    err-=b;
@@ -315,10 +306,10 @@ bool NonlinearSolver::iterate() {
   // update b
   for (auto &ineq : ineq_con) {
     ET suv = ineq->sports_util(nu(ineq->id));
-    b.coeffRef(suv.row(), suv.col()) = suv.value();
+    b(suv.row()) = suv.value();
   }
   //     std::cout << "updated b: " << b << std::endl;
-  delta_x = solver.solve(b);
+  delta_x = solve_kkt(coeffs, scoeffs, b, false);
 
   // redo line search
   max_h = 1.0;
@@ -378,6 +369,125 @@ bool NonlinearSolver::iterate() {
   return (mu > epsilon_) && (max_h > 1e-15);
 }
 
+VecD NonlinearSolver::solve_kkt(const ETV &sym, const ETV &slack,
+                                const VecD &b, bool refactor) {
+  int total_v = vars.size();
+  if (backend_ == KKTBackend::LU) {
+    if (refactor) {
+      SpMat M(total_v, total_v);
+      ETV coeffs;
+      coeffs.reserve(sym.size() + slack.size());
+      coeffs.insert(coeffs.end(), sym.begin(), sym.end());
+      coeffs.insert(coeffs.end(), slack.begin(), slack.end());
+      M.setFromTriplets(coeffs.begin(), coeffs.end());
+      //    draw_matrix(M);
+      if (!kkt_->factorize(M, KKTBackend::LU)) return VecD();
+    }
+    return kkt_->solve(b);
+  }
+
+  // Eliminate the slacks with ds = (b_s - s du) / u. What remains is
+  // [H A' G'; A 0 0; G 0 -S/U], which is symmetric and, with a small
+  // regularization, quasi-definite. The regularization is only there to
+  // keep the factorization stable, its effect on the step is removed by
+  // iterative refinement against the exact system.
+  int num_v = eq_con.size();
+  int num_u = ineq_con.size();
+  int num_z = total_v - 2 * num_u - num_v;
+  std::vector<int> red(total_v, 0);
+  for (auto &ineq : ineq_con) red.at(ineq->var_s->id) = -1;
+  int num_red = 0;
+  for (auto &r : red)
+    if (r == 0) r = num_red++;
+
+  if (refactor) {
+    const decimal_t reg = 1e-9;
+    ETV coeffs;
+    coeffs.reserve(sym.size() + num_u + num_z + num_v);
+    for (auto &t : sym)
+      coeffs.push_back(ET(red.at(t.row()), red.at(t.col()), t.value()));
+    for (auto &ineq : ineq_con)
+      coeffs.push_back(ET(red.at(ineq->var_u->id), red.at(ineq->var_u->id),
+                          -ineq->var_s->val / ineq->var_u->val));
+    reduced_.resize(num_red, num_red);
+    reduced_.setFromTriplets(coeffs.begin(), coeffs.end());
+    for (int i = 0; i < num_z; i++) coeffs.push_back(ET(red.at(i), red.at(i), reg));
+    for (auto &eq : eq_con)
+      coeffs.push_back(ET(red.at(eq->var_v->id), red.at(eq->var_v->id), -reg));
+    SpMat K(num_red, num_red);
+    K.setFromTriplets(coeffs.begin(), coeffs.end());
+    if (!kkt_->factorize(K, KKTBackend::LDLT)) {
+      std::cout << "LDLT back end failed, falling back to LU" << std::endl;
+      backend_ = KKTBackend::LU;
+      return solve_kkt(sym, slack, b, true);
+    }
+  }
+
+  VecD rb(num_red);
+  for (int i = 0; i < total_v; i++)
+    if (red.at(i) >= 0) rb(red.at(i)) = b(i);
+  for (auto &ineq : ineq_con)
+    rb(red.at(ineq->var_u->id)) -= b(ineq->var_s->id) / ineq->var_u->val;
+  VecD rx = kkt_->solve(rb);
+  for (int i = 0; i < kRefinementSteps; i++) rx += kkt_->solve(rb - reduced_ * rx);
+
+  VecD delta_x(total_v);
+  for (int i = 0; i < total_v; i++)
+    if (red.at(i) >= 0) delta_x(i) = rx(red.at(i));
+  for (auto &ineq : ineq_con) {
+    int u = ineq->var_u->id, s = ineq->var_s->id;
+    delta_x(s) = (b(s) - ineq->var_s->val * delta_x(u)) / ineq->var_u->val;
+  }
+  return delta_x;
+}
+
+bool NonlinearSolver::warmStart(const NonlinearSolver &prev) {
+  if (prev.vars.size() != vars.size() ||
+      prev.eq_con.size() != eq_con.size() ||
+      prev.ineq_con.size() != ineq_con.size())
+    return false;
+  // only the primal values are copied, the duals and slacks of a converged
+  // solution sit on the boundary and would stall the interior point method
+  int num_z = vars.size() - 2 * ineq_con.size() - eq_con.size();
+  for (int i = 0; i < num_z; i++) vars.at(i).val = prev.vars.at(i).val;
+  kkt_ = prev.kkt_;
+  solver_info.warm_started = true;
+  return true;
+}
+
+// KKT factorization
+bool KKTFactorization::same_pattern(const SpMat &M, KKTBackend backend) const {
+  if (backend != backend_ || !M.isCompressed()) return false;
+  if (outer_.size() != static_cast<size_t>(M.outerSize() + 1) ||
+      inner_.size() != static_cast<size_t>(M.nonZeros()))
+    return false;
+  return std::equal(outer_.begin(), outer_.end(), M.outerIndexPtr()) &&
+         std::equal(inner_.begin(), inner_.end(), M.innerIndexPtr());
+}
+bool KKTFactorization::factorize(const SpMat &M, KKTBackend backend) {
+  if (!same_pattern(M, backend)) {
+    backend_ = backend;
+    outer_.assign(M.outerIndexPtr(), M.outerIndexPtr() + M.outerSize() + 1);
+    inner_.assign(M.innerIndexPtr(), M.innerIndexPtr() + M.nonZeros());
+    if (backend_ == KKTBackend::LU)
+      lu_.analyzePattern(M);
+    else
+      ldlt_.analyzePattern(M);
+    analyses_++;
+  }
+  factorizations_++;
+  if (backend_ == KKTBackend::LU) {
+    lu_.factorize(M);
+    return lu_.info() == Eigen::Success;
+  }
+  ldlt_.factorize(M);
+  return ldlt_.info() == Eigen::Success;
+}
+VecD KKTFactorization::solve(const VecD &b) const {
+  if (backend_ == KKTBackend::LU) return lu_.solve(b);
+  return ldlt_.solve(b);
+}
+
 inline bool contains(const std::map<int, int> &map, int key) {
   auto val = map.find(key);
   return val != map.end();
@@ -486,6 +596,8 @@ bool NonlinearSolver::solve(bool verbose, decimal_t epsilon,
   for (int i = 0; i < num_z; i++) old_x(i) = vars.at(i).val;
 
   // bool costreg=false;
+  int analyses = kkt_->analyses();
+  int factorizations = kkt_->factorizations();
   int its = 0;
   for (int i = 0; i < max_iterations; i++) {
     its = i;
@@ -535,12 +647,16 @@ bool NonlinearSolver::solve(bool verbose, decimal_t epsilon,
     //            std::cout << "Iteration took: " << tm.toc() << std::endl;
   }
   decimal_t mu = duality();
+  solver_info.analyses = kkt_->analyses() - analyses;
+  solver_info.factorizations = kkt_->factorizations() - factorizations;
   if (verbose) {
     std::cout << "Solver terminated." << std::endl;
 
     std::cout << "Cost: " << cost->evaluate() << std::endl;
     std::cout << "Gap: " << mu << std::endl;
     std::cout << "Iterations: " << its << std::endl;
+    std::cout << "Factorizations: " << solver_info.factorizations
+              << " (symbolic: " << solver_info.analyses << ")" << std::endl;
   }
   if (verbose)
     std::cout << "Total time: " << tm_t.toc() * 1000.0 << " ms." << std::endl;
@@ -62,7 +62,8 @@ NonlinearTrajectory::NonlinearTrajectory(
     const std::vector<Waypoint> &waypoints,
     const std::vector<std::pair<MatD, VecD>> &cons, int deg, int min_dim,
     boost::shared_ptr<std::vector<decimal_t>> ds,
-    boost::shared_ptr<VecDVec> path, bool time_opt, decimal_t gap, int max_its)
+    boost::shared_ptr<VecDVec> path, bool time_opt, decimal_t gap, int max_its,
+    const NonlinearTrajectory *warm, KKTBackend backend)
     : seg_(cons.size()), deg_(deg), basis(PolyType::ENDPOINT, deg_, min_dim) {
   dim_ = waypoints.front().pos.rows();
   assert(dim_ == cons.front().first.cols());
@@ -91,6 +92,9 @@ NonlinearTrajectory::NonlinearTrajectory(
   cost = boost::make_shared<PolyCost>(traj, times, basis, min_dim);
 
   solver.setCost(cost);
+  solver.setBackend(backend);
+  // start from the last solution if the problem has the same shape
+  if (warm != NULL) solver.warmStart(warm->solver);
   // call solver
   // solved_ = solver.solve(true);
   if (time_opt)
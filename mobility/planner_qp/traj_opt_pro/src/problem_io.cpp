@@ -0,0 +1,121 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <traj_opt_pro/problem_io.h>
+
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace traj_opt {
+
+namespace {
+
+void write_mat(std::ostream &os, const MatD &m) {
+  os << m.rows() << " " << m.cols();
+  for (int i = 0; i < m.rows(); i++)
+    for (int j = 0; j < m.cols(); j++) os << " " << m(i, j);
+  os << std::endl;
+}
+bool read_mat(std::istream &is, MatD *m) {
+  int rows, cols;
+  if (!(is >> rows >> cols) || rows < 0 || cols < 0) return false;
+  m->resize(rows, cols);
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      if (!(is >> (*m)(i, j))) return false;
+  return true;
+}
+bool read_vec(std::istream &is, VecD *v) {
+  MatD m;
+  if (!read_mat(is, &m) || m.cols() != 1) return false;
+  *v = m;
+  return true;
+}
+bool expect(std::istream &is, const std::string &tag) {
+  std::string word;
+  return (is >> word) && word == tag;
+}
+
+}  // namespace
+
+bool OptimizationProblem::write(std::ostream &os) const {
+  os << std::setprecision(std::numeric_limits<decimal_t>::max_digits10);
+  os << "traj_opt_problem 1" << std::endl;
+  os << "options " << time_opt << " " << gap << " " << max_its << std::endl;
+  os << "waypoints " << waypoints.size() << std::endl;
+  for (auto &w : waypoints) {
+    os << w.knot_id << " " << w.use_pos << " " << w.use_vel << " "
+       << w.use_acc << " " << w.use_jrk << std::endl;
+    write_mat(os, w.pos);
+    write_mat(os, w.vel);
+    write_mat(os, w.acc);
+    write_mat(os, w.jrk);
+  }
+  os << "constraints " << cons.size() << std::endl;
+  for (auto &c : cons) {
+    write_mat(os, c.first);
+    write_mat(os, c.second);
+  }
+  os << "durations " << ds.size();
+  for (auto &d : ds) os << " " << d;
+  os << std::endl;
+  return static_cast<bool>(os);
+}
+
+bool OptimizationProblem::read(std::istream &is) {
+  int version;
+  if (!expect(is, "traj_opt_problem") || !(is >> version) || version != 1)
+    return false;
+  if (!expect(is, "options") || !(is >> time_opt >> gap >> max_its))
+    return false;
+  size_t n;
+  if (!expect(is, "waypoints") || !(is >> n)) return false;
+  waypoints.resize(n);
+  for (auto &w : waypoints) {
+    if (!(is >> w.knot_id >> w.use_pos >> w.use_vel >> w.use_acc >> w.use_jrk))
+      return false;
+    if (!read_vec(is, &w.pos) || !read_vec(is, &w.vel) ||
+        !read_vec(is, &w.acc) || !read_vec(is, &w.jrk))
+      return false;
+  }
+  if (!expect(is, "constraints") || !(is >> n)) return false;
+  cons.resize(n);
+  for (auto &c : cons)
+    if (!read_mat(is, &c.first) || !read_vec(is, &c.second)) return false;
+  if (!expect(is, "durations") || !(is >> n)) return false;
+  ds.resize(n);
+  for (auto &d : ds)
+    if (!(is >> d)) return false;
+  return true;
+}
+
+bool OptimizationProblem::save(const std::string &filename) const {
+  std::ofstream ofs(filename.c_str());
+  return ofs.is_open() && write(ofs);
+}
+
+bool OptimizationProblem::load(const std::string &filename) {
+  std::ifstream ifs(filename.c_str());
+  return ifs.is_open() && read(ifs);
+}
+
+}  // namespace traj_opt
@@ -0,0 +1,107 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Test the KKT backends
+// The LDLT backend regularizes the system it factorizes and refines its
+// steps against the exact one, so it must find the same trajectory as the
+// LU backend up to the duality gap, not bit for bit.
+
+#include <traj_opt_pro/nonlinear_trajectory.h>
+
+#include <boost/make_shared.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Box corridor segment lo <= x <= hi as A x <= b, with a free yaw column
+// as the planner builds them
+std::pair<traj_opt::MatD, traj_opt::VecD> Box(traj_opt::Vec3 const& lo, traj_opt::Vec3 const& hi) {
+  traj_opt::MatD A = traj_opt::MatD::Zero(6, 4);
+  traj_opt::VecD b(6);
+  A.block<3, 3>(0, 0) = traj_opt::Mat3::Identity();
+  A.block<3, 3>(3, 0) = -traj_opt::Mat3::Identity();
+  b << hi, -lo;
+  return std::make_pair(A, b);
+}
+
+traj_opt::Waypoint Endpoint(traj_opt::Vec4 const& pos, int knot_id) {
+  traj_opt::Waypoint way;
+  way.pos = pos;
+  way.use_pos = way.use_vel = way.use_acc = way.use_jrk = true;
+  way.knot_id = knot_id;
+  return way;
+}
+
+// An L shaped corridor, around a corner
+void Problem(std::vector<traj_opt::Waypoint> * waypoints,
+             std::vector<std::pair<traj_opt::MatD, traj_opt::VecD> > * cons) {
+  waypoints->push_back(Endpoint(traj_opt::Vec4(0, 0, 0, 0), 0));
+  waypoints->push_back(Endpoint(traj_opt::Vec4(1, 1.5, 0.2, 0), -1));
+  cons->push_back(Box(traj_opt::Vec3(-0.3, -0.3, -0.3), traj_opt::Vec3(1.3, 0.3, 0.3)));
+  cons->push_back(Box(traj_opt::Vec3(0.7, -0.3, -0.3), traj_opt::Vec3(1.3, 1.8, 0.5)));
+}
+
+}  // namespace
+
+TEST(KKTBackend, LDLTMatchesLU) {
+  std::vector<traj_opt::Waypoint> waypoints;
+  std::vector<std::pair<traj_opt::MatD, traj_opt::VecD> > cons;
+  Problem(&waypoints, &cons);
+  auto ds = boost::make_shared<std::vector<traj_opt::decimal_t> >(std::vector<traj_opt::decimal_t>{1.0, 1.5});
+
+  traj_opt::NonlinearTrajectory lu(waypoints, cons, 7, 3, ds, boost::shared_ptr<traj_opt::VecDVec>(), false, 1e-8,
+                                   200, NULL, traj_opt::KKTBackend::LU);
+  traj_opt::NonlinearTrajectory ldlt(waypoints, cons, 7, 3, ds, boost::shared_ptr<traj_opt::VecDVec>(), false, 1e-8,
+                                     200, NULL, traj_opt::KKTBackend::LDLT);
+  ASSERT_TRUE(lu.isSolved());
+  ASSERT_TRUE(ldlt.isSolved());
+  EXPECT_NEAR(lu.getCost(), ldlt.getCost(), 1e-6 * std::max(1.0, std::abs(lu.getCost())));
+
+  // The trajectories agree along their length too
+  ASSERT_NEAR(lu.getTotalTime(), ldlt.getTotalTime(), 1e-9);
+  for (int i = 0; i <= 20; i++) {
+    traj_opt::decimal_t t = lu.getTotalTime() * i / 20;
+    traj_opt::VecD p_lu, p_ldlt;
+    ASSERT_TRUE(lu.evaluate(t, 0, p_lu));
+    ASSERT_TRUE(ldlt.evaluate(t, 0, p_ldlt));
+    EXPECT_LT((p_lu - p_ldlt).norm(), 1e-4) << "at t = " << t;
+  }
+}
+
+TEST(KKTBackend, WarmStartMatchesCold) {
+  std::vector<traj_opt::Waypoint> waypoints;
+  std::vector<std::pair<traj_opt::MatD, traj_opt::VecD> > cons;
+  Problem(&waypoints, &cons);
+  auto ds = boost::make_shared<std::vector<traj_opt::decimal_t> >(std::vector<traj_opt::decimal_t>{1.0, 1.5});
+
+  for (auto backend : {traj_opt::KKTBackend::LU, traj_opt::KKTBackend::LDLT}) {
+    traj_opt::NonlinearTrajectory cold(waypoints, cons, 7, 3, ds, boost::shared_ptr<traj_opt::VecDVec>(), false,
+                                       1e-8, 200, NULL, backend);
+    traj_opt::NonlinearTrajectory warm(waypoints, cons, 7, 3, ds, boost::shared_ptr<traj_opt::VecDVec>(), false,
+                                       1e-8, 200, &cold, backend);
+    ASSERT_TRUE(cold.isSolved());
+    ASSERT_TRUE(warm.isSolved());
+    EXPECT_NEAR(cold.getCost(), warm.getCost(), 1e-6 * std::max(1.0, std::abs(cold.getCost())));
+  }
+}
@@ -0,0 +1,92 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Solves recorded trajectory optimization problems (see the record_directory
+// option of the QP planner) with every KKT backend, cold and warm started from
+// the previous problem in the sequence, and prints one CSV row per solve.
+
+#include <traj_opt_pro/nonlinear_trajectory.h>
+#include <traj_opt_pro/problem_io.h>
+#include <traj_opt_pro/timers.h>
+
+#include <boost/make_shared.hpp>
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using traj_opt::KKTBackend;
+using traj_opt::NonlinearTrajectory;
+using traj_opt::OptimizationProblem;
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " problem_0.txt [problem_1.txt ...]"
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> names;
+  std::vector<OptimizationProblem> problems;
+  for (int i = 1; i < argc; i++) {
+    OptimizationProblem problem;
+    if (!problem.load(argv[i])) {
+      std::cerr << "Could not read problem " << argv[i] << std::endl;
+      return 1;
+    }
+    names.push_back(argv[i]);
+    problems.push_back(problem);
+  }
+
+  printf("problem,backend,warm,solved,iterations,factorizations,analyses,"
+         "time_ms,cost\n");
+  for (auto backend : {KKTBackend::LU, KKTBackend::LDLT}) {
+    for (bool warm : {false, true}) {
+      std::unique_ptr<NonlinearTrajectory> prev;
+      double total_ms = 0.0;
+      int total_its = 0;
+      for (size_t i = 0; i < problems.size(); i++) {
+        const OptimizationProblem& p = problems[i];
+        auto ds = boost::make_shared<std::vector<traj_opt::decimal_t> >(p.ds);
+        // the solver reports its progress on std::cout, keep the CSV clean
+        std::streambuf* cout_buf = std::cout.rdbuf(NULL);
+        traj_opt::Timer timer;
+        std::unique_ptr<NonlinearTrajectory> traj(new NonlinearTrajectory(
+            p.waypoints, p.cons, 7, 3, ds, boost::shared_ptr<traj_opt::VecDVec>(),
+            p.time_opt, p.gap, p.max_its, warm ? prev.get() : NULL, backend));
+        double ms = timer.toc() * 1000.0;
+        std::cout.rdbuf(cout_buf);
+        std::cout.clear();
+        traj_opt::SolverInfo info = traj->getInfo();
+        printf("%s,%s,%d,%d,%d,%d,%d,%.3f,%.9g\n", names[i].c_str(),
+               backend == KKTBackend::LU ? "lu" : "ldlt", warm,
+               traj->isSolved(), info.iterations, info.factorizations,
+               info.analyses, ms, traj->getCost());
+        total_ms += ms;
+        total_its += info.iterations;
+        prev = std::move(traj);
+      }
+      fprintf(stderr, "%-4s %-4s: %d iterations, %.3f ms\n",
+              backend == KKTBackend::LU ? "lu" : "ldlt", warm ? "warm" : "cold",
+              total_its, total_ms);
+    }
+  }
+  return 0;
+}
@@ -49,10 +49,15 @@ class PerfTimer {
     std::chrono::time_point<std::chrono::system_clock> end;
     end = std::chrono::system_clock::now();
     std::chrono::duration<double> dt = end - start_;
+    Add(dt.count());
+  }
+  // Add a duration in seconds that was measured elsewhere
+  void Add(double seconds) {
+    if (!init_) return;
     // Add the measurement and the count
     msg_.stamp = ros::Time::now();
     msg_.count += 1.0;
-    msg_.last = dt.count();
+    msg_.last = seconds;
     if (msg_.last > msg_.max || msg_.min < 0.0) msg_.max = msg_.last;
     if (msg_.last < msg_.min || msg_.min < 0.0) msg_.min = msg_.last;
     if (msg_.count > 1) {
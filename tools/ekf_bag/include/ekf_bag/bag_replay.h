@@ -0,0 +1,65 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_BAG_BAG_REPLAY_H_
+#define EKF_BAG_BAG_REPLAY_H_
+
+#include <camera/camera_params.h>
+
+#include <ff_msgs/CameraRegistration.h>
+#include <ff_msgs/Feature2dArray.h>
+#include <ff_msgs/VisualLandmarks.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <sensor_msgs/Imu.h>
+
+#include <Eigen/Core>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ekf_bag {
+
+// One input of the EKF, in the order EkfBag delivered it
+struct ReplayMessage {
+  enum Type {IMU, GROUND_TRUTH, OF_REGISTRATION, OF_FEATURES, ML_REGISTRATION, ML_FEATURES};
+  Type type;
+  ros::Time time;
+  size_t index;  // into the vector of the type in BagReplay
+};
+
+// Everything the EKF sees of a bag, with the vision front end already run.
+// Recorded once, then replayed read only by any number of EKF runs.
+struct BagReplay {
+  std::string bagfile;
+  ros::Time start_time;
+  Eigen::Vector3f gyro_bias, accel_bias;
+  // the sparse map camera, to convert the landmark observations for output
+  std::shared_ptr<camera::CameraParameters> map_camera;
+
+  std::vector<ReplayMessage> messages;
+  std::vector<sensor_msgs::Imu> imu;
+  std::vector<geometry_msgs::PoseStamped> ground_truth;
+  std::vector<ff_msgs::CameraRegistration> registrations;  // optical flow and sparse map
+  std::vector<ff_msgs::Feature2dArray> of_features;
+  std::vector<ff_msgs::VisualLandmarks> landmarks;
+};
+
+}  // end namespace ekf_bag
+
+#endif  // EKF_BAG_BAG_REPLAY_H_
@@ -21,6 +21,7 @@
 
 #include <config_reader/config_reader.h>
 #include <ekf/ekf.h>
+#include <ekf_bag/bag_replay.h>
 #include <ff_util/ff_names.h>
 #include <lk_optical_flow/lk_optical_flow.h>
 #include <localization_node/localization.h>
@@ -29,6 +30,7 @@
 #include <rosbag/bag.h>
 #include <sensor_msgs/Imu.h>
 
+#include <memory>
 #include <string>
 
 namespace ekf_bag {
@@ -38,14 +40,23 @@ class EkfBag {
   EkfBag(const char* bagfile, const char* mapfile, bool run_ekf = true,
          bool gen_features = true, const char* biasfile = NULL,
          std::string image_topic = std::string(TOPIC_HARDWARE_NAV_CAM), const std::string& gnc_config = "gnc.config");
+  // Runs the EKF on a recorded replay instead of a bag, without loading the
+  // map or running the vision front end
+  EkfBag(std::shared_ptr<const BagReplay> replay, const std::string& gnc_config = "gnc.config");
   virtual ~EkfBag(void);
 
   void Run(void);
 
+  // records the autocode inputs of every EKF step, see Ekf::RecordStepInputs
+  bool RecordStepInputs(const std::string& filename) {return ekf_.RecordStepInputs(filename);}
+
  protected:
   virtual void ReadParams(config_reader::ConfigReader* config);
 
   virtual void UpdateImu(const ros::Time& time, const sensor_msgs::Imu& imu);
+  // called for every imu message, after any visual features due were sent
+  virtual void StepEkf(const ros::Time& time, const sensor_msgs::Imu& imu);
+  virtual void UpdateBias(const Eigen::Vector3f& gyro, const Eigen::Vector3f& accel);
   virtual void UpdateImage(const ros::Time& time,
                            const sensor_msgs::ImageConstPtr& image);
   virtual void UpdateGroundTruth(const geometry_msgs::PoseStamped& pose);
@@ -57,9 +68,13 @@ class EkfBag {
   virtual void UpdateOpticalFlowReg(const ff_msgs::CameraRegistration& reg);
   virtual void UpdateSparseMapReg(const ff_msgs::CameraRegistration& reg);
 
+  // camera of the sparse map, also available when replaying
+  camera::CameraParameters MapCameraParameters(void) const;
+
   rosbag::Bag bag_;
-  sparse_mapping::SparseMap map_;
-  localization_node::Localizer loc_;
+  // not loaded when replaying
+  std::unique_ptr<sparse_mapping::SparseMap> map_;
+  std::unique_ptr<localization_node::Localizer> loc_;
 
   lk_optical_flow::LKOpticalFlow of_;
 
@@ -72,6 +87,9 @@ class EkfBag {
 
  private:
   void EstimateBias(void);
+  void Replay(void);
+
+  std::shared_ptr<const BagReplay> replay_;
 
   bool run_ekf_;
   bool gen_features_;
@@ -0,0 +1,64 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef EKF_BAG_EKF_BAG_BATCH_H_
+#define EKF_BAG_EKF_BAG_BATCH_H_
+
+#include <ekf_bag/bag_replay.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ekf_bag {
+
+// Runs optical flow and sparse map localization on the images of a bag, as
+// EkfBag does, and records what the EKF is sent. Loads its own copy of the
+// map, so several bags can be recorded at the same time.
+std::shared_ptr<const BagReplay> RecordBag(const std::string& bagfile, const std::string& mapfile,
+                                           const std::string& image_topic, const std::string& gnc_config);
+
+// Accuracy of one EKF run against the ground truth in the bag
+struct RunSummary {
+  std::string bagfile, gnc_config, csvfile;
+  int num_poses;          // EKF poses compared to ground truth
+  double position_rmse;   // meters
+  double position_max;    // meters
+  double rotation_rmse;   // degrees
+  double run_time;        // seconds
+};
+
+// Records every bag once, then runs the EKF on each of them with each of the
+// gnc configs. Both stages run up to FLAGS_num_threads jobs at a time. Writes
+// the output of EkfBagCsv for each run to output_dir/<bag>_<config>.txt.
+std::vector<RunSummary> RunBatch(const std::vector<std::string>& bagfiles, const std::string& mapfile,
+                                 const std::vector<std::string>& gnc_configs, const std::string& image_topic,
+                                 const std::string& output_dir);
+
+// Runs the EKF on the bag of a batch run again with its gnc config, alone and
+// straight from the bag as bag_to_csv --run_ekf does, writing to csvfile.
+// Returns true if the output is the same as that of the batch run, otherwise
+// describes the first difference.
+bool MatchesSerialRun(const RunSummary& run, const std::string& mapfile, const std::string& image_topic,
+                      const std::string& csvfile, std::string* difference);
+
+bool WriteSummary(const std::string& filename, const std::vector<RunSummary>& runs);
+
+}  // end namespace ekf_bag
+
+#endif  // EKF_BAG_EKF_BAG_BATCH_H_
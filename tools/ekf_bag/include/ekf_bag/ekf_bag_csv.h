@@ -22,6 +22,7 @@
 #include <ekf_bag/ekf_bag.h>
 #include <ekf_bag/tracked_features.h>
 
+#include <memory>
 #include <string>
 
 namespace ekf_bag {
@@ -31,6 +32,8 @@ class EkfBagCsv : public EkfBag {
   EkfBagCsv(const char* bagfile, const char* mapfile, const char* csvfile,
       bool run_ekf = true, bool gen_features = true, const char* biasfile = NULL,
       std::string image_topic = std::string(TOPIC_HARDWARE_NAV_CAM), const std::string& gnc_config = "gnc.config");
+  EkfBagCsv(std::shared_ptr<const BagReplay> replay, const char* csvfile,
+      const std::string& gnc_config = "gnc.config");
   virtual ~EkfBagCsv(void);
 
  protected:
@@ -47,6 +50,8 @@ class EkfBagCsv : public EkfBag {
   TrackedOFFeatures tracked_of_;
 
  private:
+  void Init(const char* csvfile);
+
   FILE* f_;
 
   bool start_time_set_;
@@ -24,14 +24,15 @@
 #include <camera/camera_params.h>
 #include <ff_common/utils.h>
 #include <rosbag/view.h>
+#include <sparse_mapping/reprojection.h>
 #include <Eigen/Core>
 
 namespace ekf_bag {
 
 EkfBag::EkfBag(const char* bagfile, const char* mapfile, bool run_ekf, bool gen_features, const char* biasfile,
                std::string image_topic, const std::string& gnc_config)
-    : map_(mapfile, true),
-      loc_(&map_),
+    : map_(new sparse_mapping::SparseMap(mapfile, true)),
+      loc_(new localization_node::Localizer(map_.get())),
       run_ekf_(run_ekf),
       gen_features_(gen_features),
       bias_file_(biasfile),
@@ -51,7 +52,21 @@ EkfBag::EkfBag(const char* bagfile, const char* mapfile, bool run_ekf, bool gen_
   }
 }
 
-EkfBag::~EkfBag(void) { bag_.close(); }
+EkfBag::EkfBag(std::shared_ptr<const BagReplay> replay, const std::string& gnc_config)
+    : replay_(replay),
+      run_ekf_(true),
+      gen_features_(false),
+      bias_file_(NULL),
+      gnc_config_(gnc_config) {}
+
+EkfBag::~EkfBag(void) {
+  if (!replay_) bag_.close();
+}
+
+camera::CameraParameters EkfBag::MapCameraParameters(void) const {
+  if (replay_) return *replay_->map_camera;
+  return map_->GetCameraParameters();
+}
 
 void EkfBag::ReadParams(config_reader::ConfigReader* config) {
   config->AddFile("tools/ekf_bag.config");
@@ -71,7 +86,7 @@ void EkfBag::ReadParams(config_reader::ConfigReader* config) {
 
   ekf_.ReadParams(config);
   of_.ReadParams(config);
-  loc_.ReadParams(config);
+  if (loc_) loc_->ReadParams(config);
 }
 
 void EkfBag::EstimateBias(void) {
@@ -126,6 +141,10 @@ void EkfBag::EstimateBias(void) {
     printf("%g %g %g\n", gyro[0], gyro[1], gyro[2]);
     printf("%g %g %g\n", accel[0], accel[1], accel[2]);
   }
+  UpdateBias(gyro, accel);
+}
+
+void EkfBag::UpdateBias(const Eigen::Vector3f& gyro, const Eigen::Vector3f& accel) {
   ekf_.SetBias(gyro, accel);
   ekf_.Reset();
 }
@@ -142,6 +161,10 @@ void EkfBag::UpdateImu(const ros::Time& time, const sensor_msgs::Imu& imu) {
     UpdateSparseMap(vl_features_);
   }
 
+  StepEkf(time, imu);
+}
+
+void EkfBag::StepEkf(const ros::Time& time, const sensor_msgs::Imu& imu) {
   // Pass a quaternion in to do MGTF gravity correction if needed
   ekf_.PrepareStep(imu, ground_truth_.orientation);
   ff_msgs::EkfState state;
@@ -183,7 +206,7 @@ void EkfBag::UpdateImage(const ros::Time& time, const sensor_msgs::ImageConstPtr
       return;
     }
     vl_features_.landmarks.clear();
-    loc_.Localize(image, &vl_features_);
+    loc_->Localize(image, &vl_features_);
     vl_features_.camera_id = vl_id_;
     processing_sparse_map_ = true;
     vl_send_time_ = time + ros::Duration(sparse_map_delay_);
@@ -219,7 +242,13 @@ bool string_ends_with(const std::string& str, const std::string& ending) {
 }
 
 void EkfBag::Run(void) {
+  if (replay_) {
+    Replay();
+    return;
+  }
   if (run_ekf_) EstimateBias();
+  // localize as a run on just this bag would, whatever this thread did before
+  sparse_mapping::ResetRandomInt();
 
   std::vector<std::string> topics;
   topics.push_back(std::string("/") + TOPIC_HARDWARE_IMU);
@@ -289,4 +318,34 @@ void EkfBag::Run(void) {
   printf("\n");
 }
 
+// Calls the same handlers in the same order as Run did when recording
+void EkfBag::Replay(void) {
+  const BagReplay& r = *replay_;
+  UpdateBias(r.gyro_bias, r.accel_bias);
+  bag_start_time_ = r.start_time;
+
+  for (const ReplayMessage& m : r.messages) {
+    switch (m.type) {
+      case ReplayMessage::IMU:
+        StepEkf(m.time, r.imu[m.index]);
+        break;
+      case ReplayMessage::GROUND_TRUTH:
+        UpdateGroundTruth(r.ground_truth[m.index]);
+        break;
+      case ReplayMessage::OF_REGISTRATION:
+        UpdateOpticalFlowReg(r.registrations[m.index]);
+        break;
+      case ReplayMessage::OF_FEATURES:
+        UpdateOpticalFlow(r.of_features[m.index]);
+        break;
+      case ReplayMessage::ML_REGISTRATION:
+        UpdateSparseMapReg(r.registrations[m.index]);
+        break;
+      case ReplayMessage::ML_FEATURES:
+        UpdateSparseMap(r.landmarks[m.index]);
+        break;
+    }
+  }
+}
+
 }  // namespace ekf_bag
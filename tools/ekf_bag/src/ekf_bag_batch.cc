@@ -0,0 +1,267 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <ekf_bag/ekf_bag_batch.h>
+#include <ekf_bag/ekf_bag_csv.h>
+
+#include <ff_common/thread.h>
+#include <glog/logging.h>
+
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+
+namespace ekf_bag {
+
+namespace {
+
+// Reading config files sets the lua path in the environment, so only one
+// thread reads them at a time. The autocode estimator also keeps track of its
+// first instance without a lock, so estimators are only made under it too.
+std::mutex config_mutex;
+
+std::string BaseName(const std::string& path) {
+  size_t start = path.find_last_of('/');
+  start = (start == std::string::npos) ? 0 : start + 1;
+  size_t end = path.find_last_of('.');
+  if (end == std::string::npos || end < start) end = path.size();
+  return path.substr(start, end - start);
+}
+
+// Keeps what EkfBag would send to the EKF instead of sending it
+class BagRecorder : public EkfBag {
+ public:
+  BagRecorder(const std::string& bagfile, const std::string& mapfile, const std::string& image_topic,
+              const std::string& gnc_config, BagReplay* replay)
+      : EkfBag(bagfile.c_str(), mapfile.c_str(), true, true, NULL, image_topic, gnc_config), record_(replay) {
+    record_->bagfile = bagfile;
+  }
+
+  void Record(void) {
+    {
+      std::lock_guard<std::mutex> lock(config_mutex);
+      config_reader::ConfigReader config;
+      ReadParams(&config);
+    }
+    Run();
+    record_->start_time = bag_start_time_;
+    record_->map_camera.reset(new camera::CameraParameters(MapCameraParameters()));
+  }
+
+ protected:
+  virtual void StepEkf(const ros::Time& time, const sensor_msgs::Imu& imu) {
+    Add(ReplayMessage::IMU, time, imu, &record_->imu);
+  }
+  virtual void UpdateBias(const Eigen::Vector3f& gyro, const Eigen::Vector3f& accel) {
+    record_->gyro_bias = gyro;
+    record_->accel_bias = accel;
+  }
+  virtual void UpdateGroundTruth(const geometry_msgs::PoseStamped& pose) {
+    EkfBag::UpdateGroundTruth(pose);
+    Add(ReplayMessage::GROUND_TRUTH, pose.header.stamp, pose, &record_->ground_truth);
+  }
+  virtual void UpdateOpticalFlow(const ff_msgs::Feature2dArray& of) {
+    Add(ReplayMessage::OF_FEATURES, of.header.stamp, of, &record_->of_features);
+  }
+  virtual void UpdateSparseMap(const ff_msgs::VisualLandmarks& vl) {
+    Add(ReplayMessage::ML_FEATURES, vl.header.stamp, vl, &record_->landmarks);
+  }
+  virtual void UpdateOpticalFlowReg(const ff_msgs::CameraRegistration& reg) {
+    Add(ReplayMessage::OF_REGISTRATION, reg.header.stamp, reg, &record_->registrations);
+  }
+  virtual void UpdateSparseMapReg(const ff_msgs::CameraRegistration& reg) {
+    Add(ReplayMessage::ML_REGISTRATION, reg.header.stamp, reg, &record_->registrations);
+  }
+
+ private:
+  template <typename Message>
+  void Add(ReplayMessage::Type type, const ros::Time& time, const Message& msg, std::vector<Message>* messages) {
+    ReplayMessage m;
+    m.type = type;
+    m.time = time;
+    m.index = messages->size();
+    record_->messages.push_back(m);
+    messages->push_back(msg);
+  }
+
+  BagReplay* record_;
+};
+
+// Writes the csv of a replayed run and compares its poses to ground truth
+class EvaluatedRun : public EkfBagCsv {
+ public:
+  EvaluatedRun(std::shared_ptr<const BagReplay> replay, const std::string& csvfile,
+               const std::string& gnc_config, RunSummary* summary)
+      : EkfBagCsv(replay, csvfile.c_str(), gnc_config), summary_(summary), has_pose_(false),
+        position_sq_(0), rotation_sq_(0) {
+    summary_->bagfile = replay->bagfile;
+    summary_->gnc_config = gnc_config;
+    summary_->csvfile = csvfile;
+    summary_->num_poses = 0;
+    summary_->position_max = 0;
+  }
+
+  void Evaluate(void) {
+    auto start = std::chrono::steady_clock::now();
+    Run();
+    summary_->run_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int n = std::max(summary_->num_poses, 1);
+    summary_->position_rmse = std::sqrt(position_sq_ / n);
+    summary_->rotation_rmse = std::sqrt(rotation_sq_ / n);
+  }
+
+ protected:
+  virtual void UpdateEKF(const ff_msgs::EkfState& state) {
+    EkfBagCsv::UpdateEKF(state);
+    if (!ekf_.HasPoseEstimate()) return;
+    pose_ = state.pose;
+    pose_time_ = state.header.stamp;
+    has_pose_ = true;
+  }
+
+  // the EKF runs at the imu rate, so its latest pose is at most a few
+  // milliseconds older than the ground truth
+  virtual void UpdateGroundTruth(const geometry_msgs::PoseStamped& gt) {
+    EkfBagCsv::UpdateGroundTruth(gt);
+    if (!has_pose_ || std::abs((gt.header.stamp - pose_time_).toSec()) > 0.05) return;
+    Eigen::Vector3d dp(pose_.position.x - gt.pose.position.x, pose_.position.y - gt.pose.position.y,
+                       pose_.position.z - gt.pose.position.z);
+    Eigen::Quaterniond q_ekf(pose_.orientation.w, pose_.orientation.x, pose_.orientation.y, pose_.orientation.z);
+    Eigen::Quaterniond q_gt(gt.pose.orientation.w, gt.pose.orientation.x, gt.pose.orientation.y,
+                            gt.pose.orientation.z);
+    double angle = q_ekf.normalized().angularDistance(q_gt.normalized()) * 180.0 / M_PI;
+    position_sq_ += dp.squaredNorm();
+    rotation_sq_ += angle * angle;
+    summary_->position_max = std::max(summary_->position_max, dp.norm());
+    summary_->num_poses++;
+  }
+
+ private:
+  RunSummary* summary_;
+  bool has_pose_;
+  geometry_msgs::Pose pose_;
+  ros::Time pose_time_;
+  double position_sq_, rotation_sq_;
+};
+
+void RecordTask(std::string bagfile, std::string mapfile, std::string image_topic, std::string gnc_config,
+                std::shared_ptr<const BagReplay>* replay) {
+  *replay = RecordBag(bagfile, mapfile, image_topic, gnc_config);
+  LOG(INFO) << "Recorded " << bagfile << ": " << (*replay)->messages.size() << " messages.";
+}
+
+void ReplayTask(std::shared_ptr<const BagReplay> replay, std::string gnc_config, std::string csvfile,
+                RunSummary* summary) {
+  std::unique_ptr<EvaluatedRun> run;
+  {
+    std::lock_guard<std::mutex> lock(config_mutex);
+    run.reset(new EvaluatedRun(replay, csvfile, gnc_config, summary));
+  }
+  run->Evaluate();
+  LOG(INFO) << "Finished " << csvfile << " in " << summary->run_time << " s.";
+}
+
+}  // namespace
+
+std::shared_ptr<const BagReplay> RecordBag(const std::string& bagfile, const std::string& mapfile,
+                                           const std::string& image_topic, const std::string& gnc_config) {
+  std::shared_ptr<BagReplay> replay(new BagReplay());
+  std::unique_ptr<BagRecorder> recorder;
+  {
+    std::lock_guard<std::mutex> lock(config_mutex);
+    recorder.reset(new BagRecorder(bagfile, mapfile, image_topic, gnc_config, replay.get()));
+  }
+  recorder->Record();
+  return replay;
+}
+
+std::vector<RunSummary> RunBatch(const std::vector<std::string>& bagfiles, const std::string& mapfile,
+                                 const std::vector<std::string>& gnc_configs, const std::string& image_topic,
+                                 const std::string& output_dir) {
+  // The vision front end only depends on the bag, run it once per bag. The
+  // gnc config is only read to set up the unused estimator.
+  std::vector<std::shared_ptr<const BagReplay> > replays(bagfiles.size());
+  {
+    ff_common::ThreadPool pool;
+    for (size_t i = 0; i < bagfiles.size(); i++)
+      pool.AddTask(&RecordTask, bagfiles[i], mapfile, image_topic, gnc_configs[0], &replays[i]);
+    pool.Join();
+  }
+
+  std::vector<RunSummary> runs(bagfiles.size() * gnc_configs.size());
+  ff_common::ThreadPool pool;
+  for (size_t i = 0; i < bagfiles.size(); i++) {
+    for (size_t j = 0; j < gnc_configs.size(); j++) {
+      std::string csvfile = output_dir + "/" + BaseName(bagfiles[i]) + "_" + BaseName(gnc_configs[j]) + ".txt";
+      pool.AddTask(&ReplayTask, replays[i], gnc_configs[j], csvfile, &runs[i * gnc_configs.size() + j]);
+    }
+  }
+  pool.Join();
+  return runs;
+}
+
+bool MatchesSerialRun(const RunSummary& run, const std::string& mapfile, const std::string& image_topic,
+                      const std::string& csvfile, std::string* difference) {
+  {
+    std::unique_ptr<EkfBagCsv> serial;
+    {
+      std::lock_guard<std::mutex> lock(config_mutex);
+      serial.reset(new EkfBagCsv(run.bagfile.c_str(), mapfile.c_str(), csvfile.c_str(), true, false, NULL,
+                                 image_topic, run.gnc_config));
+    }
+    serial->Run();
+  }
+
+  std::ifstream batch_in(run.csvfile), serial_in(csvfile);
+  if (!batch_in || !serial_in) {
+    *difference = "failed to read " + (batch_in ? csvfile : run.csvfile);
+    return false;
+  }
+  std::string batch_line, serial_line;
+  for (int line = 1; ; line++) {
+    bool has_batch = static_cast<bool>(std::getline(batch_in, batch_line));
+    bool has_serial = static_cast<bool>(std::getline(serial_in, serial_line));
+    if (!has_batch && !has_serial)
+      return true;
+    if (has_batch != has_serial || batch_line != serial_line) {
+      *difference = "line " + std::to_string(line) + ": " + (has_batch ? batch_line.substr(0, 60) : "end of file") +
+                    " ... instead of " + (has_serial ? serial_line.substr(0, 60) : "end of file") + " ...";
+      return false;
+    }
+  }
+}
+
+bool WriteSummary(const std::string& filename, const std::vector<RunSummary>& runs) {
+  FILE* f = fopen(filename.c_str(), "w");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open file %s.\n", filename.c_str());
+    return false;
+  }
+  fprintf(f, "bag,gnc_config,output,num_poses,position_rmse,position_max,rotation_rmse_deg,run_time\n");
+  for (const RunSummary& r : runs)
+    fprintf(f, "%s,%s,%s,%d,%g,%g,%g,%g\n", r.bagfile.c_str(), r.gnc_config.c_str(), r.csvfile.c_str(),
+            r.num_poses, r.position_rmse, r.position_max, r.rotation_rmse, r.run_time);
+  fclose(f);
+  return true;
+}
+
+}  // namespace ekf_bag
@@ -48,6 +48,16 @@ EkfBagCsv::EkfBagCsv(const char* bagfile, const char* mapfile, const char* csvfi
                      std::string image_topic, const std::string& gnc_config) :
           EkfBag(bagfile, mapfile, run_ekf, gen_features, biasfile, image_topic, gnc_config),
           start_time_set_(false) {
+  Init(csvfile);
+}
+
+EkfBagCsv::EkfBagCsv(std::shared_ptr<const BagReplay> replay, const char* csvfile,
+                     const std::string& gnc_config) :
+          EkfBag(replay, gnc_config), start_time_set_(false) {
+  Init(csvfile);
+}
+
+void EkfBagCsv::Init(const char* csvfile) {
   // virtual function has to be called in subclass since not initialized in superclass
   config_reader::ConfigReader config;
   ReadParams(&config);
@@ -135,7 +145,7 @@ void EkfBagCsv::UpdateSparseMap(const ff_msgs::VisualLandmarks & vl) {
 
   EkfBag::UpdateSparseMap(vl);
 
-  const camera::CameraParameters & params = map_.GetCameraParameters();
+  const camera::CameraParameters & params = MapCameraParameters();
   fprintf(f_, "VL %g ", (ml_reg_time_ - start_time_).toSec());
   fprintf(f_, "%d ", static_cast<int>(vl.landmarks.size()));
   if (vl.landmarks.size() >= 5) {
@@ -18,6 +18,7 @@
 
 #include <ff_common/init.h>
 #include <ekf_bag/ekf_bag_csv.h>
+#include <gnc_profile.h>
 
 DEFINE_bool(gen_features, false,
             "If true, generate features from image, otherwise use from bag.");
@@ -25,6 +26,7 @@ DEFINE_bool(run_ekf, false,
             "If true, run EKF, otherwise read messages from bag.");
 DEFINE_string(image_topic, TOPIC_HARDWARE_NAV_CAM,
               "The topic to get images from..");
+DECLARE_string(record_step_inputs);  // defined in ekf.cc
 
 int main(int argc, char** argv) {
   ff_common::InitFreeFlyerApplication(&argc, &argv);
@@ -41,5 +43,9 @@ int main(int argc, char** argv) {
 
   ekf_bag::EkfBagCsv bag(argv[2], argv[1], argv[3], FLAGS_run_ekf,
                          FLAGS_gen_features, biasfile, FLAGS_image_topic, argv[4]);
+  if (!FLAGS_record_step_inputs.empty() && !bag.RecordStepInputs(FLAGS_record_step_inputs))
+    return 1;
   bag.Run();
+  if (gnc_profile_enabled())
+    LOG(INFO) << "EKF step profile:\n" << gnc_profile_report(GNC_PROFILE_EST_STEP, GNC_PROFILE_EST_APPLY_DELTA_STATE);
 }
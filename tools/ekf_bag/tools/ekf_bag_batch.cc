@@ -0,0 +1,100 @@
+/* Copyright (c) 2017, United States Government, as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ *
+ * All rights reserved.
+ *
+ * The Astrobee platform is licensed under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with the
+ * License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Runs the EKF on several bags with several gnc configs. The vision front end
+// runs once per bag, then every (bag, config) pair is replayed from memory, as
+// many at a time as --num_threads.
+
+#include <ff_common/init.h>
+#include <ff_util/ff_names.h>
+#include <ekf_bag/ekf_bag_batch.h>
+#include <gnc_profile.h>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include <string>
+#include <vector>
+
+DEFINE_string(map, "", "The sparse map to localize against.");
+DEFINE_string(gnc_configs, "", "Comma separated gnc config files, one run of each on every bag.");
+DEFINE_string(output_dir, ".", "Directory for the output of each run and summary.csv.");
+DEFINE_string(image_topic, TOPIC_HARDWARE_NAV_CAM, "The topic to get images from.");
+DEFINE_bool(check_serial, false,
+            "Then run each bag and config again alone, as bag_to_csv --run_ekf does, to <bag>_<config>_serial.txt, "
+            "and check that it gives the same output.");
+
+DECLARE_bool(logtostderr);
+
+namespace {
+
+std::vector<std::string> Split(const std::string& list) {
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+    if (end > start) items.push_back(list.substr(start, end - start));
+    start = end + 1;
+  }
+  return items;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = true;
+  ff_common::InitFreeFlyerApplication(&argc, &argv);
+
+  ros::Time::init();
+
+  std::vector<std::string> configs = Split(FLAGS_gnc_configs);
+  if (argc < 2 || FLAGS_map.empty() || configs.empty()) {
+    LOG(INFO) << "Usage: " << argv[0] << " --map map.map --gnc_configs a.config,b.config"
+              << " [--output_dir dir] [--num_threads n] bag1.bag [bag2.bag ...]";
+    return 1;
+  }
+
+  std::vector<std::string> bags(argv + 1, argv + argc);
+  std::vector<ekf_bag::RunSummary> runs =
+    ekf_bag::RunBatch(bags, FLAGS_map, configs, FLAGS_image_topic, FLAGS_output_dir);
+
+  for (const ekf_bag::RunSummary& r : runs)
+    LOG(INFO) << r.csvfile << ": position rmse " << r.position_rmse << " m, max " << r.position_max
+              << " m, rotation rmse " << r.rotation_rmse << " deg, " << r.run_time << " s.";
+  if (gnc_profile_enabled())
+    LOG(INFO) << "EKF step profile, all runs:\n"
+              << gnc_profile_report(GNC_PROFILE_EST_STEP, GNC_PROFILE_EST_APPLY_DELTA_STATE);
+  if (!ekf_bag::WriteSummary(FLAGS_output_dir + "/summary.csv", runs))
+    return 1;
+
+  int num_differ = 0;
+  if (FLAGS_check_serial) {
+    for (const ekf_bag::RunSummary& r : runs) {
+      std::string serial = r.csvfile.substr(0, r.csvfile.size() - 4) + "_serial.txt";
+      std::string difference;
+      if (ekf_bag::MatchesSerialRun(r, FLAGS_map, FLAGS_image_topic, serial, &difference)) {
+        LOG(INFO) << r.csvfile << " matches " << serial << ".";
+      } else {
+        LOG(ERROR) << r.csvfile << " differs from " << serial << " at " << difference;
+        num_differ++;
+      }
+    }
+  }
+  return num_differ == 0 ? 0 : 1;
+}